@@ -0,0 +1,602 @@
+/***************************************************************************
+ * A bounded, least-recently-used cache of decoded data samples of
+ * records read from files.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_PARSE
+#include "memprofile.h"
+
+#if !defined(LMP_WIN) && !defined(LIBMSEED_NO_THREADING)
+#define LM_BLOCKCACHE_THREADS 1
+#include <pthread.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+/* Initial number of hash table slots, a power of 2 */
+#define BLOCKCACHE_INITIALSLOTS 1024
+
+/* Decoded samples of a single record */
+typedef struct CacheBlock
+{
+  uint64_t fileid[4];        /* Device, inode, size and modification time of file */
+  int64_t offset;            /* Offset of record in file */
+  int64_t numsamples;        /* Number of decoded samples */
+  size_t size;               /* Size of samples in bytes */
+  char sampletype;           /* Sample type of decoded samples */
+  void *samples;
+  struct CacheBlock *hashnext;  /* Next block in hash table slot */
+  struct CacheBlock *newer;     /* More recently used block */
+  struct CacheBlock *older;     /* Less recently used block */
+} CacheBlock;
+
+/* Global cache state, blocks are listed from most to least recently used */
+static struct
+{
+  CacheBlock **slots;
+  uint64_t slotcount;
+  uint64_t blockcount;
+  uint64_t budget;   /* Maximum bytes of cached blocks, 0 when disabled */
+  uint64_t bytes;    /* Bytes of cached blocks */
+  uint64_t hits;
+  uint64_t misses;
+  CacheBlock *newest;
+  CacheBlock *oldest;
+#if defined(LM_BLOCKCACHE_THREADS)
+  pthread_mutex_t lock;
+#endif
+} blockcache = {
+  .slots = NULL,
+  .slotcount = 0,
+  .blockcount = 0,
+  .budget = 0,
+  .bytes = 0,
+  .hits = 0,
+  .misses = 0,
+  .newest = NULL,
+  .oldest = NULL,
+#if defined(LM_BLOCKCACHE_THREADS)
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+#if defined(LM_BLOCKCACHE_THREADS)
+#define BLOCKCACHE_LOCK() pthread_mutex_lock (&blockcache.lock)
+#define BLOCKCACHE_UNLOCK() pthread_mutex_unlock (&blockcache.lock)
+#else
+#define BLOCKCACHE_LOCK()
+#define BLOCKCACHE_UNLOCK()
+#endif
+
+int ms_blockcache_fileid (FILE *fileptr, uint64_t fileid[4]);
+int64_t ms_blockcache_unpack (MS3Record *msr, const uint64_t fileid[4], int64_t offset,
+                              int8_t verbose);
+int64_t ms_blockcache_get (const uint64_t fileid[4], int64_t offset, int64_t numsamples,
+                           void *output, uint64_t outputsize, char *sampletype);
+void ms_blockcache_put (const uint64_t fileid[4], int64_t offset, int64_t numsamples,
+                        const void *samples, char sampletype);
+
+static uint64_t blockcache_hash (const uint64_t fileid[4], int64_t offset);
+static CacheBlock *blockcache_find (const uint64_t fileid[4], int64_t offset);
+static void blockcache_unlink (CacheBlock *block);
+static void blockcache_evict (uint64_t budget);
+static int blockcache_grow (void);
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Set the byte budget of the decoded block cache
+ *
+ * When a budget is set, the data samples of records read from regular
+ * files are kept in a process-wide cache after decoding, keyed by the
+ * identity of the file and the byte offset of the record.  Records
+ * are then decoded once for repeated and overlapping reads, e.g. time
+ * windows extracted from the same files, until they are evicted.
+ *
+ * The cache is consulted when unpacking samples with
+ * ms3_readmsr_selection() and the routines that use it, e.g.
+ * ms3_readtracelist_timewin() and ms3_readtracelist_parallel(), and
+ * by mstl3_unpack_recordlist() for record list entries that refer to
+ * files.  Records in memory buffers and streams that are not regular
+ * files, e.g. URLs or stdin, are not cached.
+ *
+ * A file is identified by its device, inode, size and modification
+ * time, so a file that is modified or replaced is not served from
+ * blocks decoded from its previous contents.  Identity is determined
+ * when the file is opened, a file modified in place while it is open
+ * must not be read with the cache enabled.
+ *
+ * The least recently used blocks are evicted to keep the size of the
+ * cached samples, plus a small overhead per block, within \a budget
+ * bytes.  Setting a \a budget of 0
+ * disables the cache and frees all blocks.  The cache is shared by all
+ * threads and access is serialized internally, samples are copied out
+ * of the cache so no block is referenced after a lookup.  The cache is
+ * not available on Windows or when the library is built with
+ * \b LIBMSEED_NO_THREADING, the budget is then ignored.
+ *
+ * @param[in] budget Maximum size in bytes of cached samples, 0 to disable
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa ms3_blockcache_stats()
+ ***************************************************************************/
+int
+ms3_blockcache_set (uint64_t budget)
+{
+#if defined(LM_BLOCKCACHE_THREADS)
+  BLOCKCACHE_LOCK ();
+
+  blockcache_evict (budget);
+  blockcache.budget = budget;
+
+  if (budget == 0)
+  {
+    if (blockcache.slots)
+      libmseed_memory.free (blockcache.slots);
+
+    blockcache.slots = NULL;
+    blockcache.slotcount = 0;
+  }
+  else if (!blockcache.slots)
+  {
+    if ((blockcache.slots = (CacheBlock **)lm_malloc (BLOCKCACHE_INITIALSLOTS * sizeof (CacheBlock *))) == NULL)
+    {
+      blockcache.budget = 0;
+      BLOCKCACHE_UNLOCK ();
+
+      ms_log (2, "Cannot allocate memory for decoded block cache\n");
+      return -1;
+    }
+
+    memset (blockcache.slots, 0, BLOCKCACHE_INITIALSLOTS * sizeof (CacheBlock *));
+    blockcache.slotcount = BLOCKCACHE_INITIALSLOTS;
+  }
+
+  BLOCKCACHE_UNLOCK ();
+#else
+  (void)budget;
+#endif
+
+  return 0;
+} /* End of ms3_blockcache_set() */
+
+/**********************************************************************/ /**
+ * @brief Return the usage of the decoded block cache
+ *
+ * Any of the output parameters may be NULL.  The hit and miss counts
+ * accumulate from the start of the process, lookups made while the
+ * cache is disabled are not counted.
+ *
+ * @param[out] hits Number of records served from the cache
+ * @param[out] misses Number of records not found in the cache
+ * @param[out] blocks Number of cached blocks
+ * @param[out] bytes Size in bytes of cached blocks, counted against the budget
+ *
+ * \sa ms3_blockcache_set()
+ ***************************************************************************/
+void
+ms3_blockcache_stats (uint64_t *hits, uint64_t *misses, uint64_t *blocks, uint64_t *bytes)
+{
+  BLOCKCACHE_LOCK ();
+
+  if (hits)
+    *hits = blockcache.hits;
+  if (misses)
+    *misses = blockcache.misses;
+  if (blocks)
+    *blocks = blockcache.blockcount;
+  if (bytes)
+    *bytes = blockcache.bytes;
+
+  BLOCKCACHE_UNLOCK ();
+} /* End of ms3_blockcache_stats() */
+
+/** @cond UNDOCUMENTED */
+
+/***************************************************************************
+ * Determine the identity of an open file for cache keys.
+ *
+ * Returns 0 when the cache is enabled and the identity of a regular
+ * file was determined, otherwise -1 and the file should not be cached.
+ ***************************************************************************/
+int
+ms_blockcache_fileid (FILE *fileptr, uint64_t fileid[4])
+{
+#if defined(LM_BLOCKCACHE_THREADS)
+  struct stat sb;
+  uint64_t budget;
+
+  BLOCKCACHE_LOCK ();
+  budget = blockcache.budget;
+  BLOCKCACHE_UNLOCK ();
+
+  if (budget == 0 || !fileptr)
+    return -1;
+
+  if (fstat (fileno (fileptr), &sb) || !S_ISREG (sb.st_mode))
+    return -1;
+
+  fileid[0] = (uint64_t)sb.st_dev;
+  fileid[1] = (uint64_t)sb.st_ino;
+  fileid[2] = (uint64_t)sb.st_size;
+#if defined(__APPLE__)
+  fileid[3] = (uint64_t)sb.st_mtimespec.tv_sec * NSTMODULUS + (uint64_t)sb.st_mtimespec.tv_nsec;
+#else
+  fileid[3] = (uint64_t)sb.st_mtim.tv_sec * NSTMODULUS + (uint64_t)sb.st_mtim.tv_nsec;
+#endif
+
+  return 0;
+#else
+  (void)fileptr;
+  (void)fileid;
+
+  return -1;
+#endif
+} /* End of ms_blockcache_fileid() */
+
+/***************************************************************************
+ * Unpack the data samples of a record read from a file, using the
+ * cached samples of the record when present, otherwise decoding with
+ * msr3_unpack_data() and adding the samples to the cache.
+ *
+ * Returns the number of samples unpacked or a negative libmseed error
+ * code, as msr3_unpack_data().
+ ***************************************************************************/
+int64_t
+ms_blockcache_unpack (MS3Record *msr, const uint64_t fileid[4], int64_t offset,
+                      int8_t verbose)
+{
+  CacheBlock *block;
+  int64_t nsamples;
+
+  if (!msr)
+  {
+    ms_log (2, "%s(): Required input not defined: 'msr'\n", __func__);
+    return MS_GENERROR;
+  }
+
+  if (msr->samplecnt <= 0)
+    return 0;
+
+  BLOCKCACHE_LOCK ();
+
+  if (blockcache.budget > 0 && (block = blockcache_find (fileid, offset)) != NULL &&
+      block->numsamples == msr->samplecnt)
+  {
+    if (msr->datasize < block->size)
+    {
+      if (libmseed_prealloc_block_size)
+      {
+        size_t current_size = msr->datasize;
+        msr->datasamples = lm_prealloc (msr->datasamples, block->size, &current_size);
+        msr->datasize = current_size;
+      }
+      else
+      {
+        msr->datasamples = lm_realloc (msr->datasamples, block->size);
+        msr->datasize = block->size;
+      }
+
+      if (msr->datasamples == NULL)
+      {
+        BLOCKCACHE_UNLOCK ();
+
+        ms_log (2, "%s: Cannot (re)allocate memory\n", msr->sid);
+        msr->datasize = 0;
+        return MS_GENERROR;
+      }
+    }
+
+    memcpy (msr->datasamples, block->samples, block->size);
+    msr->numsamples = block->numsamples;
+    msr->sampletype = block->sampletype;
+    blockcache.hits++;
+
+    BLOCKCACHE_UNLOCK ();
+
+    return msr->numsamples;
+  }
+
+  if (blockcache.budget > 0)
+    blockcache.misses++;
+
+  BLOCKCACHE_UNLOCK ();
+
+  nsamples = msr3_unpack_data (msr, verbose);
+
+  if (nsamples > 0)
+    ms_blockcache_put (fileid, offset, nsamples, msr->datasamples, msr->sampletype);
+
+  return nsamples;
+} /* End of ms_blockcache_unpack() */
+
+/***************************************************************************
+ * Copy the cached samples of a record to a supplied buffer.
+ *
+ * Returns the number of samples copied, or -1 when the record is not
+ * cached with \a numsamples samples or the buffer is too small.
+ ***************************************************************************/
+int64_t
+ms_blockcache_get (const uint64_t fileid[4], int64_t offset, int64_t numsamples,
+                   void *output, uint64_t outputsize, char *sampletype)
+{
+  CacheBlock *block;
+  int64_t copied = -1;
+
+  BLOCKCACHE_LOCK ();
+
+  if (blockcache.budget > 0 && (block = blockcache_find (fileid, offset)) != NULL &&
+      block->numsamples == numsamples && block->size <= outputsize)
+  {
+    memcpy (output, block->samples, block->size);
+    *sampletype = block->sampletype;
+    copied = block->numsamples;
+    blockcache.hits++;
+  }
+  else if (blockcache.budget > 0)
+  {
+    blockcache.misses++;
+  }
+
+  BLOCKCACHE_UNLOCK ();
+
+  return copied;
+} /* End of ms_blockcache_get() */
+
+/***************************************************************************
+ * Add a copy of the decoded samples of a record to the cache, evicting
+ * the least recently used blocks to stay within the budget.  Records
+ * larger than the budget and failed allocations are not cached.
+ ***************************************************************************/
+void
+ms_blockcache_put (const uint64_t fileid[4], int64_t offset, int64_t numsamples,
+                   const void *samples, char sampletype)
+{
+  CacheBlock *block;
+  uint64_t slot;
+  uint8_t samplesize;
+  size_t size;
+
+  if (!samples || numsamples <= 0 || (samplesize = ms_samplesize (sampletype)) == 0)
+    return;
+
+  size = (size_t)numsamples * samplesize;
+
+  BLOCKCACHE_LOCK ();
+
+  if (blockcache.budget == 0 || size + sizeof (CacheBlock) > blockcache.budget)
+  {
+    BLOCKCACHE_UNLOCK ();
+    return;
+  }
+
+  /* Replace the samples of an existing block, e.g. decoded concurrently */
+  if ((block = blockcache_find (fileid, offset)) != NULL)
+  {
+    blockcache_unlink (block);
+    libmseed_memory.free (block->samples);
+    libmseed_memory.free (block);
+  }
+
+  if (blockcache.blockcount >= blockcache.slotcount)
+    blockcache_grow ();
+
+  blockcache_evict (blockcache.budget - size - sizeof (CacheBlock));
+
+  if ((block = (CacheBlock *)lm_malloc (sizeof (CacheBlock))) == NULL ||
+      (block->samples = lm_malloc (size)) == NULL)
+  {
+    if (block)
+      libmseed_memory.free (block);
+
+    BLOCKCACHE_UNLOCK ();
+    return;
+  }
+
+  memcpy (block->fileid, fileid, sizeof (block->fileid));
+  memcpy (block->samples, samples, size);
+  block->offset = offset;
+  block->numsamples = numsamples;
+  block->size = size;
+  block->sampletype = sampletype;
+
+  slot = blockcache_hash (fileid, offset) & (blockcache.slotcount - 1);
+  block->hashnext = blockcache.slots[slot];
+  blockcache.slots[slot] = block;
+
+  block->older = blockcache.newest;
+  block->newer = NULL;
+
+  if (blockcache.newest)
+    blockcache.newest->newer = block;
+  else
+    blockcache.oldest = block;
+
+  blockcache.newest = block;
+  blockcache.blockcount++;
+  blockcache.bytes += size + sizeof (CacheBlock);
+
+  BLOCKCACHE_UNLOCK ();
+} /* End of ms_blockcache_put() */
+
+/***************************************************************************
+ * Hash of a file identity and offset, FNV-1a over the key values.
+ ***************************************************************************/
+static uint64_t
+blockcache_hash (const uint64_t fileid[4], int64_t offset)
+{
+  uint64_t key[5];
+  uint64_t hash = 14695981039346656037ULL;
+  size_t idx;
+
+  memcpy (key, fileid, 4 * sizeof (uint64_t));
+  key[4] = (uint64_t)offset;
+
+  for (idx = 0; idx < sizeof (key); idx++)
+  {
+    hash ^= ((const uint8_t *)key)[idx];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+} /* End of blockcache_hash() */
+
+/***************************************************************************
+ * Find a cached block and mark it as the most recently used.  The
+ * cache must be locked by the caller.
+ ***************************************************************************/
+static CacheBlock *
+blockcache_find (const uint64_t fileid[4], int64_t offset)
+{
+  CacheBlock *block;
+  uint64_t slot;
+
+  if (!blockcache.slots)
+    return NULL;
+
+  slot = blockcache_hash (fileid, offset) & (blockcache.slotcount - 1);
+
+  for (block = blockcache.slots[slot]; block; block = block->hashnext)
+  {
+    if (block->offset == offset && !memcmp (block->fileid, fileid, sizeof (block->fileid)))
+      break;
+  }
+
+  if (!block)
+    return NULL;
+
+  /* Move to the front of the usage list */
+  if (block != blockcache.newest)
+  {
+    block->newer->older = block->older;
+
+    if (block->older)
+      block->older->newer = block->newer;
+    else
+      blockcache.oldest = block->newer;
+
+    block->older = blockcache.newest;
+    block->newer = NULL;
+    blockcache.newest->newer = block;
+    blockcache.newest = block;
+  }
+
+  return block;
+} /* End of blockcache_find() */
+
+/***************************************************************************
+ * Remove a block from the hash table and usage list without freeing
+ * it.  The cache must be locked by the caller.
+ ***************************************************************************/
+static void
+blockcache_unlink (CacheBlock *block)
+{
+  CacheBlock **pblock;
+  uint64_t slot;
+
+  slot = blockcache_hash (block->fileid, block->offset) & (blockcache.slotcount - 1);
+
+  for (pblock = &blockcache.slots[slot]; *pblock; pblock = &(*pblock)->hashnext)
+  {
+    if (*pblock == block)
+    {
+      *pblock = block->hashnext;
+      break;
+    }
+  }
+
+  if (block->newer)
+    block->newer->older = block->older;
+  else
+    blockcache.newest = block->older;
+
+  if (block->older)
+    block->older->newer = block->newer;
+  else
+    blockcache.oldest = block->newer;
+
+  blockcache.blockcount--;
+  blockcache.bytes -= block->size + sizeof (CacheBlock);
+} /* End of blockcache_unlink() */
+
+/***************************************************************************
+ * Free least recently used blocks until the cached bytes are within
+ * \a budget.  The cache must be locked by the caller.
+ ***************************************************************************/
+static void
+blockcache_evict (uint64_t budget)
+{
+  CacheBlock *block;
+
+  while (blockcache.oldest && blockcache.bytes > budget)
+  {
+    block = blockcache.oldest;
+    blockcache_unlink (block);
+
+    libmseed_memory.free (block->samples);
+    libmseed_memory.free (block);
+  }
+} /* End of blockcache_evict() */
+
+/***************************************************************************
+ * Double the number of hash table slots and rehash all blocks.  The
+ * cache must be locked by the caller.
+ *
+ * Returns 0 on success and -1 when memory cannot be allocated, the
+ * table is then left unchanged.
+ ***************************************************************************/
+static int
+blockcache_grow (void)
+{
+  CacheBlock **slots;
+  CacheBlock *block;
+  uint64_t slotcount = blockcache.slotcount * 2;
+  uint64_t slot;
+
+  if ((slots = (CacheBlock **)lm_malloc (slotcount * sizeof (CacheBlock *))) == NULL)
+    return -1;
+
+  memset (slots, 0, slotcount * sizeof (CacheBlock *));
+
+  for (block = blockcache.newest; block; block = block->older)
+  {
+    slot = blockcache_hash (block->fileid, block->offset) & (slotcount - 1);
+    block->hashnext = slots[slot];
+    slots[slot] = block;
+  }
+
+  libmseed_memory.free (blockcache.slots);
+  blockcache.slots = slots;
+  blockcache.slotcount = slotcount;
+
+  return 0;
+} /* End of blockcache_grow() */
+
+/** @endcond */
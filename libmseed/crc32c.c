@@ -408,3 +408,83 @@ ms_crc32c (const uint8_t* input, int length, uint32_t previousCRC32C)
   else
     return s_crc32c_sb8(input, length, previousCRC32C);
 } /* End of ms_crc32c() */
+
+/* private (static) function to multiply a GF(2) 32x32 matrix by a vector */
+static uint32_t s_gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+
+    while (vec) {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+
+    return sum;
+}
+
+/* private (static) function to square a GF(2) 32x32 matrix */
+static void s_gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+    int n;
+
+    for (n = 0; n < 32; n++)
+        square[n] = s_gf2_matrix_times(mat, mat[n]);
+}
+
+/************************************************************************
+ *
+ * Combine two CRC-32C values into the CRC-32C of the concatenated
+ * data, where crc1 is the CRC of the leading data and crc2 is the CRC
+ * of the trailing 'length2' bytes.  This allows a CRC to be assembled
+ * from independently calculated parts, e.g. a record header that is
+ * finalized after the payload is encoded.
+ *
+ * The zero-operator is applied by repeated squaring, so the cost is
+ * logarithmic in 'length2' and independent of the data.
+ *
+ * Return the combined CRC value.
+ ************************************************************************/
+uint32_t
+ms_crc32c_combine (uint32_t crc1, uint32_t crc2, int64_t length2)
+{
+  uint32_t even[32]; /* Even-power-of-two zeros operator */
+  uint32_t odd[32];  /* Odd-power-of-two zeros operator */
+  uint32_t row;
+  int n;
+
+  if (length2 <= 0)
+    return crc1;
+
+  /* Operator for one zero bit in odd */
+  odd[0] = CRC32C_POLYNOMIAL;
+  row = 1;
+  for (n = 1; n < 32; n++)
+  {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  /* Operator for two zero bits in even, then four zero bits in odd */
+  s_gf2_matrix_square (even, odd);
+  s_gf2_matrix_square (odd, even);
+
+  /* Apply length2 zero bytes to crc1, first squaring puts the
+   * operator for one zero byte (eight zero bits) in even */
+  do
+  {
+    s_gf2_matrix_square (even, odd);
+    if (length2 & 1)
+      crc1 = s_gf2_matrix_times (even, crc1);
+    length2 >>= 1;
+
+    if (length2 == 0)
+      break;
+
+    s_gf2_matrix_square (odd, even);
+    if (length2 & 1)
+      crc1 = s_gf2_matrix_times (odd, crc1);
+    length2 >>= 1;
+  } while (length2 != 0);
+
+  return crc1 ^ crc2;
+} /* End of ms_crc32c_combine() */
@@ -0,0 +1,192 @@
+/***************************************************************************
+ * A program illustrating and benchmarking the header-only C++ interface.
+ *
+ * Reads a file into memory and iterates over all records twice, once
+ * with msr3_parse() and once with mseed::RecordView, decoding the
+ * samples of each record of any sample type in both passes.  The
+ * results are compared and the time of each pass is reported.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include <libmseed.hpp>
+
+/* Summary of a pass over all records, compared between interfaces */
+struct Summary
+{
+  int64_t records = 0;
+  int64_t samples = 0;
+  int64_t sum = 0;
+  double fsum = 0;
+  nstime_t times = 0;
+};
+
+/* Add decoded samples to a summary */
+template <typename T>
+static void
+add_samples (Summary &summary, const T *samples, int64_t count)
+{
+  summary.samples += count;
+
+  for (int64_t index = 0; index < count; index++)
+  {
+    if constexpr (std::is_floating_point_v<T>)
+      summary.fsum += samples[index];
+    else
+      summary.sum += samples[index];
+  }
+}
+
+/* Iterate over records with the C interface */
+static Summary
+parse_c (const std::vector<char> &buffer)
+{
+  Summary summary;
+  MS3Record *msr = NULL;
+  uint64_t offset = 0;
+
+  while (offset + MINRECLEN <= buffer.size () &&
+         msr3_parse (buffer.data () + offset, buffer.size () - offset, &msr, MSF_UNPACKDATA, 0) == MS_NOERROR)
+  {
+    summary.records++;
+    summary.times += msr->starttime;
+
+    if (msr->sampletype == 'i')
+      add_samples (summary, (int32_t *)msr->datasamples, msr->numsamples);
+    else if (msr->sampletype == 'f')
+      add_samples (summary, (float *)msr->datasamples, msr->numsamples);
+    else if (msr->sampletype == 'd')
+      add_samples (summary, (double *)msr->datasamples, msr->numsamples);
+    else if (msr->sampletype == 't')
+      add_samples (summary, (char *)msr->datasamples, msr->numsamples);
+
+    offset += msr->reclen;
+  }
+
+  msr3_free (&msr);
+
+  return summary;
+}
+
+/* Decode the samples of a record as type T to a summary */
+template <typename T>
+static void
+decode_samples (Summary &summary, const mseed::RecordView &record, std::vector<char> &samples)
+{
+  samples.resize (static_cast<std::size_t> (record.sampleCount ()) * sizeof (T));
+
+  mseed::Span<T> decoded = record.decode (mseed::Span<T> (reinterpret_cast<T *> (samples.data ()),
+                                                          samples.size () / sizeof (T)));
+
+  add_samples (summary, decoded.data (), static_cast<int64_t> (decoded.size ()));
+}
+
+/* Iterate over records with the C++ interface */
+static Summary
+parse_cpp (const std::vector<char> &buffer)
+{
+  Summary summary;
+  std::vector<char> samples;
+
+  for (const mseed::RecordView &record : mseed::Records (mseed::as_bytes (buffer.data (), buffer.size ())))
+  {
+    summary.records++;
+    summary.times += record.startTime ();
+
+    switch (record.sampleType ())
+    {
+    case 'i': decode_samples<int32_t> (summary, record, samples); break;
+    case 'f': decode_samples<float> (summary, record, samples); break;
+    case 'd': decode_samples<double> (summary, record, samples); break;
+    case 't': decode_samples<char> (summary, record, samples); break;
+    }
+  }
+
+  return summary;
+}
+
+int
+main (int argc, char **argv)
+{
+  using clock = std::chrono::steady_clock;
+
+  Summary csummary;
+  Summary cppsummary;
+  int passes = 10;
+  int pass;
+
+  if (argc < 2)
+  {
+    fprintf (stderr, "Usage: %s file [passes]\n", argv[0]);
+    return 1;
+  }
+
+  if (argc > 2)
+    passes = atoi (argv[2]);
+
+  std::ifstream input (argv[1], std::ios::binary);
+  std::vector<char> buffer ((std::istreambuf_iterator<char> (input)), std::istreambuf_iterator<char> ());
+
+  if (!input && buffer.empty ())
+  {
+    fprintf (stderr, "Cannot read %s\n", argv[1]);
+    return 1;
+  }
+
+  auto start = clock::now ();
+  for (pass = 0; pass < passes; pass++)
+    csummary = parse_c (buffer);
+  auto cduration = std::chrono::duration<double> (clock::now () - start).count ();
+
+  start = clock::now ();
+  try
+  {
+    for (pass = 0; pass < passes; pass++)
+      cppsummary = parse_cpp (buffer);
+  }
+  catch (const mseed::Error &error)
+  {
+    fprintf (stderr, "Error: %s\n", error.what ());
+    return 1;
+  }
+  auto cppduration = std::chrono::duration<double> (clock::now () - start).count ();
+
+  printf ("C:   %lld records, %lld samples in %.3f ms/pass\n",
+          (long long)csummary.records, (long long)csummary.samples, cduration * 1000 / passes);
+  printf ("C++: %lld records, %lld samples in %.3f ms/pass\n",
+          (long long)cppsummary.records, (long long)cppsummary.samples, cppduration * 1000 / passes);
+
+  if (csummary.records != cppsummary.records ||
+      csummary.samples != cppsummary.samples ||
+      csummary.sum != cppsummary.sum ||
+      csummary.fsum != cppsummary.fsum ||
+      csummary.times != cppsummary.times)
+  {
+    fprintf (stderr, "Results of C and C++ interfaces differ\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -21,16 +21,19 @@
 #include "libmseed.h"
 #include "extraheaders.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_EXTRA
+#include "memprofile.h"
+
 /* Private allocation wrappers for yyjson's allocator definition */
 void *_priv_malloc(void *ctx, size_t size) {
     UNUSED(ctx);
-    return libmseed_memory.malloc(size);
+    return lm_malloc(size);
 }
 
 void *_priv_realloc(void *ctx, void *ptr, size_t oldsize, size_t size) {
     UNUSED(ctx);
     UNUSED(oldsize);
-    return libmseed_memory.realloc(ptr, size);
+    return lm_realloc(ptr, size);
 }
 
 void _priv_free(void *ctx, void *ptr) {
@@ -62,7 +65,7 @@ parse_json (char *jsonstring, size_t length, LM_PARSED_JSON *parsed)
   /* Allocate parsed state if needed */
   if (!parsed)
   {
-    if ((parsed = libmseed_memory.malloc (sizeof (LM_PARSED_JSON))) == NULL)
+    if ((parsed = lm_malloc (sizeof (LM_PARSED_JSON))) == NULL)
     {
       ms_log (2, "%s() Cannot allocate memory for internal JSON parsing state\n", __func__);
       return NULL;
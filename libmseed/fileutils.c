@@ -29,6 +29,15 @@
 #include "libmseed.h"
 #include "msio.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_IO
+#include "memprofile.h"
+
+#if !defined(LMP_WIN) && !defined(LIBMSEED_NO_THREADING)
+#define LM_READ_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 /* Skip length in bytes when skipping non-data */
 #define SKIPLEN 1
 
@@ -37,8 +46,66 @@ MS3FileParam gMS3FileParam = MS3FileParam_INITIALIZER;
 
 /* Stream state flags */
 #define MSFP_RANGEAPPLIED 0x0001  //!< Byte ranging has been applied
+#define MSFP_BLOCKCACHE 0x0002    //!< Decoded samples are cached, see ms3_blockcache_set()
+
+/* Internal from another source file */
+extern int mstl3_reclist_source (MS3TraceList *mstl, const char *filename, const char *buffer,
+                                 int64_t offset, uint32_t dataoffset);
+extern int ms_blockcache_fileid (FILE *fileptr, uint64_t fileid[4]);
+extern int64_t ms_blockcache_unpack (MS3Record *msr, const uint64_t fileid[4], int64_t offset,
+                                     int8_t verbose);
+
+#if defined(LM_READ_THREADS)
+/* Slot states of the read pipeline */
+#define SLOT_EMPTY 0
+#define SLOT_READ 1
+#define SLOT_DECODED 2
+#define SLOT_FAILED 3
+
+/* A record in the read pipeline, owned by the stage for its state */
+typedef struct ReadSlot
+{
+  MS3Record *msr;      /* Parsed record, with samples when decoded */
+  char *record;        /* Copy of raw record, MAXRECLEN bytes */
+  int64_t fileoffset;  /* Offset of record in file */
+  int8_t state;
+} ReadSlot;
+
+/* Shared state of the read pipeline, a ring of slots */
+typedef struct ReadPipeline
+{
+  ReadSlot *slots;
+  uint64_t slotcount;
+  uint64_t readcount;    /* Records read, next slot to fill */
+  uint64_t decodecount;  /* Records claimed for decoding */
+  uint64_t insertcount;  /* Records inserted, next slot to insert */
+  int readerror;         /* Return value of reading when done */
+  int8_t readdone;
+  int8_t stop;           /* Set by inserter to stop all threads */
+  char path[512];        /* Path of file without byte range */
+  uint64_t fileid[4];    /* File identity for decoded block cache */
+  int8_t blockcache;     /* Decoded samples are cached */
+  const char *mspath;
+  const MS3Selections *selections;
+  uint32_t flags;
+  int8_t verbose;
+  pthread_mutex_t lock;
+  pthread_cond_t slotfree;
+  pthread_cond_t readready;
+  pthread_cond_t decoded;
+} ReadPipeline;
+
+static void *read_worker (void *arg);
+static void *decode_worker (void *arg);
+#endif
 
 static char *parse_pathname_range (const char *string, int64_t *start, int64_t *end);
+static int sortedfixed_range (const char *path, const MS3Selections *selections,
+                              int64_t *startoffset, int64_t *endoffset, int8_t verbose);
+static int add_tracelist_record (MS3TraceList *mstl, MS3Record *msr, const char *mspath,
+                                 const char *path, int64_t fileoffset,
+                                 const MS3Tolerance *tolerance, int8_t splitversion,
+                                 uint32_t flags);
 
 /*****************************************************************/ /**
  * @brief Run-time test for URL support in libmseed.
@@ -77,7 +144,7 @@ ms3_mstl_init_fd (int fd)
   MS3FileParam *msfp;
 
   /* Initialize the read parameters if needed */
-  msfp = (MS3FileParam *)libmseed_memory.malloc (sizeof (MS3FileParam));
+  msfp = (MS3FileParam *)lm_malloc (sizeof (MS3FileParam));
 
   if (msfp == NULL)
   {
@@ -213,6 +280,7 @@ ms3_shift_msfp (MS3FileParam *msfp, int shift)
  *  - ::MSF_UNPACKDATA data samples will be unpacked
  *  - ::MSF_VALIDATECRC Validate CRC (if present in format)
  *  - ::MSF_PNAMERANGE Parse byte range suffix from \a mspath
+ *  - ::MSF_NOCACHE Release file data from the page cache once read
  *
  * If ::MSF_PNAMERANGE is set in \a flags, the \a mspath will be
  * searched for start and end byte offsets for the file or URL in the
@@ -277,7 +345,7 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
   /* Initialize the read parameters if needed */
   if (!msfp)
   {
-    msfp = (MS3FileParam *)libmseed_memory.malloc (sizeof (MS3FileParam));
+    msfp = (MS3FileParam *)lm_malloc (sizeof (MS3FileParam));
 
     if (msfp == NULL)
     {
@@ -320,7 +388,7 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
   /* Allocate reading buffer */
   if (msfp->readbuffer == NULL)
   {
-    if (!(msfp->readbuffer = (char *)libmseed_memory.malloc (MAXRECLEN)))
+    if (!(msfp->readbuffer = (char *)lm_malloc (MAXRECLEN)))
     {
       ms_log (2, "Cannot allocate memory for read buffer\n");
       return MS_GENERROR;
@@ -367,11 +435,24 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
       {
         msfp->streampos = msfp->startoffset;
       }
+
+      /* Release file data from the page cache as it is read */
+      if (flags & MSF_NOCACHE)
+      {
+        msfp->input.nocache = 1;
+      }
+
+      /* Identify regular files for the decoded block cache */
+      if (msfp->input.type == LMIO_FILE &&
+          ms_blockcache_fileid ((FILE *)msfp->input.handle, msfp->fileid) == 0)
+      {
+        msfp->flags |= MSFP_BLOCKCACHE;
+      }
     }
   }
 
-  /* Defer data unpacking if selections are used by unsetting MSF_UNPACKDATA */
-  if ((flags & MSF_UNPACKDATA) && selections)
+  /* Defer data unpacking if selections or the block cache are used by unsetting MSF_UNPACKDATA */
+  if ((flags & MSF_UNPACKDATA) && (selections || (msfp->flags & MSFP_BLOCKCACHE)))
     pflags &= ~(MSF_UNPACKDATA);
 
   /* Read data and search for records until input stream ends or end offset is reached */
@@ -449,7 +530,9 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
           /* Unpack data samples if this has been deferred */
           if (!(pflags & MSF_UNPACKDATA) && (flags & MSF_UNPACKDATA) && (*ppmsr)->samplecnt > 0)
           {
-            if (msr3_unpack_data ((*ppmsr), verbose) != (*ppmsr)->samplecnt)
+            if (((msfp->flags & MSFP_BLOCKCACHE) ?
+                 ms_blockcache_unpack ((*ppmsr), msfp->fileid, msfp->streampos, verbose) :
+                 msr3_unpack_data ((*ppmsr), verbose)) != (*ppmsr)->samplecnt)
             {
               ms_log (2, "Cannot unpack data samples for record at byte offset %" PRId64 ": %s\n",
                       msfp->streampos, msfp->path);
@@ -655,6 +738,20 @@ ms3_readtracelist_timewin (MS3TraceList **ppmstl, const char *mspath,
  * If the ::MSF_RECORDLIST flag is set in \a flags, a ::MS3RecordList
  * will be built for each ::MS3TraceSeg.  The ::MS3RecordPtr entries
  * contain the location of the data record, bit flags, extra headers, etc.
+ * If the ::MSF_COMPACTRECLIST flag is set, compact record lists are
+ * built instead, see @ref record-list.  If the ::MSF_KEEPRECORDS flag
+ * is set, the compact record lists keep a copy of each record.
+ *
+ * If the ::MSF_SORTEDFIXED flag is set and \a selections contain time
+ * windows, the file is assumed to contain fixed-length records of a
+ * single source ID in time order.  The record length is detected from
+ * the first record and the file is bisected by record index, parsing
+ * only the headers of probed records, to find the records that may
+ * contain selected data, such that only O(log n) records outside of
+ * the time windows are read.  If the file is not a regular file, its
+ * size is not a multiple of the record length, or a probed record is
+ * of a different length or source ID, the complete file is read.
+ * The results are undefined if the records are not in time order.
  *
  * @param[out] ppmstl Pointer-to-pointer to a ::MS3TraceList to populate
  * @param[in] mspath File to read
@@ -679,11 +776,10 @@ ms3_readtracelist_selection (MS3TraceList **ppmstl, const char *mspath,
 {
   MS3Record *msr     = NULL;
   MS3FileParam *msfp = NULL;
-  MS3TraceSeg *seg   = NULL;
-  MS3RecordPtr *recordptr = NULL;
-  uint32_t dataoffset;
-  uint32_t datasize;
+  int64_t startoffset = 0;
+  int64_t endoffset = 0;
   int retcode;
+  int rv;
 
   if (!ppmstl)
   {
@@ -703,48 +799,395 @@ ms3_readtracelist_selection (MS3TraceList **ppmstl, const char *mspath,
     }
   }
 
+  /* Limit reading to the selected records of a time-sorted fixed-length record file */
+  if ((flags & MSF_SORTEDFIXED) && selections &&
+      (!(flags & MSF_PNAMERANGE) || !parse_pathname_range (mspath, &startoffset, &endoffset)))
+  {
+    rv = sortedfixed_range (mspath, selections, &startoffset, &endoffset, verbose);
+
+    /* No records can match */
+    if (rv == 0)
+      return MS_NOERROR;
+
+    if (rv > 0)
+    {
+      if ((msfp = (MS3FileParam *)lm_malloc (sizeof (MS3FileParam))) == NULL)
+      {
+        ms_log (2, "Cannot allocate memory for MS3FileParam\n");
+        return MS_GENERROR;
+      }
+
+      *msfp = (MS3FileParam)MS3FileParam_INITIALIZER;
+      msfp->startoffset = startoffset;
+      msfp->endoffset = endoffset;
+    }
+  }
+
   /* Loop over the input file and add each record to trace list */
   while ((retcode = ms3_readmsr_selection (&msfp, &msr, mspath,
                                            flags, selections, verbose)) == MS_NOERROR)
   {
-    seg = mstl3_addmsr_recordptr (*ppmstl, msr, (flags & MSF_RECORDLIST) ? &recordptr : NULL,
-                                  splitversion, 1, flags, tolerance);
+    retcode = add_tracelist_record (*ppmstl, msr, mspath, msfp->path,
+                                    msfp->streampos - msr->reclen,
+                                    tolerance, splitversion, flags);
+
+    if (retcode != MS_NOERROR)
+      break;
+  }
+
+  /* Reset return code to MS_NOERROR on successful read by ms_readmsr_selection() */
+  if (retcode == MS_ENDOFFILE)
+    retcode = MS_NOERROR;
+
+  ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+
+  return retcode;
+} /* End of ms3_readtracelist_selection() */
+
+/****************************************************************/ /**
+ * @brief Read miniSEED from a file into a trace list, decoding
+ * samples with multiple threads
+ *
+ * This routine is equivalent to ms3_readtracelist_selection() and
+ * produces exactly the same trace list, but when ::MSF_UNPACKDATA is
+ * set the work is divided into a pipeline so that reading, decoding
+ * and inserting overlap:
+ * - a reader thread reads and parses records into a queue
+ * - \a threads decoder threads unpack the data samples of records
+ * - the calling thread adds records to the trace list in file order
+ *
+ * If \a threads is 0 the number of online processors is used.  The
+ * \a tolerance callbacks are only called from the calling thread.
+ *
+ * Without ::MSF_UNPACKDATA there is no decoding to overlap and on
+ * platforms without thread support, this routine calls
+ * ms3_readtracelist_selection().
+ *
+ * @param[out] ppmstl Pointer-to-pointer to a ::MS3TraceList to populate
+ * @param[in] mspath File to read
+ * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
+ * @param[in] selections Pointer to ::MS3Selections for limiting data
+ * @param[in] splitversion Flag to control splitting of version/quality
+ * @param[in] flags Flags to control reading, see ms3_readmsr_selection()
+ * @param[in] threads Number of decoder threads, 0 for all processors
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns ::MS_NOERROR and populates an ::MS3TraceList struct at *ppmstl
+ * on success, otherwise returns a (negative) libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa ms3_readtracelist_selection()
+ *********************************************************************/
+int
+ms3_readtracelist_parallel (MS3TraceList **ppmstl, const char *mspath,
+                            const MS3Tolerance *tolerance, const MS3Selections *selections,
+                            int8_t splitversion, uint32_t flags, int threads, int8_t verbose)
+{
+#if !defined(LM_READ_THREADS)
+  (void)threads;
+  return ms3_readtracelist_selection (ppmstl, mspath, tolerance, selections,
+                                      splitversion, flags, verbose);
+#else
+  ReadPipeline pipeline;
+  ReadSlot *slot;
+  pthread_t reader;
+  pthread_t *decoders = NULL;
+  uint64_t idx;
+  int started = 0;
+  int retcode = MS_NOERROR;
+  int8_t readerstarted = 0;
+  int tidx;
+
+  if (!(flags & MSF_UNPACKDATA))
+    return ms3_readtracelist_selection (ppmstl, mspath, tolerance, selections,
+                                        splitversion, flags, verbose);
+
+  if (!ppmstl || !mspath)
+  {
+    ms_log (2, "%s(): Required input not defined: 'ppmstl' or 'mspath'\n", __func__);
+    return MS_GENERROR;
+  }
+
+  if (threads <= 0)
+    threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = 1;
+
+  /* Initialize MS3TraceList if needed */
+  if (!*ppmstl)
+  {
+    *ppmstl = mstl3_init (*ppmstl);
 
-    if (seg == NULL)
+    if (!*ppmstl)
     {
-      ms_log (2, "%s: Cannot add record to trace list\n", msr->sid);
+      ms_log (2, "Cannot allocate memory\n");
+      return MS_GENERROR;
+    }
+  }
+
+  memset (&pipeline, 0, sizeof (pipeline));
+  pipeline.slotcount = (uint64_t)threads * 16;
+  pipeline.mspath = mspath;
+  pipeline.selections = selections;
+  pipeline.flags = flags;
+  pipeline.verbose = verbose;
+
+  if ((pipeline.slots = (ReadSlot *)lm_malloc ((size_t)(pipeline.slotcount * sizeof (ReadSlot)))) == NULL ||
+      (decoders = (pthread_t *)lm_malloc (threads * sizeof (pthread_t))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    if (pipeline.slots)
+      libmseed_memory.free (pipeline.slots);
+    return MS_GENERROR;
+  }
+
+  memset (pipeline.slots, 0, (size_t)(pipeline.slotcount * sizeof (ReadSlot)));
 
+  pthread_mutex_init (&pipeline.lock, NULL);
+  pthread_cond_init (&pipeline.slotfree, NULL);
+  pthread_cond_init (&pipeline.readready, NULL);
+  pthread_cond_init (&pipeline.decoded, NULL);
+
+  if (pthread_create (&reader, NULL, read_worker, &pipeline))
+  {
+    ms_log (2, "Cannot create thread: %s\n", strerror (errno));
+    retcode = MS_GENERROR;
+  }
+  else
+  {
+    readerstarted = 1;
+  }
+
+  for (tidx = 0; readerstarted && tidx < threads; tidx++)
+  {
+    if (pthread_create (&decoders[tidx], NULL, decode_worker, &pipeline))
+    {
+      ms_log (2, "Cannot create thread: %s\n", strerror (errno));
       retcode = MS_GENERROR;
       break;
     }
 
-    /* Populate remaining fields of record pointer */
-    if (recordptr)
+    started++;
+  }
+
+  /* Insert records in file order as they are decoded */
+  while (retcode == MS_NOERROR)
+  {
+    pthread_mutex_lock (&pipeline.lock);
+    slot = &pipeline.slots[pipeline.insertcount % pipeline.slotcount];
+
+    while ((pipeline.insertcount < pipeline.readcount && slot->state == SLOT_READ) ||
+           (pipeline.insertcount >= pipeline.readcount && !pipeline.readdone))
+      pthread_cond_wait (&pipeline.decoded, &pipeline.lock);
+
+    if (pipeline.insertcount >= pipeline.readcount)
     {
-      /* Determine offset to data and length of data payload */
-      if (msr3_data_bounds (msr, &dataoffset, &datasize))
-      {
-        retcode = MS_GENERROR;
-        break;
-      }
+      retcode = pipeline.readerror;
+      pthread_mutex_unlock (&pipeline.lock);
+      break;
+    }
+    pthread_mutex_unlock (&pipeline.lock);
+
+    if (slot->state == SLOT_FAILED)
+    {
+      ms_log (2, "Cannot unpack data samples for record at byte offset %" PRId64 ": %s\n",
+              slot->fileoffset, pipeline.path);
+
+      retcode = MS_GENERROR;
+      break;
+    }
+
+    retcode = add_tracelist_record (*ppmstl, slot->msr, mspath, pipeline.path, slot->fileoffset,
+                                    tolerance, splitversion, flags);
+
+    if (retcode != MS_NOERROR)
+      break;
+
+    pthread_mutex_lock (&pipeline.lock);
+    slot->state = SLOT_EMPTY;
+    pipeline.insertcount++;
+    pthread_cond_signal (&pipeline.slotfree);
+    pthread_mutex_unlock (&pipeline.lock);
+  }
+
+  /* Stop and join all threads */
+  pthread_mutex_lock (&pipeline.lock);
+  pipeline.stop = 1;
+  pthread_cond_broadcast (&pipeline.slotfree);
+  pthread_cond_broadcast (&pipeline.readready);
+  pthread_mutex_unlock (&pipeline.lock);
 
-      recordptr->bufferptr  = NULL;
-      recordptr->fileptr    = NULL;
-      recordptr->filename   = mspath;
-      recordptr->fileoffset = msfp->streampos - msr->reclen;
-      recordptr->dataoffset = dataoffset;
-      recordptr->prvtptr    = NULL;
+  if (readerstarted)
+    pthread_join (reader, NULL);
+
+  for (tidx = 0; tidx < started; tidx++)
+    pthread_join (decoders[tidx], NULL);
+
+  for (idx = 0; idx < pipeline.slotcount; idx++)
+  {
+    if (pipeline.slots[idx].msr)
+    {
+      pipeline.slots[idx].msr->record = NULL;
+      msr3_free (&pipeline.slots[idx].msr);
     }
+    if (pipeline.slots[idx].record)
+      libmseed_memory.free (pipeline.slots[idx].record);
   }
 
-  /* Reset return code to MS_NOERROR on successful read by ms_readmsr_selection() */
-  if (retcode == MS_ENDOFFILE)
-    retcode = MS_NOERROR;
+  pthread_cond_destroy (&pipeline.decoded);
+  pthread_cond_destroy (&pipeline.readready);
+  pthread_cond_destroy (&pipeline.slotfree);
+  pthread_mutex_destroy (&pipeline.lock);
 
-  ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+  libmseed_memory.free (pipeline.slots);
+  libmseed_memory.free (decoders);
 
   return retcode;
-} /* End of ms3_readtracelist_selection() */
+#endif
+} /* End of ms3_readtracelist_parallel() */
+
+#if defined(LM_READ_THREADS)
+/***************************************************************************
+ * Reader thread of the read pipeline: read and parse records without
+ * decoding and copy each into the next free slot.
+ ***************************************************************************/
+static void *
+read_worker (void *arg)
+{
+  ReadPipeline *pipeline = (ReadPipeline *)arg;
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  ReadSlot *slot;
+  char *extra;
+  void *datasamples;
+  size_t datasize;
+  int retcode;
+
+  while ((retcode = ms3_readmsr_selection (&msfp, &msr, pipeline->mspath,
+                                           pipeline->flags & ~MSF_UNPACKDATA,
+                                           pipeline->selections, pipeline->verbose)) == MS_NOERROR)
+  {
+    pthread_mutex_lock (&pipeline->lock);
+    while (pipeline->readcount - pipeline->insertcount >= pipeline->slotcount && !pipeline->stop)
+      pthread_cond_wait (&pipeline->slotfree, &pipeline->lock);
+
+    if (pipeline->stop)
+    {
+      pthread_mutex_unlock (&pipeline->lock);
+      break;
+    }
+
+    if (pipeline->readcount == 0)
+    {
+      memcpy (pipeline->path, msfp->path, sizeof (pipeline->path));
+      memcpy (pipeline->fileid, msfp->fileid, sizeof (pipeline->fileid));
+      pipeline->blockcache = (msfp->flags & MSFP_BLOCKCACHE) ? 1 : 0;
+    }
+
+    slot = &pipeline->slots[pipeline->readcount % pipeline->slotcount];
+    pthread_mutex_unlock (&pipeline->lock);
+
+    /* Allocate slot buffers on first use */
+    if (!slot->record && (slot->record = (char *)lm_malloc (MAXRECLEN)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      retcode = MS_GENERROR;
+      break;
+    }
+
+    if (!slot->msr && (slot->msr = msr3_init (NULL)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      retcode = MS_GENERROR;
+      break;
+    }
+
+    /* Copy record into slot, keeping slot sample and extra header buffers */
+    datasamples = slot->msr->datasamples;
+    datasize = slot->msr->datasize;
+    extra = slot->msr->extra;
+
+    if (msr->extralength > 0 &&
+        (extra = (char *)lm_realloc (extra, msr->extralength)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      retcode = MS_GENERROR;
+      break;
+    }
+
+    memcpy (slot->msr, msr, sizeof (MS3Record));
+    memcpy (slot->record, msr->record, msr->reclen);
+
+    if (msr->extralength > 0)
+      memcpy (extra, msr->extra, msr->extralength);
+
+    slot->msr->record = slot->record;
+    slot->msr->extra = extra;
+    slot->msr->datasamples = datasamples;
+    slot->msr->datasize = datasize;
+    slot->msr->numsamples = 0;
+    slot->fileoffset = msfp->streampos - msr->reclen;
+
+    pthread_mutex_lock (&pipeline->lock);
+    slot->state = SLOT_READ;
+    pipeline->readcount++;
+    pthread_cond_signal (&pipeline->readready);
+    pthread_mutex_unlock (&pipeline->lock);
+  }
+
+  pthread_mutex_lock (&pipeline->lock);
+  pipeline->readerror = (retcode == MS_ENDOFFILE) ? MS_NOERROR : retcode;
+  pipeline->readdone = 1;
+  pthread_cond_broadcast (&pipeline->readready);
+  pthread_cond_broadcast (&pipeline->decoded);
+  pthread_mutex_unlock (&pipeline->lock);
+
+  ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+
+  return NULL;
+} /* End of read_worker() */
+
+/***************************************************************************
+ * Decoder thread of the read pipeline: unpack the samples of read
+ * records in the order they were read.
+ ***************************************************************************/
+static void *
+decode_worker (void *arg)
+{
+  ReadPipeline *pipeline = (ReadPipeline *)arg;
+  ReadSlot *slot;
+  int8_t failed;
+
+  pthread_mutex_lock (&pipeline->lock);
+
+  for (;;)
+  {
+    while (pipeline->decodecount >= pipeline->readcount && !pipeline->readdone && !pipeline->stop)
+      pthread_cond_wait (&pipeline->readready, &pipeline->lock);
+
+    if (pipeline->stop || pipeline->decodecount >= pipeline->readcount)
+      break;
+
+    slot = &pipeline->slots[pipeline->decodecount % pipeline->slotcount];
+    pipeline->decodecount++;
+    pthread_mutex_unlock (&pipeline->lock);
+
+    failed = (slot->msr->samplecnt > 0 &&
+              ((pipeline->blockcache) ?
+               ms_blockcache_unpack (slot->msr, pipeline->fileid, slot->fileoffset, pipeline->verbose) :
+               msr3_unpack_data (slot->msr, pipeline->verbose)) != slot->msr->samplecnt);
+
+    pthread_mutex_lock (&pipeline->lock);
+    slot->state = (failed) ? SLOT_FAILED : SLOT_DECODED;
+    pthread_cond_broadcast (&pipeline->decoded);
+  }
+
+  pthread_mutex_unlock (&pipeline->lock);
+
+  return NULL;
+} /* End of decode_worker() */
+#endif
 
 /*****************************************************************/ /**
  * @brief Set User-Agent header for URL-based requests.
@@ -886,7 +1329,8 @@ ms_record_handler_int (char *record, int reclen, void *ofp)
  * @param[in,out] msr ::MS3Record containing data to write
  * @param[in] mspath File for output records
  * @param[in] overwrite Flag to control overwriting versus appending
- * @param[in] flags Flags controlling data packing, see msr3_pack()
+ * @param[in] flags Flags controlling data packing, see msr3_pack(),
+ * and ::MSF_NOCACHE to release written data from the page cache
  * @param[in] verbose Controls verbosity, 0 means no diagnostic output
  *
  * @returns the number of records written on success and -1 on error.
@@ -923,6 +1367,10 @@ msr3_writemseed (MS3Record *msr, const char *mspath, int8_t overwrite,
   /* Pack the MS3Record */
   packedrecords = msr3_pack (msr, &ms_record_handler_int, ofp, NULL, flags, verbose - 1);
 
+  /* Release written data from the page cache if requested */
+  if ((flags & MSF_NOCACHE) && ofp != stdout)
+    lmp_fdropcache (ofp, 0, 0, 1);
+
   /* Close file and return record count */
   fclose (ofp);
 
@@ -946,7 +1394,8 @@ msr3_writemseed (MS3Record *msr, const char *mspath, int8_t overwrite,
  * @param[in] overwrite Flag to control overwriting versus appending
  * @param[in] maxreclen The maximum record length to create
  * @param[in] encoding encoding Encoding for data samples, see msr3_pack()
- * @param[in] flags Flags controlling data packing, see mstl3_pack() and msr3_pack()
+ * @param[in] flags Flags controlling data packing, see mstl3_pack() and msr3_pack(),
+ * and ::MSF_NOCACHE to release written data from the page cache
  * @param[in] verbose Controls verbosity, 0 means no diagnostic output
  *
  * @returns the number of records written on success and -1 on error.
@@ -990,6 +1439,10 @@ mstl3_writemseed (MS3TraceList *mstl, const char *mspath, int8_t overwrite,
   packedrecords = mstl3_pack (mstl, &ms_record_handler_int, ofp, maxreclen,
                               encoding, NULL, flags, verbose, NULL);
 
+  /* Release written data from the page cache if requested */
+  if ((flags & MSF_NOCACHE) && ofp != stdout)
+    lmp_fdropcache (ofp, 0, 0, 1);
+
   /* Close file and return record count */
   fclose (ofp);
 
@@ -1062,3 +1515,262 @@ parse_pathname_range (const char *string, int64_t *start, int64_t *end)
 
   return at;
 } /* End of parse_pathname_range() */
+
+/***************************************************************************
+ * sortedfixed_probe:
+ *
+ * Read the record at 'index' of a fixed-length record file and parse
+ * its header.  The record must be of length 'reclen' and of source
+ * ID 'sid'.
+ *
+ * Returns 0 on success and sets 'starttime' and 'endtime', otherwise
+ * returns -1.
+ ***************************************************************************/
+static int
+sortedfixed_probe (FILE *fp, char *buffer, int64_t reclen, int64_t index,
+                   const char *sid, nstime_t *starttime, nstime_t *endtime)
+{
+  MS3Record *msr = NULL;
+  int rv = -1;
+
+  if (lmp_fseek64 (fp, index * reclen, SEEK_SET) ||
+      fread (buffer, (size_t)reclen, 1, fp) != 1)
+    return -1;
+
+  if (msr3_parse (buffer, (uint64_t)reclen, &msr, 0, 0) == MS_NOERROR &&
+      msr->reclen == reclen && !strcmp (msr->sid, sid))
+  {
+    *starttime = msr->starttime;
+    *endtime = msr3_endtime (msr);
+    rv = 0;
+  }
+
+  msr3_free (&msr);
+
+  return rv;
+} /* End of sortedfixed_probe() */
+
+/***************************************************************************
+ * sortedfixed_range:
+ *
+ * Determine the byte range of a file of fixed-length records of a
+ * single source ID in time order that contains all records that may
+ * match the time windows of 'selections'.  The record length is
+ * detected from the first record, and the first and last records of
+ * the range are found by bisecting the file by record index.
+ *
+ * Returns 1 and sets 'startoffset' and 'endoffset' (inclusive) when a
+ * range was determined, 0 when no records can match, and -1 when the
+ * file or selections do not qualify and the file should be read
+ * completely.
+ ***************************************************************************/
+static int
+sortedfixed_range (const char *path, const MS3Selections *selections,
+                   int64_t *startoffset, int64_t *endoffset, int8_t verbose)
+{
+  const MS3Selections *select;
+  const MS3SelectTime *window;
+  MS3Record *msr = NULL;
+  FILE *fp = NULL;
+  char *buffer = NULL;
+  char sid[LM_SIDLEN];
+  nstime_t earliest = NSTUNSET;
+  nstime_t latest = NSTUNSET;
+  nstime_t starttime;
+  nstime_t endtime;
+  int8_t openstart = 0;
+  int8_t openend = 0;
+  int64_t filesize;
+  int64_t reclen;
+  int64_t count;
+  int64_t first;
+  int64_t last;
+  int64_t low;
+  int64_t high;
+  int64_t mid;
+  uint8_t formatversion;
+  int probes = 0;
+  int rv = -1;
+
+  /* Determine the earliest start and latest end of all time windows */
+  for (select = selections; select; select = select->next)
+  {
+    if (!select->timewindows)
+      return -1;
+
+    for (window = select->timewindows; window; window = window->next)
+    {
+      if (window->starttime == NSTUNSET || window->starttime == NSTERROR)
+        openstart = 1;
+      else if (earliest == NSTUNSET || window->starttime < earliest)
+        earliest = window->starttime;
+
+      if (window->endtime == NSTUNSET || window->endtime == NSTERROR)
+        openend = 1;
+      else if (latest == NSTUNSET || window->endtime > latest)
+        latest = window->endtime;
+    }
+  }
+
+  if (openstart && openend)
+    return -1;
+
+  if (!strcmp (path, "-") || (fp = fopen (path, "rb")) == NULL)
+    return -1;
+
+  if (lmp_fseek64 (fp, 0, SEEK_END) || (filesize = lmp_ftell64 (fp)) < MINRECLEN)
+  {
+    fclose (fp);
+    return -1;
+  }
+
+  /* Detect the record length and source ID from the first record */
+  count = (filesize < MAXRECLENv2) ? filesize : MAXRECLENv2;
+
+  if ((buffer = (char *)lm_malloc ((size_t)count)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    fclose (fp);
+    return -1;
+  }
+
+  if (lmp_fseek64 (fp, 0, SEEK_SET) || fread (buffer, (size_t)count, 1, fp) != 1 ||
+      (reclen = ms3_detect (buffer, (uint64_t)count, &formatversion)) <= 0 ||
+      reclen > count || filesize % reclen != 0 ||
+      msr3_parse (buffer, (uint64_t)reclen, &msr, 0, 0) != MS_NOERROR)
+  {
+    msr3_free (&msr);
+    libmseed_memory.free (buffer);
+    fclose (fp);
+    return -1;
+  }
+
+  memcpy (sid, msr->sid, sizeof (sid));
+  msr3_free (&msr);
+
+  count = filesize / reclen;
+  first = 0;
+  last = count;
+
+  /* Find the first record that ends at or after the earliest start */
+  if (!openstart)
+  {
+    low = 0;
+    high = count;
+
+    while (low < high)
+    {
+      mid = low + (high - low) / 2;
+      probes++;
+
+      if (sortedfixed_probe (fp, buffer, reclen, mid, sid, &starttime, &endtime))
+        goto cleanup;
+
+      if (endtime < earliest)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    first = low;
+  }
+
+  /* Find the first record that starts after the latest end */
+  if (!openend)
+  {
+    low = first;
+    high = count;
+
+    while (low < high)
+    {
+      mid = low + (high - low) / 2;
+      probes++;
+
+      if (sortedfixed_probe (fp, buffer, reclen, mid, sid, &starttime, &endtime))
+        goto cleanup;
+
+      if (starttime > latest)
+        high = mid;
+      else
+        low = mid + 1;
+    }
+
+    last = low;
+  }
+
+  if (verbose > 1)
+    ms_log (0, "Bisected %s with %d probes to records %" PRId64 " - %" PRId64 " of %" PRId64 "\n",
+            path, probes, first, last, count);
+
+  if (first >= last)
+  {
+    rv = 0;
+  }
+  else
+  {
+    *startoffset = first * reclen;
+    *endoffset = last * reclen - 1;
+    rv = 1;
+  }
+
+cleanup:
+  libmseed_memory.free (buffer);
+  fclose (fp);
+
+  return rv;
+} /* End of sortedfixed_range() */
+
+/*********************************************************************
+ * Add a record read from a file to a trace list, building a record
+ * list entry as requested by 'flags'.  The file name is 'mspath' for
+ * linked record lists, the name given by the caller, and 'path' for
+ * compact record lists, the name without any byte range.
+ *
+ * Returns MS_NOERROR on success and MS_GENERROR on error.
+ *********************************************************************/
+static int
+add_tracelist_record (MS3TraceList *mstl, MS3Record *msr, const char *mspath,
+                      const char *path, int64_t fileoffset,
+                      const MS3Tolerance *tolerance, int8_t splitversion,
+                      uint32_t flags)
+{
+  MS3TraceSeg *seg = NULL;
+  MS3RecordPtr *recordptr = NULL;
+  uint32_t dataoffset;
+  uint32_t datasize;
+
+  /* Set record location for compact record list, unless a copy is kept */
+  if ((flags & MSF_COMPACTRECLIST) && !(flags & MSF_KEEPRECORDS))
+  {
+    if (msr3_data_bounds (msr, &dataoffset, &datasize) ||
+        mstl3_reclist_source (mstl, path, NULL, fileoffset, dataoffset))
+      return MS_GENERROR;
+  }
+
+  seg = mstl3_addmsr_recordptr (mstl, msr,
+                                (flags & MSF_RECORDLIST && !(flags & (MSF_COMPACTRECLIST | MSF_KEEPRECORDS))) ? &recordptr : NULL,
+                                splitversion, 1, flags, tolerance);
+
+  if (seg == NULL)
+  {
+    ms_log (2, "%s: Cannot add record to trace list\n", msr->sid);
+    return MS_GENERROR;
+  }
+
+  /* Populate remaining fields of record pointer */
+  if (recordptr)
+  {
+    /* Determine offset to data and length of data payload */
+    if (msr3_data_bounds (msr, &dataoffset, &datasize))
+      return MS_GENERROR;
+
+    recordptr->bufferptr  = NULL;
+    recordptr->fileptr    = NULL;
+    recordptr->filename   = mspath;
+    recordptr->fileoffset = fileoffset;
+    recordptr->dataoffset = dataoffset;
+    recordptr->prvtptr    = NULL;
+  }
+
+  return MS_NOERROR;
+} /* End of add_tracelist_record() */
@@ -0,0 +1,1024 @@
+/***************************************************************************
+ * Streaming gap and overlap analysis of miniSEED records.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+#include "mseedformat.h"
+#include "unpack.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+#if !defined(LMP_WIN) && !defined(LIBMSEED_NO_THREADING)
+#define LM_GAPSTREAM_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+/* Size of buffer used to read files */
+#define GAPSTREAM_READSIZE 1048576
+
+/* Initial number of source ID slots, a power of 2 */
+#define GAPSTREAM_INITIALSLOTS 64
+
+/* Coverage state of a source ID, only the ends of coverage are kept */
+typedef struct GapTrace
+{
+  char sid[LM_SIDLEN];
+  nstime_t firststart; /* Start of first record */
+  nstime_t firstend;   /* End of first record */
+  double firstrate;    /* Sample rate of first record */
+  nstime_t lastend;    /* End of current segment */
+  double lastrate;     /* Sample rate of current segment */
+  nstime_t maxend;     /* Latest end of any segment */
+} GapTrace;
+
+struct MS3GapStream
+{
+  GapTrace *traces;   /* Table of source IDs, open addressing */
+  uint32_t slots;     /* Number of slots in table, a power of 2 */
+  uint32_t count;     /* Number of source IDs in table */
+  int8_t usemingap;
+  int8_t usemaxgap;
+  double mingap;
+  double maxgap;
+  void (*gap_handler) (const MS3Gap *gap, void *handlerdata);
+  void *handlerdata;
+};
+
+/* Gaps collected for a file read by a worker thread */
+typedef struct GapFile
+{
+  const char *path;
+  MS3GapStream *stream;
+  MS3Gap *gaps;
+  uint64_t gapcount;
+  uint64_t gapcapacity;
+  int64_t records;
+  int8_t done;
+} GapFile;
+
+/* Shared state for file reading workers */
+typedef struct GapWork
+{
+  GapFile *files;
+  int filecount;
+  int nextfile;
+  uint32_t flags;
+  int8_t verbose;
+#if defined(LM_GAPSTREAM_THREADS)
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+#endif
+} GapWork;
+
+static GapTrace *find_trace (MS3GapStream *gs, const char *sid, int8_t insert);
+static void check_gap (MS3GapStream *gs, const char *sid, nstime_t lastend, double lastrate,
+                       nstime_t nextstart, nstime_t nextend, double nextrate);
+static int record_descriptor (const char *record, uint64_t reclen, uint8_t formatversion,
+                              char *sid, nstime_t *starttime, nstime_t *endtime, double *samprate);
+static void collect_gap (const MS3Gap *gap, void *handlerdata);
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Initialize a streaming gap analysis
+ *
+ * A gap stream consumes record descriptors, the source ID, start and
+ * end time and sample rate of each record, and keeps only the end of
+ * the current segment for each source ID.  Gaps and overlaps are
+ * passed to \a gap_handler as they are found, instead of building a
+ * ::MS3TraceList and calling mstl3_printgaplist().
+ *
+ * Records are expected in time order for each source ID, as in
+ * typical archive files; a record that starts before the end of the
+ * current segment is reported as an overlap.  A record is contiguous
+ * with the current segment when its start is within half a sample
+ * period of the expected time, the default tolerance for trace lists.
+ * Records with a sample rate of 0, usually state of health, are
+ * ignored.
+ *
+ * If \a mingap and \a maxgap are not NULL their values will be
+ * enforced and only gaps/overlaps matching their implied criteria
+ * will be passed to the handler, as with mstl3_printgaplist().
+ *
+ * @param[in] mingap Minimum gap to report in seconds (pointer to value)
+ * @param[in] maxgap Maximum gap to report in seconds (pointer to value)
+ * @param[in] gap_handler Function called for each gap or overlap
+ * @param[in] handlerdata Pointer passed to \a gap_handler
+ *
+ * @returns a pointer to a new ::MS3GapStream on success or NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa ms3_gapstream_add()
+ * \sa ms3_gapstream_readfiles()
+ * \sa ms3_gapstream_free()
+ ***************************************************************************/
+MS3GapStream *
+ms3_gapstream_init (const double *mingap, const double *maxgap,
+                    void (*gap_handler) (const MS3Gap *gap, void *handlerdata),
+                    void *handlerdata)
+{
+  MS3GapStream *gs;
+
+  if (!gap_handler)
+  {
+    ms_log (2, "%s(): Required input not defined: 'gap_handler'\n", __func__);
+    return NULL;
+  }
+
+  if ((gs = (MS3GapStream *)lm_malloc (sizeof (MS3GapStream))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return NULL;
+  }
+
+  memset (gs, 0, sizeof (MS3GapStream));
+
+  if ((gs->traces = (GapTrace *)lm_malloc (GAPSTREAM_INITIALSLOTS * sizeof (GapTrace))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    libmseed_memory.free (gs);
+    return NULL;
+  }
+
+  memset (gs->traces, 0, GAPSTREAM_INITIALSLOTS * sizeof (GapTrace));
+  gs->slots = GAPSTREAM_INITIALSLOTS;
+
+  if (mingap)
+  {
+    gs->usemingap = 1;
+    gs->mingap = *mingap;
+  }
+
+  if (maxgap)
+  {
+    gs->usemaxgap = 1;
+    gs->maxgap = *maxgap;
+  }
+
+  gs->gap_handler = gap_handler;
+  gs->handlerdata = handlerdata;
+
+  return gs;
+} /* End of ms3_gapstream_init() */
+
+/**********************************************************************/ /**
+ * @brief Add a record descriptor to a streaming gap analysis
+ *
+ * Any gap or overlap between the end of the current segment of \a sid
+ * and this record is passed to the handler of \a gs, and the record
+ * becomes the end of the current segment.
+ *
+ * @param[in] gs ::MS3GapStream to add to
+ * @param[in] sid Source identifier of record
+ * @param[in] starttime Time of first sample in record
+ * @param[in] endtime Time of last sample in record
+ * @param[in] samprate Sample rate of record in Hertz
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_gapstream_add (MS3GapStream *gs, const char *sid, nstime_t starttime,
+                   nstime_t endtime, double samprate)
+{
+  GapTrace *trace;
+
+  if (!gs || !sid)
+  {
+    ms_log (2, "%s(): Required input not defined: 'gs' or 'sid'\n", __func__);
+    return -1;
+  }
+
+  /* Skip records with 0 sample rate, usually from SOH records */
+  if (samprate == 0.0)
+    return 0;
+
+  if ((trace = find_trace (gs, sid, 0)) == NULL)
+  {
+    if ((trace = find_trace (gs, sid, 1)) == NULL)
+      return -1;
+
+    trace->firststart = starttime;
+    trace->firstend = endtime;
+    trace->firstrate = samprate;
+    trace->lastend = endtime;
+    trace->lastrate = samprate;
+    trace->maxend = endtime;
+
+    return 0;
+  }
+
+  /* A record after all coverage is checked against its latest end, so that
+   * an earlier record overlapping the current segment does not cause a gap */
+  check_gap (gs, trace->sid, (starttime > trace->maxend) ? trace->maxend : trace->lastend,
+             trace->lastrate, starttime, endtime, samprate);
+
+  /* The record continues or starts the current segment */
+  trace->lastend = endtime;
+  trace->lastrate = samprate;
+
+  if (endtime > trace->maxend)
+    trace->maxend = endtime;
+
+  return 0;
+} /* End of ms3_gapstream_add() */
+
+/**********************************************************************/ /**
+ * @brief Add a miniSEED record to a streaming gap analysis
+ *
+ * Only the fixed header (and for miniSEED 2 the blockettes needed for
+ * timing and sample rate) of the record is read, the record is not
+ * parsed into a ::MS3Record and extra headers are not read.
+ *
+ * @param[in] gs ::MS3GapStream to add to
+ * @param[in] record Buffer containing a miniSEED record
+ * @param[in] recbuflen Length of buffer
+ *
+ * @returns the record length on success, 0 if the buffer does not
+ * contain a complete record, or a (negative) libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_gapstream_addrecord (MS3GapStream *gs, const char *record, uint64_t recbuflen)
+{
+  char sid[LM_SIDLEN];
+  nstime_t starttime;
+  nstime_t endtime;
+  double samprate;
+  uint8_t formatversion = 0;
+  int64_t reclen;
+
+  if (!gs || !record)
+  {
+    ms_log (2, "%s(): Required input not defined: 'gs' or 'record'\n", __func__);
+    return MS_GENERROR;
+  }
+
+  if (recbuflen < MINRECLEN)
+    return 0;
+
+  reclen = ms3_detect (record, recbuflen, &formatversion);
+
+  if (reclen < 0)
+    return MS_NOTSEED;
+
+  if (reclen == 0 || (uint64_t)reclen > recbuflen)
+    return (reclen > MAXRECLEN) ? MS_OUTOFRANGE : 0;
+
+  if (record_descriptor (record, (uint64_t)reclen, formatversion,
+                         sid, &starttime, &endtime, &samprate))
+    return MS_GENERROR;
+
+  if (ms3_gapstream_add (gs, sid, starttime, endtime, samprate))
+    return MS_GENERROR;
+
+  return reclen;
+} /* End of ms3_gapstream_addrecord() */
+
+/**********************************************************************/ /**
+ * @brief Add all records in a file to a streaming gap analysis
+ *
+ * The file is read in large blocks and each record is added with
+ * ms3_gapstream_addrecord().
+ *
+ * Supported flags:
+ *  - ::MSF_SKIPNOTDATA - skip input that cannot be identified as miniSEED
+ *
+ * @param[in] gs ::MS3GapStream to add to
+ * @param[in] path File to read
+ * @param[in] flags Flags to control reading
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of records read on success or a (negative)
+ * libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_gapstream_readfile (MS3GapStream *gs, const char *path, uint32_t flags, int8_t verbose)
+{
+  FILE *fp;
+  char *buffer;
+  uint64_t length = 0;
+  uint64_t offset = 0;
+  uint64_t streampos = 0;
+  size_t readsize;
+  int64_t records = 0;
+  int64_t rv;
+  int8_t eof = 0;
+
+  if (!gs || !path)
+  {
+    ms_log (2, "%s(): Required input not defined: 'gs' or 'path'\n", __func__);
+    return MS_GENERROR;
+  }
+
+  if ((fp = fopen (path, "rb")) == NULL)
+  {
+    ms_log (2, "Cannot open file: %s (%s)\n", path, strerror (errno));
+    return MS_GENERROR;
+  }
+
+  if ((buffer = (char *)lm_malloc (GAPSTREAM_READSIZE)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    fclose (fp);
+    return MS_GENERROR;
+  }
+
+  while (!eof || offset < length)
+  {
+    /* Shift remaining data to the start of the buffer and fill it */
+    if (!eof)
+    {
+      if (offset > 0)
+      {
+        memmove (buffer, buffer + offset, length - offset);
+        length -= offset;
+        offset = 0;
+      }
+
+      readsize = fread (buffer + length, 1, GAPSTREAM_READSIZE - length, fp);
+      length += readsize;
+
+      if (readsize == 0)
+      {
+        if (ferror (fp))
+        {
+          ms_log (2, "Error reading %s: %s\n", path, strerror (errno));
+          records = MS_GENERROR;
+          break;
+        }
+
+        eof = 1;
+      }
+    }
+
+    while (offset < length)
+    {
+      rv = ms3_gapstream_addrecord (gs, buffer + offset, length - offset);
+
+      if (rv > 0)
+      {
+        offset += rv;
+        streampos += rv;
+        records++;
+        continue;
+      }
+
+      /* Incomplete record, read more unless at end of file */
+      if (rv == 0 && !eof && length == GAPSTREAM_READSIZE && offset == 0)
+        rv = MS_OUTOFRANGE;
+      else if (rv == 0 && !eof)
+        break;
+
+      if (flags & MSF_SKIPNOTDATA)
+      {
+        if (verbose > 1)
+          ms_log (0, "Skipped %d bytes of non-data at byte offset %" PRIu64 "\n",
+                  MINRECLEN, streampos);
+
+        if (length - offset < MINRECLEN)
+        {
+          offset = length;
+          break;
+        }
+
+        offset += MINRECLEN;
+        streampos += MINRECLEN;
+        continue;
+      }
+
+      if (rv == 0 || rv == MS_NOTSEED)
+      {
+        ms_log (2, "No miniSEED data detected in %s (starting at byte offset %" PRIu64 ")\n",
+                path, streampos);
+        rv = MS_NOTSEED;
+      }
+
+      records = rv;
+      break;
+    }
+
+    if (records < 0)
+      break;
+  }
+
+  if (verbose && records >= 0)
+    ms_log (0, "Read %" PRId64 " records from %s\n", records, path);
+
+  libmseed_memory.free (buffer);
+  fclose (fp);
+
+  return records;
+} /* End of ms3_gapstream_readfile() */
+
+/**********************************************************************/ /**
+ * @brief Merge a streaming gap analysis of later data
+ *
+ * The coverage of each source ID in \a later is appended to the
+ * coverage in \a gs, passing any gap or overlap between them to the
+ * handler of \a gs.  This is used to combine analyses of files read
+ * in parallel, \a later must contain data that follows the data in
+ * \a gs, e.g. the next file of an archive in time order.
+ *
+ * @param[in] gs ::MS3GapStream to merge into
+ * @param[in] later ::MS3GapStream of later data, unchanged
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_gapstream_merge (MS3GapStream *gs, const MS3GapStream *later)
+{
+  const GapTrace *source;
+  GapTrace *trace;
+  uint32_t slot;
+
+  if (!gs || !later)
+  {
+    ms_log (2, "%s(): Required input not defined: 'gs' or 'later'\n", __func__);
+    return -1;
+  }
+
+  for (slot = 0; slot < later->slots; slot++)
+  {
+    source = &later->traces[slot];
+
+    if (source->sid[0] == '\0')
+      continue;
+
+    if ((trace = find_trace (gs, source->sid, 0)) == NULL)
+    {
+      if ((trace = find_trace (gs, source->sid, 1)) == NULL)
+        return -1;
+
+      memcpy (trace, source, sizeof (GapTrace));
+      continue;
+    }
+
+    check_gap (gs, trace->sid,
+               (source->firststart > trace->maxend) ? trace->maxend : trace->lastend,
+               trace->lastrate, source->firststart, source->firstend, source->firstrate);
+
+    trace->lastend = source->lastend;
+    trace->lastrate = source->lastrate;
+
+    if (source->maxend > trace->maxend)
+      trace->maxend = source->maxend;
+  }
+
+  return 0;
+} /* End of ms3_gapstream_merge() */
+
+#if defined(LM_GAPSTREAM_THREADS)
+/***************************************************************************
+ * Worker thread to read files into separate gap streams until all
+ * files are claimed.
+ ***************************************************************************/
+static void *
+gap_worker (void *arg)
+{
+  GapWork *work = (GapWork *)arg;
+  GapFile *file;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&work->lock);
+    file = (work->nextfile < work->filecount) ? &work->files[work->nextfile++] : NULL;
+    pthread_mutex_unlock (&work->lock);
+
+    if (!file)
+      break;
+
+    file->records = ms3_gapstream_readfile (file->stream, file->path, work->flags, work->verbose);
+
+    pthread_mutex_lock (&work->lock);
+    file->done = 1;
+    pthread_cond_broadcast (&work->done);
+    pthread_mutex_unlock (&work->lock);
+  }
+
+  return NULL;
+}
+#endif
+
+/**********************************************************************/ /**
+ * @brief Add all records in a list of files to a streaming gap analysis
+ *
+ * Files are read in parallel by \a threads threads, or a thread for
+ * each online processor if \a threads is 0, each into a separate
+ * ::MS3GapStream that collects the gaps of the file.  The results of
+ * each file are then merged into \a gs in the order of \a paths, as
+ * soon as the file and all files before it are read, such that gaps
+ * are passed to the handler of \a gs incrementally and in the same
+ * order as if the files were read sequentially.  All handler calls
+ * are made from the calling thread.
+ *
+ * Files should be given in time order for each source ID, e.g. the
+ * day files of an archive in day order.  On platforms without thread
+ * support the files are read sequentially.
+ *
+ * @param[in] gs ::MS3GapStream to add to
+ * @param[in] paths Files to read
+ * @param[in] pathcount Number of files in \a paths
+ * @param[in] threads Number of threads to use, 0 to use all processors
+ * @param[in] flags Flags to control reading, see ms3_gapstream_readfile()
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of records read on success or a (negative)
+ * libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_gapstream_readfiles (MS3GapStream *gs, const char **paths, int pathcount,
+                         int threads, uint32_t flags, int8_t verbose)
+{
+  GapWork work;
+  GapFile *file;
+  uint64_t idx;
+  int64_t records = 0;
+  int fidx;
+#if defined(LM_GAPSTREAM_THREADS)
+  pthread_t *tids = NULL;
+  int started = 0;
+  int tidx;
+#endif
+
+  if (!gs || (!paths && pathcount > 0))
+  {
+    ms_log (2, "%s(): Required input not defined: 'gs' or 'paths'\n", __func__);
+    return MS_GENERROR;
+  }
+
+#if defined(LM_GAPSTREAM_THREADS)
+  if (threads <= 0)
+    threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#else
+  threads = 1;
+#endif
+
+  if (threads > pathcount)
+    threads = pathcount;
+
+  /* Single thread: read files sequentially into the stream */
+  if (threads <= 1)
+  {
+    for (fidx = 0; fidx < pathcount; fidx++)
+    {
+      int64_t rv = ms3_gapstream_readfile (gs, paths[fidx], flags, verbose);
+
+      if (rv < 0)
+        return rv;
+
+      records += rv;
+    }
+
+    return records;
+  }
+
+  memset (&work, 0, sizeof (GapWork));
+  work.filecount = pathcount;
+  work.flags = flags;
+  work.verbose = verbose;
+
+  if ((work.files = (GapFile *)lm_malloc (pathcount * sizeof (GapFile))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return MS_GENERROR;
+  }
+
+  memset (work.files, 0, pathcount * sizeof (GapFile));
+
+  for (fidx = 0; fidx < pathcount; fidx++)
+  {
+    file = &work.files[fidx];
+    file->path = paths[fidx];
+
+    if ((file->stream = ms3_gapstream_init (NULL, NULL, collect_gap, file)) == NULL)
+    {
+      records = MS_GENERROR;
+      break;
+    }
+
+    /* Criteria are applied when collecting, gaps are passed on as is */
+    file->stream->usemingap = gs->usemingap;
+    file->stream->mingap = gs->mingap;
+    file->stream->usemaxgap = gs->usemaxgap;
+    file->stream->maxgap = gs->maxgap;
+  }
+
+#if defined(LM_GAPSTREAM_THREADS)
+  if (records == 0)
+  {
+    pthread_mutex_init (&work.lock, NULL);
+    pthread_cond_init (&work.done, NULL);
+
+    if ((tids = (pthread_t *)lm_malloc (threads * sizeof (pthread_t))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      records = MS_GENERROR;
+    }
+
+    for (tidx = 0; tids && tidx < threads; tidx++)
+    {
+      if (pthread_create (&tids[tidx], NULL, gap_worker, &work))
+      {
+        ms_log (2, "Cannot create thread: %s\n", strerror (errno));
+        records = MS_GENERROR;
+        break;
+      }
+
+      started++;
+    }
+
+    /* Merge files in order as they are completed */
+    for (fidx = 0; started > 0 && fidx < pathcount; fidx++)
+    {
+      file = &work.files[fidx];
+
+      pthread_mutex_lock (&work.lock);
+      while (!file->done)
+        pthread_cond_wait (&work.done, &work.lock);
+      pthread_mutex_unlock (&work.lock);
+
+      if (records < 0)
+        continue;
+
+      if (file->records < 0 || ms3_gapstream_merge (gs, file->stream))
+      {
+        records = (file->records < 0) ? file->records : MS_GENERROR;
+
+        /* Stop workers from claiming further files, unclaimed files are done */
+        pthread_mutex_lock (&work.lock);
+        for (; work.nextfile < work.filecount; work.nextfile++)
+          work.files[work.nextfile].done = 1;
+        pthread_mutex_unlock (&work.lock);
+        continue;
+      }
+
+      /* Gaps between files were passed when merging, then gaps within the file */
+
+      for (idx = 0; idx < file->gapcount; idx++)
+        gs->gap_handler (&file->gaps[idx], gs->handlerdata);
+
+      records += file->records;
+
+      ms3_gapstream_free (&file->stream);
+      if (file->gaps)
+        libmseed_memory.free (file->gaps);
+      file->gaps = NULL;
+    }
+
+    for (tidx = 0; tidx < started; tidx++)
+      pthread_join (tids[tidx], NULL);
+
+    if (tids)
+      libmseed_memory.free (tids);
+
+    pthread_cond_destroy (&work.done);
+    pthread_mutex_destroy (&work.lock);
+  }
+#endif
+
+  for (fidx = 0; fidx < pathcount; fidx++)
+  {
+    file = &work.files[fidx];
+
+    if (file->stream)
+      ms3_gapstream_free (&file->stream);
+    if (file->gaps)
+      libmseed_memory.free (file->gaps);
+  }
+
+  libmseed_memory.free (work.files);
+
+  return records;
+} /* End of ms3_gapstream_readfiles() */
+
+/**********************************************************************/ /**
+ * @brief Free all memory associated with a ::MS3GapStream
+ *
+ * The pointer to the target ::MS3GapStream will be set to NULL.
+ *
+ * @param[in] ppgs Pointer-to-pointer to the target ::MS3GapStream to free
+ ***************************************************************************/
+void
+ms3_gapstream_free (MS3GapStream **ppgs)
+{
+  if (!ppgs || !*ppgs)
+    return;
+
+  if ((*ppgs)->traces)
+    libmseed_memory.free ((*ppgs)->traces);
+
+  libmseed_memory.free (*ppgs);
+
+  *ppgs = NULL;
+} /* End of ms3_gapstream_free() */
+
+/***************************************************************************
+ * Find the coverage state of a source ID in the table of a gap
+ * stream, or if 'insert' is true add an empty entry for it, growing
+ * the table as needed.
+ *
+ * Returns a pointer to the entry, or NULL if not found or on error.
+ ***************************************************************************/
+static GapTrace *
+find_trace (MS3GapStream *gs, const char *sid, int8_t insert)
+{
+  GapTrace *traces;
+  GapTrace *trace;
+  uint32_t slots;
+  uint32_t slot;
+  uint32_t hash = 2166136261u;
+  const char *cp;
+
+  /* Grow the table when more than 3/4 full */
+  if (insert && (gs->count + 1) * 4 > gs->slots * 3)
+  {
+    slots = gs->slots * 2;
+
+    if ((traces = (GapTrace *)lm_malloc (slots * sizeof (GapTrace))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    memset (traces, 0, slots * sizeof (GapTrace));
+
+    /* Rehash existing entries into the new table */
+    trace = gs->traces;
+    gs->traces = traces;
+    traces = trace;
+    gs->count = 0;
+    slot = gs->slots;
+    gs->slots = slots;
+
+    while (slot-- > 0)
+    {
+      if (traces[slot].sid[0] != '\0')
+      {
+        trace = find_trace (gs, traces[slot].sid, 1);
+        memcpy (trace, &traces[slot], sizeof (GapTrace));
+      }
+    }
+
+    libmseed_memory.free (traces);
+  }
+
+  /* FNV-1a hash of source ID */
+  for (cp = sid; *cp; cp++)
+  {
+    hash ^= (uint8_t)*cp;
+    hash *= 16777619u;
+  }
+
+  for (slot = hash & (gs->slots - 1);; slot = (slot + 1) & (gs->slots - 1))
+  {
+    trace = &gs->traces[slot];
+
+    if (trace->sid[0] == '\0')
+      break;
+
+    if (!strcmp (trace->sid, sid))
+      return trace;
+  }
+
+  if (!insert)
+    return NULL;
+
+  strncpy (trace->sid, sid, sizeof (trace->sid) - 1);
+  gs->count++;
+
+  return trace;
+} /* End of find_trace() */
+
+/***************************************************************************
+ * Check for a gap or overlap between the end of coverage and the next
+ * record of a source ID, passing it to the handler if it matches the
+ * criteria of the stream.  Gaps are calculated as by
+ * mstl3_printgaplist().
+ ***************************************************************************/
+static void
+check_gap (MS3GapStream *gs, const char *sid, nstime_t lastend, double lastrate,
+           nstime_t nextstart, nstime_t nextend, double nextrate)
+{
+  MS3Gap gap;
+  nstime_t nsdelta;
+  double delta;
+  double nsamples;
+
+  /* Contiguous if within half a sample period of the expected time */
+  nsdelta = (nextrate > 0.0) ? (nstime_t)(NSTMODULUS / nextrate) : 0;
+
+  if (ms_dabs ((double)(nextstart - lastend - nsdelta)) <= 0.5 * nsdelta)
+    return;
+
+  gap.gap = (double)(nextstart - lastend) / NSTMODULUS;
+
+  /* Check that any overlap is not larger than the trace coverage */
+  if (gap.gap < 0.0)
+  {
+    delta = (nextrate) ? (1.0 / nextrate) : 0.0;
+
+    if ((gap.gap * -1.0) > (((double)(nextend - nextstart) / NSTMODULUS) + delta))
+      gap.gap = -(((double)(nextend - nextstart) / NSTMODULUS) + delta);
+  }
+
+  /* Check gap/overlap criteria */
+  if (gs->usemingap && gap.gap < gs->mingap)
+    return;
+
+  if (gs->usemaxgap && gap.gap > gs->maxgap)
+    return;
+
+  nsamples = ms_dabs (gap.gap) * lastrate;
+
+  if (gap.gap > 0.0)
+    nsamples -= 1.0;
+  else
+    nsamples += 1.0;
+
+  memcpy (gap.sid, sid, sizeof (gap.sid));
+  gap.lasttime = lastend;
+  gap.nexttime = nextstart;
+  gap.samprate = lastrate;
+  gap.nsamples = nsamples;
+
+  gs->gap_handler (&gap, gs->handlerdata);
+} /* End of check_gap() */
+
+/***************************************************************************
+ * Read the source ID, start and end time and sample rate of a record
+ * from its header, without parsing the record.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+record_descriptor (const char *record, uint64_t reclen, uint8_t formatversion,
+                   char *sid, nstime_t *starttime, nstime_t *endtime, double *samprate)
+{
+  uint16_t offset;
+  uint16_t next;
+  uint16_t type;
+  uint16_t b1001 = 0;
+  int64_t samplecnt;
+  int count = 0;
+  int swapflag;
+
+  if (formatversion == 3)
+  {
+    swapflag = ms_bigendianhost ();
+
+    if (*pMS3FSDH_SIDLENGTH (record) >= LM_SIDLEN ||
+        (uint64_t)MS3FSDH_LENGTH + *pMS3FSDH_SIDLENGTH (record) > reclen)
+    {
+      ms_log (2, "Invalid source ID length: %d\n", *pMS3FSDH_SIDLENGTH (record));
+      return -1;
+    }
+
+    memcpy (sid, pMS3FSDH_SID (record), *pMS3FSDH_SIDLENGTH (record));
+    sid[*pMS3FSDH_SIDLENGTH (record)] = '\0';
+
+    *starttime = ms_time2nstime (HO2u (*pMS3FSDH_YEAR (record), swapflag),
+                                 HO2u (*pMS3FSDH_DAY (record), swapflag),
+                                 *pMS3FSDH_HOUR (record),
+                                 *pMS3FSDH_MIN (record),
+                                 *pMS3FSDH_SEC (record),
+                                 HO4u (*pMS3FSDH_NSEC (record), swapflag));
+    *samprate = HO8f (*pMS3FSDH_SAMPLERATE (record), swapflag);
+    samplecnt = HO4u (*pMS3FSDH_NUMSAMPLES (record), swapflag);
+  }
+  else if (formatversion == 2)
+  {
+    swapflag = !MS_ISVALIDYEARDAY (*pMS2FSDH_YEAR (record), *pMS2FSDH_DAY (record));
+
+    if (ms2_recordsid (record, sid, LM_SIDLEN) == NULL)
+    {
+      ms_log (2, "Cannot determine source ID of record\n");
+      return -1;
+    }
+
+    *samprate = ms_nomsamprate (HO2d (*pMS2FSDH_SAMPLERATEFACT (record), swapflag),
+                                HO2d (*pMS2FSDH_SAMPLERATEMULT (record), swapflag));
+    samplecnt = HO2u (*pMS2FSDH_NUMSAMPLES (record), swapflag);
+
+    /* Sample rate from Blockette 100 and microseconds from Blockette 1001 */
+    offset = HO2u (*pMS2FSDH_BLOCKETTEOFFSET (record), swapflag);
+
+    while (offset >= MS2FSDH_LENGTH && offset + 8u <= reclen && count++ < 255)
+    {
+      type = HO2u (*pMS2B100_TYPE (record + offset), swapflag);
+      next = HO2u (*pMS2B100_NEXT (record + offset), swapflag);
+
+      if (type == 100 && offset + 12u <= reclen)
+        *samprate = HO4f (*pMS2B100_SAMPRATE (record + offset), swapflag);
+      else if (type == 1001)
+        b1001 = offset;
+
+      if (next <= offset)
+        break;
+
+      offset = next;
+    }
+
+    if (HO2u (*pMS2FSDH_YEAR (record), swapflag) == 0)
+    {
+      *starttime = NSTUNSET;
+    }
+    else
+    {
+      *starttime = ms_time2nstime (HO2u (*pMS2FSDH_YEAR (record), swapflag),
+                                   HO2u (*pMS2FSDH_DAY (record), swapflag),
+                                   *pMS2FSDH_HOUR (record),
+                                   *pMS2FSDH_MIN (record),
+                                   *pMS2FSDH_SEC (record),
+                                   (uint32_t)HO2u (*pMS2FSDH_FSEC (record), swapflag) * (NSTMODULUS / 10000));
+
+      /* Apply time correction if not already applied, bit 1 of activity flags */
+      if (HO4d (*pMS2FSDH_TIMECORRECT (record), swapflag) != 0 &&
+          !(*pMS2FSDH_ACTFLAGS (record) & 0x02))
+        *starttime += (nstime_t)HO4d (*pMS2FSDH_TIMECORRECT (record), swapflag) * (NSTMODULUS / 10000);
+
+      if (b1001)
+        *starttime += (nstime_t)*pMS2B1001_MICROSECOND (record + b1001) * (NSTMODULUS / 1000000);
+    }
+  }
+  else
+  {
+    ms_log (2, "Unrecognized format version: %d\n", formatversion);
+    return -1;
+  }
+
+  if (*starttime == NSTERROR)
+  {
+    ms_log (2, "%s: Cannot convert start time to internal time stamp\n", sid);
+    return -1;
+  }
+
+  *endtime = ms_sampletime (*starttime, (samplecnt > 0) ? samplecnt - 1 : 0, *samprate);
+
+  /* Convert sample period to rate */
+  if (*samprate < 0.0)
+    *samprate = -1.0 / *samprate;
+
+  return 0;
+} /* End of record_descriptor() */
+
+/***************************************************************************
+ * Gap handler to collect the gaps of a file read by a worker thread.
+ ***************************************************************************/
+static void
+collect_gap (const MS3Gap *gap, void *handlerdata)
+{
+  GapFile *file = (GapFile *)handlerdata;
+  MS3Gap *gaps;
+
+  if (file->gapcount >= file->gapcapacity)
+  {
+    uint64_t capacity = (file->gapcapacity) ? file->gapcapacity * 2 : 64;
+
+    if ((gaps = (MS3Gap *)lm_realloc (file->gaps, capacity * sizeof (MS3Gap))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory, gap for %s dropped\n", gap->sid);
+      return;
+    }
+
+    file->gaps = gaps;
+    file->gapcapacity = capacity;
+  }
+
+  memcpy (&file->gaps[file->gapcount++], gap, sizeof (MS3Gap));
+} /* End of collect_gap() */
@@ -27,6 +27,9 @@
 #include "gmtime64.h"
 #include "libmseed.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_UTILITY
+#include "memprofile.h"
+
 static nstime_t ms_time2nstime_int (int year, int day, int hour,
                                     int min, int sec, uint32_t nsec);
 
@@ -214,7 +217,7 @@ ms_sid2nslc (const char *sid, char *net, char *sta, char *loc, char *chan)
     }
 
     idlen = strlen (sid) + 1;
-    if (!(id = libmseed_memory.malloc (idlen)))
+    if (!(id = lm_malloc (idlen)))
     {
       ms_log (2, "Error duplicating identifier\n");
       return -1;
@@ -1830,7 +1833,7 @@ ms_readleapsecondfile (const char *filename)
 
     if (fields == 2)
     {
-      if ((ls = (LeapSecond *)libmseed_memory.malloc (sizeof (LeapSecond))) == NULL)
+      if ((ls = (LeapSecond *)lm_malloc (sizeof (LeapSecond))) == NULL)
       {
         ms_log (2, "Cannot allocate LeapSecond entry, out of memory?\n");
         return -1;
@@ -28,12 +28,14 @@
 extern "C" {
 #endif
 
-#define LIBMSEED_VERSION "3.1.1"     //!< Library version
-#define LIBMSEED_RELEASE "2024.024"  //!< Library release date
+#define LIBMSEED_VERSION "4.0.0"     //!< Library version
+#define LIBMSEED_RELEASE "2026.291"  //!< Library release date
 
 /** @defgroup io-functions File and URL I/O */
 /** @defgroup miniseed-record Record Handling */
 /** @defgroup trace-list Trace List */
+/** @defgroup gap-stream Streaming Gap Analysis */
+/** @defgroup rt-buffer Real-time Buffer */
 /** @defgroup data-selections Data Selections */
 /** @defgroup string-functions Source Identifiers */
 /** @defgroup extra-headers Extra Headers */
@@ -51,6 +53,8 @@ extern "C" {
     @ingroup low-level */
 /** @defgroup byte-swap-flags Byte swap flags
     @ingroup low-level */
+/** @defgroup verify-flags Record verification problems
+    @ingroup low-level */
 /** @defgroup return-values Return codes
     @ingroup low-level */
 /** @defgroup control-flags Control flags
@@ -414,6 +418,7 @@ extern double     msr3_host_latency (const MS3Record *msr);
 extern int64_t ms3_detect (const char *record, uint64_t recbuflen, uint8_t *formatversion);
 extern int ms_parse_raw3 (const char *record, int maxreclen, int8_t details);
 extern int ms_parse_raw2 (const char *record, int maxreclen, int8_t details, int8_t swapflag);
+extern int ms3_verify_record (const char *record, uint64_t recbuflen, MS3Record **ppmsr, int8_t verbose);
 /** @} */
 
 /** @addtogroup data-selections
@@ -506,6 +511,7 @@ typedef struct MS3RecordList
   uint64_t recordcnt;  //!< Count of records in the list (for convenience)
   MS3RecordPtr *first; //!< Pointer to first entry, NULL if the none
   MS3RecordPtr *last;  //!< Pointer to last entry, NULL if the none
+  void *compact;       //!< INTERNAL: Compact entries, see ::MSF_COMPACTRECLIST and mstl3_recordlist_entry()
 } MS3RecordList;
 
 /** @} */
@@ -535,6 +541,19 @@ typedef struct MS3RecordList
           - ...
         - ...
 
+    For lists with many trace IDs or segments, mstl3_set_compact()
+    selects a compact node allocation: each ::MS3TraceID is only
+    allocated to the height of its skip list entry and the
+    ::MS3TraceSeg entries of each ID are allocated from shared arrays.
+
+    Sample statistics of each segment can be accumulated as data are
+    added by selecting them with mstl3_set_stats().
+
+    Trace lists with record lists can be saved with
+    mstl3_write_snapshot() and loaded with mstl3_read_snapshot(), which
+    is much faster than reading the data again.  Data appended to files
+    since a snapshot was written is read when the snapshot is loaded.
+
     \sa ms3_readtracelist()
     \sa ms3_readtracelist_timewin()
     \sa ms3_readtracelist_selection()
@@ -544,6 +563,24 @@ typedef struct MS3RecordList
 /** @brief Maximum skip list height for MSTraceIDs */
 #define MSTRACEID_SKIPLIST_HEIGHT 8
 
+/** @brief Sample statistics of a trace segment, see mstl3_set_stats()
+ *
+ * The mean is \c sum / \c count and the RMS is \c sqrt(sumsq / count).
+ */
+typedef struct MS3SampleStats {
+  int64_t         count;             //!< Number of samples included
+  double          min;               //!< Minimum sample value
+  double          max;               //!< Maximum sample value
+  double          sum;               //!< Sum of sample values
+  double          sumsq;             //!< Sum of squared sample values
+  int64_t         clipped;           //!< Number of samples at or beyond the clip limits
+  int64_t         constant;          //!< Number of samples equal to the previous sample
+  double          first;             //!< First sample value
+  double          last;              //!< Last sample value
+  double          clipmin;           //!< Lower clip limit, from mstl3_set_stats()
+  double          clipmax;           //!< Upper clip limit, from mstl3_set_stats()
+} MS3SampleStats;
+
 /** @brief Container for a continuous trace segment, linkable */
 typedef struct MS3TraceSeg {
   nstime_t        starttime;         //!< Time of first sample
@@ -558,6 +595,8 @@ typedef struct MS3TraceSeg {
   struct MS3RecordList *recordlist;  //!< List of pointers to records that contributed
   struct MS3TraceSeg *prev;          //!< Pointer to previous segment
   struct MS3TraceSeg *next;          //!< Pointer to next segment, NULL if the last
+  MS3SampleStats *stats;             //!< Sample statistics, NULL unless selected with mstl3_set_stats()
+  void           *spill;             //!< INTERNAL: Memory budget state, see mstl3_set_budget()
 } MS3TraceSeg;
 
 /** @brief Container for a trace ID, linkable */
@@ -570,8 +609,9 @@ typedef struct MS3TraceID {
   uint32_t        numsegments;       //!< Number of segments for this ID
   struct MS3TraceSeg *first;         //!< Pointer to first of list of segments
   struct MS3TraceSeg *last;          //!< Pointer to last of list of segments
-  struct MS3TraceID *next[MSTRACEID_SKIPLIST_HEIGHT];   //!< Next trace ID at first pointer, NULL if the last
+  void           *segpool;           //!< INTERNAL: Segment pool of compact nodes, see mstl3_set_compact()
   uint8_t         height;            //!< Height of skip list at \a next
+  struct MS3TraceID *next[MSTRACEID_SKIPLIST_HEIGHT];   //!< Next trace ID at first pointer, NULL if the last, only \a height entries with compact nodes
 } MS3TraceID;
 
 /** @brief Container for a collection of continuous trace segment, linkable */
@@ -579,6 +619,10 @@ typedef struct MS3TraceList {
   uint32_t           numtraceids;    //!< Number of traces IDs in list
   struct MS3TraceID  traces;         //!< Head node of trace skip list, first entry at \a traces.next[0]
   uint64_t           prngstate;      //!< INTERNAL: State for Pseudo RNG
+  void              *budget;         //!< INTERNAL: Memory budget state, see mstl3_set_budget()
+  void              *recordsources;  //!< INTERNAL: Record sources of compact record lists
+  void              *stats;          //!< INTERNAL: Statistics clip limits, see mstl3_set_stats()
+  int8_t             compact;        //!< INTERNAL: Compact node allocation, see mstl3_set_compact()
 } MS3TraceList;
 
 /** @brief Callback functions that return time and sample rate tolerances
@@ -619,6 +663,49 @@ typedef struct MS3Tolerance
     .time = NULL, .samprate = NULL \
   }
 
+/** @brief Alignment of columns written by mstl3_export_columns() */
+#define MS_COLUMN_ALIGN 64
+
+/** @brief Column index entry written by mstl3_export_columns()
+ *
+ * Entries are 128 bytes with all numeric values in little-endian
+ * byte order.  The \a dtype is a NumPy array-protocol type string:
+ * \c "<i4", \c "<f4", \c "<f8" or \c "|S1" for text.
+ */
+typedef struct MS3ColumnEntry {
+  char            sid[LM_SIDLEN];    //!< Source identifier as URN, max length @ref LM_SIDLEN
+  nstime_t        starttime;         //!< Time of first sample
+  double          samprate;          //!< Nominal sample rate (Hz)
+  int64_t         numsamples;        //!< Number of data samples in column
+  uint64_t        offset;            //!< Byte offset of column in data file
+  char            dtype[8];          //!< Sample type as NumPy type string
+  uint8_t         pubversion;        //!< Publication version of trace ID
+  uint8_t         reserved[23];      //!< Reserved, zero
+} MS3ColumnEntry;
+
+/** @brief Default number of samples per level 0 bucket for mstl3_export_envelopes() */
+#define MS_ENVELOPE_BUCKET 16
+
+/** @brief Envelope index entry written by mstl3_export_envelopes()
+ *
+ * Entries are 128 bytes with all numeric values in little-endian
+ * byte order, one entry for each level of each segment.  The \a dtype
+ * is the NumPy array-protocol type string of the minimum and maximum
+ * values: \c "<i4", \c "<f4" or \c "<f8".
+ */
+typedef struct MS3EnvelopeEntry {
+  char            sid[LM_SIDLEN];    //!< Source identifier as URN, max length @ref LM_SIDLEN
+  nstime_t        starttime;         //!< Time of first sample of segment
+  double          samprate;          //!< Nominal sample rate (Hz)
+  int64_t         numsamples;        //!< Number of data samples in segment
+  uint64_t        bucketsamples;     //!< Number of samples per bucket, the last may be partial
+  uint64_t        buckets;           //!< Number of min/max pairs at level
+  uint64_t        offset;            //!< Byte offset of min/max pairs in file
+  char            dtype[8];          //!< Value type as NumPy type string
+  uint8_t         level;             //!< Level, bucket size doubles with each level
+  uint8_t         reserved[7];       //!< Reserved, zero
+} MS3EnvelopeEntry;
+
 extern MS3TraceList* mstl3_init (MS3TraceList *mstl);
 extern void          mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr);
 extern MS3TraceID*   mstl3_findID (MS3TraceList *mstl, const char *sid, uint8_t pubversion, MS3TraceID **prev);
@@ -640,8 +727,24 @@ extern int64_t       mstl3_readbuffer_selection (MS3TraceList **ppmstl, const ch
                                                  int8_t verbose);
 extern int64_t mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
                                         uint64_t outputsize, int8_t verbose);
+extern int64_t mstl3_unpack_timewindow (MS3TraceID *id, MS3TraceSeg *seg, nstime_t starttime,
+                                        nstime_t endtime, void *output, uint64_t outputsize,
+                                        nstime_t *firsttime, int8_t verbose);
+extern int mstl3_recordlist_entry (const MS3RecordList *recordlist, uint64_t index,
+                                   MS3RecordPtr *recordptr, MS3Record **ppmsr,
+                                   uint32_t flags, int8_t verbose);
 extern int mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate);
 extern int mstl3_resize_buffers (MS3TraceList *mstl);
+extern int mstl3_set_compact (MS3TraceList *mstl);
+extern int mstl3_set_budget (MS3TraceList *mstl, uint64_t budget, const char *spilldir);
+extern int mstl3_set_stats (MS3TraceList *mstl, double clipmin, double clipmax);
+extern void *mstl3_segment_samples (MS3TraceSeg *seg, int8_t writable);
+extern int64_t mstl3_export_columns (MS3TraceList *mstl, const char *datafile, const char *indexfile,
+                                     int threads, int8_t verbose);
+extern int64_t mstl3_export_envelopes (MS3TraceList *mstl, const char *prefix, uint32_t bucketsamples,
+                                       int8_t verbose);
+extern int64_t mstl3_write_snapshot (MS3TraceList *mstl, const char *path, int8_t verbose);
+extern int64_t mstl3_read_snapshot (MS3TraceList **ppmstl, const char *path, uint32_t flags, int8_t verbose);
 extern int64_t mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
                            void *handlerdata, int reclen, int8_t encoding,
                            int64_t *packedsamples, uint32_t flags, int8_t verbose, char *extra);
@@ -652,6 +755,76 @@ extern void mstl3_printgaplist (const MS3TraceList *mstl, ms_timeformat_t timefo
                                 double *mingap, double *maxgap);
 /** @} */
 
+/** @addtogroup gap-stream
+    @brief Streaming gap and overlap analysis
+
+    A gap stream reports gaps and overlaps between records without
+    building a ::MS3TraceList.  Only a descriptor of each record, the
+    source ID, start and end time and sample rate, is consumed and only
+    the end of the current segment of each source ID is retained, such
+    that memory use depends on the number of source IDs and not the
+    volume of data.  Gaps are passed to a handler as they are found.
+
+    Records must be added in time order for each source ID.  Files may
+    be read in parallel with ms3_gapstream_readfiles(), the results of
+    each file are merged in the order of the files given.
+
+    \sa mstl3_printgaplist()
+    @{ */
+
+/** @brief A gap or overlap found by a ::MS3GapStream */
+typedef struct MS3Gap
+{
+  char sid[LM_SIDLEN];  //!< Source identifier
+  nstime_t lasttime;    //!< End of coverage before the gap
+  nstime_t nexttime;    //!< Start of coverage after the gap
+  double gap;           //!< Gap in seconds, negative for an overlap
+  double samprate;      //!< Sample rate of coverage before the gap
+  double nsamples;      //!< Number of samples missing or overlapping
+} MS3Gap;
+
+/** @brief Opaque state of a streaming gap analysis, see ms3_gapstream_init() */
+typedef struct MS3GapStream MS3GapStream;
+
+extern MS3GapStream *ms3_gapstream_init (const double *mingap, const double *maxgap,
+                                         void (*gap_handler) (const MS3Gap *gap, void *handlerdata),
+                                         void *handlerdata);
+extern int ms3_gapstream_add (MS3GapStream *gs, const char *sid, nstime_t starttime,
+                              nstime_t endtime, double samprate);
+extern int64_t ms3_gapstream_addrecord (MS3GapStream *gs, const char *record, uint64_t recbuflen);
+extern int64_t ms3_gapstream_readfile (MS3GapStream *gs, const char *path, uint32_t flags, int8_t verbose);
+extern int64_t ms3_gapstream_readfiles (MS3GapStream *gs, const char **paths, int pathcount,
+                                        int threads, uint32_t flags, int8_t verbose);
+extern int ms3_gapstream_merge (MS3GapStream *gs, const MS3GapStream *later);
+extern void ms3_gapstream_free (MS3GapStream **ppgs);
+/** @} */
+
+/** @addtogroup rt-buffer
+    @brief Retention-bounded buffer of recent time series data
+
+    A real-time buffer keeps the most recent data of each source ID,
+    up to a retention span, for servers that continuously receive
+    records.  Samples are stored in chains of fixed size blocks as
+    runs of contiguous samples at the size of their type, new records
+    are appended to the newest block, starting a new run after a gap,
+    and expired blocks are unlinked from the start of a chain, such
+    that neither appending nor eviction moves stored samples.
+
+    Readers take consistent copies of the retained data as a
+    ::MS3TraceList with ms3_rtbuffer_snapshot() while a writer adds
+    records.
+    @{ */
+
+/** @brief Opaque state of a real-time buffer, see ms3_rtbuffer_init() */
+typedef struct MS3RTBuffer MS3RTBuffer;
+
+extern MS3RTBuffer *ms3_rtbuffer_init (double retention, uint32_t blocksamples);
+extern int64_t ms3_rtbuffer_addmsr (MS3RTBuffer *rtb, const MS3Record *msr, int8_t verbose);
+extern int64_t ms3_rtbuffer_addrecord (MS3RTBuffer *rtb, const char *record, uint64_t recbuflen, int8_t verbose);
+extern int64_t ms3_rtbuffer_snapshot (MS3RTBuffer *rtb, MS3TraceList **ppmstl, const char *sid, int8_t verbose);
+extern void ms3_rtbuffer_free (MS3RTBuffer **pprtb);
+/** @} */
+
 /** @addtogroup io-functions
     @brief Reading and writing interfaces for miniSEED to/from files or URLs
 
@@ -677,6 +850,11 @@ extern void mstl3_printgaplist (const MS3TraceList *mstl, ms_timeformat_t timefo
     Diagnostics: Setting environment variable **LIBMSEED_URL_DEBUG** enables
     detailed verbosity of URL protocol exchanges.
 
+    Decoded data samples of records read from files can be kept in a
+    bounded cache, enabled with @ref ms3_blockcache_set(), so that
+    repeated reads of the same records, e.g. overlapping time windows,
+    are decoded once.
+
     \sa ms3_readmsr()
     \sa ms3_readmsr_selection()
     \sa ms3_readtracelist()
@@ -698,13 +876,16 @@ typedef struct LMIO
   void *handle;      //!< Primary IO handle, either file or URL
   void *handle2;     //!< Secondary IO handle for URL
   int still_running; //!< Fetch status flag for URL transmissions
+  int8_t nocache;    //!< Release file data from the page cache once read, see ::MSF_NOCACHE
+  int64_t released;  //!< Offset up to which file data has been released
 } LMIO;
 
 /** @def LMIO_INITIALIZER
     @brief Initialializer for the internal stream handle ::LMIO */
 #define LMIO_INITIALIZER                                                   \
   {                                                                        \
-    .type = LMIO_NULL, .handle = NULL, .handle2 = NULL, .still_running = 0 \
+    .type = LMIO_NULL, .handle = NULL, .handle2 = NULL, .still_running = 0, \
+    .nocache = 0, .released = 0                                            \
   }
 
 /** @brief State container for reading miniSEED records from files or URLs.
@@ -727,6 +908,7 @@ typedef struct MS3FileParam
   int readoffset;      //!< INTERNAL: Read offset in read buffer
   uint32_t flags;      //!< INTERNAL: Stream reading state flags
   LMIO input;          //!< INTERNAL: IO handle, file or URL
+  uint64_t fileid[4];  //!< INTERNAL: File identity for decoded block cache
 } MS3FileParam;
 
 /** @def MS3FileParam_INITIALIZER
@@ -735,7 +917,8 @@ typedef struct MS3FileParam
   {                                                               \
     .path = "", .startoffset = 0, .endoffset = 0, .streampos = 0, \
     .recordcount = 0, .readbuffer = NULL, .readlength = 0,        \
-    .readoffset = 0, .flags = 0, .input = LMIO_INITIALIZER        \
+    .readoffset = 0, .flags = 0, .input = LMIO_INITIALIZER,       \
+    .fileid = {0}                                                 \
   }
 
 extern int ms3_readmsr (MS3Record **ppmsr, const char *mspath, uint32_t flags, int8_t verbose);
@@ -750,6 +933,9 @@ extern int ms3_readtracelist_timewin (MS3TraceList **ppmstl, const char *mspath,
                                       int8_t verbose);
 extern int ms3_readtracelist_selection (MS3TraceList **ppmstl, const char *mspath, const MS3Tolerance *tolerance,
                                         const MS3Selections *selections, int8_t splitversion, uint32_t flags, int8_t verbose);
+extern int ms3_readtracelist_parallel (MS3TraceList **ppmstl, const char *mspath, const MS3Tolerance *tolerance,
+                                       const MS3Selections *selections, int8_t splitversion, uint32_t flags,
+                                       int threads, int8_t verbose);
 extern int ms3_url_useragent (const char *program, const char *version);
 extern int ms3_url_userpassword (const char *userpassword);
 extern int ms3_url_addheader (const char *header);
@@ -760,6 +946,59 @@ extern int64_t mstl3_writemseed (MS3TraceList *mst, const char *mspath, int8_t o
                                  int maxreclen, int8_t encoding, uint32_t flags, int8_t verbose);
 extern int libmseed_url_support (void);
 extern MS3FileParam *ms3_mstl_init_fd (int fd);
+extern int ms3_blockcache_set (uint64_t budget);
+extern void ms3_blockcache_stats (uint64_t *hits, uint64_t *misses, uint64_t *blocks, uint64_t *bytes);
+/** @} */
+
+/** @addtogroup shared-memory-ring
+    @brief Publish and consume records via a POSIX shared memory ring
+
+    A shared memory ring is a fixed number of fixed-size record slots
+    in a POSIX shared memory object.  Writers publish complete records
+    with increasing sequence numbers, overwriting the oldest records
+    when the ring is full.  Readers on the same host attach to the
+    ring and parse records in place, without copies or system calls.
+
+    Writers never wait for readers.  A reader that falls behind by
+    more than the size of the ring skips the overwritten records,
+    which are counted in ::MS3ShmRing.lost.
+
+    Shared memory rings are not supported on Windows.
+
+    \sa ms3_shmring_create()
+    \sa ms3_shmring_open()
+    \sa ms3_shmring_record_handler()
+    @{ */
+
+/** @brief Shared memory record ring handle.
+
+    In general these values should not be directly set, with the
+    exception of \c readseq, which may be set by a reader to request
+    the next sequence number to be read.
+*/
+typedef struct MS3ShmRing
+{
+  char name[256];      //!< Shared memory object name
+  uint32_t slotcount;  //!< Number of record slots in ring
+  uint32_t slotsize;   //!< Maximum record length of each slot
+  uint64_t readseq;    //!< Next sequence number to read
+  uint64_t lost;       //!< Count of records overwritten before they were read
+
+  int fd;              //!< INTERNAL: Shared memory descriptor
+  int8_t writer;       //!< INTERNAL: Flag indicating ring is open for writing
+  size_t mapsize;      //!< INTERNAL: Size of mapped shared memory
+  void *map;           //!< INTERNAL: Mapped shared memory
+} MS3ShmRing;
+
+extern MS3ShmRing *ms3_shmring_create (const char *name, uint32_t slotcount, uint32_t slotsize,
+                                       int8_t verbose);
+extern MS3ShmRing *ms3_shmring_open (const char *name, int8_t verbose);
+extern int64_t ms3_shmring_write (MS3ShmRing *ring, const char *record, int reclen);
+extern void ms3_shmring_record_handler (char *record, int reclen, void *handlerdata);
+extern int ms3_shmring_read (MS3ShmRing *ring, MS3Record **ppmsr, uint64_t *seqnum,
+                             uint32_t flags, int8_t verbose);
+extern int ms3_shmring_close (MS3ShmRing **ppring);
+extern int ms3_shmring_unlink (const char *name);
 /** @} */
 
 /** @addtogroup string-functions
@@ -1014,11 +1253,31 @@ extern int mseh_print (const MS3Record *msr, int indent);
     unpacking of data samples for a given ::MS3TraceSeg into a
     caller-specified buffer, or allocating the buffer if needed.
 
+    For large collections of records the ::MSF_COMPACTRECLIST flag
+    stores each record list as an array of fixed-size entries
+    containing the record location, length, data offset, sample count,
+    encoding and end time, with file names kept once in a table shared
+    by the trace list.  No ::MS3Record is retained, and the
+    ::MS3RecordList.first and ::MS3RecordList.last pointers are NULL.
+    Entries, and parsed records on demand, are available using @ref
+    mstl3_recordlist_entry().
+
+    With the ::MSF_KEEPRECORDS flag a compact record list also keeps
+    a copy of each record, grouped per segment.  Reading without
+    ::MSF_UNPACKDATA, a trace list then holds the encoded data, about
+    1-1.5 bytes per sample for Steim compression instead of 4-8 bytes
+    for decoded samples, and does not depend on the input buffer or
+    file after reading.  Samples are decoded on access, either for a
+    whole segment with @ref mstl3_unpack_recordlist() or for a time
+    window with @ref mstl3_unpack_timewindow().
+
     \sa mstl3_readbuffer()
     \sa mstl3_readbuffer_selection()
     \sa ms3_readtracelist()
     \sa ms3_readtracelist_selection()
     \sa mstl3_unpack_recordlist()
+    \sa mstl3_unpack_timewindow()
+    \sa mstl3_recordlist_entry()
     \sa mstl3_addmsr_recordptr()
 */
 
@@ -1249,6 +1508,8 @@ extern int ms_readleapsecondfile (const char *filename);
 extern uint8_t ms_samplesize (char sampletype);
 extern int ms_encoding_sizetype (uint8_t encoding, uint8_t *samplesize, char *sampletype);
 extern const char *ms_encodingstr (uint8_t encoding);
+extern int64_t ms_steim_size (uint8_t encoding, const int32_t *input, uint64_t samplecount,
+                              int32_t diff0, uint64_t maxframes, uint64_t *frames);
 extern const char *ms_errorstr (int errorcode);
 
 extern nstime_t ms_sampletime (nstime_t time, int64_t offset, double samprate);
@@ -1261,10 +1522,15 @@ extern int64_t lmp_ftell64 (FILE *stream);
 extern int lmp_fseek64 (FILE *stream, int64_t offset, int whence);
 /** Portable version of POSIX nanosleep() to sleep for nanoseconds */
 extern uint64_t lmp_nanosleep (uint64_t nanoseconds);
+/** Portable version of POSIX posix_fadvise() to release file data from the page cache */
+extern int lmp_fdropcache (FILE *stream, int64_t offset, int64_t length, int8_t sync);
 
 /** Return CRC32C value of supplied buffer, with optional starting CRC32C value */
 extern uint32_t ms_crc32c (const uint8_t *input, int length, uint32_t previousCRC32C);
 
+/** Return CRC32C value of concatenated data from CRC32C values of two parts */
+extern uint32_t ms_crc32c_combine (uint32_t crc1, uint32_t crc2, int64_t length2);
+
 /** In-place byte swapping of 2 byte quantity */
 static inline void
 ms_gswap2 (void *data2)
@@ -1363,6 +1629,12 @@ typedef int8_t flag;
     libmseed_memory.free = free;
     \endcode
 
+    An optional memory profiler can be enabled with
+    ms_memprofile_enable(), which wraps these allocators to count
+    allocations and track bytes allocated by each library subsystem.
+    Statistics are available via ms_memprofile_get() and
+    ms_memprofile_print().
+
     @{ */
 
 /** Container for memory management function pointers */
@@ -1397,6 +1669,45 @@ extern size_t libmseed_prealloc_block_size;
  * */
 extern void *libmseed_memory_prealloc (void *ptr, size_t size, size_t *currentsize);
 
+/** @brief Library subsystems used to tag allocations by the memory profiler
+ *
+ * @see ms_memprofile_enable */
+typedef enum
+{
+  MS_MEMPROF_OTHER = 0,  //!< Allocations by the application or otherwise untagged
+  MS_MEMPROF_PARSE,      //!< Record parsing and data sample decoding
+  MS_MEMPROF_PACK,       //!< Record packing and data sample encoding
+  MS_MEMPROF_EXTRA,      //!< Extra header JSON documents
+  MS_MEMPROF_TRACELIST,  //!< Trace lists, segments and record lists
+  MS_MEMPROF_RECORD,     //!< Record structures and sample buffers
+  MS_MEMPROF_IO,         //!< File, URL and shared memory I/O
+  MS_MEMPROF_SELECTION,  //!< Data selections
+  MS_MEMPROF_LOGGING,    //!< Log registry
+  MS_MEMPROF_UTILITY,    //!< General utilities, e.g. SIDs and leap seconds
+  MS_MEMPROF_SUBSYSTEMS  //!< Number of subsystems
+} ms_memprof_subsystem_t;
+
+/** @brief Allocation statistics of the memory profiler
+ *
+ * @see ms_memprofile_get */
+typedef struct MSMemProfile
+{
+  uint64_t allocs;       //!< Count of allocations
+  uint64_t reallocs;     //!< Count of re-allocations
+  uint64_t frees;        //!< Count of allocations freed
+  uint64_t bytes;        //!< Total bytes requested by allocations and re-allocations
+  uint64_t copybytes;    //!< Bytes copied by re-allocations that moved memory
+  int64_t livebytes;     //!< Bytes currently allocated
+  int64_t peakbytes;     //!< Peak of bytes currently allocated
+} MSMemProfile;
+
+extern int ms_memprofile_enable (void);
+extern int ms_memprofile_disable (void);
+extern void ms_memprofile_reset (void);
+extern int ms_memprofile_get (MSMemProfile *subsystems, MSMemProfile *total);
+extern const char *ms_memprofile_name (ms_memprof_subsystem_t subsystem);
+extern void ms_memprofile_print (void);
+
 /** @} */
 
 #define DE_ASCII DE_TEXT //!< Mapping of legacy DE_ASCII to DE_TEXT
@@ -1434,6 +1745,20 @@ extern void *libmseed_memory_prealloc (void *ptr, size_t size, size_t *currentsi
 #define MSSWAP_PAYLOAD  0x02    //!< Data payload needed byte swapping
 /** @} */
 
+/** @addtogroup verify-flags
+    @brief Problems detected when verifying a record
+
+    These are bit flags combined into the bitmask returned by ms3_verify_record().
+
+    @{ */
+#define MSV_UNPARSABLE  0x01    //!< Record cannot be parsed
+#define MSV_CRC         0x02    //!< CRC of version 3 record does not match
+#define MSV_STRUCTURE   0x04    //!< Invalid header fields or inconsistent blockette chain
+#define MSV_DECODE      0x08    //!< Data payload cannot be decoded
+#define MSV_SAMPLECOUNT 0x10    //!< Number of decoded samples differs from header
+#define MSV_INTEGRATION 0x20    //!< Last Steim sample differs from reverse integration constant
+/** @} */
+
 /** @addtogroup return-values
     @brief Common error codes returned by library functions.  Error values will always be negative.
 
@@ -1467,6 +1792,10 @@ extern void *libmseed_memory_prealloc (void *ptr, size_t size, size_t *currentsi
 #define MSF_PACKVER2      0x0080  //!< [Packing] Pack as miniSEED version 2 instead of 3
 #define MSF_RECORDLIST    0x0100  //!< [TraceList] Build a ::MS3RecordList for each ::MS3TraceSeg
 #define MSF_MAINTAINMSTL  0x0200  //!< [TraceList] Do not modify a trace list when packing
+#define MSF_COMPACTRECLIST 0x0400 //!< [TraceList] Build compact record lists, implies ::MSF_RECORDLIST
+#define MSF_KEEPRECORDS   0x0800  //!< [TraceList] Keep a copy of each record in compact record lists, implies ::MSF_COMPACTRECLIST
+#define MSF_NOCACHE       0x1000  //!< [I/O] Release file data from the page cache once read or written
+#define MSF_SORTEDFIXED   0x2000  //!< [TraceList] Bisect time windows in files of time-sorted fixed-length records
 /** @} */
 
 #ifdef __cplusplus
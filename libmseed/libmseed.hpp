@@ -0,0 +1,853 @@
+/***************************************************************************
+ * libmseed.hpp:
+ *
+ * Header-only C++17 interface to the miniSEED Library.
+ *
+ * Provides non-owning, zero-copy views of miniSEED records in memory,
+ * iteration over all records in a buffer, and move-only owning
+ * wrappers for ::MS3Record and ::MS3TraceList.  The views read header
+ * fields directly from the record on access, nothing is copied or
+ * allocated until requested.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#ifndef LIBMSEED_HPP
+#define LIBMSEED_HPP 1
+
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "libmseed.hpp requires C++17 or later"
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<span>)
+#include <span>
+#endif
+
+#include "libmseed.h"
+#include "mseedformat.h"
+
+namespace mseed
+{
+
+/** @brief Exception thrown by the C++ interface, \a code() is a
+ * libmseed return code, see @ref return-values */
+class Error : public std::runtime_error
+{
+public:
+  Error (const std::string &message, int code = MS_GENERROR)
+      : std::runtime_error (message), code_ (code) {}
+
+  int code () const noexcept { return code_; }
+
+private:
+  int code_;
+};
+
+#if defined(__cpp_lib_span) && __cpp_lib_span >= 202002L
+/** @brief Contiguous sequence of \a T, std::span when available */
+template <typename T>
+using Span = std::span<T>;
+#else
+/** @brief Contiguous sequence of \a T, a minimal substitute for
+ * std::span (C++20) with the members used by this interface */
+template <typename T>
+class Span
+{
+public:
+  using element_type = T;
+  using value_type = std::remove_cv_t<T>;
+  using size_type = std::size_t;
+  using pointer = T *;
+  using iterator = T *;
+
+  constexpr Span () noexcept = default;
+  constexpr Span (T *data, std::size_t size) noexcept : data_ (data), size_ (size) {}
+
+  template <typename C,
+            typename = decltype (std::data (std::declval<C &> ())),
+            typename = std::enable_if_t<std::is_convertible_v<
+                decltype (std::data (std::declval<C &> ())), T *>>>
+  constexpr Span (C &container) noexcept
+      : data_ (std::data (container)), size_ (std::size (container)) {}
+
+  template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+  constexpr Span (const Span<U> &other) noexcept : data_ (other.data ()), size_ (other.size ()) {}
+
+  constexpr T *data () const noexcept { return data_; }
+  constexpr std::size_t size () const noexcept { return size_; }
+  constexpr std::size_t size_bytes () const noexcept { return size_ * sizeof (T); }
+  constexpr bool empty () const noexcept { return size_ == 0; }
+  constexpr T &operator[] (std::size_t index) const noexcept { return data_[index]; }
+  constexpr T *begin () const noexcept { return data_; }
+  constexpr T *end () const noexcept { return data_ + size_; }
+
+  constexpr Span subspan (std::size_t offset) const noexcept
+  {
+    return Span (data_ + offset, size_ - offset);
+  }
+  constexpr Span subspan (std::size_t offset, std::size_t count) const noexcept
+  {
+    return Span (data_ + offset, count);
+  }
+  constexpr Span first (std::size_t count) const noexcept
+  {
+    return Span (data_, count);
+  }
+
+private:
+  T *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+#endif
+
+/** @brief Read-only bytes, e.g. a buffer of miniSEED records */
+using ByteSpan = Span<const std::byte>;
+
+/** @brief Create a ::ByteSpan for \a length bytes at \a data */
+inline ByteSpan
+as_bytes (const void *data, std::size_t length) noexcept
+{
+  return ByteSpan (static_cast<const std::byte *> (data), length);
+}
+
+namespace detail
+{
+/* Sample type code of C++ sample types, see @ref sample-types */
+template <typename T> struct sample_type { static constexpr char code = 0; };
+template <> struct sample_type<int32_t> { static constexpr char code = 'i'; };
+template <> struct sample_type<float> { static constexpr char code = 'f'; };
+template <> struct sample_type<double> { static constexpr char code = 'd'; };
+template <> struct sample_type<char> { static constexpr char code = 't'; };
+
+/* Description of a libmseed return code, including positive values */
+inline std::string
+errorstr (int code)
+{
+  const char *description = ms_errorstr (code);
+
+  if (code > 0)
+    return "Record is incomplete, " + std::to_string (code) + " more bytes needed";
+
+  return (description) ? description : "Unknown error code " + std::to_string (code);
+}
+} // namespace detail
+
+class Record;
+
+/**********************************************************************/ /**
+ * @brief Non-owning view of a miniSEED v2 or v3 record in memory
+ *
+ * A view is a pointer to the record and its length, header fields are
+ * read from the record when accessed.  For miniSEED v2 the blockette
+ * chain is scanned once, on first access of a field it provides.  The
+ * viewed memory must remain valid and unchanged while the view is
+ * used.  Views are cheap to copy.
+ *
+ * Time values are the same as the C interface, i.e. a start time
+ * includes the microseconds of Blockette 1001 and any unapplied time
+ * correction of a miniSEED v2 record.
+ ***************************************************************************/
+class RecordView
+{
+public:
+  RecordView () noexcept = default;
+
+  /** @brief View a record of \a formatversion (2 or 3) that is
+   * exactly the bytes of \a record, e.g. as returned by ms3_detect().
+   * The view is empty if \a record is shorter than the fixed header,
+   * for v3 including the source identifier and extra headers. */
+  RecordView (ByteSpan record, uint8_t formatversion) noexcept
+      : record_ (reinterpret_cast<const char *> (record.data ())),
+        length_ (record.size ()), version_ (formatversion)
+  {
+    if (version_ == 3 && length_ >= MS3FSDH_LENGTH &&
+        length_ >= static_cast<uint64_t> (MS3FSDH_LENGTH) + *pMS3FSDH_SIDLENGTH (record_) +
+                       HO2u (*pMS3FSDH_EXTRALENGTH (record_), ms_bigendianhost ()))
+      swap_ = ms_bigendianhost () ? 1 : 0;
+    else if (version_ == 2 && length_ >= MS2FSDH_LENGTH)
+      swap_ = MS_ISVALIDYEARDAY (*pMS2FSDH_YEAR (record_), *pMS2FSDH_DAY (record_)) ? 0 : 1;
+    else
+      length_ = 0;
+  }
+
+  /** @brief Detect a complete record at the start of \a buffer,
+   * returning an empty view if none is found */
+  static RecordView
+  detect (ByteSpan buffer) noexcept
+  {
+    uint8_t formatversion = 0;
+    int64_t length;
+
+    if (buffer.size () < MINRECLEN)
+      return RecordView ();
+
+    length = ms3_detect (reinterpret_cast<const char *> (buffer.data ()),
+                         buffer.size (), &formatversion);
+
+    if (length <= 0 || static_cast<uint64_t> (length) > buffer.size ())
+      return RecordView ();
+
+    return RecordView (buffer.first (static_cast<std::size_t> (length)), formatversion);
+  }
+
+  /** @brief True if the view refers to a record */
+  explicit operator bool () const noexcept { return length_ > 0; }
+
+  /** @brief Bytes of the record */
+  ByteSpan bytes () const noexcept { return as_bytes (record_, length_); }
+
+  /** @brief Pointer to the record */
+  const char *data () const noexcept { return record_; }
+
+  /** @brief Length of the record in bytes */
+  uint64_t length () const noexcept { return length_; }
+
+  /** @brief Format version of the record, 2 or 3 */
+  uint8_t formatVersion () const noexcept { return version_; }
+
+  /** @brief Source identifier, for miniSEED v3 a view of the record,
+   * for v2 built in \a buffer of \a size bytes (at least ::LM_SIDLEN) */
+  std::string_view
+  sid (char *buffer, std::size_t size) const noexcept
+  {
+    if (version_ == 3)
+      return std::string_view (pMS3FSDH_SID (record_), *pMS3FSDH_SIDLENGTH (record_));
+
+    char net[3] = {0};
+    char sta[6] = {0};
+    char loc[3] = {0};
+    char chan[6] = {0};
+    const char *channel = pMS2FSDH_CHANNEL (record_);
+
+    ms_strncpclean (net, pMS2FSDH_NETWORK (record_), 2);
+    ms_strncpclean (sta, pMS2FSDH_STATION (record_), 5);
+    ms_strncpclean (loc, pMS2FSDH_LOCATION (record_), 2);
+
+    /* Map 3 channel codes to BAND_SOURCE_POSITION */
+    chan[0] = channel[0];
+    chan[1] = '_';
+    chan[2] = channel[1];
+    chan[3] = '_';
+    chan[4] = channel[2];
+
+    if (ms_nslc2sid (buffer, static_cast<int> (size), 0, net, sta, loc, chan) < 0)
+      return std::string_view ();
+
+    return std::string_view (buffer);
+  }
+
+  /** @brief Source identifier as a string */
+  std::string
+  sid () const
+  {
+    char buffer[LM_SIDLEN];
+
+    return std::string (sid (buffer, sizeof (buffer)));
+  }
+
+  /** @brief Time of first sample as nanoseconds since the epoch */
+  nstime_t
+  startTime () const noexcept
+  {
+    if (version_ == 3)
+      return ms_time2nstime (HO2u (*pMS3FSDH_YEAR (record_), swap_),
+                             HO2u (*pMS3FSDH_DAY (record_), swap_),
+                             *pMS3FSDH_HOUR (record_),
+                             *pMS3FSDH_MIN (record_),
+                             *pMS3FSDH_SEC (record_),
+                             HO4u (*pMS3FSDH_NSEC (record_), swap_));
+
+    if (HO2u (*pMS2FSDH_YEAR (record_), swap_) == 0)
+      return NSTUNSET;
+
+    nstime_t starttime = ms_time2nstime (HO2u (*pMS2FSDH_YEAR (record_), swap_),
+                                         HO2u (*pMS2FSDH_DAY (record_), swap_),
+                                         *pMS2FSDH_HOUR (record_),
+                                         *pMS2FSDH_MIN (record_),
+                                         *pMS2FSDH_SEC (record_),
+                                         (uint32_t)HO2u (*pMS2FSDH_FSEC (record_), swap_) * (NSTMODULUS / 10000));
+
+    /* Apply time correction if not already applied, bit 1 of activity flags */
+    if (HO4d (*pMS2FSDH_TIMECORRECT (record_), swap_) != 0 &&
+        !(*pMS2FSDH_ACTFLAGS (record_) & 0x02))
+      starttime += (nstime_t)HO4d (*pMS2FSDH_TIMECORRECT (record_), swap_) * (NSTMODULUS / 10000);
+
+    if (blockette (1001))
+      starttime += (nstime_t)*pMS2B1001_MICROSECOND (record_ + blockette (1001)) * (NSTMODULUS / 1000000);
+
+    return starttime;
+  }
+
+  /** @brief Sample rate as in ::MS3Record.samprate, negative values
+   * are a sample period, see msr3_sampratehz() */
+  double
+  sampleRate () const noexcept
+  {
+    if (version_ == 3)
+      return HO8f (*pMS3FSDH_SAMPLERATE (record_), swap_);
+
+    if (blockette (100))
+      return HO4f (*pMS2B100_SAMPRATE (record_ + blockette (100)), swap_);
+
+    /* Nominal rate from factor and multiplier, as ms_nomsamprate() */
+    int factor = HO2d (*pMS2FSDH_SAMPLERATEFACT (record_), swap_);
+    int multiplier = HO2d (*pMS2FSDH_SAMPLERATEMULT (record_), swap_);
+    double samprate = 0.0;
+
+    if (factor > 0)
+      samprate = (double)factor;
+    else if (factor < 0)
+      samprate = -1.0 / (double)factor;
+    if (multiplier > 0)
+      samprate = samprate * (double)multiplier;
+    else if (multiplier < 0)
+      samprate = -1.0 * (samprate / (double)multiplier);
+
+    return samprate;
+  }
+
+  /** @brief Number of samples in the record */
+  int64_t
+  sampleCount () const noexcept
+  {
+    if (version_ == 3)
+      return HO4u (*pMS3FSDH_NUMSAMPLES (record_), swap_);
+
+    return HO2u (*pMS2FSDH_NUMSAMPLES (record_), swap_);
+  }
+
+  /** @brief Data encoding format, see @ref encoding-values, -1 if a
+   * miniSEED v2 record has no Blockette 1000 */
+  int
+  encoding () const noexcept
+  {
+    if (version_ == 3)
+      return *pMS3FSDH_ENCODING (record_);
+
+    if (blockette (1000))
+      return *pMS2B1000_ENCODING (record_ + blockette (1000));
+
+    return -1;
+  }
+
+  /** @brief Sample type of decoded samples, see @ref sample-types,
+   * 0 if the encoding is unknown */
+  char
+  sampleType () const noexcept
+  {
+    char sampletype = 0;
+
+    if (ms_encoding_sizetype (decodeEncoding (), nullptr, &sampletype))
+      return 0;
+
+    return sampletype;
+  }
+
+  /** @brief Publication version, mapped from the data quality
+   * indicator for miniSEED v2 */
+  uint8_t
+  pubVersion () const noexcept
+  {
+    if (version_ == 3)
+      return *pMS3FSDH_PUBVERSION (record_);
+
+    switch (*pMS2FSDH_DATAQUALITY (record_))
+    {
+    case 'M':
+      return 4;
+    case 'Q':
+      return 3;
+    case 'D':
+      return 2;
+    case 'R':
+      return 1;
+    }
+
+    return 0;
+  }
+
+  /** @brief CRC of a miniSEED v3 record, 0 for v2 */
+  uint32_t
+  crc () const noexcept
+  {
+    return (version_ == 3) ? HO4u (*pMS3FSDH_CRC (record_), swap_) : 0;
+  }
+
+  /** @brief Extra headers of a miniSEED v3 record as a JSON view */
+  std::string_view
+  extraHeaders () const noexcept
+  {
+    if (version_ != 3)
+      return std::string_view ();
+
+    return std::string_view (pMS3FSDH_SID (record_) + *pMS3FSDH_SIDLENGTH (record_),
+                             HO2u (*pMS3FSDH_EXTRALENGTH (record_), swap_));
+  }
+
+  /** @brief Encoded data payload of the record */
+  ByteSpan
+  payload () const noexcept
+  {
+    uint64_t offset;
+    uint64_t size;
+
+    if (version_ == 3)
+    {
+      offset = MS3FSDH_LENGTH + *pMS3FSDH_SIDLENGTH (record_) +
+               HO2u (*pMS3FSDH_EXTRALENGTH (record_), swap_);
+      size = HO4u (*pMS3FSDH_DATALENGTH (record_), swap_);
+    }
+    else
+    {
+      offset = HO2u (*pMS2FSDH_DATAOFFSET (record_), swap_);
+      size = (offset) ? length_ - offset : 0;
+    }
+
+    if (offset == 0 || offset + size > length_)
+      return ByteSpan ();
+
+    return as_bytes (record_ + offset, size);
+  }
+
+  /** @brief True if the data payload is in non-host byte order */
+  bool
+  payloadSwapped () const noexcept
+  {
+    /* Steim encodings are big endian, all others match the header */
+    if (version_ == 3)
+    {
+      if (encoding () == DE_STEIM1 || encoding () == DE_STEIM2)
+        return !ms_bigendianhost ();
+
+      return swap_;
+    }
+
+    if (blockette (1000))
+    {
+      if (ms_bigendianhost ())
+        return *pMS2B1000_BYTEORDER (record_ + blockette (1000)) == 0;
+      else
+        return *pMS2B1000_BYTEORDER (record_ + blockette (1000)) > 0;
+    }
+
+    return swap_;
+  }
+
+  /**********************************************************************/ /**
+   * @brief Decode data samples into a caller-provided buffer
+   *
+   * The sample type \a T must match the type of the encoding: int32_t
+   * for integer encodings, float, double or char for text.  As with
+   * msr3_unpack_data(), Steim-1 is assumed for a miniSEED v2 record
+   * without Blockette 1000.
+   *
+   * @param[out] output Buffer for at least sampleCount() samples
+   *
+   * @returns the decoded samples, a prefix of \a output.
+   *
+   * @throws Error if the sample type does not match, the buffer is too
+   * small or the data cannot be decoded.
+   ***************************************************************************/
+  template <typename T>
+  Span<T>
+  decode (Span<T> output) const
+  {
+    static_assert (detail::sample_type<T>::code != 0,
+                   "Sample type must be int32_t, float, double or char");
+
+    char sampletype = 0;
+    uint8_t samplesize = 0;
+    uint8_t format = decodeEncoding ();
+    int64_t samplecount = sampleCount ();
+    int64_t decoded;
+    ByteSpan encoded = payload ();
+    const void *input = encoded.data ();
+    std::vector<std::byte> aligned;
+    char sidbuffer[LM_SIDLEN];
+
+    if (samplecount <= 0)
+      return output.first (0);
+
+    if (ms_encoding_sizetype (format, &samplesize, &sampletype))
+      throw Error ("Cannot determine sample type for encoding " + std::to_string (format));
+
+    if (sampletype != detail::sample_type<T>::code)
+      throw Error (std::string ("Sample type does not match encoding sample type: ") + sampletype);
+
+    if (output.size () < static_cast<uint64_t> (samplecount))
+      throw Error ("Output buffer is too small for " + std::to_string (samplecount) + " samples");
+
+    /* Decoders require input aligned for the sample size */
+    if (samplesize && reinterpret_cast<uintptr_t> (input) % samplesize)
+    {
+      aligned.assign (encoded.begin (), encoded.end ());
+      input = aligned.data ();
+    }
+
+    /* Source identifier for diagnostics, terminated for the C interface */
+    std::string_view sidview = sid (sidbuffer, sizeof (sidbuffer));
+    if (sidview.data () != sidbuffer)
+    {
+      std::size_t length = std::min (sidview.size (), sizeof (sidbuffer) - 1);
+      std::memcpy (sidbuffer, sidview.data (), length);
+      sidbuffer[length] = '\0';
+    }
+
+    decoded = ms_decode_data (input, encoded.size (), format,
+                              static_cast<uint64_t> (samplecount), output.data (),
+                              output.size () * sizeof (T), &sampletype,
+                              payloadSwapped (), sidbuffer, 0);
+
+    if (decoded < 0)
+      throw Error ("Cannot decode data samples", static_cast<int> (decoded));
+
+    return output.first (static_cast<std::size_t> (decoded));
+  }
+
+  /** @brief Parse the record into an owning ::MS3Record, see msr3_parse() */
+  Record parse (uint32_t flags = 0, int8_t verbose = 0) const;
+
+private:
+  /* Encoding used to decode, Steim-1 if not specified */
+  uint8_t
+  decodeEncoding () const noexcept
+  {
+    return (encoding () < 0) ? DE_STEIM1 : static_cast<uint8_t> (encoding ());
+  }
+
+  /* Offset of the first blockette of \a type in a miniSEED v2 record,
+   * 0 if not present.  The chain is scanned on first use. */
+  uint16_t
+  blockette (uint16_t type) const noexcept
+  {
+    if (!scanned_)
+      scan ();
+
+    switch (type)
+    {
+    case 100:
+      return b100_;
+    case 1000:
+      return b1000_;
+    case 1001:
+      return b1001_;
+    }
+
+    return 0;
+  }
+
+  void
+  scan () const noexcept
+  {
+    uint16_t offset = HO2u (*pMS2FSDH_BLOCKETTEOFFSET (record_), swap_);
+    uint16_t next;
+    uint16_t type;
+    int count = 0;
+
+    scanned_ = true;
+
+    while (offset >= MS2FSDH_LENGTH && offset + 8u <= length_ && count++ < 255)
+    {
+      type = HO2u (*pMS2B1000_TYPE (record_ + offset), swap_);
+      next = HO2u (*pMS2B1000_NEXT (record_ + offset), swap_);
+
+      if (type == 100 && !b100_ && offset + 12u <= length_)
+        b100_ = offset;
+      else if (type == 1000 && !b1000_)
+        b1000_ = offset;
+      else if (type == 1001 && !b1001_)
+        b1001_ = offset;
+
+      if (next <= offset)
+        break;
+
+      offset = next;
+    }
+  }
+
+  const char *record_ = nullptr;
+  uint64_t length_ = 0;
+  uint8_t version_ = 0;
+  int8_t swap_ = 0;
+
+  mutable bool scanned_ = false;
+  mutable uint16_t b100_ = 0;
+  mutable uint16_t b1000_ = 0;
+  mutable uint16_t b1001_ = 0;
+};
+
+/**********************************************************************/ /**
+ * @brief Range of the records in a buffer, for range-based for loops
+ *
+ * Iteration yields a ::RecordView for each record, in order, and ends
+ * at the end of the buffer or at the first bytes that do not start a
+ * complete record, e.g. a partial record at the end of the buffer.
+ * The position where iteration ended is available from
+ * iterator::offset().
+ *
+ * @code
+ * for (const mseed::RecordView &record : mseed::Records (buffer))
+ *   total += record.sampleCount ();
+ * @endcode
+ ***************************************************************************/
+class Records
+{
+public:
+  class iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = RecordView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const RecordView *;
+    using reference = const RecordView &;
+
+    iterator () noexcept = default;
+    iterator (ByteSpan buffer, std::size_t offset) noexcept
+        : buffer_ (buffer), offset_ (offset)
+    {
+      detect ();
+    }
+
+    reference operator* () const noexcept { return record_; }
+    pointer operator->() const noexcept { return &record_; }
+
+    iterator &
+    operator++ () noexcept
+    {
+      offset_ += static_cast<std::size_t> (record_.length ());
+      detect ();
+      return *this;
+    }
+
+    iterator
+    operator++ (int) noexcept
+    {
+      iterator previous = *this;
+      ++*this;
+      return previous;
+    }
+
+    /** @brief Offset of the current record in the buffer */
+    std::size_t offset () const noexcept { return offset_; }
+
+    /* Iterators are equal at the same record, all ended iterators are equal */
+    bool
+    operator== (const iterator &other) const noexcept
+    {
+      if (!record_ || !other.record_)
+        return !record_ && !other.record_;
+
+      return record_.data () == other.record_.data ();
+    }
+
+    bool operator!= (const iterator &other) const noexcept { return !(*this == other); }
+
+  private:
+    void
+    detect () noexcept
+    {
+      record_ = (offset_ < buffer_.size ()) ? RecordView::detect (buffer_.subspan (offset_)) : RecordView ();
+    }
+
+    ByteSpan buffer_;
+    std::size_t offset_ = 0;
+    RecordView record_;
+  };
+
+  explicit Records (ByteSpan buffer) noexcept : buffer_ (buffer) {}
+
+  iterator begin () const noexcept { return iterator (buffer_, 0); }
+  iterator end () const noexcept { return iterator (); }
+
+private:
+  ByteSpan buffer_;
+};
+
+/**********************************************************************/ /**
+ * @brief Move-only owner of an ::MS3Record, freed with msr3_free()
+ ***************************************************************************/
+class Record
+{
+public:
+  Record () noexcept = default;
+
+  /** @brief Take ownership of \a msr */
+  explicit Record (MS3Record *msr) noexcept : msr_ (msr) {}
+
+  Record (const Record &) = delete;
+  Record &operator= (const Record &) = delete;
+
+  Record (Record &&other) noexcept : msr_ (std::exchange (other.msr_, nullptr)) {}
+
+  Record &
+  operator= (Record &&other) noexcept
+  {
+    if (this != &other)
+      reset (std::exchange (other.msr_, nullptr));
+    return *this;
+  }
+
+  ~Record () { reset (); }
+
+  /** @brief Parse \a record into an ::MS3Record, see msr3_parse() */
+  static Record
+  parse (ByteSpan record, uint32_t flags = 0, int8_t verbose = 0)
+  {
+    MS3Record *msr = nullptr;
+    int rv = msr3_parse (reinterpret_cast<const char *> (record.data ()), record.size (),
+                         &msr, flags, verbose);
+
+    if (rv != MS_NOERROR)
+    {
+      msr3_free (&msr);
+      throw Error ("Cannot parse record: " + detail::errorstr (rv), rv);
+    }
+
+    return Record (msr);
+  }
+
+  MS3Record *get () const noexcept { return msr_; }
+  MS3Record *operator->() const noexcept { return msr_; }
+  MS3Record &operator* () const noexcept { return *msr_; }
+  explicit operator bool () const noexcept { return msr_ != nullptr; }
+
+  /** @brief Release ownership, returning the ::MS3Record */
+  MS3Record *release () noexcept { return std::exchange (msr_, nullptr); }
+
+  /** @brief Free the owned ::MS3Record and take ownership of \a msr */
+  void
+  reset (MS3Record *msr = nullptr) noexcept
+  {
+    if (msr_)
+      msr3_free (&msr_);
+    msr_ = msr;
+  }
+
+private:
+  MS3Record *msr_ = nullptr;
+};
+
+inline Record
+RecordView::parse (uint32_t flags, int8_t verbose) const
+{
+  return Record::parse (bytes (), flags, verbose);
+}
+
+/**********************************************************************/ /**
+ * @brief Move-only owner of an ::MS3TraceList, freed with mstl3_free()
+ *
+ * Private pointers are not freed, as the owner cannot know what they
+ * hold.
+ ***************************************************************************/
+class TraceList
+{
+public:
+  /** @brief Create an empty trace list */
+  TraceList ()
+  {
+    if (!(mstl_ = mstl3_init (nullptr)))
+      throw Error ("Cannot initialize trace list");
+  }
+
+  /** @brief Take ownership of \a mstl */
+  explicit TraceList (MS3TraceList *mstl) noexcept : mstl_ (mstl) {}
+
+  TraceList (const TraceList &) = delete;
+  TraceList &operator= (const TraceList &) = delete;
+
+  TraceList (TraceList &&other) noexcept : mstl_ (std::exchange (other.mstl_, nullptr)) {}
+
+  TraceList &
+  operator= (TraceList &&other) noexcept
+  {
+    if (this != &other)
+      reset (std::exchange (other.mstl_, nullptr));
+    return *this;
+  }
+
+  ~TraceList () { reset (); }
+
+  /** @brief Read a file into a trace list, see ms3_readtracelist_selection() */
+  static TraceList
+  read (const std::string &path, uint32_t flags = 0, int8_t splitversion = 0,
+        const MS3Tolerance *tolerance = nullptr, const MS3Selections *selections = nullptr,
+        int8_t verbose = 0)
+  {
+    MS3TraceList *mstl = nullptr;
+    int rv = ms3_readtracelist_selection (&mstl, path.c_str (), tolerance, selections,
+                                          splitversion, flags, verbose);
+
+    if (rv != MS_NOERROR)
+    {
+      if (mstl)
+        mstl3_free (&mstl, 0);
+      throw Error ("Cannot read " + path + ": " + detail::errorstr (rv), rv);
+    }
+
+    return TraceList (mstl);
+  }
+
+  /** @brief Add a record to the trace list, see mstl3_addmsr() */
+  MS3TraceSeg *
+  add (const MS3Record *msr, int8_t splitversion = 0, int8_t autoheal = 1,
+       uint32_t flags = 0, const MS3Tolerance *tolerance = nullptr)
+  {
+    MS3TraceSeg *seg = mstl3_addmsr (mstl_, msr, splitversion, autoheal, flags, tolerance);
+
+    if (!seg)
+      throw Error ("Cannot add record to trace list");
+
+    return seg;
+  }
+
+  MS3TraceList *get () const noexcept { return mstl_; }
+  MS3TraceList *operator->() const noexcept { return mstl_; }
+  MS3TraceList &operator* () const noexcept { return *mstl_; }
+  explicit operator bool () const noexcept { return mstl_ != nullptr; }
+
+  /** @brief Release ownership, returning the ::MS3TraceList */
+  MS3TraceList *release () noexcept { return std::exchange (mstl_, nullptr); }
+
+  /** @brief Free the owned ::MS3TraceList and take ownership of \a mstl */
+  void
+  reset (MS3TraceList *mstl = nullptr) noexcept
+  {
+    if (mstl_)
+      mstl3_free (&mstl_, 0);
+    mstl_ = mstl;
+  }
+
+private:
+  MS3TraceList *mstl_ = nullptr;
+};
+
+} // namespace mseed
+
+#endif /* LIBMSEED_HPP */
@@ -25,6 +25,9 @@
 
 #include "libmseed.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_LOGGING
+#include "memprofile.h"
+
 void rloginit_int (MSLogParam *logp,
                    void (*log_print) (const char *), const char *logprefix,
                    void (*diag_print) (const char *), const char *errprefix,
@@ -45,22 +48,9 @@ void print_message_int (MSLogParam *logp, int level, const char *message,
  * it's own "global" logging parameters initialized to the library
  * default settings.
  *
- * Windows has its own designation for TLS.
- * Otherwise, C11 defines the standardized _Thread_local storage-class.
- * Otherwise fallback to the commonly supported __thread keyword.
+ * The lm_thread_local storage-class is defined in memprofile.h.
  */
-#if !defined(LIBMSEED_NO_THREADING)
-#if defined(LMP_WIN)
-  #define lm_thread_local __declspec( thread )
-#elif __STDC_VERSION__ >= 201112L
-  #define lm_thread_local _Thread_local
-#else
-  #define lm_thread_local __thread
-#endif
 lm_thread_local MSLogParam gMSLogParam = MSLogParam_INITIALIZER;
-#else
-MSLogParam gMSLogParam = MSLogParam_INITIALIZER;
-#endif
 
 /**********************************************************************/ /**
  * @brief Initialize the global logging parameters.
@@ -140,7 +130,7 @@ ms_rloginit_l (MSLogParam *logp,
 
   if (logp == NULL)
   {
-    llog = (MSLogParam *)libmseed_memory.malloc (sizeof (MSLogParam));
+    llog = (MSLogParam *)lm_malloc (sizeof (MSLogParam));
 
     if (llog == NULL)
     {
@@ -451,7 +441,7 @@ add_message_int (MSLogRegistry *logreg, const char *function, int level,
     return -1;
 
   /* Allocate new entry */
-  logentry = (MSLogEntry *)libmseed_memory.malloc (sizeof (MSLogEntry));
+  logentry = (MSLogEntry *)lm_malloc (sizeof (MSLogEntry));
 
   if (logentry == NULL)
   {
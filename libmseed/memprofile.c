@@ -0,0 +1,543 @@
+/***************************************************************************
+ * Optional memory profiler that instruments the library allocators.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+#include "memprofile.h"
+
+/** @cond UNDOCUMENTED */
+
+/* Subsystem of the next allocation, set by the lm_*alloc() wrappers */
+lm_thread_local int ms_memprofile_tag = MS_MEMPROF_OTHER;
+
+/* Live allocation table entry, keyed by pointer */
+typedef struct MemEntry
+{
+  void *ptr;
+  size_t size;
+  int subsystem;
+} MemEntry;
+
+#define MEMENTRY_DELETED ((void *)1)
+
+static struct
+{
+  int8_t enabled;
+  LIBMSEED_MEMORY inner;   /* Allocators wrapped by the profiler */
+  MemEntry *entries;       /* Open addressing table of live allocations */
+  size_t capacity;
+  size_t used;             /* Count of live and deleted entries */
+  size_t live;             /* Count of live entries */
+  uint64_t untracked;      /* Allocations not tracked when the table could not grow */
+  MSMemProfile subsystems[MS_MEMPROF_SUBSYSTEMS];
+  MSMemProfile total;
+} gMemProfile;
+
+/* Simple spin lock protecting the profile, allocations are short */
+#if defined(LMP_WIN)
+static volatile LONG gMemProfileLock = 0;
+#define MEMPROFILE_LOCK()   while (InterlockedExchange (&gMemProfileLock, 1)) {}
+#define MEMPROFILE_UNLOCK() InterlockedExchange (&gMemProfileLock, 0)
+#else
+static char gMemProfileLock = 0;
+#define MEMPROFILE_LOCK()   while (__atomic_test_and_set (&gMemProfileLock, __ATOMIC_ACQUIRE)) {}
+#define MEMPROFILE_UNLOCK() __atomic_clear (&gMemProfileLock, __ATOMIC_RELEASE)
+#endif
+
+static const char *gMemProfileNames[MS_MEMPROF_SUBSYSTEMS] = {
+  "other", "parse", "pack", "extra", "tracelist",
+  "record", "io", "selection", "logging", "utility"};
+
+static size_t
+mp_hash (const void *ptr, size_t capacity)
+{
+  uint64_t key = (uint64_t)(uintptr_t)ptr;
+
+  key ^= key >> 33;
+  key *= UINT64_C (0xff51afd7ed558ccd);
+  key ^= key >> 33;
+
+  return (size_t)(key & (capacity - 1));
+}
+
+/* Find the table entry for a pointer, NULL if not found */
+static MemEntry *
+mp_find (const void *ptr)
+{
+  size_t idx;
+
+  if (!gMemProfile.entries)
+    return NULL;
+
+  idx = mp_hash (ptr, gMemProfile.capacity);
+
+  while (gMemProfile.entries[idx].ptr != NULL)
+  {
+    if (gMemProfile.entries[idx].ptr == ptr)
+      return &gMemProfile.entries[idx];
+
+    idx = (idx + 1) & (gMemProfile.capacity - 1);
+  }
+
+  return NULL;
+}
+
+/* Grow or compact table, returns 0 on success and -1 on error */
+static int
+mp_rehash (void)
+{
+  MemEntry *entries;
+  size_t capacity;
+  size_t idx;
+  size_t newidx;
+
+  capacity = (gMemProfile.capacity) ? gMemProfile.capacity : 1024;
+
+  while (gMemProfile.live * 4 >= capacity)
+    capacity *= 2;
+
+  if ((entries = (MemEntry *)gMemProfile.inner.malloc (capacity * sizeof (MemEntry))) == NULL)
+    return -1;
+
+  memset (entries, 0, capacity * sizeof (MemEntry));
+
+  for (idx = 0; idx < gMemProfile.capacity; idx++)
+  {
+    if (gMemProfile.entries[idx].ptr == NULL || gMemProfile.entries[idx].ptr == MEMENTRY_DELETED)
+      continue;
+
+    newidx = mp_hash (gMemProfile.entries[idx].ptr, capacity);
+
+    while (entries[newidx].ptr != NULL)
+      newidx = (newidx + 1) & (capacity - 1);
+
+    entries[newidx] = gMemProfile.entries[idx];
+  }
+
+  if (gMemProfile.entries)
+    gMemProfile.inner.free (gMemProfile.entries);
+
+  gMemProfile.entries  = entries;
+  gMemProfile.capacity = capacity;
+  gMemProfile.used     = gMemProfile.live;
+
+  return 0;
+}
+
+/* Account for a new live allocation */
+static void
+mp_add (void *ptr, size_t size, int subsystem)
+{
+  MSMemProfile *sub = &gMemProfile.subsystems[subsystem];
+  size_t idx;
+
+  /* Without a table entry the free would not be matched, leave out of live bytes */
+  if ((gMemProfile.used + 1) * 2 > gMemProfile.capacity && mp_rehash ())
+  {
+    gMemProfile.untracked++;
+    return;
+  }
+
+  sub->livebytes += size;
+  if (sub->livebytes > sub->peakbytes)
+    sub->peakbytes = sub->livebytes;
+
+  gMemProfile.total.livebytes += size;
+  if (gMemProfile.total.livebytes > gMemProfile.total.peakbytes)
+    gMemProfile.total.peakbytes = gMemProfile.total.livebytes;
+
+  idx = mp_hash (ptr, gMemProfile.capacity);
+
+  while (gMemProfile.entries[idx].ptr != NULL && gMemProfile.entries[idx].ptr != MEMENTRY_DELETED)
+    idx = (idx + 1) & (gMemProfile.capacity - 1);
+
+  if (gMemProfile.entries[idx].ptr == NULL)
+    gMemProfile.used++;
+
+  gMemProfile.entries[idx].ptr       = ptr;
+  gMemProfile.entries[idx].size      = size;
+  gMemProfile.entries[idx].subsystem = subsystem;
+  gMemProfile.live++;
+}
+
+/* Account for removal of a live allocation */
+static void
+mp_remove (MemEntry *entry)
+{
+  gMemProfile.subsystems[entry->subsystem].livebytes -= entry->size;
+  gMemProfile.total.livebytes -= entry->size;
+
+  entry->ptr = MEMENTRY_DELETED;
+  gMemProfile.live--;
+}
+
+/* Release the table and clear all statistics, the wrapped allocators are retained */
+static void
+mp_clear (void)
+{
+  if (gMemProfile.entries)
+    gMemProfile.inner.free (gMemProfile.entries);
+
+  gMemProfile.entries   = NULL;
+  gMemProfile.capacity  = 0;
+  gMemProfile.used      = 0;
+  gMemProfile.live      = 0;
+  gMemProfile.untracked = 0;
+  memset (gMemProfile.subsystems, 0, sizeof (gMemProfile.subsystems));
+  memset (&gMemProfile.total, 0, sizeof (gMemProfile.total));
+}
+
+/* Return and reset the subsystem of the current allocation */
+static int
+mp_consume_tag (void)
+{
+  int subsystem = ms_memprofile_tag;
+
+  ms_memprofile_tag = MS_MEMPROF_OTHER;
+
+  if (subsystem < 0 || subsystem >= MS_MEMPROF_SUBSYSTEMS)
+    subsystem = MS_MEMPROF_OTHER;
+
+  return subsystem;
+}
+
+static void *
+mp_malloc (size_t size)
+{
+  int subsystem = mp_consume_tag ();
+  MemEntry *entry;
+  void *ptr;
+
+  if ((ptr = gMemProfile.inner.malloc (size)) == NULL)
+    return NULL;
+
+  MEMPROFILE_LOCK ();
+
+  /* Called via the wrapper after the profiler was disabled */
+  if (!gMemProfile.enabled)
+  {
+    MEMPROFILE_UNLOCK ();
+    return ptr;
+  }
+
+  /* Remove stale entry for memory released outside of the profiler */
+  if ((entry = mp_find (ptr)))
+    mp_remove (entry);
+
+  gMemProfile.subsystems[subsystem].allocs++;
+  gMemProfile.subsystems[subsystem].bytes += size;
+  gMemProfile.total.allocs++;
+  gMemProfile.total.bytes += size;
+  mp_add (ptr, size, subsystem);
+
+  MEMPROFILE_UNLOCK ();
+
+  return ptr;
+}
+
+static void *
+mp_realloc (void *ptr, size_t size)
+{
+  int subsystem = mp_consume_tag ();
+  MemEntry *entry;
+  size_t oldsize = 0;
+  int known = 0;
+  void *newptr;
+
+  if (ptr)
+  {
+    MEMPROFILE_LOCK ();
+    if ((entry = mp_find (ptr)))
+    {
+      oldsize = entry->size;
+      known   = 1;
+    }
+    MEMPROFILE_UNLOCK ();
+  }
+
+  if ((newptr = gMemProfile.inner.realloc (ptr, size)) == NULL && size > 0)
+    return NULL;
+
+  MEMPROFILE_LOCK ();
+
+  if (!gMemProfile.enabled)
+  {
+    MEMPROFILE_UNLOCK ();
+    return newptr;
+  }
+
+  if (ptr && (entry = mp_find (ptr)))
+    mp_remove (entry);
+
+  if (newptr && newptr != ptr && (entry = mp_find (newptr)))
+    mp_remove (entry);
+
+  gMemProfile.subsystems[subsystem].reallocs++;
+  gMemProfile.subsystems[subsystem].bytes += size;
+  gMemProfile.total.reallocs++;
+  gMemProfile.total.bytes += size;
+
+  /* Moved allocations copy the smaller of the old and new sizes */
+  if (known && newptr != ptr)
+  {
+    gMemProfile.subsystems[subsystem].copybytes += (oldsize < size) ? oldsize : size;
+    gMemProfile.total.copybytes += (oldsize < size) ? oldsize : size;
+  }
+
+  if (newptr)
+    mp_add (newptr, size, subsystem);
+
+  MEMPROFILE_UNLOCK ();
+
+  return newptr;
+}
+
+static void
+mp_free (void *ptr)
+{
+  MemEntry *entry;
+
+  if (ptr)
+  {
+    MEMPROFILE_LOCK ();
+
+    if ((entry = mp_find (ptr)))
+    {
+      gMemProfile.subsystems[entry->subsystem].frees++;
+      gMemProfile.total.frees++;
+      mp_remove (entry);
+    }
+
+    MEMPROFILE_UNLOCK ();
+  }
+
+  gMemProfile.inner.free (ptr);
+}
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Enable the library memory profiler
+ *
+ * The current ::libmseed_memory allocators are wrapped with functions
+ * that count allocations, re-allocations and frees, and track bytes
+ * currently allocated, per library subsystem.  Allocations are tagged
+ * by the subsystem of the library that requested them, see
+ * ::ms_memprof_subsystem_t, allocations made by the application via
+ * ::libmseed_memory are tagged ::MS_MEMPROF_OTHER.
+ *
+ * Memory allocated before the profiler is enabled may be freed while
+ * it is enabled, and vice versa.  Such allocations are not included
+ * in the statistics.
+ *
+ * Custom allocators should be set in ::libmseed_memory before
+ * enabling the profiler and must not be changed while it is enabled.
+ *
+ * The profiler adds a lock and table update to every allocation and
+ * is intended for diagnostics.
+ *
+ * @returns 0 on success and -1 on error
+ *
+ * \sa ms_memprofile_get()
+ * \sa ms_memprofile_print()
+ * \sa ms_memprofile_disable()
+ ***************************************************************************/
+int
+ms_memprofile_enable (void)
+{
+  if (gMemProfile.enabled)
+    return 0;
+
+  MEMPROFILE_LOCK ();
+
+  gMemProfile.inner = libmseed_memory;
+  mp_clear ();
+
+  if (mp_rehash ())
+  {
+    MEMPROFILE_UNLOCK ();
+    ms_log (2, "Cannot allocate memory for profiler\n");
+    return -1;
+  }
+
+  gMemProfile.enabled = 1;
+
+  MEMPROFILE_UNLOCK ();
+
+  libmseed_memory.malloc  = mp_malloc;
+  libmseed_memory.realloc = mp_realloc;
+  libmseed_memory.free    = mp_free;
+
+  return 0;
+} /* End of ms_memprofile_enable() */
+
+/**********************************************************************/ /**
+ * @brief Disable the library memory profiler
+ *
+ * The allocators that were set in ::libmseed_memory when the profiler
+ * was enabled are restored and all statistics are discarded.  Calls
+ * to the profiler allocators that are in progress, or that were
+ * obtained from ::libmseed_memory before disabling, continue to use
+ * the restored allocators without being profiled.
+ *
+ * @returns 0 on success and -1 if the profiler is not enabled
+ ***************************************************************************/
+int
+ms_memprofile_disable (void)
+{
+  if (!gMemProfile.enabled)
+    return -1;
+
+  MEMPROFILE_LOCK ();
+
+  libmseed_memory = gMemProfile.inner;
+
+  /* The wrapped allocators are retained for callers already in a wrapper */
+  gMemProfile.enabled = 0;
+  mp_clear ();
+
+  MEMPROFILE_UNLOCK ();
+
+  return 0;
+} /* End of ms_memprofile_disable() */
+
+/**********************************************************************/ /**
+ * @brief Reset the memory profiler counters
+ *
+ * Counts and byte totals are set to zero.  Bytes currently allocated
+ * are retained and peak values are set to the current values.
+ ***************************************************************************/
+void
+ms_memprofile_reset (void)
+{
+  int idx;
+
+  MEMPROFILE_LOCK ();
+
+  for (idx = 0; idx <= MS_MEMPROF_SUBSYSTEMS; idx++)
+  {
+    MSMemProfile *profile = (idx < MS_MEMPROF_SUBSYSTEMS) ? &gMemProfile.subsystems[idx] : &gMemProfile.total;
+
+    profile->allocs    = 0;
+    profile->reallocs  = 0;
+    profile->frees     = 0;
+    profile->bytes     = 0;
+    profile->copybytes = 0;
+    profile->peakbytes = profile->livebytes;
+  }
+
+  MEMPROFILE_UNLOCK ();
+} /* End of ms_memprofile_reset() */
+
+/**********************************************************************/ /**
+ * @brief Get memory profiler statistics
+ *
+ * @param[out] subsystems Array of ::MS_MEMPROF_SUBSYSTEMS ::MSMemProfile
+ * entries, indexed by ::ms_memprof_subsystem_t, populated with
+ * statistics per subsystem.  May be NULL.
+ * @param[out] total ::MSMemProfile populated with statistics for all
+ * subsystems.  May be NULL.
+ *
+ * @returns 0 on success and -1 if the profiler is not enabled
+ ***************************************************************************/
+int
+ms_memprofile_get (MSMemProfile *subsystems, MSMemProfile *total)
+{
+  if (!gMemProfile.enabled)
+    return -1;
+
+  MEMPROFILE_LOCK ();
+
+  if (subsystems)
+    memcpy (subsystems, gMemProfile.subsystems, sizeof (gMemProfile.subsystems));
+
+  if (total)
+    *total = gMemProfile.total;
+
+  MEMPROFILE_UNLOCK ();
+
+  return 0;
+} /* End of ms_memprofile_get() */
+
+/**********************************************************************/ /**
+ * @brief Return the name of a memory profiler subsystem
+ *
+ * @param[in] subsystem Subsystem, see ::ms_memprof_subsystem_t
+ *
+ * @returns Name of subsystem, or "unknown"
+ ***************************************************************************/
+const char *
+ms_memprofile_name (ms_memprof_subsystem_t subsystem)
+{
+  if ((int)subsystem < 0 || subsystem >= MS_MEMPROF_SUBSYSTEMS)
+    return "unknown";
+
+  return gMemProfileNames[subsystem];
+} /* End of ms_memprofile_name() */
+
+/**********************************************************************/ /**
+ * @brief Print memory profiler statistics
+ *
+ * Statistics for each subsystem with allocations and the total are
+ * printed using ms_log() at level 0.
+ ***************************************************************************/
+void
+ms_memprofile_print (void)
+{
+  MSMemProfile subsystems[MS_MEMPROF_SUBSYSTEMS];
+  MSMemProfile total;
+  uint64_t untracked;
+  int idx;
+
+  if (ms_memprofile_get (subsystems, &total))
+  {
+    ms_log (0, "Memory profiler is not enabled\n");
+    return;
+  }
+
+  ms_log (0, "%-10s %10s %10s %10s %14s %14s %12s %12s\n",
+          "Subsystem", "Allocs", "Reallocs", "Frees", "Bytes", "Copied", "Live", "Peak");
+
+  for (idx = 0; idx <= MS_MEMPROF_SUBSYSTEMS; idx++)
+  {
+    MSMemProfile *profile = (idx < MS_MEMPROF_SUBSYSTEMS) ? &subsystems[idx] : &total;
+
+    if (idx < MS_MEMPROF_SUBSYSTEMS && profile->allocs == 0 &&
+        profile->reallocs == 0 && profile->frees == 0)
+      continue;
+
+    ms_log (0, "%-10s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %14" PRIu64 " %14" PRIu64
+               " %12" PRId64 " %12" PRId64 "\n",
+            (idx < MS_MEMPROF_SUBSYSTEMS) ? gMemProfileNames[idx] : "total",
+            profile->allocs, profile->reallocs, profile->frees, profile->bytes,
+            profile->copybytes, profile->livebytes, profile->peakbytes);
+  }
+
+  MEMPROFILE_LOCK ();
+  untracked = gMemProfile.untracked;
+  MEMPROFILE_UNLOCK ();
+
+  if (untracked)
+    ms_log (0, "%" PRIu64 " allocations not tracked, live and peak bytes are incomplete\n",
+            untracked);
+} /* End of ms_memprofile_print() */
@@ -0,0 +1,74 @@
+/***************************************************************************
+ * Internal allocation wrappers that tag allocations by library subsystem
+ * for the optional memory profiler in memprofile.c
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#ifndef MEMPROFILE_H
+#define MEMPROFILE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "libmseed.h"
+
+/* Thread-local storage designation
+ *
+ * If not disabled by a defined LIBMSEED_NO_THREADING, use options for
+ * thread-local storage.
+ *
+ * Windows has its own designation for TLS.
+ * Otherwise, C11 defines the standardized _Thread_local storage-class.
+ * Otherwise fallback to the commonly supported __thread keyword.
+ */
+#if !defined(LIBMSEED_NO_THREADING)
+#if defined(LMP_WIN)
+  #define lm_thread_local __declspec( thread )
+#elif __STDC_VERSION__ >= 201112L
+  #define lm_thread_local _Thread_local
+#else
+  #define lm_thread_local __thread
+#endif
+#else
+  #define lm_thread_local
+#endif
+
+/* Subsystem of the next allocation, consumed by the profiler */
+extern lm_thread_local int ms_memprofile_tag;
+
+/* Each source file defines LM_MEMPROF_SUBSYSTEM before including this
+ * header, the allocation wrappers tag allocations with it. */
+#if !defined(LM_MEMPROF_SUBSYSTEM)
+  #define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_OTHER
+#endif
+
+#define lm_malloc(size) \
+  (ms_memprofile_tag = LM_MEMPROF_SUBSYSTEM, libmseed_memory.malloc (size))
+
+#define lm_realloc(ptr, size) \
+  (ms_memprofile_tag = LM_MEMPROF_SUBSYSTEM, libmseed_memory.realloc ((ptr), (size)))
+
+#define lm_prealloc(ptr, size, currentsize) \
+  (ms_memprofile_tag = LM_MEMPROF_SUBSYSTEM, libmseed_memory_prealloc ((ptr), (size), (currentsize)))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
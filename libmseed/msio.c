@@ -25,6 +25,14 @@
 
 #include "msio.h"
 
+#if !defined(LMP_WIN)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Amount of file data read between releases from the page cache */
+#define MSIO_RELEASESIZE 16777216
+
 /* Include libcurl library header if URL supported is requested */
 #if defined(LIBMSEED_URL)
 
@@ -432,6 +440,10 @@ msio_fclose (LMIO *io)
 
   if (io->type == LMIO_FILE || io->type == LMIO_FD)
   {
+    /* Release all file data from the page cache */
+    if (io->nocache)
+      lmp_fdropcache (io->handle, 0, 0, 0);
+
     rv = fclose (io->handle);
 
     if (rv)
@@ -455,6 +467,8 @@ msio_fclose (LMIO *io)
   io->type = LMIO_NULL;
   io->handle = NULL;
   io->handle2 = NULL;
+  io->nocache = 0;
+  io->released = 0;
 
   return 0;
 } /* End of msio_fclose() */
@@ -479,6 +493,7 @@ size_t
 msio_fread (LMIO *io, void *buffer, size_t size)
 {
   size_t read = 0;
+  int64_t position;
 
   if (!io)
     return -1;
@@ -493,6 +508,18 @@ msio_fread (LMIO *io, void *buffer, size_t size)
   if (io->type == LMIO_FILE || io->type == LMIO_FD)
   {
     read = fread (buffer, 1, size, io->handle);
+
+    /* Release consumed file data from the page cache in large ranges */
+    if (io->nocache && read > 0)
+    {
+      position = lmp_ftell64 (io->handle);
+
+      if (position - io->released >= MSIO_RELEASESIZE)
+      {
+        lmp_fdropcache (io->handle, io->released, position - io->released, 0);
+        io->released = position;
+      }
+    }
   }
   /* Read from URL stream */
   else if (io->type == LMIO_URL)
@@ -796,6 +823,47 @@ lmp_fseek64 (FILE *stream, int64_t offset, int whence)
 } /* End of lmp_fseeko() */
 
 
+/***************************************************************************
+ * lmp_fdropcache:
+ *
+ * Release a range of a file from the system page cache, such that
+ * data read or written once does not displace cached data of other
+ * processes.  A 'length' of 0 means to the end of the file.  If
+ * 'sync' is true the stream is flushed and its data written to
+ * storage first, modified pages cannot be released until written.
+ *
+ * Uses posix_fadvise(POSIX_FADV_DONTNEED) where supported and does
+ * nothing on other platforms.
+ *
+ * Returns 0 on success or if not supported and -1 on error.
+ ***************************************************************************/
+int
+lmp_fdropcache (FILE *stream, int64_t offset, int64_t length, int8_t sync)
+{
+#if defined(POSIX_FADV_DONTNEED)
+  int fd;
+
+  if (!stream)
+    return -1;
+
+  fd = fileno (stream);
+
+  if (sync && (fflush (stream) || fdatasync (fd)))
+    return -1;
+
+  if (posix_fadvise (fd, (off_t)offset, (off_t)length, POSIX_FADV_DONTNEED))
+    return -1;
+#else
+  (void)stream;
+  (void)offset;
+  (void)length;
+  (void)sync;
+#endif
+
+  return 0;
+} /* End of lmp_fdropcache() */
+
+
 /***************************************************************************
  * @brief Sleep for a specified number of nanoseconds
  *
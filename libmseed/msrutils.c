@@ -25,6 +25,9 @@
 
 #include "libmseed.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_RECORD
+#include "memprofile.h"
+
 /**********************************************************************/ /**
  * @brief Initialize and return an ::MS3Record
  *
@@ -48,7 +51,7 @@ msr3_init (MS3Record *msr)
 
   if (!msr)
   {
-    msr = (MS3Record *)libmseed_memory.malloc (sizeof (MS3Record));
+    msr = (MS3Record *)lm_malloc (sizeof (MS3Record));
   }
   else
   {
@@ -146,7 +149,7 @@ msr3_duplicate (const MS3Record *msr, int8_t datadup)
   if (msr->extralength > 0 && msr->extra)
   {
     /* Allocate memory for new FSDH structure */
-    if ((dupmsr->extra = (char *)libmseed_memory.malloc (msr->extralength)) == NULL)
+    if ((dupmsr->extra = (char *)lm_malloc (msr->extralength)) == NULL)
     {
       ms_log (2, "Error allocating memory\n");
       msr3_free (&dupmsr);
@@ -163,7 +166,7 @@ msr3_duplicate (const MS3Record *msr, int8_t datadup)
   if (datadup && msr->numsamples > 0 && msr->datasize > 0 && msr->datasamples)
   {
     /* Allocate memory for new data array */
-    if ((dupmsr->datasamples = libmseed_memory.malloc ((size_t) (msr->datasize))) == NULL)
+    if ((dupmsr->datasamples = lm_malloc ((size_t) (msr->datasize))) == NULL)
     {
       ms_log (2, "Error allocating memory\n");
       msr3_free (&dupmsr);
@@ -321,7 +324,7 @@ msr3_resize_buffer (MS3Record *msr)
 
     if (msr->datasize > datasize)
     {
-      msr->datasamples = libmseed_memory.realloc (msr->datasamples, datasize);
+      msr->datasamples = lm_realloc (msr->datasamples, datasize);
 
       if (msr->datasamples == NULL)
       {
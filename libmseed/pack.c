@@ -29,6 +29,9 @@
 #include "packdata.h"
 #include "extraheaders.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_PACK
+#include "memprofile.h"
+
 /* Internal from another source file */
 extern double ms_nomsamprate (int factor, int multiplier);
 
@@ -43,7 +46,11 @@ static int msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char
 
 static int64_t msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes,
                               char sampletype, int8_t encoding, int8_t swapflag,
-                              uint32_t *byteswritten, const char *sid, int8_t verbose);
+                              uint32_t *byteswritten, uint32_t *crc, const char *sid, int8_t verbose);
+
+static void ms_swapcopy (void *dest, const void *src, uint32_t length, int width);
+
+static void ms_swapsteim (void *data, uint32_t length, int8_t encoding);
 
 static int ms_genfactmult (double samprate, int16_t *factor, int16_t *multiplier);
 
@@ -157,7 +164,6 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
                   uint32_t flags, int8_t verbose)
 {
   char *rawrec = NULL;
-  char *encoded = NULL;  /* Separate encoded data buffer for alignment */
   int8_t swapflag;
   int dataoffset = 0;
 
@@ -173,6 +179,7 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
   uint8_t encoding;
 
   uint32_t crc;
+  uint32_t datacrc;
   uint32_t datalength;
   nstime_t nextstarttime;
   uint16_t year;
@@ -209,7 +216,7 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
   swapflag = (ms_bigendianhost ()) ? 1 : 0;
 
   /* Allocate space for data record */
-  rawrec = (char *)libmseed_memory.malloc (maxreclen);
+  rawrec = (char *)lm_malloc (maxreclen);
 
   if (rawrec == NULL)
   {
@@ -277,19 +284,6 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
     maxsamples = maxdatabytes / samplesize;
   }
 
-  /* Allocate space for encoded data separately for alignment */
-  if (msr->numsamples > 0)
-  {
-    encoded = (char *)libmseed_memory.malloc (maxdatabytes);
-
-    if (encoded == NULL)
-    {
-      ms_log (2, "%s: Cannot allocate memory\n", msr->sid);
-      libmseed_memory.free (rawrec);
-      return -1;
-    }
-  }
-
   /* Pack samples into records */
   totalpackedsamples = 0;
   packoffset = 0;
@@ -298,16 +292,16 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
 
   while ((msr->numsamples - totalpackedsamples) > maxsamples || flags & MSF_FLUSHDATA)
   {
-    packsamples = msr_pack_data (encoded,
+    /* Encode directly into record, calculating CRC of data as written */
+    packsamples = msr_pack_data (rawrec + dataoffset,
                                  (char *)msr->datasamples + packoffset,
                                  (int)(msr->numsamples - totalpackedsamples), maxdatabytes,
                                  msr->sampletype, encoding, swapflag,
-                                 &datalength, msr->sid, verbose);
+                                 &datalength, &datacrc, msr->sid, verbose);
 
     if (packsamples < 0)
     {
       ms_log (2, "%s: Error packing data samples\n", msr->sid);
-      libmseed_memory.free (encoded);
       libmseed_memory.free (rawrec);
       return -1;
     }
@@ -315,16 +309,14 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
     packoffset += packsamples * samplesize;
     reclen = dataoffset + datalength;
 
-    /* Copy encoded data into record */
-    memcpy (rawrec + dataoffset, encoded, datalength);
-
     /* Update number of samples and data length */
     *pMS3FSDH_NUMSAMPLES(rawrec) = HO4u ((uint32_t)packsamples, swapflag);
     *pMS3FSDH_DATALENGTH(rawrec) = HO4u (datalength, swapflag);
 
-    /* Calculate CRC (with CRC field set to 0) and set */
+    /* Calculate header CRC (with CRC field set to 0), combine with data CRC and set */
     memset (pMS3FSDH_CRC(rawrec), 0, sizeof(uint32_t));
-    crc = ms_crc32c ((const uint8_t*)rawrec, reclen, 0);
+    crc = ms_crc32c ((const uint8_t*)rawrec, dataoffset, 0);
+    crc = ms_crc32c_combine (crc, datacrc, datalength);
     *pMS3FSDH_CRC(rawrec) = HO4u (crc, swapflag);
 
     if (verbose >= 1)
@@ -363,9 +355,6 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
   if (verbose >= 2)
     ms_log (0, "%s: Packed %" PRId64 " total samples\n", msr->sid, totalpackedsamples);
 
-  if (encoded)
-    libmseed_memory.free (encoded);
-
   libmseed_memory.free (rawrec);
 
   return recordcnt;
@@ -381,6 +370,11 @@ msr3_pack_mseed3 (const MS3Record *msr, void (*record_handler) (char *, int, voi
  * This can be used to efficiently convert format versions or modify
  * header values without unpacking the data samples.
  *
+ * If the byte order of the encoded data does not match the order
+ * required for version 3 (big endian for Steim encodings, little
+ * endian for integer and float encodings) the data words are swapped
+ * while copying, no decoding is needed.
+ *
  * @param[in] msr ::MS3Record containing record to repack
  * @param[out] record Destination buffer for repacked record
  * @param[in] recbuflen Length of destination buffer
@@ -400,6 +394,8 @@ msr3_repack_mseed3 (const MS3Record *msr, char *record, uint32_t recbuflen,
   uint32_t crc;
   uint32_t reclen;
   int8_t swapflag;
+  int bigendianpayload;
+  int width;
 
   if (!msr || !msr->record || ! record)
   {
@@ -447,8 +443,48 @@ msr3_repack_mseed3 (const MS3Record *msr, char *record, uint32_t recbuflen,
 
   reclen = dataoffset + origdatasize;
 
-  /* Copy encoded data into record */
-  memcpy (record + dataoffset, msr->record + origdataoffset, origdatasize);
+  /* Determine if the encoded data are big endian */
+  bigendianpayload = (ms_bigendianhost ()) ? !(msr->swapflag & MSSWAP_PAYLOAD)
+                                           : (msr->swapflag & MSSWAP_PAYLOAD) != 0;
+
+  /* Determine word size to swap if payload byte order does not match version 3,
+   * integer and float encodings are little endian, Steim encodings are big endian */
+  switch (msr->encoding)
+  {
+  case DE_INT16:
+    width = (bigendianpayload) ? 2 : 0;
+    break;
+  case DE_INT32:
+  case DE_FLOAT32:
+    width = (bigendianpayload) ? 4 : 0;
+    break;
+  case DE_FLOAT64:
+    width = (bigendianpayload) ? 8 : 0;
+    break;
+  default:
+    width = 0;
+  }
+
+  /* Copy encoded data into record, swapping byte order as needed */
+  if (width)
+  {
+    if (verbose > 2)
+      ms_log (0, "%s: Swapping byte order of %d-byte data samples\n", msr->sid, width);
+
+    ms_swapcopy (record + dataoffset, msr->record + origdataoffset, origdatasize, width);
+  }
+  else
+  {
+    memcpy (record + dataoffset, msr->record + origdataoffset, origdatasize);
+
+    if ((msr->encoding == DE_STEIM1 || msr->encoding == DE_STEIM2) && !bigendianpayload)
+    {
+      if (verbose > 2)
+        ms_log (0, "%s: Swapping byte order of Steim frames\n", msr->sid);
+
+      ms_swapsteim (record + dataoffset, origdatasize, msr->encoding);
+    }
+  }
 
   /* Check to see if byte swapping is needed, miniSEED 3 is little endian */
   swapflag = (ms_bigendianhost ()) ? 1 : 0;
@@ -593,7 +629,6 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
                   uint32_t flags, int8_t verbose)
 {
   char *rawrec = NULL;
-  char *encoded = NULL;  /* Separate encoded data buffer for alignment */
   int8_t swapflag;
   uint32_t reclen;
   uint8_t encoding;
@@ -654,7 +689,7 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
   swapflag = (ms_bigendianhost ()) ? 0 : 1;
 
   /* Allocate space for data record */
-  rawrec = (char *)libmseed_memory.malloc (reclen);
+  rawrec = (char *)lm_malloc (reclen);
 
   if (rawrec == NULL)
   {
@@ -735,19 +770,6 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
     maxsamples = maxdatabytes / samplesize;
   }
 
-  /* Allocate space for encoded data separately for alignment */
-  if (msr->numsamples > 0)
-  {
-    encoded = (char *)libmseed_memory.malloc (maxdatabytes);
-
-    if (encoded == NULL)
-    {
-      ms_log (2, "%s: Cannot allocate memory\n", msr->sid);
-      libmseed_memory.free (rawrec);
-      return -1;
-    }
-  }
-
   /* Pack samples into records */
   totalpackedsamples = 0;
   packoffset = 0;
@@ -756,16 +778,16 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
 
   while ((msr->numsamples - totalpackedsamples) > maxsamples || flags & MSF_FLUSHDATA)
   {
-    packsamples = msr_pack_data (encoded,
+    /* Encode directly into record */
+    packsamples = msr_pack_data (rawrec + dataoffset,
                                  (char *)msr->datasamples + packoffset,
                                  (int)(msr->numsamples - totalpackedsamples), maxdatabytes,
                                  msr->sampletype, encoding, swapflag,
-                                 &datalength, msr->sid, verbose);
+                                 &datalength, NULL, msr->sid, verbose);
 
     if (packsamples < 0)
     {
       ms_log (2, "%s: Error packing data samples\n", msr->sid);
-      libmseed_memory.free (encoded);
       libmseed_memory.free (rawrec);
       return -1;
     }
@@ -774,16 +796,12 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
     {
       ms_log (2, "%s: Too many samples packed (%" PRId64 ") for a single v2 record)\n",
               msr->sid, packsamples);
-      libmseed_memory.free (encoded);
       libmseed_memory.free (rawrec);
       return -1;
     }
 
     packoffset += packsamples * samplesize;
 
-    /* Copy encoded data into record */
-    memcpy (rawrec + dataoffset, encoded, datalength);
-
     /* Update number of samples */
     *pMS2FSDH_NUMSAMPLES(rawrec) = HO2u ((uint16_t)packsamples, swapflag);
 
@@ -814,7 +832,6 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
     {
       ms_log (2, "%s: Cannot convert next record starttime: %" PRId64 "\n",
               msr->sid, nextstarttime);
-      libmseed_memory.free (encoded);
       libmseed_memory.free (rawrec);
       return -1;
     }
@@ -830,9 +847,6 @@ msr3_pack_mseed2 (const MS3Record *msr, void (*record_handler) (char *, int, voi
   if (verbose >= 2)
     ms_log (0, "%s: Packed %" PRId64 " total samples\n", msr->sid, totalpackedsamples);
 
-  if (encoded)
-    libmseed_memory.free (encoded);
-
   libmseed_memory.free (rawrec);
 
   return recordcnt;
@@ -1583,7 +1597,11 @@ msr3_pack_header2 (const MS3Record *msr, char *record, uint32_t recbuflen, int8_
 
 /************************************************************************
  *  Pack data samples.  The input data samples specified as 'src' will
- *  be packed with 'encoding' format and placed in 'dest'.
+ *  be packed with 'encoding' format and placed in 'dest', which does
+ *  not need to be aligned.
+ *
+ *  If 'crc' is not NULL it is set to the CRC-32C of the encoded data,
+ *  calculated as the data are written.
  *
  *  Return number of samples packed on success and a negative on error.
  *
@@ -1592,13 +1610,16 @@ msr3_pack_header2 (const MS3Record *msr, char *record, uint32_t recbuflen, int8_
 static int64_t
 msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes,
                char sampletype, int8_t encoding, int8_t swapflag,
-               uint32_t *byteswritten, const char *sid, int8_t verbose)
+               uint32_t *byteswritten, uint32_t *crc, const char *sid, int8_t verbose)
 {
   int64_t nsamples;
 
   if (byteswritten)
     *byteswritten = 0;
 
+  if (crc)
+    *crc = 0;
+
   /* Decide if this is a format that we can encode */
   switch (encoding)
   {
@@ -1613,7 +1634,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     if (verbose > 1)
       ms_log (0, "%s: Packing text data\n", sid);
 
-    nsamples = msr_encode_text ((char *)src, maxsamples, (char *)dest, maxdatabytes);
+    nsamples = msr_encode_text ((char *)src, maxsamples, dest, maxdatabytes, crc);
 
     if (byteswritten && nsamples > 0)
       *byteswritten = (uint32_t)nsamples;
@@ -1638,7 +1659,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     if (verbose > 1)
       ms_log (0, "%s: Packing INT16 data samples\n", sid);
 
-    nsamples = msr_encode_int16 ((int32_t *)src, maxsamples, (int16_t *)dest, maxdatabytes, swapflag);
+    nsamples = msr_encode_int16 ((int32_t *)src, maxsamples, dest, maxdatabytes, swapflag, crc);
 
     if (byteswritten && nsamples > 0)
       *byteswritten = (uint32_t)(nsamples * 2);
@@ -1663,7 +1684,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     if (verbose > 1)
       ms_log (0, "%s: Packing INT32 data samples\n", sid);
 
-    nsamples = msr_encode_int32 ((int32_t *)src, maxsamples, (int32_t *)dest, maxdatabytes, swapflag);
+    nsamples = msr_encode_int32 ((int32_t *)src, maxsamples, dest, maxdatabytes, swapflag, crc);
 
     if (byteswritten && nsamples > 0)
       *byteswritten = (uint32_t)(nsamples * 4);
@@ -1688,7 +1709,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     if (verbose > 1)
       ms_log (0, "%s: Packing FLOAT32 data samples\n", sid);
 
-    nsamples = msr_encode_float32 ((float *)src, maxsamples, (float *)dest, maxdatabytes, swapflag);
+    nsamples = msr_encode_float32 ((float *)src, maxsamples, dest, maxdatabytes, swapflag, crc);
 
     if (byteswritten && nsamples > 0)
       *byteswritten = (uint32_t)(nsamples * 4);
@@ -1713,7 +1734,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     if (verbose > 1)
       ms_log (0, "%s: Packing FLOAT64 data samples\n", sid);
 
-    nsamples = msr_encode_float64 ((double *)src, maxsamples, (double *)dest, maxdatabytes, swapflag);
+    nsamples = msr_encode_float64 ((double *)src, maxsamples, dest, maxdatabytes, swapflag, crc);
 
     if (byteswritten && nsamples > 0)
       *byteswritten = (uint32_t)(nsamples * 8);
@@ -1741,7 +1762,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     /* Always big endian Steim1 */
     swapflag = (ms_bigendianhost()) ? 0 : 1;
 
-    nsamples = msr_encode_steim1 ((int32_t *)src, maxsamples, (int32_t *)dest, maxdatabytes, 0, byteswritten, swapflag);
+    nsamples = msr_encode_steim1 ((int32_t *)src, maxsamples, dest, maxdatabytes, 0, byteswritten, swapflag, crc);
 
     break;
 
@@ -1766,7 +1787,7 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
     /* Always big endian Steim2 */
     swapflag = (ms_bigendianhost()) ? 0 : 1;
 
-    nsamples = msr_encode_steim2 ((int32_t *)src, maxsamples, (int32_t *)dest, maxdatabytes, 0, byteswritten, sid, swapflag);
+    nsamples = msr_encode_steim2 ((int32_t *)src, maxsamples, dest, maxdatabytes, 0, byteswritten, sid, swapflag, crc);
 
     break;
 
@@ -1779,6 +1800,116 @@ msr_pack_data (void *dest, void *src, uint64_t maxsamples, uint64_t maxdatabytes
   return nsamples;
 } /* End of msr_pack_data() */
 
+/***************************************************************************
+ * ms_swapcopy:
+ *
+ * Copy 'length' bytes from 'src' to 'dest' while reversing the byte
+ * order of each 'width' (2, 4 or 8) byte word.  Neither buffer needs to
+ * be aligned and trailing bytes of a partial word are copied as is.
+ *
+ * Words are swapped eight bytes at a time with shifts and masks, which
+ * compilers readily turn into vector instructions.
+ ***************************************************************************/
+static void
+ms_swapcopy (void *dest, const void *src, uint32_t length, int width)
+{
+  const uint8_t *input = (const uint8_t *)src;
+  uint8_t *output = (uint8_t *)dest;
+  uint64_t word;
+  uint32_t offset = 0;
+
+  for (; offset + 8 <= length; offset += 8)
+  {
+    memcpy (&word, input + offset, 8);
+
+    /* Swap bytes of 16-bit words, then 16-bit halves of 32-bit words,
+     * then 32-bit halves of the 64-bit word as needed */
+    word = ((word & 0x00FF00FF00FF00FFull) << 8) | ((word >> 8) & 0x00FF00FF00FF00FFull);
+
+    if (width >= 4)
+      word = ((word & 0x0000FFFF0000FFFFull) << 16) | ((word >> 16) & 0x0000FFFF0000FFFFull);
+
+    if (width == 8)
+      word = (word << 32) | (word >> 32);
+
+    memcpy (output + offset, &word, 8);
+  }
+
+  /* Remaining words shorter than eight bytes */
+  for (; offset + width <= length; offset += width)
+  {
+    memcpy (output + offset, input + offset, width);
+
+    if (width == 2)
+      ms_gswap2 (output + offset);
+    else if (width == 4)
+      ms_gswap4 (output + offset);
+  }
+
+  if (offset < length)
+    memcpy (output + offset, input + offset, length - offset);
+} /* End of ms_swapcopy() */
+
+/***************************************************************************
+ * ms_swapsteim:
+ *
+ * Reverse the byte order of the Steim 1 or 2 frames in 'data', in place,
+ * without decoding the differences.  Each difference is swapped within
+ * its own width as determined by the nibble of its word: 8-bit
+ * differences are left as is, 16-bit Steim-1 differences are swapped in
+ * pairs and all other words, including the nibble word and the forward
+ * and reverse integration constants, are swapped as 32-bit words.
+ *
+ * Any trailing partial frame is left unchanged.
+ ***************************************************************************/
+static void
+ms_swapsteim (void *data, uint32_t length, int8_t encoding)
+{
+  uint8_t *frame;
+  uint32_t nibbles;
+  uint32_t offset;
+  int nibble;
+  int widx;
+
+  for (offset = 0; offset + 64 <= length; offset += 64)
+  {
+    frame = (uint8_t *)data + offset;
+
+    /* Nibbles of the original byte order for the words of this frame */
+    ms_gswap4 (frame);
+    memcpy (&nibbles, frame, 4);
+
+    if (!ms_bigendianhost ())
+      ms_gswap4 (&nibbles);
+
+    /* Integration constants in the first frame */
+    if (offset == 0)
+    {
+      ms_gswap4 (frame + 4);
+      ms_gswap4 (frame + 8);
+    }
+
+    for (widx = (offset == 0) ? 3 : 1; widx < 16; widx++)
+    {
+      nibble = (nibbles >> (30 - (2 * widx))) & 0x3;
+
+      /* 00: no differences, 01: four 8-bit differences */
+      if (nibble < 2)
+        continue;
+
+      if (encoding == DE_STEIM1 && nibble == 2)
+      {
+        ms_gswap2 (frame + 4 * widx);
+        ms_gswap2 (frame + 4 * widx + 2);
+      }
+      else
+      {
+        ms_gswap4 (frame + 4 * widx);
+      }
+    }
+  }
+} /* End of ms_swapsteim() */
+
 /***************************************************************************
  * ms_ratapprox:
  *
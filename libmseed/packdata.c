@@ -26,19 +26,41 @@
 #include "libmseed.h"
 #include "packdata.h"
 
+/* Size of local blocks for fixed-width sample encodings */
+#define ENCODE_BLOCK_BYTES 256
+
+/************************************************************************
+ * Copy an encoded block to the output and update the running CRC-32C,
+ * if requested, from the local (cache resident) block so that output
+ * is written once and never re-read.
+ ************************************************************************/
+static inline void
+emit_block (uint8_t *output, const void *block, size_t length, uint32_t *crc)
+{
+  memcpy (output, block, length);
+
+  if (crc)
+    *crc = ms_crc32c ((const uint8_t *)block, (int)length, *crc);
+}
+
 /************************************************************************
  * msr_encode_text:
  *
  * Encode text data and place in supplied buffer.
  *
+ * If crc is not NULL it is set to the CRC-32C of the output bytes.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int64_t
-msr_encode_text (char *input, uint64_t samplecount, char *output,
-                 uint64_t outputlength)
+msr_encode_text (char *input, uint64_t samplecount, void *output,
+                 uint64_t outputlength, uint32_t *crc)
 {
   uint64_t length;
 
+  if (crc)
+    *crc = 0;
+
   if (samplecount == 0)
     return 0;
 
@@ -50,6 +72,9 @@ msr_encode_text (char *input, uint64_t samplecount, char *output,
 
   memcpy (output, input, length);
 
+  if (crc)
+    *crc = ms_crc32c ((const uint8_t *)input, (int)length, 0);
+
   return length;
 } /* End of msr_encode_text() */
 
@@ -59,13 +84,22 @@ msr_encode_text (char *input, uint64_t samplecount, char *output,
  * Encode 16-bit integer data from an array of 32-bit integers and
  * place in supplied buffer.  Swap if requested.
  *
+ * The output buffer does not need to be aligned.  If crc is not NULL
+ * it is set to the CRC-32C of the output bytes.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int64_t
-msr_encode_int16 (int32_t *input, uint64_t samplecount, int16_t *output,
-                  uint64_t outputlength, int swapflag)
+msr_encode_int16 (int32_t *input, uint64_t samplecount, void *output,
+                  uint64_t outputlength, int swapflag, uint32_t *crc)
 {
+  int16_t block[ENCODE_BLOCK_BYTES / sizeof (int16_t)];
+  uint8_t *outptr = (uint8_t *)output;
   uint64_t idx;
+  size_t bidx = 0;
+
+  if (crc)
+    *crc = 0;
 
   if (samplecount == 0)
     return 0;
@@ -75,14 +109,24 @@ msr_encode_int16 (int32_t *input, uint64_t samplecount, int16_t *output,
 
   for (idx = 0; idx < samplecount && outputlength >= sizeof (int16_t); idx++)
   {
-    output[idx] = (int16_t)input[idx];
+    block[bidx] = (int16_t)input[idx];
 
     if (swapflag)
-      ms_gswap2 (&output[idx]);
+      ms_gswap2 (&block[bidx]);
 
     outputlength -= sizeof (int16_t);
+
+    if (++bidx == sizeof (block) / sizeof (int16_t))
+    {
+      emit_block (outptr, block, sizeof (block), crc);
+      outptr += sizeof (block);
+      bidx = 0;
+    }
   }
 
+  if (bidx)
+    emit_block (outptr, block, bidx * sizeof (int16_t), crc);
+
   return idx;
 } /* End of msr_encode_int16() */
 
@@ -92,13 +136,22 @@ msr_encode_int16 (int32_t *input, uint64_t samplecount, int16_t *output,
  * Encode 32-bit integer data from an array of 32-bit integers and
  * place in supplied buffer.  Swap if requested.
  *
+ * The output buffer does not need to be aligned.  If crc is not NULL
+ * it is set to the CRC-32C of the output bytes.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int64_t
-msr_encode_int32 (int32_t *input, uint64_t samplecount, int32_t *output,
-                  uint64_t outputlength, int swapflag)
+msr_encode_int32 (int32_t *input, uint64_t samplecount, void *output,
+                  uint64_t outputlength, int swapflag, uint32_t *crc)
 {
+  int32_t block[ENCODE_BLOCK_BYTES / sizeof (int32_t)];
+  uint8_t *outptr = (uint8_t *)output;
   uint64_t idx;
+  size_t bidx = 0;
+
+  if (crc)
+    *crc = 0;
 
   if (samplecount == 0)
     return 0;
@@ -108,14 +161,24 @@ msr_encode_int32 (int32_t *input, uint64_t samplecount, int32_t *output,
 
   for (idx = 0; idx < samplecount && outputlength >= sizeof (int32_t); idx++)
   {
-    output[idx] = input[idx];
+    block[bidx] = input[idx];
 
     if (swapflag)
-      ms_gswap4 (&output[idx]);
+      ms_gswap4 (&block[bidx]);
 
     outputlength -= sizeof (int32_t);
+
+    if (++bidx == sizeof (block) / sizeof (int32_t))
+    {
+      emit_block (outptr, block, sizeof (block), crc);
+      outptr += sizeof (block);
+      bidx = 0;
+    }
   }
 
+  if (bidx)
+    emit_block (outptr, block, bidx * sizeof (int32_t), crc);
+
   return idx;
 } /* End of msr_encode_int32() */
 
@@ -125,13 +188,22 @@ msr_encode_int32 (int32_t *input, uint64_t samplecount, int32_t *output,
  * Encode 32-bit float data from an array of 32-bit floats and place
  * in supplied buffer.  Swap if requested.
  *
+ * The output buffer does not need to be aligned.  If crc is not NULL
+ * it is set to the CRC-32C of the output bytes.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int64_t
-msr_encode_float32 (float *input, uint64_t samplecount, float *output,
-                    uint64_t outputlength, int swapflag)
+msr_encode_float32 (float *input, uint64_t samplecount, void *output,
+                    uint64_t outputlength, int swapflag, uint32_t *crc)
 {
+  float block[ENCODE_BLOCK_BYTES / sizeof (float)];
+  uint8_t *outptr = (uint8_t *)output;
   uint64_t idx;
+  size_t bidx = 0;
+
+  if (crc)
+    *crc = 0;
 
   if (samplecount == 0)
     return 0;
@@ -141,14 +213,24 @@ msr_encode_float32 (float *input, uint64_t samplecount, float *output,
 
   for (idx = 0; idx < samplecount && outputlength >= sizeof (float); idx++)
   {
-    output[idx] = input[idx];
+    block[bidx] = input[idx];
 
     if (swapflag)
-      ms_gswap4 (&output[idx]);
+      ms_gswap4 (&block[bidx]);
 
     outputlength -= sizeof (float);
+
+    if (++bidx == sizeof (block) / sizeof (float))
+    {
+      emit_block (outptr, block, sizeof (block), crc);
+      outptr += sizeof (block);
+      bidx = 0;
+    }
   }
 
+  if (bidx)
+    emit_block (outptr, block, bidx * sizeof (float), crc);
+
   return idx;
 } /* End of msr_encode_float32() */
 
@@ -158,13 +240,22 @@ msr_encode_float32 (float *input, uint64_t samplecount, float *output,
  * Encode 64-bit float data from an array of 64-bit doubles and place
  * in supplied buffer.  Swap if requested.
  *
+ * The output buffer does not need to be aligned.  If crc is not NULL
+ * it is set to the CRC-32C of the output bytes.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int64_t
-msr_encode_float64 (double *input, uint64_t samplecount, double *output,
-                    uint64_t outputlength, int swapflag)
+msr_encode_float64 (double *input, uint64_t samplecount, void *output,
+                    uint64_t outputlength, int swapflag, uint32_t *crc)
 {
+  double block[ENCODE_BLOCK_BYTES / sizeof (double)];
+  uint8_t *outptr = (uint8_t *)output;
   uint64_t idx;
+  size_t bidx = 0;
+
+  if (crc)
+    *crc = 0;
 
   if (samplecount == 0)
     return 0;
@@ -174,17 +265,80 @@ msr_encode_float64 (double *input, uint64_t samplecount, double *output,
 
   for (idx = 0; idx < samplecount && outputlength >= sizeof (double); idx++)
   {
-    output[idx] = input[idx];
+    block[bidx] = input[idx];
 
     if (swapflag)
-      ms_gswap8 (&output[idx]);
+      ms_gswap8 (&block[bidx]);
 
     outputlength -= sizeof (double);
+
+    if (++bidx == sizeof (block) / sizeof (double))
+    {
+      emit_block (outptr, block, sizeof (block), crc);
+      outptr += sizeof (block);
+      bidx = 0;
+    }
   }
 
+  if (bidx)
+    emit_block (outptr, block, bidx * sizeof (double), crc);
+
   return idx;
 } /* End of msr_encode_float64() */
 
+/************************************************************************
+ * Build the image of a subsequent Steim frame with all zero
+ * differences from the nibble and data words, swapped if requested.
+ ************************************************************************/
+void
+steim_zeroframe (uint32_t *frame, uint32_t nibbles, uint32_t word, int swapflag)
+{
+  int idx;
+
+  frame[0] = nibbles;
+  for (idx = 1; idx < 16; idx++)
+    frame[idx] = word;
+
+  if (swapflag)
+  {
+    for (idx = 0; idx < 16; idx++)
+      ms_gswap4 (&frame[idx]);
+  }
+}
+
+/************************************************************************
+ * Determine if the next frame of differences are all zero, i.e. the
+ * pending differences are zero and enough following samples are equal
+ * to complete a frame of 'framesamples' differences.
+ *
+ * Return the number of input samples after 'inputidx' covered by the
+ * frame, or 0 if the differences are not all zero.
+ ************************************************************************/
+static inline uint64_t
+steim_zerorun (const int32_t *input, uint64_t inputidx, uint64_t samplecount,
+               const int32_t *pending, int pendingcount, int framesamples)
+{
+  uint64_t needed = framesamples - pendingcount;
+  uint64_t idx;
+
+  for (idx = 0; idx < (uint64_t)pendingcount; idx++)
+  {
+    if (pending[idx] != 0)
+      return 0;
+  }
+
+  if (samplecount - 1 - inputidx < needed)
+    return 0;
+
+  for (idx = 1; idx <= needed; idx++)
+  {
+    if (input[inputidx + idx] != input[inputidx])
+      return 0;
+  }
+
+  return needed;
+}
+
 /* Macro to determine number of bits needed to represent VALUE in
  * the following bit widths: 4,5,6,8,10,15,16,30,32 and set RESULT. */
 #define BITWIDTH(VALUE, RESULT)                       \
@@ -217,16 +371,26 @@ msr_encode_float64 (double *input, uint64_t samplecount, double *output,
  * sample to the sample previous to it (not available to this
  * function).  It should be set to 0 if this value is not known.
  *
+ * Frames are built in a local buffer and copied to the output, which
+ * does not need to be aligned.  The first frame is copied last, after
+ * the reverse integration constant is known.  If crc is not NULL it is
+ * set to the CRC-32C of the output bytes, accumulated as each frame is
+ * emitted.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  *
  * \ref MessageOnError - this function logs a message on error
  ************************************************************************/
 int64_t
-msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
+msr_encode_steim1 (int32_t *input, uint64_t samplecount, void *output,
                    uint64_t outputlength, int32_t diff0, uint32_t *byteswritten,
-                   int swapflag)
+                   int swapflag, uint32_t *crc)
 {
-  int32_t *frameptr;   /* Frame pointer in output */
+  int32_t frame0[16];  /* First frame, emitted last */
+  int32_t frameN[16];  /* Subsequent frames */
+  int32_t *frameptr;   /* Pointer to current frame */
+  uint8_t *outptr = (uint8_t *)output;
+  uint32_t crcrest = 0; /* CRC of frames after the first */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
   int32_t diffs[4];
   int32_t bitwidth[4];
@@ -234,6 +398,9 @@ msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
   uint64_t outputsamples = 0;
   uint64_t maxframes     = outputlength / 64;
   uint64_t frameidx;
+  uint64_t zerorun;
+  uint32_t zeroframe[16]; /* Image of a frame with zero differences */
+  int zeroframeset = 0;
   int diffcount     = 0;
   int packedsamples = 0;
   int startnibble;
@@ -246,6 +413,9 @@ msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
     int32_t d32;
   } * word;
 
+  if (crc)
+    *crc = 0;
+
   if (samplecount == 0)
     return 0;
 
@@ -268,7 +438,30 @@ msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
 
   for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
   {
-    frameptr = output + (16 * frameidx);
+    /* Emit a run of zero differences filling a subsequent frame from a frame image */
+    if (frameidx > 0 &&
+        (zerorun = steim_zerorun (input, inputidx, samplecount, diffs + packedsamples,
+                                  diffcount, STEIM1_FRAME_MAX_SAMPLES)) > 0)
+    {
+      if (!zeroframeset)
+      {
+        steim_zeroframe (zeroframe, STEIM1_ZERO_NIBBLES, STEIM1_ZERO_WORD, swapflag);
+        zeroframeset = 1;
+      }
+
+      memcpy (outptr + (64 * frameidx), zeroframe, 64);
+
+      if (crc)
+        crcrest = ms_crc32c ((const uint8_t *)zeroframe, 64, crcrest);
+
+      inputidx += zerorun;
+      outputsamples += STEIM1_FRAME_MAX_SAMPLES;
+      diffcount     = 0;
+      packedsamples = 0;
+      continue;
+    }
+
+    frameptr = (frameidx == 0) ? frame0 : frameN;
 
     /* Set 64-byte frame to 0's */
     memset (frameptr, 0, 64);
@@ -393,13 +586,30 @@ msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
     /* Swap word with nibbles */
     if (swapflag)
       ms_gswap4 (&frameptr[0]);
+
+    /* Emit completed subsequent frame */
+    if (frameidx > 0)
+    {
+      memcpy (outptr + (64 * frameidx), frameN, 64);
+
+      if (crc)
+        crcrest = ms_crc32c ((const uint8_t *)frameN, 64, crcrest);
+    }
   } /* Done with frames */
 
-  /* Set Xn (reverse integration constant) in first frame to last sample */
+  /* Set Xn (reverse integration constant) in first frame to last sample and emit */
   if (Xnp)
+  {
     *Xnp = *(input + outputsamples - 1);
-  if (swapflag)
-    ms_gswap4 (Xnp);
+    if (swapflag)
+      ms_gswap4 (Xnp);
+
+    memcpy (outptr, frame0, 64);
+
+    if (crc)
+      *crc = ms_crc32c_combine (ms_crc32c ((const uint8_t *)frame0, 64, 0),
+                                crcrest, (int64_t)(frameidx - 1) * 64);
+  }
 
   if (byteswritten)
     *byteswritten = (uint32_t)(frameidx * 64);
@@ -417,16 +627,26 @@ msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
  * sample to the sample previous to it (not available to this
  * function).  It should be set to 0 if this value is not known.
  *
+ * Frames are built in a local buffer and copied to the output, which
+ * does not need to be aligned.  The first frame is copied last, after
+ * the reverse integration constant is known.  If crc is not NULL it is
+ * set to the CRC-32C of the output bytes, accumulated as each frame is
+ * emitted.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  *
  * \ref MessageOnError - this function logs a message on error
  ************************************************************************/
 int64_t
-msr_encode_steim2 (int32_t *input, uint64_t samplecount, int32_t *output,
+msr_encode_steim2 (int32_t *input, uint64_t samplecount, void *output,
                    uint64_t outputlength, int32_t diff0, uint32_t *byteswritten,
-                   const char *sid, int swapflag)
+                   const char *sid, int swapflag, uint32_t *crc)
 {
-  uint32_t *frameptr;  /* Frame pointer in output */
+  uint32_t frame0[16]; /* First frame, emitted last */
+  uint32_t frameN[16]; /* Subsequent frames */
+  uint32_t *frameptr;  /* Pointer to current frame */
+  uint8_t *outptr = (uint8_t *)output;
+  uint32_t crcrest = 0; /* CRC of frames after the first */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
   int32_t diffs[7];
   int32_t bitwidth[7];
@@ -434,6 +654,9 @@ msr_encode_steim2 (int32_t *input, uint64_t samplecount, int32_t *output,
   uint64_t outputsamples = 0;
   uint64_t maxframes     = outputlength / 64;
   uint64_t frameidx;
+  uint64_t zerorun;
+  uint32_t zeroframe[16]; /* Image of a frame with zero differences */
+  int zeroframeset = 0;
   int diffcount     = 0;
   int packedsamples = 0;
   int startnibble;
@@ -446,6 +669,9 @@ msr_encode_steim2 (int32_t *input, uint64_t samplecount, int32_t *output,
     int32_t d32;
   } * word;
 
+  if (crc)
+    *crc = 0;
+
   if (samplecount == 0)
     return 0;
 
@@ -468,7 +694,30 @@ msr_encode_steim2 (int32_t *input, uint64_t samplecount, int32_t *output,
 
   for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
   {
-    frameptr = (uint32_t *)output + (16 * frameidx);
+    /* Emit a run of zero differences filling a subsequent frame from a frame image */
+    if (frameidx > 0 &&
+        (zerorun = steim_zerorun (input, inputidx, samplecount, diffs + packedsamples,
+                                  diffcount, STEIM2_FRAME_MAX_SAMPLES)) > 0)
+    {
+      if (!zeroframeset)
+      {
+        steim_zeroframe (zeroframe, STEIM2_ZERO_NIBBLES, STEIM2_ZERO_WORD, swapflag);
+        zeroframeset = 1;
+      }
+
+      memcpy (outptr + (64 * frameidx), zeroframe, 64);
+
+      if (crc)
+        crcrest = ms_crc32c ((const uint8_t *)zeroframe, 64, crcrest);
+
+      inputidx += zerorun;
+      outputsamples += STEIM2_FRAME_MAX_SAMPLES;
+      diffcount     = 0;
+      packedsamples = 0;
+      continue;
+    }
+
+    frameptr = (frameidx == 0) ? frame0 : frameN;
 
     /* Set 64-byte frame to 0's */
     memset (frameptr, 0, 64);
@@ -709,16 +958,268 @@ msr_encode_steim2 (int32_t *input, uint64_t samplecount, int32_t *output,
     /* Swap word with nibbles */
     if (swapflag)
       ms_gswap4 (&frameptr[0]);
+
+    /* Emit completed subsequent frame */
+    if (frameidx > 0)
+    {
+      memcpy (outptr + (64 * frameidx), frameN, 64);
+
+      if (crc)
+        crcrest = ms_crc32c ((const uint8_t *)frameN, 64, crcrest);
+    }
   } /* Done with frames */
 
-  /* Set Xn (reverse integration constant) in first frame to last sample */
+  /* Set Xn (reverse integration constant) in first frame to last sample and emit */
   if (Xnp)
+  {
     *Xnp = *(input + outputsamples - 1);
-  if (swapflag)
-    ms_gswap4 (Xnp);
+    if (swapflag)
+      ms_gswap4 (Xnp);
+
+    memcpy (outptr, frame0, 64);
+
+    if (crc)
+      *crc = ms_crc32c_combine (ms_crc32c ((const uint8_t *)frame0, 64, 0),
+                                crcrest, (int64_t)(frameidx - 1) * 64);
+  }
 
   if (byteswritten)
     *byteswritten = (uint32_t)(frameidx * 64);
 
   return outputsamples;
 } /* End of msr_encode_steim2() */
+
+/** @cond UNDOCUMENTED */
+
+/* Number of differences sized per block by ms_steim_size() */
+#define STEIM_SIZE_BLOCK 1024
+
+/* Words available for differences in the first and subsequent frames */
+#define STEIM_FRAME0_WORDS 13
+#define STEIM_FRAMEN_WORDS 15
+
+/************************************************************************
+ * Determine the width class of a Steim difference from the bit length
+ * of its ones' complement magnitude.
+ *
+ * Steim-1 classes: 0 = 8-bit, 1 = 16-bit, 2 = 32-bit
+ *
+ * Steim-2 classes: 0 = 4-bit, 1 = 5-bit, 2 = 6-bit, 3 = 8-bit,
+ * 4 = 10-bit, 5 = 15-bit, 6 = 30-bit, 7 = not representable
+ *
+ * With GCC or clang the bit length is a count of leading zeros and a
+ * table lookup, otherwise a branchless count of exceeded limits.
+ ************************************************************************/
+#if defined(__GNUC__) || defined(__clang__)
+static const uint8_t steim1_bitclass[33] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2};
+static const uint8_t steim2_bitclass[33] = {
+  0, 0, 0, 0, 1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 5, 6,
+  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7};
+#endif
+
+static inline uint8_t
+steim_class (uint32_t diff, int steim2)
+{
+  uint32_t mag = diff ^ (uint32_t)((int32_t)diff >> 31);
+
+#if defined(__GNUC__) || defined(__clang__)
+  int bits = 32 - __builtin_clz (mag | 1);
+
+  return (steim2) ? steim2_bitclass[bits] : steim1_bitclass[bits];
+#else
+  if (steim2)
+    return (uint8_t)((mag > 7) + (mag > 15) + (mag > 31) + (mag > 127) +
+                     (mag > 511) + (mag > 16383) + (mag > 536870911));
+
+  return (uint8_t)((mag > 127) + (mag > 32767));
+#endif
+}
+
+/************************************************************************
+ * Determine the classes of the differences of 'input' from index
+ * 'start' to 'end', the difference at index 0 must be handled by the
+ * caller.
+ ************************************************************************/
+static void
+steim1_classes (const int32_t *input, int start, int end, uint8_t *class)
+{
+  int idx;
+
+  for (idx = start; idx < end; idx++)
+    class[idx] = steim_class ((uint32_t)input[idx] - (uint32_t)input[idx - 1], 0);
+}
+
+static void
+steim2_classes (const int32_t *input, int start, int end, uint8_t *class)
+{
+  int idx;
+
+  for (idx = start; idx < end; idx++)
+    class[idx] = steim_class ((uint32_t)input[idx] - (uint32_t)input[idx - 1], 1);
+}
+
+/************************************************************************
+ * Determine the number of differences packed into a word starting at
+ * 'class', which must contain the classes of the next 7 differences,
+ * padded beyond the last difference with the largest class.
+ *
+ * The encoders choose the largest number of differences whose widest
+ * fits the width for that number:
+ *
+ * Steim-1: 4 x 8-bit, 2 x 16-bit, 1 x 32-bit
+ *
+ * Steim-2: 7 x 4-bit, 6 x 5-bit, 5 x 6-bit, 4 x 8-bit, 3 x 10-bit,
+ * 2 x 15-bit, 1 x 30-bit, or 0 if the difference is not representable
+ *
+ * For Steim-2 each difference j allows at most 7 - class[j]
+ * differences in its word, so the count is the minimum over the next
+ * differences of the larger of j and that allowance.
+ ************************************************************************/
+static inline int
+steim1_word (const uint8_t *class)
+{
+  if ((class[0] | class[1] | class[2] | class[3]) == 0)
+    return 4;
+
+  return 1 + (class[0] <= 1 && class[1] <= 1);
+}
+
+static inline int
+steim2_word (const uint8_t *class)
+{
+  int packed = 7 - class[0];
+  int allow;
+  int idx;
+
+  /* Fixed number of branchless steps, which compile to conditional moves */
+  for (idx = 1; idx < 7; idx++)
+  {
+    allow  = 7 - class[idx];
+    allow  = (allow > idx) ? allow : idx;
+    packed = (allow < packed) ? allow : packed;
+  }
+
+  return packed;
+}
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Determine the size of Steim-1 or Steim-2 encoded samples
+ *
+ * Determine how many 64-byte frames the Steim encoders would produce
+ * for an array of samples, without producing any output.  The sample
+ * packing decisions are identical to those of the encoders, so the
+ * results are exact.  This is substantially faster than encoding and
+ * is intended for choosing record boundaries and lengths before
+ * packing.
+ *
+ * If \a maxframes is 0 all samples are counted, otherwise counting
+ * stops when \a maxframes frames are full and the returned number of
+ * samples is how many fit in that many frames.
+ *
+ * The \a diff0 value is the first difference in the sequence, relating
+ * the first sample to the sample previous to it.  It should be 0 if
+ * this value is not known, as used by msr3_pack().
+ *
+ * @param[in] encoding Data encoding, ::DE_STEIM1 or ::DE_STEIM2
+ * @param[in] input Array of 32-bit integer samples
+ * @param[in] samplecount Number of samples in \a input
+ * @param[in] diff0 First difference of the sequence
+ * @param[in] maxframes Maximum number of frames, 0 for no limit
+ * @param[out] frames Number of frames needed, may be NULL
+ *
+ * @returns number of samples that fit in the frames on success, and
+ * -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms_steim_size (uint8_t encoding, const int32_t *input, uint64_t samplecount,
+               int32_t diff0, uint64_t maxframes, uint64_t *frames)
+{
+  uint8_t class[STEIM_SIZE_BLOCK + 6];
+  uint64_t maxwords = UINT64_MAX;
+  uint64_t words    = 0;
+  uint64_t diffidx  = 0; /* Next difference to pack */
+  uint64_t blockstart;
+  uint8_t padclass;
+  int available;
+  int packed;
+  int count;
+  int steim2;
+  int idx;
+
+  if (frames)
+    *frames = 0;
+
+  if (encoding != DE_STEIM1 && encoding != DE_STEIM2)
+  {
+    ms_log (2, "%s(): Unsupported encoding: %d\n", __func__, encoding);
+    return -1;
+  }
+
+  if (samplecount == 0)
+    return 0;
+
+  if (!input)
+  {
+    ms_log (2, "%s(): Required input not defined: 'input'\n", __func__);
+    return -1;
+  }
+
+  steim2   = (encoding == DE_STEIM2);
+  padclass = (steim2) ? 7 : 2;
+
+  if (maxframes > 0 && maxframes < (UINT64_MAX - STEIM_FRAME0_WORDS) / STEIM_FRAMEN_WORDS)
+    maxwords = STEIM_FRAME0_WORDS + STEIM_FRAMEN_WORDS * (maxframes - 1);
+
+  /* Differences in sequence: diff0 followed by one per sample after the first */
+  while (diffidx < samplecount && words < maxwords)
+  {
+    blockstart = diffidx;
+    count      = (samplecount - blockstart > STEIM_SIZE_BLOCK) ? STEIM_SIZE_BLOCK : (int)(samplecount - blockstart);
+
+    /* Classes of the block and the following 6 differences, padded beyond the last */
+    available = (samplecount - blockstart > (uint64_t)count + 6) ? count + 6 : (int)(samplecount - blockstart);
+    idx       = 0;
+
+    if (blockstart == 0)
+      class[idx++] = steim_class ((uint32_t)diff0, steim2);
+
+    if (steim2)
+      steim2_classes (input + blockstart, idx, available, class);
+    else
+      steim1_classes (input + blockstart, idx, available, class);
+
+    for (idx = available; idx < count + 6; idx++)
+      class[idx] = padclass;
+
+    /* Walk words through the block, the last word may extend past it */
+    while (diffidx < blockstart + count && words < maxwords)
+    {
+      if (steim2)
+      {
+        if ((packed = steim2_word (class + (diffidx - blockstart))) == 0)
+        {
+          ms_log (2, "%s(): Unable to represent difference in <= 30 bits at sample %" PRIu64 "\n",
+                  __func__, diffidx);
+          return -1;
+        }
+      }
+      else
+      {
+        packed = steim1_word (class + (diffidx - blockstart));
+      }
+
+      diffidx += packed;
+      words++;
+    }
+  }
+
+  if (frames)
+    *frames = (words <= STEIM_FRAME0_WORDS) ? 1 : 1 + (words - STEIM_FRAME0_WORDS + STEIM_FRAMEN_WORDS - 1) / STEIM_FRAMEN_WORDS;
+
+  return (int64_t)diffidx;
+} /* End of ms_steim_size() */
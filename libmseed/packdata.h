@@ -31,22 +31,31 @@ extern "C" {
 #define STEIM1_FRAME_MAX_SAMPLES 60
 #define STEIM2_FRAME_MAX_SAMPLES 105
 
-extern int64_t msr_encode_text (char *input, uint64_t samplecount, char *output,
-                                uint64_t outputlength);
-extern int64_t msr_encode_int16 (int32_t *input, uint64_t samplecount, int16_t *output,
-                                 uint64_t outputlength, int swapflag);
-extern int64_t msr_encode_int32 (int32_t *input, uint64_t samplecount, int32_t *output,
-                                 uint64_t outputlength, int swapflag);
-extern int64_t msr_encode_float32 (float *input, uint64_t samplecount, float *output,
-                                   uint64_t outputlength, int swapflag);
-extern int64_t msr_encode_float64 (double *input, uint64_t samplecount, double *output,
-                                   uint64_t outputlength, int swapflag);
-extern int64_t msr_encode_steim1 (int32_t *input, uint64_t samplecount, int32_t *output,
+/* Nibble word and data words of a subsequent frame with all zero
+ * differences, in host byte order, as produced by the encoders */
+#define STEIM1_ZERO_NIBBLES 0x15555555ul
+#define STEIM1_ZERO_WORD    0x00000000ul
+#define STEIM2_ZERO_NIBBLES 0x3FFFFFFFul
+#define STEIM2_ZERO_WORD    0x80000000ul
+
+extern void steim_zeroframe (uint32_t *frame, uint32_t nibbles, uint32_t word, int swapflag);
+
+extern int64_t msr_encode_text (char *input, uint64_t samplecount, void *output,
+                                uint64_t outputlength, uint32_t *crc);
+extern int64_t msr_encode_int16 (int32_t *input, uint64_t samplecount, void *output,
+                                 uint64_t outputlength, int swapflag, uint32_t *crc);
+extern int64_t msr_encode_int32 (int32_t *input, uint64_t samplecount, void *output,
+                                 uint64_t outputlength, int swapflag, uint32_t *crc);
+extern int64_t msr_encode_float32 (float *input, uint64_t samplecount, void *output,
+                                   uint64_t outputlength, int swapflag, uint32_t *crc);
+extern int64_t msr_encode_float64 (double *input, uint64_t samplecount, void *output,
+                                   uint64_t outputlength, int swapflag, uint32_t *crc);
+extern int64_t msr_encode_steim1 (int32_t *input, uint64_t samplecount, void *output,
                                   uint64_t outputlength, int32_t diff0, uint32_t *byteswritten,
-                                  int swapflag);
-extern int64_t msr_encode_steim2 (int32_t *input, uint64_t samplecount, int32_t *output,
+                                  int swapflag, uint32_t *crc);
+extern int64_t msr_encode_steim2 (int32_t *input, uint64_t samplecount, void *output,
                                   uint64_t outputlength, int32_t diff0, uint32_t *byteswritten,
-                                  const char *sid, int swapflag);
+                                  const char *sid, int swapflag, uint32_t *crc);
 
 #ifdef __cplusplus
 }
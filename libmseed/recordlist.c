@@ -0,0 +1,848 @@
+/***************************************************************************
+ * Routines for compact record lists, an alternative storage for the
+ * record lists of trace list segments that keeps fixed-size entries in
+ * per-segment arrays with record locations in a table shared by the
+ * trace list.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+#include "mseedformat.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+/** @cond UNDOCUMENTED */
+
+/* Record source, a file or a buffer */
+typedef struct RLSource
+{
+  char *filename;        /* File name, owned by table, NULL for buffer */
+  const char *buffer;    /* Buffer containing records, NULL for file */
+} RLSource;
+
+/* Record source table for a trace list, at MS3TraceList.recordsources */
+typedef struct RLSources
+{
+  RLSource *sources;     /* Array of sources, indexed by entry source ID */
+  uint32_t count;        /* Number of sources in array */
+  uint32_t capacity;     /* Allocated capacity of array */
+  int8_t pending;        /* Location of next added record is set */
+  uint32_t pendingid;    /* Source ID of next added record */
+  int64_t pendingoffset; /* Offset of next added record in source */
+  uint32_t pendingdataoffset; /* Offset to encoded data in next added record */
+} RLSources;
+
+/* Compact record list entry, 32 bytes */
+typedef struct RLEntry
+{
+  int64_t offset;        /* Offset to record in file or buffer */
+  nstime_t enddelta;     /* Record end time relative to RLCompact.basetime */
+  uint32_t sourceid;     /* Index into record source table */
+  uint32_t reclen;       /* Length of record in bytes */
+  uint32_t samplecnt;    /* Number of samples in record */
+  uint16_t dataoffset;   /* Offset to encoded data, 0 if larger than 16 bits */
+  uint8_t encoding;      /* Data encoding */
+  uint8_t swapflag;      /* Byte swap flags */
+} RLEntry;
+
+/* Compact storage for a record list, at MS3RecordList.compact */
+typedef struct RLCompact
+{
+  RLEntry *entries;      /* Allocated entry array, first entry at 'start' */
+  uint64_t start;        /* Index of first entry, space is left to prepend */
+  uint64_t capacity;     /* Allocated capacity of entry array */
+  nstime_t basetime;     /* Base time for entry end time deltas */
+  RLSources *table;      /* Record source table of trace list */
+  char *records;         /* Kept record copies, see MSF_KEEPRECORDS */
+  uint64_t recordsize;   /* Bytes of kept records */
+  uint64_t recordcapacity; /* Allocated size of kept records */
+} RLCompact;
+
+/* Source ID of entries for records kept in RLCompact.records */
+#define RLSOURCE_KEPT (UINT32_MAX - 1)
+
+int mstl3_reclist_source (MS3TraceList *mstl, const char *filename, const char *buffer,
+                          int64_t offset, uint32_t dataoffset);
+int mstl3_reclist_add (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                       nstime_t endtime, int8_t whence);
+int mstl3_reclist_keep (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                        nstime_t endtime, int8_t whence);
+int mstl3_reclist_merge (MS3RecordList *recordlist1, MS3RecordList *recordlist2);
+void mstl3_reclist_release (MS3RecordList *recordlist);
+void mstl3_reclist_free (MS3TraceList *mstl);
+MS3RecordPtr *mstl3_reclist_next (const MS3RecordList *recordlist, const MS3RecordPtr *recordptr,
+                                  uint64_t *index, MS3RecordPtr *view, MS3Record *viewmsr);
+uint32_t mstl3_reclist_dataoffset (const char *record);
+int64_t mstl3_reclist_addfile (MS3TraceList *mstl, const char *filename);
+int mstl3_reclist_append (MS3TraceList *mstl, MS3TraceSeg *seg, uint32_t sourceid, int64_t offset,
+                          uint32_t dataoffset, const MS3Record *msr, nstime_t endtime);
+
+static int64_t add_source (MS3TraceList *mstl, const char *filename, const char *buffer);
+static RLEntry *add_entry (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                           nstime_t endtime, int8_t whence);
+static int reserve_entries (RLCompact *compact, uint64_t count, uint64_t needed, int8_t front);
+static int reserve_records (RLCompact *compact, uint64_t needed);
+
+/** @endcond */
+
+/***************************************************************************
+ * Set the location of the next record added to a compact record list
+ * of the trace list, either a file name or a buffer, the offset of the
+ * record in the source and the offset to the encoded data.
+ *
+ * A new source table entry is only created when the source differs
+ * from the most recently set source.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_reclist_source (MS3TraceList *mstl, const char *filename, const char *buffer,
+                      int64_t offset, uint32_t dataoffset)
+{
+  RLSources *table;
+  RLSource *source;
+  int64_t sourceid;
+
+  if (!mstl || (!filename && !buffer))
+    return -1;
+
+  table = (RLSources *)mstl->recordsources;
+  source = (table && table->count > 0) ? &table->sources[table->count - 1] : NULL;
+
+  /* Add a new source if different from the last */
+  if (!source ||
+      (buffer && source->buffer != buffer) ||
+      (filename && (!source->filename || strcmp (source->filename, filename))))
+  {
+    if ((sourceid = add_source (mstl, filename, buffer)) < 0)
+      return -1;
+
+    table = (RLSources *)mstl->recordsources;
+  }
+
+  table->pending = 1;
+  table->pendingid = table->count - 1;
+  table->pendingoffset = offset;
+  table->pendingdataoffset = dataoffset;
+
+  return 0;
+} /* End of mstl3_reclist_source() */
+
+/***************************************************************************
+ * Add an entry for a record to the compact record list of a segment,
+ * using the location set by mstl3_reclist_source().  The 'whence'
+ * values are the same as for mstl3_add_recordptr().
+ *
+ * The location is consumed, records added without a location are
+ * recorded with an unknown source and cannot be unpacked.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_reclist_add (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                   nstime_t endtime, int8_t whence)
+{
+  RLSources *table = (RLSources *)mstl->recordsources;
+  RLEntry *entry;
+
+  if ((entry = add_entry (mstl, seg, msr, endtime, whence)) == NULL)
+    return -1;
+
+  if (table && table->pending)
+  {
+    entry->sourceid = table->pendingid;
+    entry->offset = table->pendingoffset;
+    entry->dataoffset = (table->pendingdataoffset <= UINT16_MAX) ? (uint16_t)table->pendingdataoffset : 0;
+    table->pending = 0;
+  }
+  else
+  {
+    entry->sourceid = UINT32_MAX;
+    entry->offset = 0;
+    entry->dataoffset = 0;
+  }
+
+  return 0;
+} /* End of mstl3_reclist_add() */
+
+/***************************************************************************
+ * Add an entry for a record to the compact record list of a segment
+ * with a copy of the record kept in the list, for ::MSF_KEEPRECORDS.
+ * The record must be available at MS3Record.record.  The 'whence'
+ * values are the same as for mstl3_add_recordptr().
+ *
+ * Records are appended to the kept storage of the segment in the order
+ * they are added, the entries locate them in time order.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_reclist_keep (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                    nstime_t endtime, int8_t whence)
+{
+  RLCompact *compact;
+  RLEntry *entry;
+  uint32_t dataoffset;
+  uint32_t datasize;
+
+  if (!msr->record || msr->reclen <= 0)
+  {
+    ms_log (2, "%s: Record is not available to keep in record list\n", msr->sid);
+    return -1;
+  }
+
+  if (msr3_data_bounds (msr, &dataoffset, &datasize))
+    return -1;
+
+  if ((entry = add_entry (mstl, seg, msr, endtime, whence)) == NULL)
+    return -1;
+
+  compact = (RLCompact *)seg->recordlist->compact;
+
+  if (reserve_records (compact, (uint64_t)msr->reclen))
+  {
+    /* Remove the entry, it was added at the start or end */
+    if (whence == 2)
+      compact->start++;
+
+    seg->recordlist->recordcnt -= 1;
+    return -1;
+  }
+
+  memcpy (compact->records + compact->recordsize, msr->record, (size_t)msr->reclen);
+
+  entry->sourceid = RLSOURCE_KEPT;
+  entry->offset = (int64_t)compact->recordsize;
+  entry->dataoffset = (dataoffset <= UINT16_MAX) ? (uint16_t)dataoffset : 0;
+
+  compact->recordsize += (uint64_t)msr->reclen;
+
+  return 0;
+} /* End of mstl3_reclist_keep() */
+
+/***************************************************************************
+ * Add a file to the record source table of the trace list, even if the
+ * same file is already in the table.
+ *
+ * Returns the source ID of the file on success and -1 on error.
+ ***************************************************************************/
+int64_t
+mstl3_reclist_addfile (MS3TraceList *mstl, const char *filename)
+{
+  if (!mstl || !filename)
+    return -1;
+
+  return add_source (mstl, filename, NULL);
+} /* End of mstl3_reclist_addfile() */
+
+/***************************************************************************
+ * Append an entry for a record to the end of the compact record list
+ * of a segment with an explicit location, a source ID returned by
+ * mstl3_reclist_addfile() and the offsets of the record and its
+ * encoded data.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_reclist_append (MS3TraceList *mstl, MS3TraceSeg *seg, uint32_t sourceid, int64_t offset,
+                      uint32_t dataoffset, const MS3Record *msr, nstime_t endtime)
+{
+  RLEntry *entry;
+
+  if ((entry = add_entry (mstl, seg, msr, endtime, 1)) == NULL)
+    return -1;
+
+  entry->sourceid = sourceid;
+  entry->offset = offset;
+  entry->dataoffset = (dataoffset <= UINT16_MAX) ? (uint16_t)dataoffset : 0;
+
+  return 0;
+} /* End of mstl3_reclist_append() */
+
+/***************************************************************************
+ * Append the entries of compact record list 2 to compact record list 1
+ * and release the compact storage of list 2.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_reclist_merge (MS3RecordList *recordlist1, MS3RecordList *recordlist2)
+{
+  RLCompact *compact1 = (RLCompact *)recordlist1->compact;
+  RLCompact *compact2 = (RLCompact *)recordlist2->compact;
+  RLEntry *entry;
+  nstime_t shift;
+  uint64_t idx;
+
+  if (!compact1 || !compact2 || recordlist1->first || recordlist2->first)
+  {
+    ms_log (2, "Cannot merge compact and linked record lists\n");
+    return -1;
+  }
+
+  if (reserve_entries (compact1, recordlist1->recordcnt, recordlist2->recordcnt, 0))
+    return -1;
+
+  if (compact2->recordsize > 0 && reserve_records (compact1, compact2->recordsize))
+    return -1;
+
+  /* Copy entries, adjusting end time deltas to the base time of list 1 */
+  shift = compact2->basetime - compact1->basetime;
+  entry = &compact1->entries[compact1->start + recordlist1->recordcnt];
+
+  memcpy (entry, &compact2->entries[compact2->start], (size_t)(recordlist2->recordcnt * sizeof (RLEntry)));
+
+  for (idx = 0; idx < recordlist2->recordcnt; idx++)
+  {
+    entry[idx].enddelta += shift;
+
+    /* Relocate kept records after those of list 1 */
+    if (entry[idx].sourceid == RLSOURCE_KEPT)
+      entry[idx].offset += (int64_t)compact1->recordsize;
+  }
+
+  if (compact2->recordsize > 0)
+  {
+    memcpy (compact1->records + compact1->recordsize, compact2->records, (size_t)compact2->recordsize);
+    compact1->recordsize += compact2->recordsize;
+  }
+
+  recordlist1->recordcnt += recordlist2->recordcnt;
+
+  mstl3_reclist_release (recordlist2);
+
+  return 0;
+} /* End of mstl3_reclist_merge() */
+
+/***************************************************************************
+ * Free the compact storage of a record list.
+ ***************************************************************************/
+void
+mstl3_reclist_release (MS3RecordList *recordlist)
+{
+  RLCompact *compact;
+
+  if (!recordlist || !recordlist->compact)
+    return;
+
+  compact = (RLCompact *)recordlist->compact;
+
+  if (compact->entries)
+    libmseed_memory.free (compact->entries);
+
+  if (compact->records)
+    libmseed_memory.free (compact->records);
+
+  libmseed_memory.free (compact);
+
+  recordlist->compact = NULL;
+  recordlist->recordcnt = 0;
+} /* End of mstl3_reclist_release() */
+
+/***************************************************************************
+ * Free the record source table of a trace list.
+ ***************************************************************************/
+void
+mstl3_reclist_free (MS3TraceList *mstl)
+{
+  RLSources *table;
+  uint32_t idx;
+
+  if (!mstl || !mstl->recordsources)
+    return;
+
+  table = (RLSources *)mstl->recordsources;
+
+  for (idx = 0; idx < table->count; idx++)
+    if (table->sources[idx].filename)
+      libmseed_memory.free (table->sources[idx].filename);
+
+  if (table->sources)
+    libmseed_memory.free (table->sources);
+
+  libmseed_memory.free (table);
+
+  mstl->recordsources = NULL;
+} /* End of mstl3_reclist_free() */
+
+/***************************************************************************
+ * Iterate the entries of a record list of either form.
+ *
+ * For a linked list the next ::MS3RecordPtr in the list is returned.
+ * For a compact list the 'view' and 'viewmsr' structures are populated
+ * from the entry at the next index and 'view' is returned.  Only the
+ * record length, sample count, encoding and swap flag are set in
+ * 'viewmsr'.
+ *
+ * Start iteration with 'recordptr' set to NULL.
+ *
+ * Returns the next record pointer or NULL when the list is complete.
+ ***************************************************************************/
+MS3RecordPtr *
+mstl3_reclist_next (const MS3RecordList *recordlist, const MS3RecordPtr *recordptr,
+                    uint64_t *index, MS3RecordPtr *view, MS3Record *viewmsr)
+{
+  RLCompact *compact;
+  RLEntry *entry;
+  RLSource *source = NULL;
+
+  if (!recordlist)
+    return NULL;
+
+  if (!recordlist->compact)
+    return (recordptr) ? recordptr->next : recordlist->first;
+
+  compact = (RLCompact *)recordlist->compact;
+  *index = (recordptr) ? *index + 1 : 0;
+
+  if (*index >= recordlist->recordcnt)
+    return NULL;
+
+  entry = &compact->entries[compact->start + *index];
+
+  if (compact->table && entry->sourceid < compact->table->count)
+    source = &compact->table->sources[entry->sourceid];
+
+  memset (view, 0, sizeof (MS3RecordPtr));
+
+  if (entry->sourceid == RLSOURCE_KEPT)
+    view->bufferptr = compact->records + entry->offset;
+  else
+    view->bufferptr = (source && source->buffer) ? source->buffer + entry->offset : NULL;
+
+  view->filename = (source) ? source->filename : NULL;
+  view->fileoffset = entry->offset;
+  view->endtime = compact->basetime + entry->enddelta;
+  view->dataoffset = entry->dataoffset;
+  view->msr = viewmsr;
+
+  memset (viewmsr, 0, sizeof (MS3Record));
+  viewmsr->reclen = (int32_t)entry->reclen;
+  viewmsr->samplecnt = entry->samplecnt;
+  viewmsr->encoding = (int8_t)entry->encoding;
+  viewmsr->swapflag = entry->swapflag;
+
+  return view;
+} /* End of mstl3_reclist_next() */
+
+/***************************************************************************
+ * Determine the offset to encoded data from the header of a miniSEED
+ * version 3 record, used for compact entries with offsets that do not
+ * fit the entry.
+ *
+ * Returns the offset on success and 0 if the record is not version 3.
+ ***************************************************************************/
+uint32_t
+mstl3_reclist_dataoffset (const char *record)
+{
+  if (!record || !MS3_ISVALIDHEADER (record))
+    return 0;
+
+  return MS3FSDH_LENGTH + *pMS3FSDH_SIDLENGTH (record) +
+         HO2u (*pMS3FSDH_EXTRALENGTH (record), ms_bigendianhost ());
+} /* End of mstl3_reclist_dataoffset() */
+
+/**********************************************************************/ /**
+ * @brief Get an entry of a @ref record-list and optionally the record
+ *
+ * Populate \a recordptr with the location, end time and data offset
+ * of the record at \a index in \a recordlist.  This works for both
+ * linked and compact (::MSF_COMPACTRECLIST) record lists and is the
+ * only way to access the entries of compact lists.  The
+ * ::MS3RecordPtr.msr and ::MS3RecordPtr.next values are set to NULL.
+ *
+ * If \a ppmsr is not NULL the record is read from its buffer or file
+ * and parsed into a new ::MS3Record at \a *ppmsr, using \a flags as
+ * for msr3_parse().  A compact list does not retain parsed records,
+ * they are only created on demand by this function.  The caller is
+ * responsible for freeing the record with msr3_free().
+ *
+ * The entries of a list are in time order, this function locates an
+ * entry of a linked list by traversal.
+ *
+ * @param[in] recordlist ::MS3RecordList of a ::MS3TraceSeg
+ * @param[in] index Index of entry in list, from 0 to \a recordcnt - 1
+ * @param[out] recordptr ::MS3RecordPtr to populate, can be NULL
+ * @param[out] ppmsr Pointer-to-pointer for a parsed ::MS3Record, can be NULL
+ * @param[in] flags Flags for parsing the record, see msr3_parse()
+ * @param[in] verbose Controls logging verbosity, 0 is no diagnostic output
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_unpack_recordlist()
+ ***************************************************************************/
+int
+mstl3_recordlist_entry (const MS3RecordList *recordlist, uint64_t index,
+                        MS3RecordPtr *recordptr, MS3Record **ppmsr,
+                        uint32_t flags, int8_t verbose)
+{
+  MS3RecordPtr view;
+  MS3Record viewmsr;
+  const MS3RecordPtr *entry = NULL;
+  char *record = NULL;
+  FILE *fp;
+  uint64_t iterindex = 0;
+  uint64_t idx;
+  int retval = 0;
+
+  if (!recordlist)
+  {
+    ms_log (2, "%s(): Required input not defined: 'recordlist'\n", __func__);
+    return -1;
+  }
+
+  if (index >= recordlist->recordcnt)
+  {
+    ms_log (2, "Record list index %" PRIu64 " is beyond count of %" PRIu64 "\n",
+            index, recordlist->recordcnt);
+    return -1;
+  }
+
+  /* Locate entry by index */
+  if (recordlist->compact)
+  {
+    iterindex = index - 1;
+    entry = mstl3_reclist_next (recordlist, (index) ? &view : NULL, &iterindex, &view, &viewmsr);
+  }
+  else
+  {
+    for (entry = recordlist->first, idx = 0; entry && idx < index; idx++)
+      entry = entry->next;
+  }
+
+  if (!entry)
+  {
+    ms_log (2, "Record list entry %" PRIu64 " not found\n", index);
+    return -1;
+  }
+
+  if (recordptr)
+  {
+    *recordptr = *entry;
+    recordptr->msr = NULL;
+    recordptr->next = NULL;
+    recordptr->prvtptr = NULL;
+  }
+
+  if (!ppmsr)
+    return 0;
+
+  /* Create record on demand, duplicating a retained record when available */
+  if (!recordlist->compact && entry->msr)
+  {
+    if (*ppmsr)
+      msr3_free (ppmsr);
+
+    if ((*ppmsr = msr3_duplicate (entry->msr, 0)) == NULL)
+    {
+      ms_log (2, "Cannot duplicate record\n");
+      return -1;
+    }
+
+    return 0;
+  }
+
+  if (entry->bufferptr)
+  {
+    record = (char *)entry->bufferptr;
+  }
+  else if (entry->fileptr || entry->filename)
+  {
+    if ((record = lm_malloc (entry->msr->reclen)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for record\n");
+      return -1;
+    }
+
+    fp = (entry->fileptr) ? entry->fileptr : fopen (entry->filename, "rb");
+
+    if (!fp)
+    {
+      ms_log (2, "Cannot open file (%s): %s\n", entry->filename, strerror (errno));
+      libmseed_memory.free (record);
+      return -1;
+    }
+
+    if (lmp_fseek64 (fp, entry->fileoffset, SEEK_SET) ||
+        fread (record, 1, entry->msr->reclen, fp) != (size_t)entry->msr->reclen)
+    {
+      ms_log (2, "Cannot read record from file: %s (%s)\n",
+              (entry->filename) ? entry->filename : "", strerror (errno));
+      retval = -1;
+    }
+
+    if (!entry->fileptr)
+      fclose (fp);
+  }
+  else
+  {
+    ms_log (2, "No buffer or file for record list entry %" PRIu64 "\n", index);
+    return -1;
+  }
+
+  if (retval == 0 && msr3_parse (record, entry->msr->reclen, ppmsr, flags, verbose))
+  {
+    ms_log (2, "Cannot parse record for record list entry %" PRIu64 "\n", index);
+    retval = -1;
+  }
+
+  /* Parsed record references the read buffer, which is not retained */
+  if (retval == 0 && record != entry->bufferptr)
+    (*ppmsr)->record = NULL;
+
+  if (record != entry->bufferptr)
+    libmseed_memory.free (record);
+
+  return retval;
+} /* End of mstl3_recordlist_entry() */
+
+/***************************************************************************
+ * Add a source, a file name or a buffer, to the end of the record
+ * source table of a trace list, allocating the table if needed.
+ *
+ * Returns the source ID on success and -1 on error.
+ ***************************************************************************/
+static int64_t
+add_source (MS3TraceList *mstl, const char *filename, const char *buffer)
+{
+  RLSources *table;
+  RLSource *source;
+  RLSource *sources;
+  uint32_t capacity;
+
+  if (!mstl->recordsources)
+  {
+    if ((mstl->recordsources = lm_malloc (sizeof (RLSources))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for record source table\n");
+      return -1;
+    }
+
+    memset (mstl->recordsources, 0, sizeof (RLSources));
+  }
+
+  table = (RLSources *)mstl->recordsources;
+
+  if (table->count == UINT32_MAX)
+  {
+    ms_log (2, "Too many record sources for trace list\n");
+    return -1;
+  }
+
+  if (table->count == table->capacity)
+  {
+    capacity = (table->capacity) ? table->capacity * 2 : 16;
+
+    if ((sources = lm_realloc (table->sources, capacity * sizeof (RLSource))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for record source table\n");
+      return -1;
+    }
+
+    table->sources = sources;
+    table->capacity = capacity;
+  }
+
+  source = &table->sources[table->count];
+  source->filename = NULL;
+  source->buffer = buffer;
+
+  if (filename)
+  {
+    if ((source->filename = lm_malloc (strlen (filename) + 1)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for record source name\n");
+      return -1;
+    }
+
+    strcpy (source->filename, filename);
+    source->buffer = NULL;
+  }
+
+  return table->count++;
+} /* End of add_source() */
+
+/***************************************************************************
+ * Add an entry to the compact record list of a segment, allocating the
+ * list if needed, and set all values except the record location.  The
+ * 'whence' values are the same as for mstl3_add_recordptr().
+ *
+ * Returns a pointer to the entry on success and NULL on error.
+ ***************************************************************************/
+static RLEntry *
+add_entry (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+           nstime_t endtime, int8_t whence)
+{
+  RLCompact *compact;
+  RLEntry *entry;
+
+  if (seg->recordlist && seg->recordlist->first)
+  {
+    ms_log (2, "%s: Cannot add compact record entry to a linked record list\n", msr->sid);
+    return NULL;
+  }
+
+  if (msr->samplecnt > UINT32_MAX || msr->reclen < 0)
+  {
+    ms_log (2, "%s: Record cannot be represented in compact record list\n", msr->sid);
+    return NULL;
+  }
+
+  /* Allocate record list and compact storage if needed */
+  if (!seg->recordlist)
+  {
+    if ((seg->recordlist = lm_malloc (sizeof (MS3RecordList))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    memset (seg->recordlist, 0, sizeof (MS3RecordList));
+  }
+
+  if (!seg->recordlist->compact)
+  {
+    if ((compact = lm_malloc (sizeof (RLCompact))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    memset (compact, 0, sizeof (RLCompact));
+    compact->basetime = endtime;
+    seg->recordlist->compact = compact;
+    seg->recordlist->recordcnt = 0;
+  }
+
+  compact = (RLCompact *)seg->recordlist->compact;
+  compact->table = (RLSources *)mstl->recordsources;
+
+  if (reserve_entries (compact, seg->recordlist->recordcnt, 1, (whence == 2) ? 1 : 0))
+    return NULL;
+
+  /* Beginning of list */
+  if (whence == 2)
+  {
+    compact->start--;
+    entry = &compact->entries[compact->start];
+  }
+  /* End of list */
+  else
+  {
+    entry = &compact->entries[compact->start + seg->recordlist->recordcnt];
+  }
+
+  entry->enddelta = endtime - compact->basetime;
+  entry->reclen = (uint32_t)msr->reclen;
+  entry->samplecnt = (uint32_t)msr->samplecnt;
+  entry->encoding = (uint8_t)msr->encoding;
+  entry->swapflag = msr->swapflag;
+
+  seg->recordlist->recordcnt += 1;
+
+  return entry;
+} /* End of add_entry() */
+
+/***************************************************************************
+ * Ensure space for 'needed' more entries in a compact record list
+ * holding 'count' entries, at the end or, if 'front' is true, before
+ * the first entry.  Space at the front is created by moving entries to
+ * the middle of a larger array, so repeated prepending is amortized.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+reserve_entries (RLCompact *compact, uint64_t count, uint64_t needed, int8_t front)
+{
+  RLEntry *entries;
+  uint64_t capacity;
+  uint64_t start;
+
+  if (front && compact->start >= needed)
+    return 0;
+
+  if (!front && compact->start + count + needed <= compact->capacity)
+    return 0;
+
+  /* Grow to at least double, with space on both sides when prepending */
+  capacity = (compact->capacity) ? compact->capacity * 2 : 8;
+  while (capacity < count + needed + ((front) ? count / 2 + needed : 0))
+    capacity *= 2;
+
+  /* Center entries when prepending, otherwise start at the beginning */
+  start = (front) ? capacity - count - (capacity - count - needed) / 2 : 0;
+
+  if ((entries = lm_malloc ((size_t)(capacity * sizeof (RLEntry)))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for compact record list\n");
+    return -1;
+  }
+
+  if (compact->entries)
+  {
+    memcpy (&entries[start], &compact->entries[compact->start], (size_t)(count * sizeof (RLEntry)));
+    libmseed_memory.free (compact->entries);
+  }
+
+  compact->entries = entries;
+  compact->start = start;
+  compact->capacity = capacity;
+
+  return 0;
+} /* End of reserve_entries() */
+
+/***************************************************************************
+ * Ensure space for 'needed' more bytes of kept records in a compact
+ * record list, growing by half of the current size to limit unused
+ * space in lists that are kept in memory.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+reserve_records (RLCompact *compact, uint64_t needed)
+{
+  char *records;
+  uint64_t capacity;
+
+  if (compact->recordsize + needed <= compact->recordcapacity)
+    return 0;
+
+  capacity = compact->recordcapacity + compact->recordcapacity / 2;
+
+  if (capacity < compact->recordsize + needed)
+    capacity = compact->recordsize + needed;
+
+  if ((records = lm_realloc (compact->records, (size_t)capacity)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for kept records\n");
+    return -1;
+  }
+
+  compact->records = records;
+  compact->recordcapacity = capacity;
+
+  return 0;
+} /* End of reserve_records() */
@@ -0,0 +1,730 @@
+/***************************************************************************
+ * Retention-bounded buffer of recent time series data.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+#if !defined(LMP_WIN) && !defined(LIBMSEED_NO_THREADING)
+#define LM_RTBUFFER_THREADS 1
+#include <pthread.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+/* Initial number of source ID slots, a power of 2 */
+#define RTBUFFER_INITIALSLOTS 64
+
+/* Default number of samples per block */
+#define RTBUFFER_BLOCKSAMPLES 4096
+
+/* Run of contiguous samples in a block, the samples follow the structure */
+typedef struct RTRun
+{
+  nstime_t starttime;  /* Time of first sample */
+  nstime_t endtime;    /* Time of last sample */
+  double samprate;     /* Sample rate in Hertz */
+  uint32_t numsamples; /* Number of samples in run */
+  char sampletype;     /* Sample type code */
+  uint8_t pubversion;  /* Publication version */
+} RTRun;
+
+/* Block of runs, the runs follow the structure, each aligned to 8 bytes */
+typedef struct RTBlock
+{
+  struct RTBlock *next;
+  nstime_t endtime;    /* Time of last sample of newest run */
+  uint32_t used;       /* Bytes of block used by runs */
+  uint32_t lastrun;    /* Offset of newest run, valid if used > 0 */
+} RTBlock;
+
+#define RTBLOCK_DATA(block) ((char *)(block) + sizeof (RTBlock))
+#define RTRUN_SAMPLES(run) ((char *)(run) + sizeof (RTRun))
+#define RTRUN_ALIGN(offset) (((offset) + 7) & ~(uint32_t)7)
+
+/* Chain of blocks for a source ID, oldest first */
+typedef struct RTTrace
+{
+  char sid[LM_SIDLEN];
+  RTBlock *head;       /* Oldest block */
+  RTBlock *tail;       /* Newest block, the only one appended to */
+  nstime_t cutoff;     /* Samples before this time are expired */
+} RTTrace;
+
+struct MS3RTBuffer
+{
+  RTTrace *traces;       /* Table of source IDs, open addressing */
+  uint32_t slots;        /* Number of slots in table, a power of 2 */
+  uint32_t count;        /* Number of source IDs in table */
+  nstime_t retention;    /* Retention span */
+  uint32_t blockbytes;   /* Capacity of each block in bytes */
+  RTBlock *freeblocks;   /* Evicted blocks available for reuse */
+#if defined(LM_RTBUFFER_THREADS)
+  pthread_rwlock_t lock;
+#endif
+};
+
+static RTTrace *find_trace (MS3RTBuffer *rtb, const char *sid, int8_t insert);
+static RTBlock *new_block (MS3RTBuffer *rtb, RTTrace *trace);
+static RTRun *new_run (MS3RTBuffer *rtb, RTTrace *trace, uint8_t samplesize);
+static void evict_blocks (MS3RTBuffer *rtb, RTTrace *trace);
+static int snapshot_trace (MS3TraceList *mstl, const RTTrace *trace, int64_t *samples);
+
+#if defined(LM_RTBUFFER_THREADS)
+#define RTBUFFER_RDLOCK(rtb) pthread_rwlock_rdlock (&(rtb)->lock)
+#define RTBUFFER_WRLOCK(rtb) pthread_rwlock_wrlock (&(rtb)->lock)
+#define RTBUFFER_UNLOCK(rtb) pthread_rwlock_unlock (&(rtb)->lock)
+#else
+#define RTBUFFER_RDLOCK(rtb)
+#define RTBUFFER_WRLOCK(rtb)
+#define RTBUFFER_UNLOCK(rtb)
+#endif
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Initialize a retention-bounded real-time buffer
+ *
+ * A real-time buffer keeps the most recent \a retention seconds of
+ * data for each source ID in chains of fixed size blocks.  Each block
+ * holds runs of contiguous samples, packed at the size of their
+ * sample type.  New samples are appended to the newest run of a
+ * source ID, a record that does not continue it starts a new run in
+ * the same block, and a new block is linked to the end of the chain
+ * when it is full, such that appending is amortized O(1) and samples
+ * are never moved once stored.  Blocks that contain only expired data
+ * are unlinked from the start of the chain in O(1) each and kept for
+ * reuse.
+ *
+ * Retention is relative to the end of the newest data of each source
+ * ID, not the system clock, such that a source ID that stops
+ * receiving data retains its last \a retention seconds.
+ *
+ * The buffer may be shared between threads, a single lock is held
+ * while a record is appended and while a snapshot is taken, see
+ * ms3_rtbuffer_snapshot().
+ *
+ * @param[in] retention Retention span in seconds
+ * @param[in] blocksamples Size of each block as a number of 8-byte
+ * samples, 0 for a default of 4096.  Blocks hold more samples of
+ * smaller sample types.
+ *
+ * @returns a pointer to a new ::MS3RTBuffer on success or NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa ms3_rtbuffer_addmsr()
+ * \sa ms3_rtbuffer_snapshot()
+ * \sa ms3_rtbuffer_free()
+ ***************************************************************************/
+MS3RTBuffer *
+ms3_rtbuffer_init (double retention, uint32_t blocksamples)
+{
+  MS3RTBuffer *rtb;
+
+  if (retention <= 0.0)
+  {
+    ms_log (2, "%s(): Retention must be positive: %g\n", __func__, retention);
+    return NULL;
+  }
+
+  if ((rtb = (MS3RTBuffer *)lm_malloc (sizeof (MS3RTBuffer))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return NULL;
+  }
+
+  memset (rtb, 0, sizeof (MS3RTBuffer));
+
+  if ((rtb->traces = (RTTrace *)lm_malloc (RTBUFFER_INITIALSLOTS * sizeof (RTTrace))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    libmseed_memory.free (rtb);
+    return NULL;
+  }
+
+  memset (rtb->traces, 0, RTBUFFER_INITIALSLOTS * sizeof (RTTrace));
+  rtb->slots = RTBUFFER_INITIALSLOTS;
+  rtb->retention = (nstime_t)(retention * NSTMODULUS);
+  rtb->blockbytes = ((blocksamples) ? blocksamples : RTBUFFER_BLOCKSAMPLES) * sizeof (double);
+
+  /* Room for at least one run of one sample */
+  if (rtb->blockbytes < sizeof (RTRun) + sizeof (double))
+    rtb->blockbytes = sizeof (RTRun) + sizeof (double);
+
+#if defined(LM_RTBUFFER_THREADS)
+  pthread_rwlock_init (&rtb->lock, NULL);
+#endif
+
+  return rtb;
+} /* End of ms3_rtbuffer_init() */
+
+/**********************************************************************/ /**
+ * @brief Add the samples of a ::MS3Record to a real-time buffer
+ *
+ * The decoded samples of \a msr are appended to the chain of its
+ * source ID.  If the samples have not been decoded, a copy of the
+ * record is decoded.  A record that is contiguous with the newest
+ * run, within half a sample period of the expected time and with the
+ * same sample rate, type and publication version, is appended to it;
+ * otherwise a new run is started.
+ *
+ * Records that start before the end of the newest data of their
+ * source ID, e.g. overlapping or out of order records, are not
+ * added, nor are records without samples or with a sample rate of 0.
+ * After a record is added, blocks of the source ID that end before
+ * the retention window are evicted.
+ *
+ * @param[in] rtb ::MS3RTBuffer to add to
+ * @param[in] msr ::MS3Record to add
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of samples added, 0 if the record was not
+ * added, or -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_rtbuffer_addmsr (MS3RTBuffer *rtb, const MS3Record *msr, int8_t verbose)
+{
+  MS3Record *decoded = NULL;
+  const MS3Record *source = msr;
+  RTTrace *trace;
+  RTBlock *block;
+  RTRun *run = NULL;
+  nstime_t nsdelta;
+  double samprate;
+  uint64_t copied = 0;
+  uint64_t count;
+  uint8_t samplesize;
+  int64_t rv = 0;
+
+  if (!rtb || !msr)
+  {
+    ms_log (2, "%s(): Required input not defined: 'rtb' or 'msr'\n", __func__);
+    return -1;
+  }
+
+  samprate = msr3_sampratehz (msr);
+
+  if (msr->samplecnt <= 0 || samprate <= 0.0)
+    return 0;
+
+  /* Decode a copy of the record if needed, outside of the lock */
+  if (msr->numsamples <= 0 || !msr->datasamples)
+  {
+    if (!msr->record || (decoded = msr3_duplicate (msr, 0)) == NULL)
+    {
+      ms_log (2, "%s: Cannot decode record samples\n", msr->sid);
+      return -1;
+    }
+
+    if (msr3_unpack_data (decoded, verbose) <= 0)
+    {
+      ms_log (2, "%s: Cannot decode record samples\n", msr->sid);
+      msr3_free (&decoded);
+      return -1;
+    }
+
+    source = decoded;
+  }
+
+  if ((samplesize = ms_samplesize (source->sampletype)) == 0)
+  {
+    ms_log (2, "%s: Unsupported sample type: %c\n", msr->sid, source->sampletype);
+    msr3_free (&decoded);
+    return -1;
+  }
+
+  nsdelta = (nstime_t)(NSTMODULUS / samprate);
+
+  RTBUFFER_WRLOCK (rtb);
+
+  if ((trace = find_trace (rtb, source->sid, 1)) == NULL)
+  {
+    rv = -1;
+  }
+  /* Skip overlapping and out of order records */
+  else if (trace->tail && source->starttime < trace->tail->endtime + nsdelta / 2)
+  {
+    if (verbose > 1)
+      ms_log (0, "%s: Skipping record that does not follow newest data\n", source->sid);
+  }
+  else
+  {
+    /* Continue the newest run if contiguous */
+    if ((block = trace->tail) != NULL && block->used > 0)
+    {
+      run = (RTRun *)(RTBLOCK_DATA (block) + block->lastrun);
+
+      if (run->sampletype != source->sampletype ||
+          run->pubversion != source->pubversion ||
+          !MS_ISRATETOLERABLE (run->samprate, samprate) ||
+          ms_dabs ((double)(source->starttime - run->endtime - nsdelta)) > 0.5 * nsdelta)
+        run = NULL;
+    }
+
+    while (rv == 0 && copied < (uint64_t)source->numsamples)
+    {
+      block = trace->tail;
+
+      /* Start a new run, continuing the samples in a new block when full */
+      if (!run || block->used + samplesize > rtb->blockbytes)
+      {
+        if ((run = new_run (rtb, trace, samplesize)) == NULL)
+        {
+          rv = -1;
+          break;
+        }
+
+        block = trace->tail;
+        run->starttime = ms_sampletime (source->starttime, copied, samprate);
+        run->samprate = samprate;
+        run->sampletype = source->sampletype;
+        run->pubversion = source->pubversion;
+      }
+
+      count = (rtb->blockbytes - block->used) / samplesize;
+      if (count > (uint64_t)source->numsamples - copied)
+        count = (uint64_t)source->numsamples - copied;
+
+      memcpy (RTRUN_SAMPLES (run) + (size_t)run->numsamples * samplesize,
+              (char *)source->datasamples + (size_t)copied * samplesize,
+              (size_t)count * samplesize);
+
+      run->numsamples += (uint32_t)count;
+      block->used += (uint32_t)count * samplesize;
+      copied += count;
+
+      run->endtime = ms_sampletime (run->starttime, run->numsamples - 1, run->samprate);
+      block->endtime = run->endtime;
+    }
+
+    if (rv == 0)
+    {
+      evict_blocks (rtb, trace);
+      rv = (int64_t)copied;
+    }
+  }
+
+  RTBUFFER_UNLOCK (rtb);
+
+  if (decoded)
+    msr3_free (&decoded);
+
+  return rv;
+} /* End of ms3_rtbuffer_addmsr() */
+
+/**********************************************************************/ /**
+ * @brief Add a miniSEED record in a buffer to a real-time buffer
+ *
+ * The record in \a record is parsed, decoded and added with
+ * ms3_rtbuffer_addmsr().  This is convenient for records received
+ * from a real-time data stream.
+ *
+ * @param[in] rtb ::MS3RTBuffer to add to
+ * @param[in] record Buffer containing a miniSEED record
+ * @param[in] recbuflen Length of \a record in bytes
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of samples added, 0 if the record was not
+ * added, or -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_rtbuffer_addrecord (MS3RTBuffer *rtb, const char *record, uint64_t recbuflen, int8_t verbose)
+{
+  MS3Record *msr = NULL;
+  int64_t rv;
+
+  if (!rtb || !record)
+  {
+    ms_log (2, "%s(): Required input not defined: 'rtb' or 'record'\n", __func__);
+    return -1;
+  }
+
+  if (msr3_parse (record, recbuflen, &msr, MSF_UNPACKDATA, verbose) != MS_NOERROR)
+  {
+    ms_log (2, "%s(): Cannot parse record\n", __func__);
+    msr3_free (&msr);
+    return -1;
+  }
+
+  rv = ms3_rtbuffer_addmsr (rtb, msr, verbose);
+
+  msr3_free (&msr);
+
+  return rv;
+} /* End of ms3_rtbuffer_addrecord() */
+
+/**********************************************************************/ /**
+ * @brief Copy the retained data of a real-time buffer to a trace list
+ *
+ * The retained samples of all source IDs, or only of \a sid if not
+ * NULL, are added to the ::MS3TraceList at \a ppmstl, which is
+ * allocated if it is NULL.  Each run of contiguous blocks becomes a
+ * segment, and samples before the retention window of a partially
+ * expired block are left out.
+ *
+ * The buffer is locked while the samples are copied, such that a
+ * snapshot is consistent with the records added before it even while
+ * another thread is adding records.  The trace list is independent
+ * of the buffer and must be freed with mstl3_free() by the caller.
+ *
+ * @param[in] rtb ::MS3RTBuffer to copy from
+ * @param[in,out] ppmstl Pointer to ::MS3TraceList to add segments to
+ * @param[in] sid Source ID to copy, or NULL for all
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of samples copied or -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_rtbuffer_snapshot (MS3RTBuffer *rtb, MS3TraceList **ppmstl, const char *sid, int8_t verbose)
+{
+  RTTrace *trace;
+  uint32_t slot;
+  int64_t samples = 0;
+  int rv = 0;
+
+  if (!rtb || !ppmstl)
+  {
+    ms_log (2, "%s(): Required input not defined: 'rtb' or 'ppmstl'\n", __func__);
+    return -1;
+  }
+
+  if (!*ppmstl && (*ppmstl = mstl3_init (NULL)) == NULL)
+    return -1;
+
+  RTBUFFER_RDLOCK (rtb);
+
+  if (sid)
+  {
+    if ((trace = find_trace (rtb, sid, 0)) != NULL)
+      rv = snapshot_trace (*ppmstl, trace, &samples);
+  }
+  else
+  {
+    for (slot = 0; slot < rtb->slots && rv == 0; slot++)
+    {
+      if (rtb->traces[slot].sid[0] != '\0')
+        rv = snapshot_trace (*ppmstl, &rtb->traces[slot], &samples);
+    }
+  }
+
+  RTBUFFER_UNLOCK (rtb);
+
+  if (rv)
+    return -1;
+
+  if (verbose > 1)
+    ms_log (0, "Copied %" PRId64 " retained samples\n", samples);
+
+  return samples;
+} /* End of ms3_rtbuffer_snapshot() */
+
+/**********************************************************************/ /**
+ * @brief Free all memory associated with a real-time buffer
+ *
+ * The pointer at \a pprtb is set to NULL.
+ *
+ * @param[in,out] pprtb Pointer to ::MS3RTBuffer to free
+ ***************************************************************************/
+void
+ms3_rtbuffer_free (MS3RTBuffer **pprtb)
+{
+  MS3RTBuffer *rtb;
+  RTBlock *block;
+  uint32_t slot;
+
+  if (!pprtb || !*pprtb)
+    return;
+
+  rtb = *pprtb;
+
+  for (slot = 0; slot < rtb->slots; slot++)
+  {
+    while ((block = rtb->traces[slot].head) != NULL)
+    {
+      rtb->traces[slot].head = block->next;
+      libmseed_memory.free (block);
+    }
+  }
+
+  while ((block = rtb->freeblocks) != NULL)
+  {
+    rtb->freeblocks = block->next;
+    libmseed_memory.free (block);
+  }
+
+#if defined(LM_RTBUFFER_THREADS)
+  pthread_rwlock_destroy (&rtb->lock);
+#endif
+
+  libmseed_memory.free (rtb->traces);
+  libmseed_memory.free (rtb);
+
+  *pprtb = NULL;
+} /* End of ms3_rtbuffer_free() */
+
+/** @cond UNDOCUMENTED */
+
+/***************************************************************************
+ * Find the entry for a source ID in the table, optionally inserting
+ * a new entry if not found.  The table is grown as needed.
+ *
+ * Returns a pointer to the entry or NULL if not found or on error.
+ ***************************************************************************/
+static RTTrace *
+find_trace (MS3RTBuffer *rtb, const char *sid, int8_t insert)
+{
+  RTTrace *traces;
+  RTTrace *trace;
+  uint32_t slots;
+  uint32_t slot;
+  uint32_t hash = 2166136261u;
+  const char *cp;
+
+  /* Grow the table when more than 3/4 full */
+  if (insert && (rtb->count + 1) * 4 > rtb->slots * 3)
+  {
+    slots = rtb->slots * 2;
+
+    if ((traces = (RTTrace *)lm_malloc (slots * sizeof (RTTrace))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    memset (traces, 0, slots * sizeof (RTTrace));
+
+    /* Rehash existing entries into the new table */
+    trace = rtb->traces;
+    rtb->traces = traces;
+    traces = trace;
+    rtb->count = 0;
+    slot = rtb->slots;
+    rtb->slots = slots;
+
+    while (slot-- > 0)
+    {
+      if (traces[slot].sid[0] != '\0')
+      {
+        trace = find_trace (rtb, traces[slot].sid, 1);
+        memcpy (trace, &traces[slot], sizeof (RTTrace));
+      }
+    }
+
+    libmseed_memory.free (traces);
+  }
+
+  /* FNV-1a hash of source ID */
+  for (cp = sid; *cp; cp++)
+  {
+    hash ^= (uint8_t)*cp;
+    hash *= 16777619u;
+  }
+
+  for (slot = hash & (rtb->slots - 1);; slot = (slot + 1) & (rtb->slots - 1))
+  {
+    trace = &rtb->traces[slot];
+
+    if (trace->sid[0] == '\0')
+      break;
+
+    if (!strcmp (trace->sid, sid))
+      return trace;
+  }
+
+  if (!insert)
+    return NULL;
+
+  memset (trace, 0, sizeof (RTTrace));
+  strncpy (trace->sid, sid, sizeof (trace->sid) - 1);
+  rtb->count++;
+
+  return trace;
+} /* End of find_trace() */
+
+/***************************************************************************
+ * Link an empty block to the end of the chain of a source ID, reusing
+ * an evicted block if available.
+ *
+ * Returns a pointer to the block or NULL on error.
+ ***************************************************************************/
+static RTBlock *
+new_block (MS3RTBuffer *rtb, RTTrace *trace)
+{
+  RTBlock *block;
+
+  if ((block = rtb->freeblocks) != NULL)
+  {
+    rtb->freeblocks = block->next;
+  }
+  else if ((block = (RTBlock *)lm_malloc (sizeof (RTBlock) + rtb->blockbytes)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return NULL;
+  }
+
+  memset (block, 0, sizeof (RTBlock));
+
+  if (trace->tail)
+    trace->tail->next = block;
+  else
+    trace->head = block;
+
+  trace->tail = block;
+
+  return block;
+} /* End of new_block() */
+
+/***************************************************************************
+ * Start an empty run in the newest block of a source ID if it has
+ * room for the run and at least one sample, otherwise in a new block.
+ *
+ * Returns a pointer to the run or NULL on error.
+ ***************************************************************************/
+static RTRun *
+new_run (MS3RTBuffer *rtb, RTTrace *trace, uint8_t samplesize)
+{
+  RTBlock *block = trace->tail;
+  RTRun *run;
+  uint32_t offset;
+
+  offset = (block) ? RTRUN_ALIGN (block->used) : 0;
+
+  if (!block || offset + sizeof (RTRun) + samplesize > rtb->blockbytes)
+  {
+    if ((block = new_block (rtb, trace)) == NULL)
+      return NULL;
+
+    offset = 0;
+  }
+
+  run = (RTRun *)(RTBLOCK_DATA (block) + offset);
+  memset (run, 0, sizeof (RTRun));
+
+  block->lastrun = offset;
+  block->used = offset + sizeof (RTRun);
+
+  return run;
+} /* End of new_run() */
+
+/***************************************************************************
+ * Unlink blocks that end before the retention window of a source ID
+ * from the start of its chain and keep them for reuse.  The newest
+ * block is never evicted.
+ ***************************************************************************/
+static void
+evict_blocks (MS3RTBuffer *rtb, RTTrace *trace)
+{
+  RTBlock *block;
+
+  trace->cutoff = trace->tail->endtime - rtb->retention;
+
+  while ((block = trace->head) != trace->tail && block->endtime < trace->cutoff)
+  {
+    trace->head = block->next;
+
+    block->next = rtb->freeblocks;
+    rtb->freeblocks = block;
+  }
+} /* End of evict_blocks() */
+
+/***************************************************************************
+ * Add the retained runs of a source ID to a trace list, merging
+ * contiguous runs into segments.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+snapshot_trace (MS3TraceList *mstl, const RTTrace *trace, int64_t *samples)
+{
+  MS3Record *msr;
+  const RTBlock *block;
+  const RTRun *run;
+  double offset;
+  uint32_t runoffset;
+  uint32_t skip;
+  uint8_t samplesize;
+  int rv = 0;
+
+  if ((msr = msr3_init (NULL)) == NULL)
+    return -1;
+
+  memcpy (msr->sid, trace->sid, sizeof (msr->sid));
+
+  for (block = trace->head; block && rv == 0; block = block->next)
+  {
+    for (runoffset = 0; runoffset < block->used && rv == 0;
+         runoffset = RTRUN_ALIGN (runoffset + sizeof (RTRun) + run->numsamples * samplesize))
+    {
+      run = (const RTRun *)(RTBLOCK_DATA (block) + runoffset);
+      samplesize = ms_samplesize (run->sampletype);
+
+      if (run->numsamples == 0)
+        continue;
+
+      /* Leave out samples before the retention window */
+      skip = 0;
+      if (run->starttime < trace->cutoff)
+      {
+        offset = (double)(trace->cutoff - run->starttime) * run->samprate / NSTMODULUS;
+        skip = (uint32_t)offset;
+
+        if ((double)skip < offset)
+          skip++;
+
+        if (skip >= run->numsamples)
+          continue;
+      }
+
+      msr->starttime = ms_sampletime (run->starttime, skip, run->samprate);
+      msr->samprate = run->samprate;
+      msr->pubversion = run->pubversion;
+      msr->sampletype = run->sampletype;
+      msr->samplecnt = run->numsamples - skip;
+      msr->numsamples = msr->samplecnt;
+      msr->datasamples = (char *)RTRUN_SAMPLES (run) + (size_t)skip * samplesize;
+
+      /* Contiguous runs are merged into one segment by the trace list */
+      if (!mstl3_addmsr (mstl, msr, 0, 0, 0, NULL))
+        rv = -1;
+      else
+        *samples += msr->numsamples;
+    }
+  }
+
+  msr->datasamples = NULL;
+  msr3_free (&msr);
+
+  return rv;
+} /* End of snapshot_trace() */
+
+/** @endcond */
@@ -26,6 +26,9 @@
 
 #include "libmseed.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_SELECTION
+#include "memprofile.h"
+
 static int ms_isinteger (const char *string);
 static int ms_globmatch (const char *string, const char *pattern);
 
@@ -192,7 +195,7 @@ ms3_addselect (MS3Selections **ppselections, const char *sidpattern,
   }
 
   /* Allocate new SelectTime and populate */
-  if (!(newst = (MS3SelectTime *)libmseed_memory.malloc (sizeof (MS3SelectTime))))
+  if (!(newst = (MS3SelectTime *)lm_malloc (sizeof (MS3SelectTime))))
   {
     ms_log (2, "Cannot allocate memory\n");
     return -1;
@@ -206,7 +209,7 @@ ms3_addselect (MS3Selections **ppselections, const char *sidpattern,
   if (!*ppselections)
   {
     /* Allocate new Selections and populate */
-    if (!(newsl = (MS3Selections *)libmseed_memory.malloc (sizeof (MS3Selections))))
+    if (!(newsl = (MS3Selections *)lm_malloc (sizeof (MS3Selections))))
     {
       ms_log (2, "Cannot allocate memory\n");
       return -1;
@@ -247,7 +250,7 @@ ms3_addselect (MS3Selections **ppselections, const char *sidpattern,
     else
     {
       /* Allocate new MS3Selections and populate */
-      if (!(newsl = (MS3Selections *)libmseed_memory.malloc (sizeof (MS3Selections))))
+      if (!(newsl = (MS3Selections *)lm_malloc (sizeof (MS3Selections))))
       {
         ms_log (2, "Cannot allocate memory\n");
         return -1;
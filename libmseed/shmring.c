@@ -0,0 +1,623 @@
+/***************************************************************************
+ * Routines to publish and consume miniSEED records via a shared memory ring.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_IO
+#include "memprofile.h"
+
+#if !defined(LMP_WIN)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+#define SHMRING_MAGIC    "LMSHRING"
+#define SHMRING_VERSION  1
+#define SHMRING_ALIGN    64
+
+/* Ring header at the start of the shared memory object.  The write
+ * sequence is the next sequence number to be claimed by a writer,
+ * sequence numbers start at 1. */
+typedef struct ShmRingHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t slotcount;
+  uint32_t slotsize;
+  uint32_t slotstride;
+  uint64_t writeseq;
+  uint8_t reserved[SHMRING_ALIGN - 32];
+} ShmRingHeader;
+
+/* Slot header preceding each record.  A sequence number of 0
+ * indicates the slot is empty or being written. */
+typedef struct ShmRingSlot
+{
+  uint64_t seqnum;
+  uint32_t reclen;
+  uint32_t reserved;
+} ShmRingSlot;
+
+#define SHMRING_HEADER(RING) ((ShmRingHeader *)(RING)->map)
+#define SHMRING_SLOT(RING, SEQ)                                           \
+  ((ShmRingSlot *)((uint8_t *)(RING)->map + sizeof (ShmRingHeader) +      \
+                   ((SEQ) % (RING)->slotcount) * (uint64_t)SHMRING_HEADER (RING)->slotstride))
+#define SHMRING_DATA(SLOT) ((char *)(SLOT) + sizeof (ShmRingSlot))
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHM_LOAD_ACQUIRE(P)     __atomic_load_n ((P), __ATOMIC_ACQUIRE)
+#define SHM_LOAD_RELAXED(P)     __atomic_load_n ((P), __ATOMIC_RELAXED)
+#define SHM_STORE_RELEASE(P, V) __atomic_store_n ((P), (V), __ATOMIC_RELEASE)
+#define SHM_STORE_RELAXED(P, V) __atomic_store_n ((P), (V), __ATOMIC_RELAXED)
+#define SHM_FETCH_ADD(P, V)     __atomic_fetch_add ((P), (V), __ATOMIC_ACQ_REL)
+#define SHM_FENCE_ACQUIRE()     __atomic_thread_fence (__ATOMIC_ACQUIRE)
+#define SHM_FENCE_RELEASE()     __atomic_thread_fence (__ATOMIC_RELEASE)
+#endif
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Create, or attach to, a shared memory record ring for writing
+ *
+ * A POSIX shared memory object identified by \a name is created if
+ * it does not exist and initialized with \a slotcount slots of \a
+ * slotsize bytes each.  If an object with the same name and
+ * geometry already exists it is re-used and publishing continues
+ * with the existing sequence numbering, allowing attached readers to
+ * continue uninterrupted.  An existing object with different
+ * geometry is re-initialized.
+ *
+ * Records are published with ms3_shmring_write() or via
+ * ms3_shmring_record_handler() as a record handler for msr3_pack()
+ * and mstl3_pack().  Each record is assigned a sequence number and
+ * when the ring is full the oldest record is overwritten.  Multiple
+ * writers, in the same or different processes, may publish to the
+ * same ring as long as there are fewer concurrent writers than slots.
+ *
+ * An existing ring is re-used if it has the same geometry.  An
+ * existing shared memory object with a different size or geometry is
+ * not modified, as readers may have it mapped, and an error is
+ * returned.  To re-create a ring with a different geometry remove it
+ * with ms3_shmring_unlink() first, readers attached to the removed
+ * ring are not affected.
+ *
+ * The shared memory object is not removed when the ring is closed,
+ * use ms3_shmring_unlink() to remove it.
+ *
+ * @param[in] name Shared memory object name, e.g. "/mseed"
+ * @param[in] slotcount Number of record slots in the ring
+ * @param[in] slotsize Maximum record length in bytes for each slot
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns An allocated ::MS3ShmRing on success, NULL on error
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa ms3_shmring_open()
+ * \sa ms3_shmring_close()
+ ***************************************************************************/
+MS3ShmRing *
+ms3_shmring_create (const char *name, uint32_t slotcount, uint32_t slotsize, int8_t verbose)
+{
+#if defined(LMP_WIN) || !(defined(__GNUC__) || defined(__clang__))
+  (void)name; (void)slotcount; (void)slotsize; (void)verbose;
+  ms_log (2, "Shared memory rings are not supported on this platform\n");
+  return NULL;
+#else
+  MS3ShmRing *ring = NULL;
+  ShmRingHeader *header;
+  struct stat sb;
+  uint32_t slotstride;
+  size_t mapsize;
+  int initialize = 1;
+
+  if (!name)
+  {
+    ms_log (2, "Required argument not defined: 'name'\n");
+    return NULL;
+  }
+
+  if (slotcount == 0 || slotsize < MINRECLEN || slotsize > MAXRECLEN)
+  {
+    ms_log (2, "Invalid ring geometry, slot count: %u, slot size: %u\n", slotcount, slotsize);
+    return NULL;
+  }
+
+  /* Slot stride includes the slot header and is aligned to a cache line */
+  slotstride = (uint32_t)(sizeof (ShmRingSlot) + slotsize + SHMRING_ALIGN - 1) & ~(uint32_t)(SHMRING_ALIGN - 1);
+  mapsize = sizeof (ShmRingHeader) + (size_t)slotcount * slotstride;
+
+  if ((ring = (MS3ShmRing *)lm_malloc (sizeof (MS3ShmRing))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return NULL;
+  }
+
+  memset (ring, 0, sizeof (MS3ShmRing));
+  strncpy (ring->name, name, sizeof (ring->name) - 1);
+  ring->slotcount = slotcount;
+  ring->slotsize  = slotsize;
+  ring->writer    = 1;
+  ring->fd        = -1;
+
+  if ((ring->fd = shm_open (name, O_RDWR | O_CREAT, 0644)) < 0)
+  {
+    ms_log (2, "Cannot open shared memory %s: %s\n", name, strerror (errno));
+    libmseed_memory.free (ring);
+    return NULL;
+  }
+
+  if (fstat (ring->fd, &sb))
+  {
+    ms_log (2, "Cannot stat shared memory %s: %s\n", name, strerror (errno));
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  /* Never resize an existing ring, readers may have it mapped */
+  if (sb.st_size != 0 && (size_t)sb.st_size != mapsize)
+  {
+    ms_log (2, "Shared memory %s exists with a different size, remove it to re-create\n", name);
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  if (sb.st_size == 0 && ftruncate (ring->fd, (off_t)mapsize))
+  {
+    ms_log (2, "Cannot size shared memory %s: %s\n", name, strerror (errno));
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  ring->map = mmap (NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+
+  if (ring->map == MAP_FAILED)
+  {
+    ms_log (2, "Cannot map shared memory %s: %s\n", name, strerror (errno));
+    ring->map = NULL;
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  ring->mapsize = mapsize;
+  header        = SHMRING_HEADER (ring);
+
+  /* Re-use existing ring with matching geometry */
+  if (sb.st_size != 0)
+  {
+    if (memcmp (header->magic, SHMRING_MAGIC, sizeof (header->magic)) ||
+        header->version != SHMRING_VERSION ||
+        header->slotcount != slotcount ||
+        header->slotsize != slotsize ||
+        header->slotstride != slotstride)
+    {
+      ms_log (2, "Shared memory %s exists with a different geometry, remove it to re-create\n", name);
+      ms3_shmring_close (&ring);
+      return NULL;
+    }
+
+    initialize = 0;
+  }
+
+  if (initialize)
+  {
+    memset (ring->map, 0, mapsize);
+    header->version    = SHMRING_VERSION;
+    header->slotcount  = slotcount;
+    header->slotsize   = slotsize;
+    header->slotstride = slotstride;
+    SHM_STORE_RELAXED (&header->writeseq, 1);
+    SHM_FENCE_RELEASE ();
+    memcpy (header->magic, SHMRING_MAGIC, sizeof (header->magic));
+  }
+
+  if (verbose)
+    ms_log (0, "%s shared memory ring %s with %u slots of %u bytes\n",
+            (initialize) ? "Created" : "Attached to", name, slotcount, slotsize);
+
+  return ring;
+#endif
+} /* End of ms3_shmring_create() */
+
+/**********************************************************************/ /**
+ * @brief Attach to an existing shared memory record ring for reading
+ *
+ * The shared memory object identified by \a name is mapped read-only.
+ * The returned ring is positioned to return records published after
+ * this call; to start with the oldest record still available set
+ * ::MS3ShmRing.readseq to 1 before reading.
+ *
+ * @param[in] name Shared memory object name used with ms3_shmring_create()
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns An allocated ::MS3ShmRing on success, NULL on error
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa ms3_shmring_read()
+ * \sa ms3_shmring_close()
+ ***************************************************************************/
+MS3ShmRing *
+ms3_shmring_open (const char *name, int8_t verbose)
+{
+#if defined(LMP_WIN) || !(defined(__GNUC__) || defined(__clang__))
+  (void)name; (void)verbose;
+  ms_log (2, "Shared memory rings are not supported on this platform\n");
+  return NULL;
+#else
+  MS3ShmRing *ring = NULL;
+  ShmRingHeader *header;
+  struct stat sb;
+
+  if (!name)
+  {
+    ms_log (2, "Required argument not defined: 'name'\n");
+    return NULL;
+  }
+
+  if ((ring = (MS3ShmRing *)lm_malloc (sizeof (MS3ShmRing))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return NULL;
+  }
+
+  memset (ring, 0, sizeof (MS3ShmRing));
+  strncpy (ring->name, name, sizeof (ring->name) - 1);
+  ring->fd = -1;
+
+  if ((ring->fd = shm_open (name, O_RDONLY, 0)) < 0)
+  {
+    ms_log (2, "Cannot open shared memory %s: %s\n", name, strerror (errno));
+    libmseed_memory.free (ring);
+    return NULL;
+  }
+
+  if (fstat (ring->fd, &sb))
+  {
+    ms_log (2, "Cannot stat shared memory %s: %s\n", name, strerror (errno));
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  if ((size_t)sb.st_size < sizeof (ShmRingHeader))
+  {
+    ms_log (2, "Shared memory %s is not a record ring\n", name);
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  ring->map = mmap (NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, ring->fd, 0);
+
+  if (ring->map == MAP_FAILED)
+  {
+    ms_log (2, "Cannot map shared memory %s: %s\n", name, strerror (errno));
+    ring->map = NULL;
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  ring->mapsize = (size_t)sb.st_size;
+  header        = SHMRING_HEADER (ring);
+
+  if (memcmp (header->magic, SHMRING_MAGIC, sizeof (header->magic)) ||
+      header->version != SHMRING_VERSION ||
+      sizeof (ShmRingHeader) + (size_t)header->slotcount * header->slotstride > ring->mapsize)
+  {
+    ms_log (2, "Shared memory %s is not a compatible record ring\n", name);
+    ms3_shmring_close (&ring);
+    return NULL;
+  }
+
+  ring->slotcount = header->slotcount;
+  ring->slotsize  = header->slotsize;
+  ring->readseq   = SHM_LOAD_ACQUIRE (&header->writeseq);
+
+  if (verbose)
+    ms_log (0, "Opened shared memory ring %s with %u slots of %u bytes at sequence %" PRIu64 "\n",
+            name, ring->slotcount, ring->slotsize, ring->readseq);
+
+  return ring;
+#endif
+} /* End of ms3_shmring_open() */
+
+/**********************************************************************/ /**
+ * @brief Publish a record to a shared memory ring
+ *
+ * The record is copied into the next slot of the ring, overwriting
+ * the oldest record if the ring is full.
+ *
+ * @param[in] ring ::MS3ShmRing created with ms3_shmring_create()
+ * @param[in] record Record buffer to publish
+ * @param[in] reclen Length of record in bytes
+ *
+ * @returns The sequence number assigned to the record on success, -1 on error
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_shmring_write (MS3ShmRing *ring, const char *record, int reclen)
+{
+#if defined(LMP_WIN) || !(defined(__GNUC__) || defined(__clang__))
+  (void)ring; (void)record; (void)reclen;
+  ms_log (2, "Shared memory rings are not supported on this platform\n");
+  return -1;
+#else
+  ShmRingSlot *slot;
+  uint64_t seqnum;
+
+  if (!ring || !record)
+  {
+    ms_log (2, "Required argument not defined: 'ring' or 'record'\n");
+    return -1;
+  }
+
+  if (!ring->writer || !ring->map)
+  {
+    ms_log (2, "Shared memory ring %s is not open for writing\n", ring->name);
+    return -1;
+  }
+
+  if (reclen <= 0 || (uint32_t)reclen > ring->slotsize)
+  {
+    ms_log (2, "Record length %d does not fit in ring %s slot size of %u bytes\n",
+            reclen, ring->name, ring->slotsize);
+    return -1;
+  }
+
+  /* Claim a sequence number and slot, then mark slot as being written */
+  seqnum = SHM_FETCH_ADD (&SHMRING_HEADER (ring)->writeseq, 1);
+  slot   = SHMRING_SLOT (ring, seqnum);
+
+  SHM_STORE_RELAXED (&slot->seqnum, 0);
+  SHM_FENCE_RELEASE ();
+
+  memcpy (SHMRING_DATA (slot), record, reclen);
+  SHM_STORE_RELAXED (&slot->reclen, (uint32_t)reclen);
+
+  /* Publish record */
+  SHM_STORE_RELEASE (&slot->seqnum, seqnum);
+
+  return (int64_t)seqnum;
+#endif
+} /* End of ms3_shmring_write() */
+
+/**********************************************************************/ /**
+ * @brief Record handler that publishes records to a shared memory ring
+ *
+ * Suitable for use as the \c record_handler of msr3_pack(),
+ * mstl3_pack() and similar routines with the ::MS3ShmRing as the
+ * \c handlerdata.
+ *
+ * @param[in] record Record buffer to publish
+ * @param[in] reclen Length of record in bytes
+ * @param[in] handlerdata ::MS3ShmRing created with ms3_shmring_create()
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+void
+ms3_shmring_record_handler (char *record, int reclen, void *handlerdata)
+{
+  ms3_shmring_write ((MS3ShmRing *)handlerdata, record, reclen);
+} /* End of ms3_shmring_record_handler() */
+
+/**********************************************************************/ /**
+ * @brief Read the next record from a shared memory ring
+ *
+ * The next available record is parsed directly from shared memory
+ * using msr3_parse(), no intermediate copy is made.  If a record was
+ * overwritten by a writer before or while it was parsed it is skipped
+ * and ::MS3ShmRing.lost is incremented.
+ *
+ * The ::MS3Record.record pointer refers to the record in shared memory
+ * and is only valid until the slot is overwritten, which is a
+ * function of the ring size and publishing rate.  Header values and,
+ * if requested with ::MSF_UNPACKDATA, data samples are copied into
+ * the ::MS3Record and are verified to be consistent.
+ *
+ * @param[in] ring ::MS3ShmRing opened with ms3_shmring_open()
+ * @param[out] ppmsr Pointer to ::MS3Record, populated with record
+ * @param[out] seqnum Sequence number of returned record, may be NULL
+ * @param[in] flags Flags used by msr3_parse(), e.g. ::MSF_UNPACKDATA
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns ::MS_NOERROR when a record is returned, ::MS_ENDOFFILE if
+ * no new record is available, and a (negative) @ref return-values on
+ * error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_shmring_read (MS3ShmRing *ring, MS3Record **ppmsr, uint64_t *seqnum,
+                  uint32_t flags, int8_t verbose)
+{
+#if defined(LMP_WIN) || !(defined(__GNUC__) || defined(__clang__))
+  (void)ring; (void)ppmsr; (void)seqnum; (void)flags; (void)verbose;
+  ms_log (2, "Shared memory rings are not supported on this platform\n");
+  return MS_GENERROR;
+#else
+  ShmRingSlot *slot;
+  uint64_t writeseq;
+  uint64_t slotseq;
+  uint32_t reclen;
+  int retcode;
+
+  if (!ring || !ppmsr)
+  {
+    ms_log (2, "Required argument not defined: 'ring' or 'ppmsr'\n");
+    return MS_GENERROR;
+  }
+
+  if (!ring->map)
+  {
+    ms_log (2, "Shared memory ring %s is not open\n", ring->name);
+    return MS_GENERROR;
+  }
+
+  if (ring->readseq == 0)
+    ring->readseq = 1;
+
+  for (;;)
+  {
+    writeseq = SHM_LOAD_ACQUIRE (&SHMRING_HEADER (ring)->writeseq);
+
+    if (ring->readseq >= writeseq)
+      return MS_ENDOFFILE;
+
+    /* Skip records that have been overwritten, reader has been lapped */
+    if (writeseq - ring->readseq > ring->slotcount)
+    {
+      ring->lost += writeseq - ring->slotcount - ring->readseq;
+      ring->readseq = writeseq - ring->slotcount;
+    }
+
+    slot    = SHMRING_SLOT (ring, ring->readseq);
+    slotseq = SHM_LOAD_ACQUIRE (&slot->seqnum);
+
+    /* Record is claimed but not yet published */
+    if (slotseq < ring->readseq)
+      return MS_ENDOFFILE;
+
+    /* Record was overwritten since the write sequence was checked */
+    if (slotseq > ring->readseq)
+    {
+      ring->lost++;
+      ring->readseq++;
+      continue;
+    }
+
+    reclen = SHM_LOAD_RELAXED (&slot->reclen);
+
+    if (reclen > ring->slotsize)
+      reclen = ring->slotsize;
+
+    retcode = msr3_parse (SHMRING_DATA (slot), reclen, ppmsr, flags, verbose);
+
+    /* Verify the slot was not overwritten during parsing */
+    SHM_FENCE_ACQUIRE ();
+    if (SHM_LOAD_RELAXED (&slot->seqnum) != slotseq)
+    {
+      if (verbose > 1)
+        ms_log (0, "Record %" PRIu64 " overwritten while reading from ring %s\n",
+                slotseq, ring->name);
+
+      ring->lost++;
+      ring->readseq++;
+      continue;
+    }
+
+    ring->readseq++;
+
+    if (retcode != MS_NOERROR)
+    {
+      ms_log (2, "Cannot parse record %" PRIu64 " from ring %s: %s\n",
+              slotseq, ring->name, (retcode < 0) ? ms_errorstr (retcode) : "incomplete record");
+      return (retcode < 0) ? retcode : MS_WRONGLENGTH;
+    }
+
+    if (seqnum)
+      *seqnum = slotseq;
+
+    return MS_NOERROR;
+  }
+#endif
+} /* End of ms3_shmring_read() */
+
+/**********************************************************************/ /**
+ * @brief Close a shared memory ring and free associated resources
+ *
+ * The shared memory object itself is not removed, see
+ * ms3_shmring_unlink().
+ *
+ * @param[in] ppring Pointer to ::MS3ShmRing to close, set to NULL on return
+ *
+ * @returns 0 on success and -1 on error
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_shmring_close (MS3ShmRing **ppring)
+{
+  int rv = 0;
+
+  if (!ppring || !*ppring)
+    return 0;
+
+#if !defined(LMP_WIN)
+  if ((*ppring)->map && munmap ((*ppring)->map, (*ppring)->mapsize))
+  {
+    ms_log (2, "Cannot unmap shared memory %s: %s\n", (*ppring)->name, strerror (errno));
+    rv = -1;
+  }
+
+  if ((*ppring)->fd >= 0)
+    close ((*ppring)->fd);
+#endif
+
+  libmseed_memory.free (*ppring);
+  *ppring = NULL;
+
+  return rv;
+} /* End of ms3_shmring_close() */
+
+/**********************************************************************/ /**
+ * @brief Remove a shared memory ring
+ *
+ * Rings that are currently mapped remain valid until closed.  A ring
+ * that does not exist is not an error, allowing a ring to be removed
+ * before re-creating it without checking for it first.
+ *
+ * @param[in] name Shared memory object name used with ms3_shmring_create()
+ *
+ * @returns 0 on success and -1 on error
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_shmring_unlink (const char *name)
+{
+#if defined(LMP_WIN)
+  (void)name;
+  ms_log (2, "Shared memory rings are not supported on this platform\n");
+  return -1;
+#else
+  if (!name)
+  {
+    ms_log (2, "Required argument not defined: 'name'\n");
+    return -1;
+  }
+
+  if (shm_unlink (name) && errno != ENOENT)
+  {
+    ms_log (2, "Cannot remove shared memory %s: %s\n", name, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+#endif
+} /* End of ms3_shmring_unlink() */
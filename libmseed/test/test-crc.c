@@ -157,4 +157,27 @@ TEST(CRC, CRC32C) {
 
   result = ms_crc32c ((const uint8_t *)"SOMEDATA", 0, 0);
   CHECK (result == 0, "CRC-32C NULL input test failure");
-}
\ No newline at end of file
+}
+
+TEST(CRC, CRC32C_combine) {
+  const uint8_t *input = (const uint8_t *)"123456789 The quick brown fox jumps over the lazy dog";
+  int length = (int)strlen ((const char *)input);
+  uint32_t whole;
+  uint32_t crc1;
+  uint32_t crc2;
+  int split;
+
+  whole = ms_crc32c (input, length, 0);
+
+  /* Combining CRCs of any split must match the CRC of the whole */
+  for (split = 1; split < length; split++)
+  {
+    crc1 = ms_crc32c (input, split, 0);
+    crc2 = ms_crc32c (input + split, length - split, 0);
+
+    CHECK (ms_crc32c_combine (crc1, crc2, length - split) == whole, "CRC-32C combine failure");
+  }
+
+  /* Zero length second part returns first CRC */
+  CHECK (ms_crc32c_combine (whole, 0, 0) == whole, "CRC-32C combine zero length failure");
+}
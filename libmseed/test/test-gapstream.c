@@ -0,0 +1,230 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+#define MAXGAPS 16
+
+/* Collected gaps for checking */
+typedef struct GapList
+{
+  MS3Gap gaps[MAXGAPS];
+  int count;
+} GapList;
+
+static void
+gap_handler (const MS3Gap *gap, void *handlerdata)
+{
+  GapList *list = (GapList *)handlerdata;
+
+  if (list->count < MAXGAPS)
+    list->gaps[list->count] = *gap;
+
+  list->count++;
+}
+
+TEST (gapstream, descriptors)
+{
+  MS3GapStream *gs = NULL;
+  GapList list = {0};
+  double mingap = 0.0;
+  const char *sid = "FDSN:XX_TEST__B_H_Z";
+  nstime_t second = NSTMODULUS;
+  int rv;
+
+  gs = ms3_gapstream_init (NULL, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  /* 1 Hz records of 10 samples: contiguous, a 6 second gap, a 2 second overlap */
+  rv = ms3_gapstream_add (gs, sid, 0, 9 * second, 1.0);
+  rv |= ms3_gapstream_add (gs, sid, 10 * second, 19 * second, 1.0);
+  rv |= ms3_gapstream_add (gs, sid, 25 * second, 34 * second, 1.0);
+  rv |= ms3_gapstream_add (gs, sid, 33 * second, 42 * second, 1.0);
+  rv |= ms3_gapstream_add (gs, sid, 43 * second, 52 * second, 0.0);
+  rv |= ms3_gapstream_add (gs, "FDSN:XX_TEST__B_H_N", 100 * second, 109 * second, 1.0);
+  CHECK (rv == 0, "ms3_gapstream_add() did not return expected 0");
+
+  REQUIRE (list.count == 2, "Gap count is not expected 2");
+
+  CHECK_STREQ (list.gaps[0].sid, sid);
+  CHECK (list.gaps[0].lasttime == 19 * second, "Gap last time is not expected");
+  CHECK (list.gaps[0].nexttime == 25 * second, "Gap next time is not expected");
+  CHECK (list.gaps[0].gap == 6.0, "Gap is not expected 6.0");
+  CHECK (list.gaps[0].nsamples == 5.0, "Gap samples is not expected 5.0");
+
+  CHECK (list.gaps[1].gap == -1.0, "Overlap is not expected -1.0");
+  CHECK (list.gaps[1].nsamples == 2.0, "Overlap samples is not expected 2.0");
+
+  ms3_gapstream_free (&gs);
+  CHECK (gs == NULL, "ms3_gapstream_free() did not set pointer to NULL");
+
+  /* Minimum gap of 0 excludes overlaps */
+  memset (&list, 0, sizeof (list));
+  gs = ms3_gapstream_init (&mingap, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  ms3_gapstream_add (gs, sid, 0, 9 * second, 1.0);
+  ms3_gapstream_add (gs, sid, 5 * second, 14 * second, 1.0);
+  ms3_gapstream_add (gs, sid, 20 * second, 29 * second, 1.0);
+
+  CHECK (list.count == 1, "Gap count with minimum gap is not expected 1");
+  CHECK (list.gaps[0].gap == 6.0, "Gap with minimum gap is not expected 6.0");
+
+  /* A record within the current segment does not move its end back */
+  memset (&list, 0, sizeof (list));
+  ms3_gapstream_add (gs, "FDSN:XX_TEST__B_H_E", 0, 19 * second, 1.0);
+  ms3_gapstream_add (gs, "FDSN:XX_TEST__B_H_E", 5 * second, 9 * second, 1.0);
+  ms3_gapstream_add (gs, "FDSN:XX_TEST__B_H_E", 20 * second, 29 * second, 1.0);
+
+  CHECK (list.count == 0, "Gap reported after record within segment");
+
+  ms3_gapstream_free (&gs);
+}
+
+TEST (gapstream, manysids)
+{
+  MS3GapStream *gs = NULL;
+  GapList list = {0};
+  char sid[LM_SIDLEN];
+  nstime_t second = NSTMODULUS;
+  int idx;
+
+  gs = ms3_gapstream_init (NULL, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  /* Enough source IDs to grow the table, contiguous then one gap each */
+  for (idx = 0; idx < 1000; idx++)
+  {
+    snprintf (sid, sizeof (sid), "FDSN:XX_S%d__B_H_Z", idx);
+    ms3_gapstream_add (gs, sid, 0, 9 * second, 1.0);
+  }
+  for (idx = 0; idx < 1000; idx++)
+  {
+    snprintf (sid, sizeof (sid), "FDSN:XX_S%d__B_H_Z", idx);
+    ms3_gapstream_add (gs, sid, 10 * second, 19 * second, 1.0);
+  }
+
+  CHECK (list.count == 0, "Gap count of contiguous records is not expected 0");
+
+  for (idx = 0; idx < 1000; idx++)
+  {
+    snprintf (sid, sizeof (sid), "FDSN:XX_S%d__B_H_Z", idx);
+    ms3_gapstream_add (gs, sid, 30 * second, 39 * second, 1.0);
+  }
+
+  CHECK (list.count == 1000, "Gap count is not expected 1000");
+
+  ms3_gapstream_free (&gs);
+}
+
+TEST (gapstream, files)
+{
+  MS3GapStream *gs = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3Record *msr = NULL;
+  GapList list = {0};
+  const char *paths[4];
+  char record[4096];
+  FILE *fp;
+  int64_t records;
+  int idx;
+  int rv;
+
+  char *v3path = "data/testdata-3channel-signal.mseed3";
+  char *v2path = "data/testdata-3channel-signal.mseed2";
+  char *tcpath = "data/testdata-unapplied-timecorrection.mseed2";
+  nstime_t second = NSTMODULUS;
+
+  /* Continuous data, no gaps */
+  gs = ms3_gapstream_init (NULL, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  records = ms3_gapstream_readfile (gs, v3path, 0, 0);
+  CHECK (records == 107, "ms3_gapstream_readfile() did not return expected 107 records");
+  CHECK (list.count == 0, "Gap count of continuous data is not expected 0");
+
+  records = ms3_gapstream_readfile (gs, v2path, 0, 0);
+  CHECK (records == 107, "ms3_gapstream_readfile() did not return expected 107 records");
+  CHECK (list.count == 3, "Overlap count of repeated data is not expected 3");
+
+  ms3_gapstream_free (&gs);
+
+  /* Same files read in parallel result in the same gaps, in the same order */
+  for (idx = 0; idx < 4; idx++)
+    paths[idx] = (idx % 2) ? v2path : v3path;
+
+  memset (&list, 0, sizeof (list));
+  gs = ms3_gapstream_init (NULL, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  records = ms3_gapstream_readfiles (gs, paths, 4, 3, 0, 0);
+  CHECK (records == 428, "ms3_gapstream_readfiles() did not return expected 428 records");
+  REQUIRE (list.count == 9, "Overlap count of repeated data is not expected 9");
+
+  mstl = mstl3_init (NULL);
+  rv = ms3_readtracelist (&mstl, v3path, NULL, 0, 0, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  for (idx = 0; idx < 9; idx++)
+  {
+    MS3TraceID *id = mstl3_findID (mstl, list.gaps[idx].sid, 0, NULL);
+
+    REQUIRE (id != NULL, "Source ID of overlap not found in trace list");
+    CHECK (list.gaps[idx].lasttime == id->latest, "Overlap last time is not end of trace");
+    CHECK (list.gaps[idx].nexttime == id->earliest, "Overlap next time is not start of trace");
+    CHECK (list.gaps[idx].gap < 0.0, "Overlap is not negative");
+  }
+
+  mstl3_free (&mstl, 0);
+  ms3_gapstream_free (&gs);
+
+  /* Record start time includes unapplied time correction */
+  fp = fopen (tcpath, "rb");
+  REQUIRE (fp != NULL, "Cannot open test file");
+  rv = (int)fread (record, 1, sizeof (record), fp);
+  fclose (fp);
+  REQUIRE (rv == 4096, "Cannot read test record");
+
+  rv = msr3_parse (record, sizeof (record), &msr, 0, 0);
+  REQUIRE (rv == MS_NOERROR, "msr3_parse() did not return expected MS_NOERROR");
+
+  memset (&list, 0, sizeof (list));
+  gs = ms3_gapstream_init (NULL, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  records = ms3_gapstream_addrecord (gs, record, sizeof (record));
+  CHECK (records == 4096, "ms3_gapstream_addrecord() did not return expected 4096");
+
+  /* A record starting one second later than expected is a gap */
+  ms3_gapstream_add (gs, msr->sid, msr3_endtime (msr) + second + (nstime_t)(NSTMODULUS / msr->samprate),
+                     msr3_endtime (msr) + 10 * second, msr->samprate);
+  REQUIRE (list.count == 1, "Gap count is not expected 1");
+  CHECK (list.gaps[0].lasttime == msr3_endtime (msr), "Gap last time is not end of parsed record");
+
+  CHECK (ms3_gapstream_addrecord (gs, record, 100) == 0,
+         "ms3_gapstream_addrecord() did not return 0 for a short buffer");
+
+  msr3_free (&msr);
+  ms3_gapstream_free (&gs);
+}
+
+TEST (gapstream, files_error)
+{
+  MS3GapStream *gs = NULL;
+  GapList list = {0};
+  const char *paths[64];
+  int64_t records;
+  int idx;
+
+  /* A file that cannot be read stops reading without waiting for unclaimed files */
+  paths[0] = "data/no-such-file.mseed";
+  for (idx = 1; idx < 64; idx++)
+    paths[idx] = "data/testdata-3channel-signal.mseed3";
+
+  gs = ms3_gapstream_init (NULL, NULL, gap_handler, &list);
+  REQUIRE (gs != NULL, "ms3_gapstream_init() returned unexpected NULL");
+
+  records = ms3_gapstream_readfiles (gs, paths, 64, 2, 0, 0);
+  CHECK (records < 0, "ms3_gapstream_readfiles() did not return an error for a missing file");
+  CHECK (list.count == 0, "Gaps reported after a file could not be read");
+
+  ms3_gapstream_free (&gs);
+}
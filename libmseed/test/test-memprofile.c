@@ -0,0 +1,106 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+#include "testdata.h"
+
+static void
+discard_handler (char *record, int reclen, void *handlerdata)
+{
+  (void)record;
+  (void)reclen;
+  (void)handlerdata;
+}
+
+TEST (memprofile, subsystems)
+{
+  MSMemProfile subsystems[MS_MEMPROF_SUBSYSTEMS];
+  MSMemProfile total;
+  MS3Record *msr = NULL;
+  MS3TraceList *mstl = NULL;
+  LIBMSEED_MEMORY profiled;
+  int32_t sinedata[SINE_DATA_SAMPLES];
+  int64_t packedsamples;
+  int64_t packedrecords;
+  void *ptr;
+  int idx;
+  int rv;
+
+  CHECK (ms_memprofile_get (subsystems, &total) == -1, "ms_memprofile_get() did not return -1 when disabled");
+
+  /* Allocated before profiling, freed while profiling */
+  ptr = libmseed_memory.malloc (100);
+
+  rv = ms_memprofile_enable ();
+  REQUIRE (rv == 0, "ms_memprofile_enable() did not return 0");
+
+  libmseed_memory.free (ptr);
+
+  for (idx = 0; idx < SINE_DATA_SAMPLES; idx++)
+    sinedata[idx] = (int32_t)(fsinedata[idx]);
+
+  msr = msr3_init (msr);
+  REQUIRE (msr != NULL, "msr3_init() returned unexpected NULL");
+
+  msr->reclen      = 512;
+  msr->pubversion  = 1;
+  msr->starttime   = ms_timestr2nstime ("2012-05-12T00:00:00");
+  msr->samprate    = 40.0;
+  msr->encoding    = DE_STEIM1;
+  msr->numsamples  = SINE_DATA_SAMPLES;
+  msr->datasamples = sinedata;
+  msr->sampletype  = 'i';
+  strcpy (msr->sid, "FDSN:XX_TEST__B_H_Z");
+
+  packedrecords = msr3_pack (msr, discard_handler, NULL, &packedsamples, MSF_FLUSHDATA, 0);
+  CHECK (packedrecords > 0, "msr3_pack() did not pack records");
+
+  msr->datasamples = NULL;
+  msr3_free (&msr);
+
+  rv = ms3_readtracelist (&mstl, "data/testdata-oneseries-mixedlengths-mixedorder.mseed2",
+                          NULL, 0, MSF_UNPACKDATA, 0);
+  CHECK (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  rv = ms_memprofile_get (subsystems, &total);
+  REQUIRE (rv == 0, "ms_memprofile_get() did not return 0");
+
+  CHECK (subsystems[MS_MEMPROF_RECORD].allocs > 0, "No record allocations counted");
+  CHECK (subsystems[MS_MEMPROF_PACK].allocs > 0, "No packing allocations counted");
+  CHECK (subsystems[MS_MEMPROF_PACK].livebytes == 0, "Packing allocations not freed");
+  CHECK (subsystems[MS_MEMPROF_PACK].peakbytes >= 512, "Packing peak bytes not tracked");
+  CHECK (subsystems[MS_MEMPROF_TRACELIST].allocs > 0, "No trace list allocations counted");
+  CHECK (subsystems[MS_MEMPROF_TRACELIST].reallocs > 0, "No trace list re-allocations counted");
+  CHECK (subsystems[MS_MEMPROF_TRACELIST].livebytes > 0, "No live trace list allocations");
+  CHECK (subsystems[MS_MEMPROF_OTHER].frees == 0, "Untracked free was counted");
+  CHECK (total.livebytes <= total.peakbytes, "Total live bytes exceed peak");
+  CHECK_STREQ (ms_memprofile_name (MS_MEMPROF_TRACELIST), "tracelist");
+
+  mstl3_free (&mstl, 1);
+  ms3_readmsr (&msr, NULL, 0, 0);
+
+  rv = ms_memprofile_get (subsystems, &total);
+  CHECK (subsystems[MS_MEMPROF_TRACELIST].livebytes == 0, "Trace list allocations not freed");
+  CHECK (subsystems[MS_MEMPROF_TRACELIST].frees > 0, "No trace list frees counted");
+
+  ms_memprofile_reset ();
+  rv = ms_memprofile_get (subsystems, &total);
+  CHECK (total.allocs == 0, "ms_memprofile_reset() did not reset counts");
+  CHECK (total.peakbytes == total.livebytes, "ms_memprofile_reset() did not reset peak");
+
+  /* Allocated while profiling, freed after */
+  ptr = libmseed_memory.malloc (100);
+  profiled = libmseed_memory;
+
+  CHECK (ms_memprofile_disable () == 0, "ms_memprofile_disable() did not return 0");
+  CHECK (ms_memprofile_disable () == -1, "ms_memprofile_disable() did not return -1 when disabled");
+  CHECK (libmseed_memory.malloc == malloc, "Allocators not restored");
+
+  libmseed_memory.free (ptr);
+
+  /* Profiler allocators obtained before disabling still work */
+  ptr = profiled.malloc (100);
+  CHECK (ptr != NULL, "Profiler malloc after disabling returned NULL");
+  ptr = profiled.realloc (ptr, 200);
+  CHECK (ptr != NULL, "Profiler realloc after disabling returned NULL");
+  profiled.free (ptr);
+}
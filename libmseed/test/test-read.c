@@ -398,6 +398,231 @@ TEST (read, selection)
   ms3_freeselections (selections);
 }
 
+/* Compare the segments and samples of two trace lists */
+static int
+same_samples (MS3TraceList *mstl1, MS3TraceList *mstl2)
+{
+  MS3TraceID *id1 = mstl1->traces.next[0];
+  MS3TraceID *id2 = mstl2->traces.next[0];
+  MS3TraceSeg *seg1;
+  MS3TraceSeg *seg2;
+
+  for (; id1 && id2; id1 = id1->next[0], id2 = id2->next[0])
+  {
+    for (seg1 = id1->first, seg2 = id2->first; seg1 && seg2; seg1 = seg1->next, seg2 = seg2->next)
+    {
+      if (seg1->numsamples != seg2->numsamples || seg1->sampletype != seg2->sampletype ||
+          memcmp (seg1->datasamples, seg2->datasamples,
+                  (size_t)seg1->numsamples * ms_samplesize (seg1->sampletype)))
+        return 0;
+    }
+
+    if (seg1 || seg2)
+      return 0;
+  }
+
+  return (id1 == NULL && id2 == NULL);
+}
+
+TEST (read, blockcache)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  nstime_t starttime;
+  nstime_t endtime;
+  uint64_t hits0, misses0;
+  uint64_t hits, misses, blocks, bytes;
+  uint32_t flags = MSF_UNPACKDATA;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+
+  starttime = ms_timestr2nstime ("2010-02-27T06:52:00Z");
+  endtime = ms_timestr2nstime ("2010-02-27T06:55:00Z");
+
+  /* Reference time window without cache */
+  rv = ms3_readtracelist_timewin (&reference, path, NULL, starttime, endtime, 0, flags, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+
+  rv = ms3_blockcache_set (10 * 1024 * 1024);
+  REQUIRE (rv == 0, "ms3_blockcache_set() returned an unexpected error");
+  ms3_blockcache_stats (&hits0, &misses0, NULL, NULL);
+
+  /* First read decodes and fills the cache */
+  rv = ms3_readtracelist_timewin (&mstl, path, NULL, starttime, endtime, 0, flags, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Cache filling read does not match reference");
+  mstl3_free (&mstl, 0);
+
+  ms3_blockcache_stats (&hits, &misses, &blocks, &bytes);
+  CHECK (hits == hits0, "Unexpected cache hits on first read");
+  CHECK (misses > misses0, "Expected cache misses on first read");
+  CHECK (blocks == misses - misses0, "Cached block count is not the number of decoded records");
+  CHECK (bytes > 0 && bytes <= 10 * 1024 * 1024, "Cached bytes not within budget");
+
+  /* Same window is served from the cache */
+  hits0 = hits;
+  misses0 = misses;
+  rv = ms3_readtracelist_timewin (&mstl, path, NULL, starttime, endtime, 0, flags, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Cached read does not match reference");
+  mstl3_free (&mstl, 0);
+
+  ms3_blockcache_stats (&hits, &misses, NULL, NULL);
+  CHECK (hits - hits0 == blocks, "Expected all records from the cache");
+  CHECK (misses == misses0, "Unexpected cache misses on repeated read");
+
+  /* Record list unpacking is served from the cache */
+  hits0 = hits;
+  rv = ms3_readtracelist_timewin (&mstl, path, NULL, starttime, endtime, 0, MSF_RECORDLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+    for (seg = id->first; seg; seg = seg->next)
+      CHECK (mstl3_unpack_recordlist (id, seg, NULL, 0, 0) == seg->samplecnt,
+             "mstl3_unpack_recordlist() did not return expected sample count");
+
+  CHECK (same_samples (reference, mstl), "Record list unpacked from cache does not match reference");
+  mstl3_free (&mstl, 0);
+
+  ms3_blockcache_stats (&hits, NULL, NULL, NULL);
+  CHECK (hits - hits0 == blocks, "Expected all record list entries from the cache");
+
+  /* Small budget evicts least recently used blocks */
+  rv = ms3_blockcache_set (16384);
+  REQUIRE (rv == 0, "ms3_blockcache_set() returned an unexpected error");
+  ms3_blockcache_stats (NULL, NULL, &blocks, &bytes);
+  CHECK (blocks > 0 && bytes <= 16384, "Cache not reduced to budget");
+
+  rv = ms3_readtracelist_timewin (&mstl, path, NULL, starttime, endtime, 0, flags, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Read with small cache does not match reference");
+  mstl3_free (&mstl, 0);
+
+  ms3_blockcache_stats (NULL, NULL, NULL, &bytes);
+  CHECK (bytes <= 16384, "Cached bytes not within reduced budget");
+
+  /* Disabling frees all blocks */
+  ms3_blockcache_set (0);
+  ms3_blockcache_stats (NULL, NULL, &blocks, &bytes);
+  CHECK (blocks == 0 && bytes == 0, "Disabled cache is not empty");
+
+  mstl3_free (&reference, 0);
+}
+
+TEST (read, nocache)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  FILE *fp;
+  int64_t records;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+  char *output = "testdata-nocache.mseed3";
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Reading while releasing the page cache returns the same data */
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_UNPACKDATA | MSF_NOCACHE, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Read with MSF_NOCACHE does not match reference");
+  mstl3_free (&mstl, 0);
+
+  /* Writing while releasing the page cache */
+  records = mstl3_writemseed (reference, output, 1, 4096, DE_STEIM2, MSF_NOCACHE, 0);
+  CHECK (records > 0, "mstl3_writemseed() did not write records");
+
+  rv = ms3_readtracelist (&mstl, output, NULL, 0, MSF_UNPACKDATA | MSF_NOCACHE, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Written with MSF_NOCACHE does not match reference");
+  mstl3_free (&mstl, 0);
+
+  /* Releasing a whole file */
+  fp = fopen (output, "rb");
+  REQUIRE (fp != NULL, "Cannot open written file");
+  CHECK (lmp_fdropcache (fp, 0, 0, 0) == 0, "lmp_fdropcache() did not return expected 0");
+  fclose (fp);
+
+  remove (output);
+  mstl3_free (&reference, 0);
+}
+
+TEST (read, sortedfixed)
+{
+  MS3Selections *selections = NULL;
+  MS3TraceList *input = NULL;
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  FILE *fp;
+  char zeros[512] = {0};
+  nstime_t starttime;
+  nstime_t endtime;
+  int64_t records;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+  char *output = "testdata-sortedfixed.mseed2";
+
+  /* Write one source ID as fixed-length 512-byte version 2 records */
+  rv = ms3_addselect (&selections, "FDSN:IU_COLA_00_L_H_1", NSTUNSET, NSTUNSET, 0);
+  REQUIRE (rv == 0, "ms3_addselect() did not return expected 0");
+
+  rv = ms3_readtracelist_selection (&input, path, NULL, selections, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_selection() did not return expected MS_NOERROR");
+  REQUIRE (input->numtraceids == 1, "Selection did not return expected 1 trace");
+  id = input->traces.next[0];
+
+  records = mstl3_writemseed (input, output, 1, 512, DE_STEIM2, MSF_PACKVER2, 0);
+  REQUIRE (records > 16, "mstl3_writemseed() did not write expected records");
+
+  starttime = id->first->endtime - (nstime_t)600 * NSTMODULUS;
+  endtime = id->first->endtime;
+
+  /* Reference time window read of the complete file */
+  rv = ms3_readtracelist_timewin (&reference, output, NULL, starttime, endtime, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+
+  rv = ms3_readtracelist_timewin (&mstl, output, NULL, starttime, endtime, 0,
+                                  MSF_UNPACKDATA | MSF_SORTEDFIXED, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Bisected read does not match reference");
+  mstl3_free (&mstl, 0);
+
+  /* Overwrite the second record, only a bisected read does not reach it */
+  fp = fopen (output, "r+b");
+  REQUIRE (fp != NULL, "Cannot open written file");
+  fseek (fp, 512, SEEK_SET);
+  fwrite (zeros, sizeof (zeros), 1, fp);
+  fclose (fp);
+
+  rv = ms3_readtracelist_timewin (&mstl, output, NULL, starttime, endtime, 0, MSF_UNPACKDATA, 0);
+  CHECK (rv != MS_NOERROR, "Complete read did not fail on overwritten record");
+  mstl3_free (&mstl, 0);
+
+  rv = ms3_readtracelist_timewin (&mstl, output, NULL, starttime, endtime, 0,
+                                  MSF_UNPACKDATA | MSF_SORTEDFIXED, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+  CHECK (same_samples (reference, mstl), "Bisected read does not match reference");
+  mstl3_free (&mstl, 0);
+
+  /* A window after the data matches no records */
+  rv = ms3_readtracelist_timewin (&mstl, output, NULL, endtime + NSTMODULUS, NSTUNSET, 0,
+                                  MSF_UNPACKDATA | MSF_SORTEDFIXED, 0);
+  CHECK (rv == MS_NOERROR, "ms3_readtracelist_timewin() did not return expected MS_NOERROR");
+  CHECK (mstl->numtraceids == 0, "Window after the data returned traces");
+  mstl3_free (&mstl, 0);
+
+  remove (output);
+  mstl3_free (&reference, 0);
+  mstl3_free (&input, 0);
+  ms3_freeselections (selections);
+}
+
 TEST (read, oddball)
 {
   MS3Record *msr = NULL;
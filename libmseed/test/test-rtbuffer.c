@@ -0,0 +1,252 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+#include <pthread.h>
+
+#define RTBUFFER_TESTFILE "data/testdata-3channel-signal.mseed3"
+
+/* Add all records of a file to a real-time buffer */
+static int64_t
+add_file (MS3RTBuffer *rtb, const char *path)
+{
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  int64_t samples = 0;
+  int64_t added;
+  int rv;
+
+  while ((rv = ms3_readmsr_r (&msfp, &msr, path, MSF_UNPACKDATA, 0)) == MS_NOERROR)
+  {
+    if ((added = ms3_rtbuffer_addmsr (rtb, msr, 0)) < 0)
+    {
+      samples = -1;
+      break;
+    }
+
+    samples += added;
+  }
+
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+
+  return samples;
+}
+
+/* Check that the samples of a segment match the reference segment at the same time */
+static int
+match_reference (MS3TraceList *reference, const char *sid, const MS3TraceSeg *seg)
+{
+  MS3TraceID *id;
+  int64_t offset;
+
+  if ((id = mstl3_findID (reference, sid, 0, NULL)) == NULL || seg->sampletype != 'i')
+    return 0;
+
+  offset = (int64_t)((double)(seg->starttime - id->first->starttime) * id->first->samprate / NSTMODULUS + 0.5);
+
+  if (offset < 0 || offset + seg->numsamples > id->first->numsamples)
+    return 0;
+
+  return !memcmp (seg->datasamples, (int32_t *)id->first->datasamples + offset,
+                  (size_t)seg->numsamples * sizeof (int32_t));
+}
+
+TEST (rtbuffer, retention)
+{
+  MS3RTBuffer *rtb = NULL;
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  MS3TraceID *refid;
+  MS3Record *msr = NULL;
+  MS3FileParam *msfp = NULL;
+  nstime_t cutoff;
+  int64_t samples;
+  int rv;
+
+  rv = ms3_readtracelist (&reference, RTBUFFER_TESTFILE, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Retention longer than the data, small blocks: everything is retained */
+  rtb = ms3_rtbuffer_init (86400.0, 100);
+  REQUIRE (rtb != NULL, "ms3_rtbuffer_init() returned unexpected NULL");
+
+  samples = add_file (rtb, RTBUFFER_TESTFILE);
+  CHECK (samples == 3 * 4200, "ms3_rtbuffer_addmsr() did not add expected 12600 samples");
+
+  samples = ms3_rtbuffer_snapshot (rtb, &mstl, NULL, 0);
+  CHECK (samples == 3 * 4200, "ms3_rtbuffer_snapshot() did not return expected 12600");
+  REQUIRE (mstl != NULL && mstl->numtraceids == 3, "Snapshot does not contain expected 3 traces");
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    refid = mstl3_findID (reference, id->sid, 0, NULL);
+    REQUIRE (refid != NULL, "Snapshot trace not in reference");
+
+    CHECK (id->numsegments == 1, "Snapshot trace does not have expected 1 segment");
+    CHECK (id->first->starttime == refid->first->starttime, "Snapshot start time is not expected");
+    CHECK (id->first->numsamples == 4200, "Snapshot segment does not have expected 4200 samples");
+    CHECK (match_reference (reference, id->sid, id->first), "Snapshot samples do not match");
+  }
+
+  mstl3_free (&mstl, 0);
+
+  /* Records that do not follow the newest data are not added */
+  rv = ms3_readmsr_r (&msfp, &msr, RTBUFFER_TESTFILE, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readmsr_r() did not return expected MS_NOERROR");
+  CHECK (ms3_rtbuffer_addmsr (rtb, msr, 0) == 0, "ms3_rtbuffer_addmsr() did not return expected 0");
+
+  /* Records without decoded samples are decoded */
+  rv = ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+  rv = ms3_readmsr_r (&msfp, &msr, RTBUFFER_TESTFILE, 0, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readmsr_r() did not return expected MS_NOERROR");
+  ms3_rtbuffer_free (&rtb);
+  rtb = ms3_rtbuffer_init (600.0, 0);
+  REQUIRE (rtb != NULL, "ms3_rtbuffer_init() returned unexpected NULL");
+  CHECK (ms3_rtbuffer_addmsr (rtb, msr, 0) == msr->samplecnt, "ms3_rtbuffer_addmsr() did not decode record");
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+  ms3_rtbuffer_free (&rtb);
+
+  /* Retention of 10 minutes with blocks of 100 samples */
+  rtb = ms3_rtbuffer_init (600.0, 100);
+  REQUIRE (rtb != NULL, "ms3_rtbuffer_init() returned unexpected NULL");
+
+  samples = add_file (rtb, RTBUFFER_TESTFILE);
+  CHECK (samples == 3 * 4200, "ms3_rtbuffer_addmsr() did not add expected 12600 samples");
+
+  samples = ms3_rtbuffer_snapshot (rtb, &mstl, "FDSN:IU_COLA_00_L_H_1", 0);
+  CHECK (samples == 601, "ms3_rtbuffer_snapshot() did not return expected 601");
+  REQUIRE (mstl != NULL && mstl->numtraceids == 1, "Snapshot does not contain expected 1 trace");
+
+  id = mstl->traces.next[0];
+  refid = mstl3_findID (reference, id->sid, 0, NULL);
+  REQUIRE (refid != NULL, "Snapshot trace not in reference");
+
+  cutoff = refid->first->endtime - (nstime_t)600 * NSTMODULUS;
+  CHECK (id->numsegments == 1, "Snapshot trace does not have expected 1 segment");
+  CHECK (id->first->starttime >= cutoff, "Snapshot includes expired samples");
+  CHECK (id->first->starttime - NSTMODULUS < cutoff, "Snapshot is missing retained samples");
+  CHECK (id->first->endtime == refid->first->endtime, "Snapshot end time is not expected");
+  CHECK (match_reference (reference, id->sid, id->first), "Snapshot samples do not match");
+
+  mstl3_free (&mstl, 0);
+  ms3_rtbuffer_free (&rtb);
+  CHECK (rtb == NULL, "ms3_rtbuffer_free() did not set pointer to NULL");
+
+  mstl3_free (&reference, 0);
+}
+
+TEST (rtbuffer, gaps)
+{
+  MS3RTBuffer *rtb = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  MS3Record *msr = NULL;
+  MS3FileParam *msfp = NULL;
+  int64_t added = 0;
+  int64_t samples;
+  int64_t count = 0;
+  int rv;
+
+  rtb = ms3_rtbuffer_init (86400.0, 4096);
+  REQUIRE (rtb != NULL, "ms3_rtbuffer_init() returned unexpected NULL");
+
+  /* Every other record of each trace, leaving a gap after each added record */
+  while ((rv = ms3_readmsr_r (&msfp, &msr, RTBUFFER_TESTFILE, MSF_UNPACKDATA, 0)) == MS_NOERROR)
+  {
+    if (count++ % 2)
+      continue;
+
+    if ((samples = ms3_rtbuffer_addmsr (rtb, msr, 0)) < 0)
+      break;
+
+    added += samples;
+  }
+
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+  CHECK (rv == MS_ENDOFFILE, "Cannot add all test records");
+
+  samples = ms3_rtbuffer_snapshot (rtb, &mstl, NULL, 0);
+  CHECK (samples == added, "ms3_rtbuffer_snapshot() did not return all added samples");
+  REQUIRE (mstl != NULL && mstl->numtraceids == 3, "Snapshot does not contain expected 3 traces");
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    CHECK (id->numsegments > 1, "Snapshot trace does not have expected gaps");
+  }
+
+  mstl3_free (&mstl, 0);
+  ms3_rtbuffer_free (&rtb);
+}
+
+/* Writer adding all records of the test file */
+static void *
+writer_thread (void *arg)
+{
+  add_file ((MS3RTBuffer *)arg, RTBUFFER_TESTFILE);
+
+  return NULL;
+}
+
+TEST (rtbuffer, concurrent_snapshots)
+{
+  MS3RTBuffer *rtb = NULL;
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl;
+  MS3TraceID *id;
+  pthread_t writer;
+  nstime_t cutoff;
+  int64_t samples = 0;
+  int consistent = 1;
+  int iteration;
+  int rv;
+
+  rv = ms3_readtracelist (&reference, RTBUFFER_TESTFILE, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  rtb = ms3_rtbuffer_init (1200.0, 64);
+  REQUIRE (rtb != NULL, "ms3_rtbuffer_init() returned unexpected NULL");
+
+  REQUIRE (pthread_create (&writer, NULL, writer_thread, rtb) == 0, "Cannot create writer thread");
+
+  /* Every snapshot taken while records are added must be a single matching segment per trace */
+  for (iteration = 0; iteration < 200 && consistent; iteration++)
+  {
+    mstl = NULL;
+
+    if (ms3_rtbuffer_snapshot (rtb, &mstl, NULL, 0) < 0)
+      consistent = 0;
+
+    for (id = mstl->traces.next[0]; id && consistent; id = id->next[0])
+    {
+      if (id->numsegments != 1 || !match_reference (reference, id->sid, id->first))
+        consistent = 0;
+    }
+
+    mstl3_free (&mstl, 0);
+  }
+
+  pthread_join (writer, NULL);
+
+  CHECK (consistent, "Snapshot taken during writing is not consistent");
+
+  /* Every trace retains the window before its newest sample, the
+   * samples of the test data are not all exactly 1 second apart */
+  mstl = NULL;
+  samples = ms3_rtbuffer_snapshot (rtb, &mstl, NULL, 0);
+  CHECK (samples >= 3 * 1200 && samples <= 3 * 1201, "ms3_rtbuffer_snapshot() did not return expected samples");
+  CHECK (mstl->numtraceids == 3, "Snapshot does not have expected 3 traces");
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    cutoff = id->first->endtime - (nstime_t)1200 * NSTMODULUS;
+    CHECK (id->numsegments == 1, "Snapshot trace does not have expected 1 segment");
+    CHECK (id->first->starttime >= cutoff, "Snapshot includes expired samples");
+    CHECK (id->first->starttime - cutoff <= NSTMODULUS + NSTMODULUS / 2, "Snapshot is missing retained samples");
+    samples -= id->first->numsamples;
+  }
+
+  CHECK (samples == 0, "Snapshot sample count does not match segments");
+
+  mstl3_free (&mstl, 0);
+  ms3_rtbuffer_free (&rtb);
+  mstl3_free (&reference, 0);
+}
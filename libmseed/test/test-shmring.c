@@ -0,0 +1,113 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+#include "testdata.h"
+
+#define TESTRING_NAME "/libmseed-test-shmring"
+
+TEST (shmring, publish_read)
+{
+  MS3ShmRing *writer = NULL;
+  MS3ShmRing *reader = NULL;
+  MS3ShmRing *other = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *readmsr = NULL;
+  int32_t sinedata[SINE_DATA_SAMPLES];
+  int64_t packedsamples;
+  int64_t packedrecords;
+  uint64_t seqnum = 0;
+  uint64_t lastseqnum = 0;
+  int64_t samplecount = 0;
+  int records = 0;
+  int idx;
+  int rv;
+
+  for (idx = 0; idx < SINE_DATA_SAMPLES; idx++)
+    sinedata[idx] = (int32_t)(fsinedata[idx]);
+
+  ms3_shmring_unlink (TESTRING_NAME);
+  ms_rloginit (NULL, NULL, NULL, NULL, 10);
+
+  writer = ms3_shmring_create (TESTRING_NAME, 4, 512, 0);
+  REQUIRE (writer != NULL, "ms3_shmring_create() returned unexpected NULL");
+
+  reader = ms3_shmring_open (TESTRING_NAME, 0);
+  REQUIRE (reader != NULL, "ms3_shmring_open() returned unexpected NULL");
+
+  rv = ms3_shmring_read (reader, &readmsr, NULL, 0, 0);
+  CHECK (rv == MS_ENDOFFILE, "ms3_shmring_read() of empty ring did not return MS_ENDOFFILE");
+
+  msr = msr3_init (msr);
+  REQUIRE (msr != NULL, "msr3_init() returned unexpected NULL");
+
+  msr->reclen      = 256;
+  msr->pubversion  = 1;
+  msr->starttime   = ms_timestr2nstime ("2012-05-12T00:00:00");
+  msr->samprate    = 40.0;
+  msr->encoding    = DE_STEIM1;
+  msr->numsamples  = SINE_DATA_SAMPLES;
+  msr->datasamples = sinedata;
+  msr->sampletype  = 'i';
+  strcpy (msr->sid, "FDSN:XX_TEST__B_H_Z");
+
+  packedrecords = msr3_pack (msr, ms3_shmring_record_handler, writer, &packedsamples, MSF_FLUSHDATA, 0);
+  CHECK (packedrecords > 4, "msr3_pack() did not create more records than ring slots");
+  CHECK (packedsamples == SINE_DATA_SAMPLES, "msr3_pack() did not pack all samples");
+
+  /* Reader started at the beginning of the ring, oldest records were overwritten */
+  reader->readseq = 1;
+  while ((rv = ms3_shmring_read (reader, &readmsr, &seqnum, MSF_UNPACKDATA, 0)) == MS_NOERROR)
+  {
+    CHECK_STREQ (readmsr->sid, "FDSN:XX_TEST__B_H_Z");
+    CHECK (readmsr->numsamples == readmsr->samplecnt, "Record samples not unpacked");
+    CHECK (seqnum > lastseqnum, "Sequence numbers are not increasing");
+    lastseqnum = seqnum;
+    samplecount += readmsr->numsamples;
+    records++;
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "ms3_shmring_read() did not return MS_ENDOFFILE");
+  CHECK (records == 4, "Did not read expected 4 records from ring");
+  CHECK (reader->lost == (uint64_t)(packedrecords - 4), "Lost record count is not expected");
+  CHECK (lastseqnum == (uint64_t)packedrecords, "Last sequence number is not expected");
+  CHECK (samplecount < SINE_DATA_SAMPLES, "Unexpected sample count from ring");
+
+  /* Records longer than the slot size are rejected */
+  msr->reclen = 1024;
+  packedrecords = msr3_pack (msr, ms3_shmring_record_handler, writer, &packedsamples, MSF_FLUSHDATA, 0);
+  rv = ms3_shmring_read (reader, &readmsr, NULL, 0, 0);
+  CHECK (rv == MS_ENDOFFILE, "Oversized records were unexpectedly published");
+
+  /* Attaching with matching geometry continues sequence numbering */
+  CHECK (ms3_shmring_close (&writer) == 0, "ms3_shmring_close() did not return 0");
+  writer = ms3_shmring_create (TESTRING_NAME, 4, 512, 0);
+  REQUIRE (writer != NULL, "ms3_shmring_create() returned unexpected NULL");
+  CHECK (ms3_shmring_write (writer, "not a record", 12) == (int64_t)lastseqnum + 1,
+         "Sequence number did not continue with existing ring");
+
+  rv = ms3_shmring_read (reader, &readmsr, NULL, 0, 0);
+  CHECK (rv < 0, "ms3_shmring_read() did not return error for invalid record");
+
+  /* Existing ring with different geometry is not re-created while attached */
+  other = ms3_shmring_create (TESTRING_NAME, 8, 512, 0);
+  CHECK (other == NULL, "ms3_shmring_create() with different geometry did not return NULL");
+  CHECK (ms3_shmring_read (reader, &readmsr, NULL, 0, 0) == MS_ENDOFFILE,
+         "Attached reader affected by different geometry");
+
+  /* Different geometry after removal, attached reader keeps the removed ring */
+  CHECK (ms3_shmring_unlink (TESTRING_NAME) == 0, "ms3_shmring_unlink() did not return 0");
+  other = ms3_shmring_create (TESTRING_NAME, 8, 512, 0);
+  REQUIRE (other != NULL, "ms3_shmring_create() after removal returned unexpected NULL");
+  CHECK (other->slotcount == 8, "Re-created ring does not have expected 8 slots");
+  ms3_shmring_close (&other);
+
+  ms_rlog_free (NULL);
+
+  msr->datasamples = NULL;
+  msr3_free (&msr);
+  msr3_free (&readmsr);
+  ms3_shmring_close (&reader);
+  ms3_shmring_close (&writer);
+  CHECK (ms3_shmring_unlink (TESTRING_NAME) == 0, "ms3_shmring_unlink() did not return 0");
+  CHECK (ms3_shmring_unlink (TESTRING_NAME) == 0, "ms3_shmring_unlink() of removed ring did not return 0");
+}
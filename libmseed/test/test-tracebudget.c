@@ -0,0 +1,188 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+/* Compare all segment samples of a budgeted list to a reference list */
+static int
+compare_samples (MS3TraceList *mstl, MS3TraceList *reference)
+{
+  MS3TraceID *id;
+  MS3TraceID *refid;
+  MS3TraceSeg *seg;
+  MS3TraceSeg *refseg;
+  void *samples;
+
+  for (id = mstl->traces.next[0], refid = reference->traces.next[0];
+       id && refid; id = id->next[0], refid = refid->next[0])
+  {
+    for (seg = id->first, refseg = refid->first;
+         seg && refseg; seg = seg->next, refseg = refseg->next)
+    {
+      if ((samples = mstl3_segment_samples (seg, 0)) == NULL)
+        return -1;
+
+      if (seg->numsamples != refseg->numsamples || seg->sampletype != refseg->sampletype)
+        return -1;
+
+      if (memcmp (samples, refseg->datasamples, refseg->numsamples * ms_samplesize (refseg->sampletype)))
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Count segments with released samples */
+static int
+count_released (MS3TraceList *mstl)
+{
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  int released = 0;
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+    for (seg = id->first; seg; seg = seg->next)
+      if (seg->samplecnt > 0 && seg->datasamples == NULL)
+        released++;
+
+  return released;
+}
+
+TEST (tracebudget, spill_file)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  int32_t *samples;
+  int32_t original;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() returned unexpected NULL");
+
+  /* Budget for two of the three segments of samples */
+  rv = mstl3_set_budget (mstl, 40000, NULL);
+  CHECK (rv == 0, "mstl3_set_budget() did not return 0");
+
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (mstl->numtraceids == 3, "mstl->numtraceids is not expected 3");
+  CHECK (count_released (mstl) > 0, "No segments were released to stay within budget");
+
+  CHECK (compare_samples (mstl, reference) == 0, "Restored samples do not match reference");
+
+  /* Modified samples are retained through spilling */
+  samples = (int32_t *)mstl3_segment_samples (mstl->traces.next[0]->first, 1);
+  REQUIRE (samples != NULL, "mstl3_segment_samples() returned unexpected NULL");
+  original = samples[0];
+  samples[0] = original + 1;
+
+  /* Accessing the other segments releases the modified segment */
+  CHECK (mstl3_segment_samples (mstl->traces.next[0]->next[0]->first, 0) != NULL, "Segment samples not returned");
+  CHECK (mstl3_segment_samples (mstl->traces.next[0]->next[0]->next[0]->first, 0) != NULL, "Segment samples not returned");
+  CHECK (mstl->traces.next[0]->first->datasamples == NULL, "Modified segment was not released");
+
+  samples = (int32_t *)mstl3_segment_samples (mstl->traces.next[0]->first, 1);
+  REQUIRE (samples != NULL, "mstl3_segment_samples() returned unexpected NULL");
+  CHECK (samples[0] == original + 1, "Modified sample was not retained");
+  CHECK (compare_samples (mstl, reference) != 0, "Modified samples unexpectedly match reference");
+
+  samples = (int32_t *)mstl3_segment_samples (mstl->traces.next[0]->first, 1);
+  REQUIRE (samples != NULL, "mstl3_segment_samples() returned unexpected NULL");
+  samples[0] = original;
+
+  /* Removing the budget restores all samples */
+  rv = mstl3_set_budget (mstl, 0, NULL);
+  CHECK (rv == 0, "mstl3_set_budget() did not return 0");
+  CHECK (count_released (mstl) == 0, "Segments were not restored when budget was removed");
+  CHECK (compare_samples (mstl, reference) == 0, "Restored samples do not match reference");
+
+  mstl3_free (&mstl, 1);
+  mstl3_free (&reference, 1);
+}
+
+TEST (tracebudget, spill_reuse)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  int32_t *samples;
+  int32_t value;
+  int iteration;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() returned unexpected NULL");
+
+  rv = mstl3_set_budget (mstl, 40000, NULL);
+  CHECK (rv == 0, "mstl3_set_budget() did not return 0");
+
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Modified segments are spilled repeatedly, reusing released spill file regions */
+  for (iteration = 0; iteration < 10; iteration++)
+  {
+    for (id = mstl->traces.next[0], value = iteration * 10; id; id = id->next[0], value++)
+    {
+      samples = (int32_t *)mstl3_segment_samples (id->first, 1);
+      REQUIRE (samples != NULL, "mstl3_segment_samples() returned unexpected NULL");
+      samples[0] = value;
+    }
+  }
+
+  CHECK (count_released (mstl) > 0, "No segments were released to stay within budget");
+
+  for (id = mstl->traces.next[0], value = 90; id; id = id->next[0], value++)
+  {
+    samples = (int32_t *)mstl3_segment_samples (id->first, 0);
+    REQUIRE (samples != NULL, "mstl3_segment_samples() returned unexpected NULL");
+    CHECK (samples[0] == value, "Modified sample was not retained");
+  }
+
+  mstl3_free (&mstl, 1);
+}
+
+TEST (tracebudget, redecode_recordlist)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  char tmpdir[] = "/tmp/libmseed-test-XXXXXX";
+  char *spilldir;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+
+  spilldir = mkdtemp (tmpdir);
+  REQUIRE (spilldir != NULL, "mkdtemp() returned unexpected NULL");
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_UNPACKDATA | MSF_RECORDLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Setting a budget on a populated list releases segments immediately */
+  rv = mstl3_set_budget (mstl, 40000, spilldir);
+  CHECK (rv == 0, "mstl3_set_budget() did not return 0");
+  CHECK (count_released (mstl) == 2, "Segments were not released when budget was set");
+
+  CHECK (compare_samples (mstl, reference) == 0, "Decoded samples do not match reference");
+
+  /* Conversion restores and converts released segments */
+  CHECK (mstl->traces.next[0]->first->datasamples == NULL, "Segment was not released");
+  rv = mstl3_convertsamples (mstl->traces.next[0]->first, 'd', 0);
+  CHECK (rv == 0, "mstl3_convertsamples() did not return 0");
+  CHECK (mstl->traces.next[0]->first->sampletype == 'd', "Sample type is not expected 'd'");
+  CHECK (mstl->traces.next[0]->first->numsamples == reference->traces.next[0]->first->numsamples,
+         "Converted sample count is not expected");
+
+  mstl3_free (&mstl, 1);
+  mstl3_free (&reference, 1);
+
+  CHECK (rmdir (spilldir) == 0, "Spill directory is not empty");
+}
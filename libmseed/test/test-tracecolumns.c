@@ -0,0 +1,86 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+/* Read a complete file into an allocated buffer */
+static char *
+read_file (const char *path, long *length)
+{
+  FILE *fp;
+  char *buffer = NULL;
+
+  if ((fp = fopen (path, "rb")) == NULL)
+    return NULL;
+
+  fseek (fp, 0, SEEK_END);
+  *length = ftell (fp);
+  fseek (fp, 0, SEEK_SET);
+
+  if ((buffer = (char *)malloc (*length)) != NULL &&
+      fread (buffer, *length, 1, fp) != 1)
+  {
+    free (buffer);
+    buffer = NULL;
+  }
+
+  fclose (fp);
+
+  return buffer;
+}
+
+TEST (tracecolumns, export)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  MS3ColumnEntry entry;
+  char *data = NULL;
+  char *index = NULL;
+  long datalength = 0;
+  long indexlength = 0;
+  int64_t columns;
+  int column;
+  int rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+  char *datafile = "testdata-columns.dat";
+  char *indexfile = "testdata-columns.idx";
+
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  columns = mstl3_export_columns (mstl, datafile, indexfile, 2, 0);
+  CHECK (columns == 3, "mstl3_export_columns() did not return expected 3");
+
+  data = read_file (datafile, &datalength);
+  index = read_file (indexfile, &indexlength);
+  REQUIRE (data != NULL, "Cannot read data file");
+  REQUIRE (index != NULL, "Cannot read index file");
+
+  CHECK (indexlength == 16 + 3 * (long)sizeof (MS3ColumnEntry), "Index length is not expected");
+  CHECK (sizeof (MS3ColumnEntry) == 128, "Index entry size is not expected 128");
+  CHECK (memcmp (index, "MSCOLIDX", 8) == 0, "Index identifier is not expected");
+
+  /* Compare each column to trace list samples, valid on little endian hosts */
+  for (id = mstl->traces.next[0], column = 0; id && column < 3; id = id->next[0], column++)
+  {
+    memcpy (&entry, index + 16 + column * sizeof (MS3ColumnEntry), sizeof (MS3ColumnEntry));
+
+    CHECK_STREQ (entry.sid, id->sid);
+    CHECK_STREQ (entry.dtype, "<i4");
+    CHECK (entry.offset % MS_COLUMN_ALIGN == 0, "Column offset is not aligned");
+
+    if (!ms_bigendianhost ())
+    {
+      CHECK (entry.starttime == id->first->starttime, "Column start time is not expected");
+      CHECK (entry.numsamples == id->first->numsamples, "Column sample count is not expected");
+      REQUIRE ((long)(entry.offset + entry.numsamples * 4) <= datalength, "Column extends beyond data file");
+      CHECK (memcmp (data + entry.offset, id->first->datasamples, entry.numsamples * 4) == 0,
+             "Column samples do not match trace list");
+    }
+  }
+
+  free (data);
+  free (index);
+  remove (datafile);
+  remove (indexfile);
+  mstl3_free (&mstl, 0);
+}
@@ -0,0 +1,131 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+/* Read a complete file into an allocated buffer */
+static char *
+read_file (const char *path, long *length)
+{
+  FILE *fp;
+  char *buffer = NULL;
+
+  if ((fp = fopen (path, "rb")) == NULL)
+    return NULL;
+
+  fseek (fp, 0, SEEK_END);
+  *length = ftell (fp);
+  fseek (fp, 0, SEEK_SET);
+
+  if ((buffer = (char *)malloc (*length)) != NULL &&
+      fread (buffer, *length, 1, fp) != 1)
+  {
+    free (buffer);
+    buffer = NULL;
+  }
+
+  fclose (fp);
+
+  return buffer;
+}
+
+TEST (traceenvelope, export)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  MS3EnvelopeEntry entry;
+  char path[1024];
+  char *data = NULL;
+  long length = 0;
+  int64_t files;
+  int64_t entries;
+  int64_t expected;
+  uint64_t bucket;
+  uint64_t idx;
+  int32_t *samples;
+  int32_t pair[2];
+  int32_t min;
+  int32_t max;
+  int level;
+  int rv;
+
+  char *input = "data/testdata-3channel-signal.mseed3";
+  char *prefix = "testdata-envelope-";
+
+  rv = ms3_readtracelist (&mstl, input, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  files = mstl3_export_envelopes (mstl, prefix, 100, 0);
+  CHECK (files == 3, "mstl3_export_envelopes() did not return expected 3");
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    /* File names contain the source ID with ':' replaced */
+    snprintf (path, sizeof (path), "%s%s.env", prefix, id->sid);
+    REQUIRE (strchr (path, ':') != NULL, "Unexpected test data");
+    *strchr (path, ':') = '_';
+    data = read_file (path, &length);
+    REQUIRE (data != NULL, "Cannot read envelope file");
+
+    CHECK (memcmp (data, "MSENVIDX", 8) == 0, "Envelope identifier is not expected");
+    CHECK (sizeof (MS3EnvelopeEntry) == 128, "Envelope entry size is not expected 128");
+
+    /* 4200 samples in buckets of 100: 42, 21, 11, 6, 3, 2 and 1 buckets */
+    REQUIRE (id->numsegments == 1 && id->first->numsamples == 4200, "Unexpected test data");
+    memcpy (&entries, data + 16, 8);
+
+    /* Compare each level to the trace list samples, valid on little endian hosts */
+    if (!ms_bigendianhost ())
+    {
+      CHECK (entries == 7, "Envelope entry count is not expected 7");
+      samples = (int32_t *)id->first->datasamples;
+
+      for (level = 0; level < entries; level++)
+      {
+        memcpy (&entry, data + 32 + level * sizeof (MS3EnvelopeEntry), sizeof (MS3EnvelopeEntry));
+
+        CHECK_STREQ (entry.sid, id->sid);
+        CHECK_STREQ (entry.dtype, "<i4");
+        CHECK (entry.level == level, "Envelope level is not expected");
+        CHECK (entry.starttime == id->first->starttime, "Envelope start time is not expected");
+        CHECK (entry.bucketsamples == (uint64_t)100 << level, "Envelope bucket size is not expected");
+
+        expected = (4200 + entry.bucketsamples - 1) / entry.bucketsamples;
+        CHECK (entry.buckets == (uint64_t)expected, "Envelope bucket count is not expected");
+        REQUIRE ((long)(entry.offset + entry.buckets * 8) <= length, "Envelope level extends beyond file");
+
+        for (bucket = 0; bucket < entry.buckets; bucket++)
+        {
+          min = max = samples[bucket * entry.bucketsamples];
+
+          for (idx = bucket * entry.bucketsamples;
+               idx < (bucket + 1) * entry.bucketsamples && idx < 4200; idx++)
+          {
+            if (samples[idx] < min)
+              min = samples[idx];
+            if (samples[idx] > max)
+              max = samples[idx];
+          }
+
+          memcpy (pair, data + entry.offset + bucket * 8, 8);
+
+          if (pair[0] != min || pair[1] != max)
+            break;
+        }
+
+        CHECK (bucket == entry.buckets, "Envelope values do not match samples");
+      }
+    }
+
+    free (data);
+    remove (path);
+  }
+
+  /* No samples, no envelope files */
+  mstl3_free (&mstl, 0);
+  rv = ms3_readtracelist (&mstl, input, NULL, 0, 0, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  files = mstl3_export_envelopes (mstl, prefix, 0, 0);
+  CHECK (files == 0, "mstl3_export_envelopes() did not return expected 0");
+
+  mstl3_free (&mstl, 0);
+}
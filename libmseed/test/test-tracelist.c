@@ -1,5 +1,6 @@
 #include <tau/tau.h>
 #include <libmseed.h>
+#include <math.h>
 
 TEST (trace, read)
 {
@@ -181,4 +182,552 @@ TEST (read, recptr_buffer)
   CHECK (int32s[3951] == -146622, "Decoded sample value mismatch");
 
   mstl3_free (&mstl, 1);
-}
\ No newline at end of file
+}
+TEST (read, recptr_compact)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl   = NULL;
+  MS3TraceList *linked = NULL;
+  MS3TraceID *id       = NULL;
+  MS3RecordPtr recptr;
+  MS3Record *msr = NULL;
+  nstime_t endtime;
+  int64_t unpacked;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  endtime = ms_timestr2nstime ("2010-02-27T07:55:51.069539Z");
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  rv = ms3_readtracelist (&linked, path, NULL, 0, MSF_RECORDLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Build compact record list, out of order records are prepended and merged */
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_COMPACTRECLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  REQUIRE (mstl->numtraceids == 1, "mstl->numtraceids is not expected 1");
+
+  id = mstl->traces.next[0];
+
+  REQUIRE (id->first != NULL, "id->first is not populated");
+  REQUIRE (id->first->recordlist != NULL, "id->first->recordlist is not populated");
+  CHECK (id->first->samplecnt == 3952, "id->first->samplecnt is not expected 3952");
+  CHECK (id->first->recordlist->first == NULL, "recordlist->first is not expected NULL");
+  CHECK (id->first->recordlist->recordcnt == linked->traces.next[0]->first->recordlist->recordcnt,
+         "recordlist->recordcnt does not match linked record list");
+
+  /* Last entry matches the linked record list */
+  rv = mstl3_recordlist_entry (id->first->recordlist, id->first->recordlist->recordcnt - 1,
+                               &recptr, &msr, 0, 0);
+  REQUIRE (rv == 0, "mstl3_recordlist_entry() did not return 0");
+  CHECK_STREQ (recptr.filename, path);
+  CHECK (recptr.bufferptr == NULL, "recptr.bufferptr is not expected NULL");
+  CHECK (recptr.fileoffset == 1152, "recptr.fileoffset is not expected 1152");
+  CHECK (recptr.endtime == endtime, "recptr.endtime is not expected '2010-02-27T07:55:51.069539Z'");
+  CHECK (recptr.dataoffset == 64, "recptr.dataoffset is not expected 64");
+  CHECK (recptr.msr == NULL, "recptr.msr is not expected NULL");
+
+  /* Record is parsed on demand */
+  REQUIRE (msr != NULL, "mstl3_recordlist_entry() did not parse record");
+  CHECK_STREQ (msr->sid, id->sid);
+  CHECK (msr3_endtime (msr) == endtime, "Parsed record end time is not expected");
+  msr3_free (&msr);
+
+  rv = mstl3_recordlist_entry (id->first->recordlist, id->first->recordlist->recordcnt, &recptr, NULL, 0, 0);
+  CHECK (rv == -1, "mstl3_recordlist_entry() did not return -1 for index beyond list");
+
+  /* Decode data */
+  unpacked = mstl3_unpack_recordlist (id, id->first, NULL, 0, 0);
+  CHECK (unpacked == 3952, "Return from mstl3_unpack_recordlist is not expected 3952");
+  REQUIRE (id->first->numsamples == reference->traces.next[0]->first->numsamples,
+           "Decoded sample count does not match reference");
+  CHECK (memcmp (id->first->datasamples, reference->traces.next[0]->first->datasamples,
+                 id->first->numsamples * sizeof (int32_t)) == 0,
+         "Decoded samples do not match reference");
+
+  mstl3_free (&mstl, 1);
+  mstl3_free (&linked, 1);
+  mstl3_free (&reference, 1);
+}
+
+TEST (read, recptr_keep)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id = NULL;
+  MS3TraceSeg *refseg;
+  MS3RecordPtr recptr;
+  nstime_t starttime;
+  nstime_t endtime;
+  nstime_t firsttime;
+  int32_t *samples;
+  char *buffer;
+  FILE *fp;
+  int64_t count;
+  int64_t unpacked;
+  int64_t offset;
+  size_t rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  refseg = reference->traces.next[0]->first;
+
+  /* Read test data into buffer */
+  buffer = (char *)malloc (16256);
+  REQUIRE (buffer != NULL, "Cannot allocate buffer");
+
+  fp = fopen (path, "rb");
+  REQUIRE (fp != NULL, "File pointer is unexpected NULL");
+  rv = fread (buffer, 16256, 1, fp);
+  fclose (fp);
+  REQUIRE (rv == 1, "fread() did not read entire file");
+
+  /* Keep record copies, out of order records are prepended and merged */
+  count = mstl3_readbuffer (&mstl, buffer, 16256, 0, MSF_KEEPRECORDS, NULL, 0);
+  CHECK (count == 7, "mstl3_readbuffer did not return expected 7");
+
+  /* Records no longer depend on the buffer */
+  memset (buffer, 0, 16256);
+  free (buffer);
+
+  REQUIRE (mstl->numtraceids == 1, "mstl->numtraceids is not expected 1");
+  id = mstl->traces.next[0];
+  REQUIRE (id->first->recordlist != NULL, "id->first->recordlist is not populated");
+  CHECK (id->first->recordlist->first == NULL, "recordlist->first is not expected NULL");
+  CHECK (id->first->recordlist->recordcnt == 7, "recordlist->recordcnt is not expected 7");
+  CHECK (id->first->datasamples == NULL, "id->first->datasamples is not expected NULL");
+
+  rv = mstl3_recordlist_entry (id->first->recordlist, 0, &recptr, NULL, 0, 0);
+  REQUIRE (rv == 0, "mstl3_recordlist_entry() did not return 0");
+  CHECK (recptr.bufferptr != NULL, "recptr.bufferptr is unexpected NULL");
+  CHECK (recptr.filename == NULL, "recptr.filename is not expected NULL");
+
+  /* Decode complete segment into a caller buffer */
+  samples = (int32_t *)malloc (refseg->numsamples * sizeof (int32_t));
+  REQUIRE (samples != NULL, "Cannot allocate samples");
+
+  unpacked = mstl3_unpack_recordlist (id, id->first, samples, refseg->numsamples * sizeof (int32_t), 0);
+  CHECK (unpacked == refseg->numsamples, "Return from mstl3_unpack_recordlist is not expected");
+  CHECK (memcmp (samples, refseg->datasamples, refseg->numsamples * sizeof (int32_t)) == 0,
+         "Decoded samples do not match reference");
+  CHECK (id->first->datasamples == NULL, "id->first->datasamples is not expected NULL");
+
+  /* Decode a time window in the middle of the segment */
+  starttime = ms_timestr2nstime ("2010-02-27T07:52:00Z");
+  endtime = ms_timestr2nstime ("2010-02-27T07:53:00Z");
+
+  count = mstl3_unpack_timewindow (id, id->first, starttime, endtime, NULL, 0, &firsttime, 0);
+  CHECK (count > 0 && count < refseg->numsamples, "Window sample count is not expected");
+  CHECK (firsttime <= starttime, "Window does not start at or before start time");
+  CHECK (ms_sampletime (firsttime, count - 1, id->first->samprate) >= endtime,
+         "Window does not end at or after end time");
+
+  memset (samples, 0, refseg->numsamples * sizeof (int32_t));
+  unpacked = mstl3_unpack_timewindow (id, id->first, starttime, endtime, samples,
+                                      refseg->numsamples * sizeof (int32_t), &firsttime, 0);
+  CHECK (unpacked == count, "Return from mstl3_unpack_timewindow is not expected");
+
+  offset = (int64_t)((firsttime - refseg->starttime) * refseg->samprate / NSTMODULUS + 0.5);
+  REQUIRE (offset >= 0 && offset + unpacked <= refseg->numsamples, "Window offset is not expected");
+  CHECK (memcmp (samples, (int32_t *)refseg->datasamples + offset, unpacked * sizeof (int32_t)) == 0,
+         "Window samples do not match reference");
+
+  /* Window outside of segment */
+  count = mstl3_unpack_timewindow (id, id->first, ms_timestr2nstime ("2011-01-01T00:00:00Z"), NSTUNSET,
+                                   samples, refseg->numsamples * sizeof (int32_t), NULL, 0);
+  CHECK (count == 0, "Window after segment did not return 0");
+
+  free (samples);
+  mstl3_free (&mstl, 0);
+  mstl3_free (&reference, 0);
+}
+
+TEST (trace, compact)
+{
+  MS3TraceList *reference = NULL;
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *refid;
+  MS3TraceID *id;
+  MS3TraceSeg *refseg;
+  MS3TraceSeg *seg;
+  MS3Record *msr = NULL;
+  int index;
+  int idx;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  /* Compact nodes are only selectable for an empty list */
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (mstl3_set_compact (reference) == -1, "mstl3_set_compact() did not return -1 for a populated list");
+
+  /* Out of order records are merged, reusing released segments */
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+  REQUIRE (mstl3_set_compact (mstl) == 0, "mstl3_set_compact() did not return 0");
+
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  REQUIRE (mstl->numtraceids == 1, "mstl->numtraceids is not expected 1");
+
+  id = mstl->traces.next[0];
+  refid = reference->traces.next[0];
+
+  REQUIRE (id->first != NULL, "id->first is not populated");
+  CHECK (id->numsegments == 1, "id->numsegments is not expected 1");
+  CHECK (id->first == id->last, "id->first is not equal to id->last as expected");
+  CHECK (id->first->samplecnt == 3952, "id->first->samplecnt is not expected 3952");
+  REQUIRE (id->first->numsamples == refid->first->numsamples, "Sample count does not match reference");
+  CHECK (memcmp (id->first->datasamples, refid->first->datasamples,
+                 id->first->numsamples * sizeof (int32_t)) == 0,
+         "Samples do not match reference");
+
+  mstl3_free (&mstl, 1);
+  mstl3_free (&reference, 1);
+
+  /* Many trace IDs with gaps, each gap filled in a second pass */
+  reference = mstl3_init (NULL);
+  mstl = mstl3_init (NULL);
+  msr = msr3_init (NULL);
+  REQUIRE (reference != NULL && mstl != NULL && msr != NULL, "Cannot initialize structures");
+  REQUIRE (mstl3_set_compact (mstl) == 0, "mstl3_set_compact() did not return 0");
+
+  msr->samprate = 1.0;
+  msr->samplecnt = 10;
+  msr->pubversion = 1;
+
+  for (index = 0; index < 2 * 300 * 4; index++)
+  {
+    /* Trace IDs in scattered order, even then odd records of each ID */
+    idx = (index % 300) * 7 % 300;
+    msr->starttime = ms_timestr2nstime ("2024-01-01T00:00:00Z") +
+                     (nstime_t)(((index / 300) % 4) * 2 + (index / 1200)) * 10 * NSTMODULUS;
+    snprintf (msr->sid, sizeof (msr->sid), "FDSN:XX_S%03d_00_B_H_Z", idx);
+
+    REQUIRE (mstl3_addmsr (reference, msr, 0, 1, 0, NULL) != NULL, "mstl3_addmsr() failed");
+    REQUIRE (mstl3_addmsr (mstl, msr, 0, 1, 0, NULL) != NULL, "mstl3_addmsr() failed");
+  }
+
+  CHECK (mstl->numtraceids == 300, "mstl->numtraceids is not expected 300");
+
+  /* Trace IDs and segments match the reference list */
+  for (refid = reference->traces.next[0], id = mstl->traces.next[0];
+       refid && id;
+       refid = refid->next[0], id = id->next[0])
+  {
+    CHECK_STREQ (id->sid, refid->sid);
+    CHECK (id->height >= 1 && id->height <= MSTRACEID_SKIPLIST_HEIGHT, "id->height is not in range");
+    CHECK (id->numsegments == 1, "id->numsegments is not expected 1");
+    CHECK (mstl3_findID (mstl, refid->sid, 0, NULL) == id, "mstl3_findID() did not find ID");
+
+    for (refseg = refid->first, seg = id->first;
+         refseg && seg;
+         refseg = refseg->next, seg = seg->next)
+    {
+      CHECK (seg->starttime == refseg->starttime, "Segment start time does not match reference");
+      CHECK (seg->endtime == refseg->endtime, "Segment end time does not match reference");
+      CHECK (seg->samplecnt == 80, "Segment sample count is not expected 80");
+    }
+    CHECK (refseg == NULL && seg == NULL, "Segment count does not match reference");
+  }
+  CHECK (refid == NULL && id == NULL, "Trace ID count does not match reference");
+  CHECK (mstl3_findID (mstl, "FDSN:XX_S300_00_B_H_Z", 0, NULL) == NULL, "mstl3_findID() found missing ID");
+
+  msr3_free (&msr);
+  mstl3_free (&mstl, 1);
+  mstl3_free (&reference, 1);
+}
+
+/* Compare two trace lists including samples and record lists, returns
+ * the number of differences */
+static int
+compare_tracelists (MS3TraceList *mstl1, MS3TraceList *mstl2)
+{
+  MS3TraceID *id1;
+  MS3TraceID *id2;
+  MS3TraceSeg *seg1;
+  MS3TraceSeg *seg2;
+  MS3RecordPtr recptr1;
+  MS3RecordPtr recptr2;
+  uint64_t idx;
+  int differences = 0;
+
+  if (mstl1->numtraceids != mstl2->numtraceids)
+    return 1;
+
+  for (id1 = mstl1->traces.next[0], id2 = mstl2->traces.next[0]; id1 && id2;
+       id1 = id1->next[0], id2 = id2->next[0])
+  {
+    if (strcmp (id1->sid, id2->sid) || id1->pubversion != id2->pubversion ||
+        id1->earliest != id2->earliest || id1->latest != id2->latest ||
+        id1->numsegments != id2->numsegments)
+    {
+      differences++;
+      continue;
+    }
+
+    for (seg1 = id1->first, seg2 = id2->first; seg1 && seg2; seg1 = seg1->next, seg2 = seg2->next)
+    {
+      if (seg1->starttime != seg2->starttime || seg1->endtime != seg2->endtime ||
+          seg1->samprate != seg2->samprate || seg1->samplecnt != seg2->samplecnt ||
+          seg1->numsamples != seg2->numsamples || seg1->sampletype != seg2->sampletype ||
+          (seg1->numsamples &&
+           memcmp (seg1->datasamples, seg2->datasamples,
+                   seg1->numsamples * ms_samplesize (seg1->sampletype))))
+      {
+        differences++;
+        continue;
+      }
+
+      if (!seg1->recordlist != !seg2->recordlist)
+      {
+        differences++;
+        continue;
+      }
+
+      if (!seg1->recordlist)
+        continue;
+
+      if (seg1->recordlist->recordcnt != seg2->recordlist->recordcnt)
+      {
+        differences++;
+        continue;
+      }
+
+      for (idx = 0; idx < seg1->recordlist->recordcnt; idx++)
+      {
+        if (mstl3_recordlist_entry (seg1->recordlist, idx, &recptr1, NULL, 0, 0) ||
+            mstl3_recordlist_entry (seg2->recordlist, idx, &recptr2, NULL, 0, 0) ||
+            recptr1.fileoffset != recptr2.fileoffset || recptr1.endtime != recptr2.endtime ||
+            recptr1.dataoffset != recptr2.dataoffset || strcmp (recptr1.filename, recptr2.filename))
+          differences++;
+      }
+    }
+  }
+
+  return differences;
+}
+
+TEST (trace, parallel)
+{
+  MS3TraceList *serial = NULL;
+  MS3TraceList *parallel = NULL;
+  MS3Selections *selections = NULL;
+  uint32_t flags[] = {MSF_UNPACKDATA,
+                      MSF_UNPACKDATA | MSF_RECORDLIST,
+                      MSF_UNPACKDATA | MSF_COMPACTRECLIST,
+                      MSF_RECORDLIST};
+  int fidx;
+  int pidx;
+  int rv;
+
+  char *paths[] = {"data/testdata-3channel-signal.mseed3",
+                   "data/testdata-3channel-signal.mseed2",
+                   "data/testdata-oneseries-mixedlengths-mixedorder.mseed2",
+                   "data/testdata-oneseries-mixedlengths-mixedorder.mseed3",
+                   "data/testdata-no-blockette1000-steim1.mseed2",
+                   "data/reference-testdata-float64.mseed3",
+                   "data/reference-testdata-text.mseed2"};
+
+  /* Identical lists for each file and flag combination */
+  for (pidx = 0; pidx < (int)(sizeof (paths) / sizeof (paths[0])); pidx++)
+  {
+    for (fidx = 0; fidx < (int)(sizeof (flags) / sizeof (flags[0])); fidx++)
+    {
+      rv = ms3_readtracelist (&serial, paths[pidx], NULL, 0, flags[fidx], 0);
+      REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+      rv = ms3_readtracelist_parallel (&parallel, paths[pidx], NULL, NULL, 0, flags[fidx], 3, 0);
+      REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_parallel() did not return expected MS_NOERROR");
+
+      CHECK (compare_tracelists (serial, parallel) == 0, "Parallel trace list does not match serial");
+
+      mstl3_free (&serial, 1);
+      mstl3_free (&parallel, 1);
+    }
+  }
+
+  /* Selections applied before decoding, single decoder thread */
+  rv = ms3_addselect (&selections, "FDSN:IU_COLA_00_L_H_Z", NSTUNSET, NSTUNSET, 0);
+  REQUIRE (rv == 0, "ms3_addselect() did not return expected 0");
+
+  rv = ms3_readtracelist_selection (&serial, paths[0], NULL, selections, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_selection() did not return expected MS_NOERROR");
+
+  rv = ms3_readtracelist_parallel (&parallel, paths[0], NULL, selections, 0, MSF_UNPACKDATA, 1, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist_parallel() did not return expected MS_NOERROR");
+
+  CHECK (serial->numtraceids == 1, "Selected trace list does not contain 1 ID");
+  CHECK (compare_tracelists (serial, parallel) == 0, "Parallel selected trace list does not match serial");
+
+  mstl3_free (&serial, 1);
+  mstl3_free (&parallel, 1);
+  ms3_freeselections (selections);
+
+  /* Same error for a missing file */
+  ms_rloginit (NULL, NULL, NULL, NULL, 10);
+  rv = ms3_readtracelist_parallel (&parallel, "data/no-such-file.mseed", NULL, NULL, 0, MSF_UNPACKDATA, 2, 0);
+  CHECK (rv == MS_GENERROR, "ms3_readtracelist_parallel() did not return expected MS_GENERROR");
+  mstl3_free (&parallel, 1);
+}
+
+/* Check segment statistics against a pass over the segment samples,
+ * returns the number of differences */
+static int
+check_stats (MS3TraceList *mstl, double clipmin, double clipmax)
+{
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  MS3SampleStats *stats;
+  double value;
+  double previous = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  double sum = 0.0;
+  double sumsq = 0.0;
+  int64_t clipped;
+  int64_t constant;
+  int64_t idx;
+  int differences = 0;
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if ((stats = seg->stats) == NULL || stats->count != seg->numsamples)
+      {
+        differences++;
+        continue;
+      }
+
+      sum = sumsq = 0.0;
+      clipped = constant = 0;
+
+      for (idx = 0; idx < seg->numsamples; idx++)
+      {
+        if (seg->sampletype == 'i')
+          value = ((int32_t *)seg->datasamples)[idx];
+        else if (seg->sampletype == 'f')
+          value = ((float *)seg->datasamples)[idx];
+        else
+          value = ((double *)seg->datasamples)[idx];
+
+        if (idx == 0 || value < min)
+          min = value;
+        if (idx == 0 || value > max)
+          max = value;
+        if (idx > 0 && value == previous)
+          constant++;
+        if (clipmin < clipmax && (value <= clipmin || value >= clipmax))
+          clipped++;
+
+        sum += value;
+        sumsq += value * value;
+        previous = value;
+      }
+
+      if (stats->min != min || stats->max != max ||
+          stats->clipped != clipped || stats->constant != constant ||
+          fabs (stats->sum - sum) > 1e-9 * sumsq + 1e-6 ||
+          fabs (stats->sumsq - sumsq) > 1e-9 * sumsq)
+        differences++;
+    }
+  }
+
+  return differences;
+}
+
+TEST (trace, stats)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceSeg *seg;
+  MS3Record *msr = NULL;
+  int32_t samples[10];
+  nstime_t offsets[4] = {20, 0, 30, 10};
+  int rv;
+  int idx;
+
+  const char *paths[] = {"data/testdata-oneseries-mixedlengths-mixedorder.mseed2",
+                         "data/testdata-3channel-signal.mseed3",
+                         "data/reference-testdata-float32.mseed3",
+                         "data/reference-testdata-float64.mseed3"};
+
+  /* Statistics are only selectable for an empty list */
+  rv = ms3_readtracelist (&mstl, paths[0], NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (mstl->traces.next[0]->first->stats == NULL, "Segment statistics present when not selected");
+  CHECK (mstl3_set_stats (mstl, -1000.0, 1000.0) == -1, "mstl3_set_stats() did not return -1 for a populated list");
+  mstl3_free (&mstl, 0);
+
+  for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+  {
+    mstl = mstl3_init (NULL);
+    REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+    REQUIRE (mstl3_set_stats (mstl, -1000.5, 1000.5) == 0, "mstl3_set_stats() did not return 0");
+
+    rv = ms3_readtracelist (&mstl, paths[idx], NULL, 0, MSF_UNPACKDATA, 0);
+    REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+    CHECK (check_stats (mstl, -1000.5, 1000.5) == 0, "Segment statistics do not match samples");
+
+    mstl3_free (&mstl, 0);
+  }
+
+  /* Records added out of order, compact nodes and clipping disabled */
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+  REQUIRE (mstl3_set_compact (mstl) == 0, "mstl3_set_compact() did not return 0");
+  REQUIRE (mstl3_set_stats (mstl, 0.0, 0.0) == 0, "mstl3_set_stats() did not return 0");
+
+  rv = ms3_readtracelist (&mstl, paths[0], NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  seg = mstl->traces.next[0]->first;
+  REQUIRE (seg != NULL && seg->stats != NULL, "Segment statistics not populated");
+  CHECK (seg->stats->count == 3952, "Segment statistics count is not expected 3952");
+  CHECK (seg->stats->clipped == 0, "Clipped samples counted when disabled");
+  CHECK (check_stats (mstl, 1.0, 0.0) == 0, "Segment statistics do not match samples");
+
+  mstl3_free (&mstl, 0);
+
+  /* Constant records joined at the end, the beginning and between segments */
+  mstl = mstl3_init (NULL);
+  msr = msr3_init (NULL);
+  REQUIRE (mstl != NULL && msr != NULL, "Cannot initialize structures");
+  REQUIRE (mstl3_set_stats (mstl, 0.0, 5.0) == 0, "mstl3_set_stats() did not return 0");
+
+  for (idx = 0; idx < 10; idx++)
+    samples[idx] = 5;
+
+  strcpy (msr->sid, "FDSN:XX_TEST_00_B_H_Z");
+  msr->samprate = 1.0;
+  msr->samplecnt = 10;
+  msr->numsamples = 10;
+  msr->sampletype = 'i';
+  msr->datasamples = samples;
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    msr->starttime = ms_timestr2nstime ("2024-01-01T00:00:00Z") + offsets[idx] * NSTMODULUS;
+    REQUIRE (mstl3_addmsr (mstl, msr, 0, 1, 0, NULL) != NULL, "mstl3_addmsr() failed");
+  }
+
+  seg = mstl->traces.next[0]->first;
+  REQUIRE (seg != NULL && seg->stats != NULL, "Segment statistics not populated");
+  CHECK (mstl->traces.next[0]->numsegments == 1, "numsegments is not expected 1");
+  CHECK (seg->stats->count == 40, "Segment statistics count is not expected 40");
+  CHECK (seg->stats->constant == 39, "Segment statistics constant is not expected 39");
+  CHECK (seg->stats->clipped == 40, "Segment statistics clipped is not expected 40");
+  CHECK (seg->stats->min == 5.0 && seg->stats->max == 5.0, "Segment statistics range is not expected 5");
+  CHECK (seg->stats->sum == 200.0 && seg->stats->sumsq == 1000.0, "Segment statistics sums not expected");
+
+  msr->datasamples = NULL;
+  msr3_free (&msr);
+  mstl3_free (&mstl, 0);
+}
@@ -0,0 +1,213 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+
+/* Write the first 'length' bytes of a file to a new file, or append
+ * the remaining bytes after 'length' to an existing file */
+static int
+copy_part (const char *source, const char *target, long length, int append)
+{
+  FILE *in;
+  FILE *out;
+  char buffer[4096];
+  size_t count;
+  long total = 0;
+  int rv = 0;
+
+  if ((in = fopen (source, "rb")) == NULL)
+    return -1;
+
+  if ((out = fopen (target, (append) ? "ab" : "wb")) == NULL)
+  {
+    fclose (in);
+    return -1;
+  }
+
+  if (append)
+    fseek (in, length, SEEK_SET);
+
+  while ((count = fread (buffer, 1, sizeof (buffer), in)) > 0)
+  {
+    if (!append && total + (long)count > length)
+      count = length - total;
+
+    if (fwrite (buffer, 1, count, out) != count)
+      rv = -1;
+
+    total += count;
+
+    if (!append && total >= length)
+      break;
+  }
+
+  fclose (in);
+  fclose (out);
+
+  return rv;
+}
+
+/* Compare a trace list loaded from a snapshot to a reference list with
+ * unpacked samples, returns number of differences */
+static int
+compare_lists (MS3TraceList *loaded, MS3TraceList *reference)
+{
+  MS3TraceID *id;
+  MS3TraceID *refid;
+  MS3TraceSeg *seg;
+  MS3TraceSeg *refseg;
+  int differences = 0;
+  int64_t unpacked;
+
+  if (loaded->numtraceids != reference->numtraceids)
+    return 1;
+
+  for (id = loaded->traces.next[0], refid = reference->traces.next[0];
+       id && refid; id = id->next[0], refid = refid->next[0])
+  {
+    if (strcmp (id->sid, refid->sid) || id->earliest != refid->earliest ||
+        id->latest != refid->latest || id->numsegments != refid->numsegments)
+    {
+      differences++;
+      continue;
+    }
+
+    for (seg = id->first, refseg = refid->first; seg && refseg; seg = seg->next, refseg = refseg->next)
+    {
+      if (seg->starttime != refseg->starttime || seg->endtime != refseg->endtime ||
+          seg->samplecnt != refseg->samplecnt || seg->samprate != refseg->samprate)
+      {
+        differences++;
+        continue;
+      }
+
+      unpacked = mstl3_unpack_recordlist (id, seg, NULL, 0, 0);
+
+      if (unpacked != refseg->numsamples || seg->sampletype != refseg->sampletype ||
+          memcmp (seg->datasamples, refseg->datasamples,
+                  (size_t)(unpacked * ms_samplesize (seg->sampletype))))
+        differences++;
+    }
+  }
+
+  return differences;
+}
+
+TEST (tracesnapshot, roundtrip)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *loaded = NULL;
+  MS3TraceList *reference = NULL;
+  int64_t rv;
+
+  char *path = "data/testdata-3channel-signal.mseed3";
+  char *snapshot = "testdata-tracelist.snapshot";
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Linked record list */
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_RECORDLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  rv = mstl3_write_snapshot (mstl, snapshot, 0);
+  CHECK (rv == 107, "mstl3_write_snapshot() did not return expected 107 records");
+  mstl3_free (&mstl, 0);
+
+  rv = mstl3_read_snapshot (&loaded, snapshot, 0, 0);
+  CHECK (rv == 0, "mstl3_read_snapshot() did not return expected 0");
+  REQUIRE (loaded != NULL, "mstl3_read_snapshot() did not return a trace list");
+  CHECK (compare_lists (loaded, reference) == 0, "Loaded snapshot does not match reference");
+
+  /* Snapshot of a loaded snapshot, into a compact node list */
+  rv = mstl3_write_snapshot (loaded, snapshot, 0);
+  CHECK (rv == 107, "mstl3_write_snapshot() did not return expected 107 records");
+  mstl3_free (&loaded, 0);
+
+  loaded = mstl3_init (NULL);
+  REQUIRE (mstl3_set_compact (loaded) == 0, "mstl3_set_compact() did not return expected 0");
+
+  rv = mstl3_read_snapshot (&loaded, snapshot, 0, 0);
+  CHECK (rv == 0, "mstl3_read_snapshot() did not return expected 0");
+  REQUIRE (loaded != NULL, "mstl3_read_snapshot() did not return a trace list");
+  CHECK (compare_lists (loaded, reference) == 0, "Loaded compact snapshot does not match reference");
+
+  /* Not a snapshot */
+  mstl3_free (&loaded, 0);
+  rv = mstl3_read_snapshot (&loaded, path, 0, 0);
+  CHECK (rv == -1, "mstl3_read_snapshot() did not return expected -1 for non-snapshot");
+  CHECK (loaded == NULL, "mstl3_read_snapshot() did not free list on error");
+
+  mstl3_free (&reference, 0);
+  remove (snapshot);
+}
+
+TEST (tracesnapshot, append)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *loaded = NULL;
+  MS3TraceList *reference = NULL;
+  int64_t rv;
+
+  char *path = "data/testdata-3channel-signal.mseed2";
+  char *datafile = "testdata-snapshot.mseed2";
+  char *snapshot = "testdata-append.snapshot";
+
+  rv = ms3_readtracelist (&reference, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  /* Snapshot of the first 60 records */
+  REQUIRE (copy_part (path, datafile, 60 * 512, 0) == 0, "Cannot write partial data file");
+
+  rv = ms3_readtracelist (&mstl, datafile, NULL, 0, MSF_RECORDLIST | MSF_COMPACTRECLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  rv = mstl3_write_snapshot (mstl, snapshot, 0);
+  CHECK (rv == 60, "mstl3_write_snapshot() did not return expected 60 records");
+  mstl3_free (&mstl, 0);
+
+  /* Append remaining records, loading reads the appended records */
+  REQUIRE (copy_part (path, datafile, 60 * 512, 1) == 0, "Cannot append to data file");
+
+  rv = mstl3_read_snapshot (&loaded, snapshot, 0, 0);
+  CHECK (rv == 1, "mstl3_read_snapshot() did not return expected 1 updated file");
+  REQUIRE (loaded != NULL, "mstl3_read_snapshot() did not return a trace list");
+  CHECK (compare_lists (loaded, reference) == 0, "Updated snapshot does not match reference");
+
+  /* Updated snapshot loads without reading */
+  rv = mstl3_write_snapshot (loaded, snapshot, 0);
+  CHECK (rv == 107, "mstl3_write_snapshot() did not return expected 107 records");
+  mstl3_free (&loaded, 0);
+
+  rv = mstl3_read_snapshot (&loaded, snapshot, 0, 0);
+  CHECK (rv == 0, "mstl3_read_snapshot() did not return expected 0 updated files");
+  REQUIRE (loaded != NULL, "mstl3_read_snapshot() did not return a trace list");
+  CHECK (compare_lists (loaded, reference) == 0, "Rewritten snapshot does not match reference");
+  mstl3_free (&loaded, 0);
+
+  /* Records appended before a snapshot is written are read when loading */
+  REQUIRE (copy_part (path, datafile, 60 * 512, 0) == 0, "Cannot write partial data file");
+
+  rv = ms3_readtracelist (&mstl, datafile, NULL, 0, MSF_RECORDLIST | MSF_COMPACTRECLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  REQUIRE (copy_part (path, datafile, 60 * 512, 1) == 0, "Cannot append to data file");
+
+  rv = mstl3_write_snapshot (mstl, snapshot, 0);
+  CHECK (rv == 60, "mstl3_write_snapshot() did not return expected 60 records");
+  mstl3_free (&mstl, 0);
+
+  rv = mstl3_read_snapshot (&loaded, snapshot, 0, 0);
+  CHECK (rv == 1, "mstl3_read_snapshot() did not read records appended before writing");
+  REQUIRE (loaded != NULL, "mstl3_read_snapshot() did not return a trace list");
+  CHECK (compare_lists (loaded, reference) == 0, "Snapshot with early append does not match reference");
+  mstl3_free (&loaded, 0);
+
+  /* Truncated file makes the snapshot stale */
+  REQUIRE (copy_part (path, datafile, 30 * 512, 0) == 0, "Cannot write partial data file");
+
+  rv = mstl3_read_snapshot (&loaded, snapshot, 0, 0);
+  CHECK (rv == -1, "mstl3_read_snapshot() did not return expected -1 for stale snapshot");
+  CHECK (loaded == NULL, "mstl3_read_snapshot() did not free list of stale snapshot");
+
+  mstl3_free (&reference, 0);
+  remove (datafile);
+  remove (snapshot);
+}
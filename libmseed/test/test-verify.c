@@ -0,0 +1,125 @@
+#include <tau/tau.h>
+#include <libmseed.h>
+#include <mseedformat.h>
+
+/* Read the first record of a file into a buffer, returning the record length */
+static int
+read_record (const char *path, char *record, size_t size)
+{
+  FILE *fp;
+  size_t length;
+  uint8_t formatversion;
+
+  if ((fp = fopen (path, "rb")) == NULL)
+    return -1;
+
+  length = fread (record, 1, size, fp);
+  fclose (fp);
+
+  return (int)ms3_detect (record, length, &formatversion);
+}
+
+/* Re-calculate the CRC of a version 3 record */
+static void
+update_crc (char *record, int reclen)
+{
+  uint32_t crc;
+
+  *pMS3FSDH_CRC (record) = 0;
+  crc = ms_crc32c ((const uint8_t *)record, reclen, 0);
+  *pMS3FSDH_CRC (record) = HO4u (crc, ms_bigendianhost ());
+}
+
+TEST (verify, intact)
+{
+  const char *paths[] = {
+      "data/reference-testdata-steim1.mseed3",
+      "data/reference-testdata-steim2.mseed3",
+      "data/reference-testdata-steim1.mseed2",
+      "data/reference-testdata-steim2-LE.mseed2",
+      "data/reference-testdata-int32.mseed3",
+      "data/reference-testdata-text.mseed2",
+      "data/testdata-no-blockette1000-steim1.mseed2",
+  };
+  MS3Record *msr = NULL;
+  char record[8192];
+  int reclen;
+  int idx;
+
+  for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+  {
+    reclen = read_record (paths[idx], record, sizeof (record));
+    REQUIRE (reclen > 0, "Cannot read test record");
+
+    CHECK (ms3_verify_record (record, reclen, &msr, 0) == 0, "Intact record not verified");
+  }
+
+  CHECK (ms3_verify_record (NULL, 0, &msr, 0) == MS_GENERROR,
+         "ms3_verify_record() did not return expected MS_GENERROR");
+
+  msr3_free (&msr);
+}
+
+TEST (verify, corrupt)
+{
+  MS3Record *msr = NULL;
+  uint32_t dataoffset;
+  uint32_t datasize;
+  char record[8192];
+  int reclen;
+  int rv;
+
+  /* Version 3: corrupt payload byte */
+  reclen = read_record ("data/reference-testdata-steim2.mseed3", record, sizeof (record));
+  REQUIRE (reclen > 0, "Cannot read test record");
+
+  record[reclen - 1] ^= 0x55;
+  rv = ms3_verify_record (record, reclen, &msr, 0);
+  CHECK (rv & MSV_CRC, "Corrupt version 3 record not detected by CRC");
+
+  /* Version 3: reverse integration constant changed and CRC re-calculated */
+  reclen = read_record ("data/reference-testdata-steim2.mseed3", record, sizeof (record));
+  REQUIRE (reclen > 0, "Cannot read test record");
+  REQUIRE (msr3_parse (record, reclen, &msr, 0, 0) == MS_NOERROR, "Cannot parse test record");
+  REQUIRE (msr3_data_bounds (msr, &dataoffset, &datasize) == 0, "Cannot determine data bounds");
+
+  record[dataoffset + 11] ^= 0x01;
+  update_crc (record, reclen);
+  rv = ms3_verify_record (record, reclen, &msr, 0);
+  CHECK (rv == MSV_INTEGRATION, "Changed Xn in version 3 record not detected");
+
+  /* Version 2, little-endian: reverse integration constant changed */
+  reclen = read_record ("data/reference-testdata-steim1-LE.mseed2", record, sizeof (record));
+  REQUIRE (reclen > 0, "Cannot read test record");
+  REQUIRE (msr3_parse (record, reclen, &msr, 0, 0) == MS_NOERROR, "Cannot parse test record");
+  REQUIRE (msr3_data_bounds (msr, &dataoffset, &datasize) == 0, "Cannot determine data bounds");
+
+  record[dataoffset + 8] ^= 0x01;
+  rv = ms3_verify_record (record, reclen, &msr, 0);
+  CHECK (rv == MSV_INTEGRATION, "Changed Xn in little-endian version 2 record not detected");
+
+  /* Version 2: sample count larger than encoded samples */
+  reclen = read_record ("data/reference-testdata-steim1.mseed2", record, sizeof (record));
+  REQUIRE (reclen > 0, "Cannot read test record");
+
+  *pMS2FSDH_NUMSAMPLES (record) = HO2u (30000, !ms_bigendianhost ());
+  rv = ms3_verify_record (record, reclen, &msr, 0);
+  CHECK (rv & MSV_SAMPLECOUNT, "Sample count larger than encoded samples not detected");
+
+  /* Version 2: number of blockettes inconsistent with blockette chain */
+  reclen = read_record ("data/reference-testdata-steim1.mseed2", record, sizeof (record));
+  REQUIRE (reclen > 0, "Cannot read test record");
+
+  *pMS2FSDH_NUMBLOCKETTES (record) += 1;
+  rv = ms3_verify_record (record, reclen, &msr, 0);
+  CHECK (rv == MSV_STRUCTURE, "Inconsistent blockette count not detected");
+
+  /* Truncated record cannot be parsed */
+  reclen = read_record ("data/reference-testdata-steim1.mseed2", record, sizeof (record));
+  REQUIRE (reclen > 0, "Cannot read test record");
+
+  rv = ms3_verify_record (record, reclen / 2, &msr, 0);
+  CHECK (rv == MSV_UNPARSABLE, "Truncated record not detected");
+
+  msr3_free (&msr);
+}
@@ -2,6 +2,8 @@
 #include <libmseed.h>
 
 #include "testdata.h"
+#include "../packdata.h"
+#include "../unpackdata.h"
 
 extern int cmpfiles (char *fileA, char *fileB);
 
@@ -273,3 +275,212 @@ TEST (write, trace)
   msr->datasamples = NULL;
   msr3_free (&msr);
 }
+
+/* Compare the Steim size estimate with encoding for all frame limits,
+ * returns number of differences */
+static int
+compare_steim_size (uint8_t encoding, int32_t *input, uint64_t samplecount, int32_t diff0)
+{
+  static uint8_t output[64 * 256];
+  uint64_t maxframes;
+  uint64_t frames;
+  uint32_t byteswritten;
+  int64_t encoded;
+  int64_t estimated;
+  int differences = 0;
+
+  for (maxframes = 1; maxframes <= 256; maxframes++)
+  {
+    if (encoding == DE_STEIM1)
+      encoded = msr_encode_steim1 (input, samplecount, output, maxframes * 64, diff0,
+                                   &byteswritten, 0, NULL);
+    else
+      encoded = msr_encode_steim2 (input, samplecount, output, maxframes * 64, diff0,
+                                   &byteswritten, "TEST", 0, NULL);
+
+    estimated = ms_steim_size (encoding, input, samplecount, diff0, maxframes, &frames);
+
+    if (estimated != encoded || frames * 64 != byteswritten)
+      differences++;
+
+    /* All samples fit, no limit must give the same result */
+    if (encoded == (int64_t)samplecount)
+    {
+      estimated = ms_steim_size (encoding, input, samplecount, diff0, 0, &frames);
+
+      if (estimated != encoded || frames * 64 != byteswritten)
+        differences++;
+
+      break;
+    }
+  }
+
+  return differences;
+}
+
+TEST (write, steim_size)
+{
+  int32_t sinedata[SINE_DATA_SAMPLES];
+  int32_t data[4000];
+  uint32_t seed = 12345;
+  uint64_t frames;
+  int64_t rv;
+  int width;
+  int idx;
+
+  for (idx = 0; idx < SINE_DATA_SAMPLES; idx++)
+    sinedata[idx] = (int32_t)(fsinedata[idx]);
+
+  /* Sine wave, all but last sample for which the difference cannot be represented in Steim2 */
+  CHECK (compare_steim_size (DE_STEIM1, sinedata, SINE_DATA_SAMPLES, 0) == 0, "Steim1 size mismatch for sine");
+  CHECK (compare_steim_size (DE_STEIM2, sinedata, SINE_DATA_SAMPLES - 1, 0) == 0, "Steim2 size mismatch for sine");
+
+  rv = ms_steim_size (DE_STEIM2, sinedata, SINE_DATA_SAMPLES, 0, 0, NULL);
+  CHECK (rv == -1, "ms_steim_size() did not return expected -1 for unrepresentable difference");
+
+  /* Random walks with differences of increasing width, mixed within each sequence */
+  for (width = 1; width <= 29; width += 2)
+  {
+    data[0] = 0;
+    for (idx = 1; idx < 4000; idx++)
+    {
+      seed = seed * 1103515245 + 12345;
+      data[idx] = data[idx - 1] + (int32_t)((seed >> 8) % (1u << ((idx / 37) % width + 1))) -
+                  (int32_t)(1u << ((idx / 37) % width));
+    }
+
+    CHECK (compare_steim_size (DE_STEIM1, data, 4000, 0) == 0, "Steim1 size mismatch for random walk");
+    CHECK (compare_steim_size (DE_STEIM2, data, 4000, 0) == 0, "Steim2 size mismatch for random walk");
+    CHECK (compare_steim_size (DE_STEIM2, data + 1, 3999, data[1] - data[0]) == 0,
+           "Steim2 size mismatch with first difference");
+  }
+
+  /* Short sequences */
+  for (idx = 1; idx <= 20; idx++)
+  {
+    CHECK (compare_steim_size (DE_STEIM1, data, idx, 0) == 0, "Steim1 size mismatch for short sequence");
+    CHECK (compare_steim_size (DE_STEIM2, data, idx, 0) == 0, "Steim2 size mismatch for short sequence");
+  }
+
+  /* Constant values, 7 differences per word */
+  for (idx = 0; idx < 4000; idx++)
+    data[idx] = 42;
+
+  rv = ms_steim_size (DE_STEIM2, data, 4000, 0, 0, &frames);
+  CHECK (rv == 4000, "ms_steim_size() did not return expected 4000 samples");
+  CHECK (frames == 39, "ms_steim_size() did not return expected 39 frames");
+  CHECK (compare_steim_size (DE_STEIM2, data, 4000, 0) == 0, "Steim2 size mismatch for constant");
+
+  CHECK (ms_steim_size (DE_STEIM2, data, 0, 0, 0, &frames) == 0, "ms_steim_size() did not return 0 for no samples");
+  CHECK (frames == 0, "ms_steim_size() did not return 0 frames for no samples");
+  CHECK (ms_steim_size (DE_INT32, data, 4000, 0, 0, &frames) == -1,
+         "ms_steim_size() did not return -1 for unsupported encoding");
+}
+
+TEST (write, steim_constant)
+{
+  static int32_t data[5000];
+  static int32_t decoded[5000];
+  static uint32_t output[5000];
+  uint32_t zeroframe[16];
+  uint32_t byteswritten;
+  uint64_t frames;
+  uint64_t zeroframes;
+  uint64_t idx;
+  int64_t encoded;
+  int64_t rv;
+  int encoding;
+  int swapflag;
+
+  /* Runs of zeros and stuck values between varying samples */
+  for (idx = 0; idx < 5000; idx++)
+  {
+    if (idx < 1000)
+      data[idx] = 0;
+    else if (idx < 1500)
+      data[idx] = (int32_t)(idx * 7919 % 1000) - 500;
+    else if (idx < 4000)
+      data[idx] = -123456;
+    else
+      data[idx] = (int32_t)(idx % 17);
+  }
+
+  for (encoding = DE_STEIM1; encoding <= DE_STEIM2; encoding++)
+  {
+    for (swapflag = 0; swapflag <= 1; swapflag++)
+    {
+      if (encoding == DE_STEIM1)
+        encoded = msr_encode_steim1 (data, 5000, output, sizeof (output), 0, &byteswritten, swapflag, NULL);
+      else
+        encoded = msr_encode_steim2 (data, 5000, output, sizeof (output), 0, &byteswritten, "TEST", swapflag, NULL);
+
+      REQUIRE (encoded == 5000, "Steim encoding did not return expected 5000 samples");
+
+      /* Same size as the packing decisions of the size estimator */
+      rv = ms_steim_size (encoding, data, 5000, 0, 0, &frames);
+      CHECK (rv == 5000 && frames * 64 == byteswritten, "Steim encoded size does not match estimate");
+
+      /* Constant runs are encoded as zero difference frames */
+      if (encoding == DE_STEIM1)
+        steim_zeroframe (zeroframe, STEIM1_ZERO_NIBBLES, STEIM1_ZERO_WORD, swapflag);
+      else
+        steim_zeroframe (zeroframe, STEIM2_ZERO_NIBBLES, STEIM2_ZERO_WORD, swapflag);
+
+      for (idx = 1, zeroframes = 0; idx < byteswritten / 64; idx++)
+      {
+        if (!memcmp (output + 16 * idx, zeroframe, 64))
+          zeroframes++;
+      }
+
+      CHECK (zeroframes >= ((encoding == DE_STEIM1) ? 50 : 28), "Constant runs not encoded as zero difference frames");
+
+      if (encoding == DE_STEIM1)
+        rv = msr_decode_steim1 ((int32_t *)output, byteswritten, 5000, decoded, sizeof (decoded), "TEST", swapflag);
+      else
+        rv = msr_decode_steim2 ((int32_t *)output, byteswritten, 5000, decoded, sizeof (decoded), "TEST", swapflag);
+
+      CHECK (rv == 5000, "Steim decoding did not return expected 5000 samples");
+      CHECK (!memcmp (data, decoded, sizeof (data)), "Decoded samples do not match original");
+    }
+  }
+}
+
+TEST (write, repack_byteorder)
+{
+  MS3Record *msr = NULL;
+  MS3Record *repacked = NULL;
+  static char record[MAXRECLEN];
+  int reclen;
+  int rv;
+  int idx;
+
+  /* Little endian Steim and big endian integer and float payloads */
+  const char *files[] = {"data/reference-testdata-steim1-LE.mseed2",
+                         "data/reference-testdata-steim2-LE.mseed2",
+                         "data/reference-testdata-int16.mseed2",
+                         "data/reference-testdata-int32.mseed2",
+                         "data/reference-testdata-float32.mseed2",
+                         "data/reference-testdata-float64.mseed2"};
+
+  for (idx = 0; idx < (int)(sizeof (files) / sizeof (files[0])); idx++)
+  {
+    rv = ms3_readmsr (&msr, files[idx], MSF_UNPACKDATA, 0);
+    REQUIRE (rv == MS_NOERROR, "ms3_readmsr() did not return expected MS_NOERROR");
+
+    /* Encoded data are copied with byte order normalized for version 3 */
+    reclen = msr3_repack_mseed3 (msr, record, sizeof (record), 0);
+    REQUIRE (reclen > 0, "msr3_repack_mseed3() did not return a record length");
+
+    rv = msr3_parse (record, reclen, &repacked, MSF_UNPACKDATA | MSF_VALIDATECRC, 0);
+    REQUIRE (rv == MS_NOERROR, "msr3_parse() did not return expected MS_NOERROR");
+
+    CHECK (repacked->numsamples == msr->numsamples, "Repacked sample count does not match original");
+    CHECK (repacked->sampletype == msr->sampletype, "Repacked sample type does not match original");
+    CHECK (!memcmp (repacked->datasamples, msr->datasamples,
+                    (size_t)(msr->numsamples * ms_samplesize (msr->sampletype))),
+           "Repacked samples do not match original");
+
+    ms3_readmsr (&msr, NULL, 0, 0);
+    msr3_free (&repacked);
+  }
+}
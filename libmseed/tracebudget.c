@@ -0,0 +1,859 @@
+/***************************************************************************
+ * Routines to limit the memory used by trace list sample buffers by
+ * spilling cold segments to temporary files or dropping samples that
+ * can be decoded again from a record list.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+#if !defined(LMP_WIN)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+/* Free region of the spill file */
+typedef struct TLRegion
+{
+  uint64_t offset;
+  uint64_t size;
+} TLRegion;
+
+/* Spill state for a trace segment, at MS3TraceSeg.spill */
+typedef struct TLSpill
+{
+  MS3TraceList *mstl;    /* Trace list containing segment */
+  MS3TraceID *id;        /* Trace ID containing segment */
+  MS3TraceSeg *seg;      /* Segment */
+  struct TLSpill *lruprev; /* Previous, less recently used, resident segment */
+  struct TLSpill *lrunext; /* Next, more recently used, resident segment */
+  uint64_t accounted;    /* Bytes accounted in budget for segment */
+  uint64_t fileoffset;   /* Offset of sample copy in spill file */
+  uint64_t filesize;     /* Size of sample copy in spill file, 0 if none */
+  int64_t numsamples;    /* Number of samples when spilled */
+  int8_t resident;       /* Samples are in memory */
+  int8_t modified;       /* Samples may have been modified by the caller */
+} TLSpill;
+
+/* Budget state for a trace list, at MS3TraceList.budget */
+typedef struct TLBudget
+{
+  uint64_t limit;        /* Budget for resident sample buffers in bytes */
+  uint64_t resident;     /* Bytes of sample buffers currently resident */
+  TLSpill *lruhead;      /* Least recently used resident segment */
+  TLSpill *lrutail;      /* Most recently used resident segment */
+  int fd;                /* Spill file descriptor, -1 when not open */
+  uint64_t fileend;      /* End of used space in spill file */
+  TLRegion *freeregions; /* Free regions below fileend, sorted by offset */
+  uint32_t freecount;    /* Count of free regions */
+  uint32_t freemax;      /* Allocated count of free regions */
+  char spilldir[512];    /* Directory for spill file */
+} TLBudget;
+
+/* Fraction of the budget to reduce usage to when spilling */
+#define TLBUDGET_TARGET(LIMIT) ((LIMIT) - (LIMIT) / 4)
+
+int mstl3_budget_fault (MS3TraceSeg *seg, int8_t modify);
+int mstl3_budget_track (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
+void mstl3_budget_account (MS3TraceSeg *seg);
+int mstl3_budget_enforce (MS3TraceList *mstl, MS3TraceSeg *keep);
+void mstl3_budget_release (MS3TraceSeg *seg);
+void mstl3_budget_free (MS3TraceList *mstl);
+int mstl3_budget_released (const MS3TraceSeg *seg);
+
+MS3RecordPtr *mstl3_reclist_next (const MS3RecordList *recordlist, const MS3RecordPtr *recordptr,
+                                  uint64_t *index, MS3RecordPtr *view, MS3Record *viewmsr);
+
+static int spill_segment (MS3TraceSeg *seg);
+static int redecodable (MS3TraceSeg *seg);
+static int spillfile_write (TLBudget *budget, TLSpill *state, const void *data, uint64_t size);
+static int spillfile_read (TLBudget *budget, TLSpill *state, void *data);
+static void spillfile_release (TLBudget *budget, TLSpill *state);
+static void spillfile_reclaim (TLBudget *budget, uint64_t offset, uint64_t size);
+static void lru_append (TLBudget *budget, TLSpill *state);
+static void lru_unlink (TLBudget *budget, TLSpill *state);
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Set a memory budget for the sample buffers of a ::MS3TraceList
+ *
+ * When the sample buffers of the trace list exceed \a budget bytes,
+ * the buffers of the least recently accessed segments are released
+ * until usage is reduced to 75% of the budget.  Released segments
+ * are either:
+ *   - dropped, when the samples can be decoded again from the
+ *     segment's @ref record-list, i.e. the list was built with
+ *     ::MSF_RECORDLIST and the record locations remain available, or
+ *   - spilled to a temporary file that is written and read using
+ *     memory mapping.
+ *
+ * The temporary file is created in \a spilldir, or the directory
+ * specified by the \b TMPDIR environment variable, or \c /tmp.  The
+ * file is removed from the file system immediately after creation
+ * and is closed when the budget is removed or the list is freed.
+ *
+ * A released segment has ::MS3TraceSeg.datasamples set to NULL and
+ * ::MS3TraceSeg.numsamples and ::MS3TraceSeg.datasize set to 0, all
+ * other values are retained.  Samples are restored transparently by
+ * mstl3_segment_samples() and when a segment is modified by
+ * mstl3_addmsr(), mstl3_convertsamples(), mstl3_pack() or
+ * mstl3_unpack_recordlist().  Sample buffers should not be accessed
+ * directly while a budget is set.
+ *
+ * The budget is checked when records are added and when samples are
+ * accessed, so usage may briefly exceed the budget by the size of
+ * the most recently added or accessed segment.
+ *
+ * Spilling to file is not supported on Windows, only segments that
+ * can be decoded again are released on that platform.
+ *
+ * @param[in] mstl ::MS3TraceList to set budget for
+ * @param[in] budget Budget in bytes, 0 removes the budget and restores
+ * all released segments
+ * @param[in] spilldir Directory for spill file, can be NULL
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_segment_samples()
+ ***************************************************************************/
+int
+mstl3_set_budget (MS3TraceList *mstl, uint64_t budget, const char *spilldir)
+{
+  TLBudget *tlbudget;
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+
+  if (!mstl)
+  {
+    ms_log (2, "%s(): Required input not defined: 'mstl'\n", __func__);
+    return -1;
+  }
+
+  /* Remove budget, restoring all segments */
+  if (budget == 0)
+  {
+    if (!mstl->budget)
+      return 0;
+
+    for (id = mstl->traces.next[0]; id; id = id->next[0])
+    {
+      for (seg = id->first; seg; seg = seg->next)
+      {
+        if (seg->spill && mstl3_budget_fault (seg, 0))
+          return -1;
+
+        mstl3_budget_release (seg);
+      }
+    }
+
+    mstl3_budget_free (mstl);
+
+    return 0;
+  }
+
+  if (spilldir && strlen (spilldir) >= sizeof (tlbudget->spilldir))
+  {
+    ms_log (2, "Spill directory name is too long: %s\n", spilldir);
+    return -1;
+  }
+
+  if ((tlbudget = (TLBudget *)mstl->budget) == NULL)
+  {
+    if ((tlbudget = (TLBudget *)lm_malloc (sizeof (TLBudget))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+
+    memset (tlbudget, 0, sizeof (TLBudget));
+    tlbudget->fd = -1;
+
+    mstl->budget = tlbudget;
+  }
+
+  tlbudget->limit = budget;
+
+  if (spilldir)
+    strcpy (tlbudget->spilldir, spilldir);
+
+  /* Track all existing segments */
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if (mstl3_budget_track (mstl, id, seg))
+        return -1;
+    }
+  }
+
+  return mstl3_budget_enforce (mstl, NULL);
+} /* End of mstl3_set_budget() */
+
+/**********************************************************************/ /**
+ * @brief Return the data samples of a ::MS3TraceSeg, restoring them if needed
+ *
+ * If the segment's samples were released to stay within the memory
+ * budget of the trace list, set with mstl3_set_budget(), they are
+ * restored either by reading them from the spill file or by decoding
+ * them from the segment's @ref record-list.  The segment is marked as
+ * recently used and the budget is enforced for other segments.
+ *
+ * If \a writable is true the caller may modify the returned samples,
+ * and the segment will subsequently only be spilled to file, never
+ * dropped and decoded again.
+ *
+ * The returned pointer is valid until the next call that may enforce
+ * the budget of the same trace list: another call to this function,
+ * adding records to the list, or packing the list.
+ *
+ * For segments of a list without a budget this function simply
+ * returns ::MS3TraceSeg.datasamples.
+ *
+ * @param[in] seg ::MS3TraceSeg to return samples for
+ * @param[in] writable Flag indicating the samples will be modified
+ *
+ * @returns a pointer to ::MS3TraceSeg.numsamples samples of type
+ * ::MS3TraceSeg.sampletype, or NULL on error or if the segment has no
+ * samples.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_set_budget()
+ ***************************************************************************/
+void *
+mstl3_segment_samples (MS3TraceSeg *seg, int8_t writable)
+{
+  TLSpill *state;
+
+  if (!seg)
+  {
+    ms_log (2, "%s(): Required input not defined: 'seg'\n", __func__);
+    return NULL;
+  }
+
+  if ((state = (TLSpill *)seg->spill) == NULL)
+    return seg->datasamples;
+
+  if (mstl3_budget_fault (seg, writable))
+    return NULL;
+
+  if (writable)
+    state->modified = 1;
+
+  if (mstl3_budget_track (state->mstl, state->id, seg))
+    return NULL;
+
+  if (mstl3_budget_enforce (state->mstl, seg))
+    return NULL;
+
+  return seg->datasamples;
+} /* End of mstl3_segment_samples() */
+
+/** @cond UNDOCUMENTED */
+
+/***************************************************************************
+ * Restore the samples of a segment if released.
+ *
+ * If the modify flag is set the samples are about to be changed by
+ * the library and any copy in the spill file is discarded.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_budget_fault (MS3TraceSeg *seg, int8_t modify)
+{
+  TLSpill *state;
+  void *samples = NULL;
+  int64_t unpacked;
+
+  if (!seg || (state = (TLSpill *)seg->spill) == NULL)
+    return 0;
+
+  if (!state->resident)
+  {
+    /* Read copy from spill file */
+    if (state->filesize > 0)
+    {
+      if ((samples = lm_malloc ((size_t)state->filesize)) == NULL)
+      {
+        ms_log (2, "%s: Cannot allocate memory for segment samples\n", state->id->sid);
+        return -1;
+      }
+
+      if (spillfile_read ((TLBudget *)state->mstl->budget, state, samples))
+      {
+        libmseed_memory.free (samples);
+        return -1;
+      }
+
+      seg->datasamples = samples;
+      seg->datasize = state->filesize;
+      seg->numsamples = state->numsamples;
+    }
+    /* Decode again from record list, marked resident to avoid recursion */
+    else
+    {
+      state->resident = 1;
+
+      unpacked = mstl3_unpack_recordlist (state->id, seg, NULL, 0, 0);
+
+      if (unpacked != state->numsamples)
+      {
+        ms_log (2, "%s: Cannot restore segment samples from record list, decoded %" PRId64 " of %" PRId64 "\n",
+                state->id->sid, unpacked, state->numsamples);
+        state->resident = 0;
+        return -1;
+      }
+    }
+
+    state->resident = 1;
+    lru_append ((TLBudget *)state->mstl->budget, state);
+    mstl3_budget_account (seg);
+  }
+
+  if (modify && state->filesize > 0)
+    spillfile_release ((TLBudget *)state->mstl->budget, state);
+
+  return 0;
+} /* End of mstl3_budget_fault() */
+
+/***************************************************************************
+ * Start tracking a segment if needed, update accounting and mark the
+ * segment as recently used.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_budget_track (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg)
+{
+  TLBudget *budget;
+  TLSpill *state;
+
+  if (!mstl || !id || !seg || (budget = (TLBudget *)mstl->budget) == NULL)
+    return 0;
+
+  if ((state = (TLSpill *)seg->spill) == NULL)
+  {
+    if ((state = (TLSpill *)lm_malloc (sizeof (TLSpill))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+
+    memset (state, 0, sizeof (TLSpill));
+    state->mstl = mstl;
+    state->id = id;
+    state->seg = seg;
+    state->resident = 1;
+
+    seg->spill = state;
+  }
+
+  /* Mark as most recently used */
+  if (state->resident)
+    lru_append (budget, state);
+
+  mstl3_budget_account (seg);
+
+  return 0;
+} /* End of mstl3_budget_track() */
+
+/***************************************************************************
+ * Update the budget accounting for a resident segment after its
+ * sample buffer may have changed size.
+ ***************************************************************************/
+void
+mstl3_budget_account (MS3TraceSeg *seg)
+{
+  TLBudget *budget;
+  TLSpill *state;
+
+  if (!seg || (state = (TLSpill *)seg->spill) == NULL || !state->resident)
+    return;
+
+  budget = (TLBudget *)state->mstl->budget;
+
+  budget->resident -= state->accounted;
+  state->accounted = (seg->datasamples) ? seg->datasize : 0;
+  budget->resident += state->accounted;
+} /* End of mstl3_budget_account() */
+
+/***************************************************************************
+ * Release the least recently used segments until the usage is reduced
+ * to the target, if the budget is exceeded.  The keep segment, if not
+ * NULL, is not released.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_budget_enforce (MS3TraceList *mstl, MS3TraceSeg *keep)
+{
+  TLBudget *budget;
+  TLSpill *state;
+  TLSpill *next;
+
+  if (!mstl || (budget = (TLBudget *)mstl->budget) == NULL)
+    return 0;
+
+  if (budget->resident <= budget->limit)
+    return 0;
+
+  /* Release coldest segments first, released segments leave the list */
+  for (state = budget->lruhead; state && budget->resident > TLBUDGET_TARGET (budget->limit); state = next)
+  {
+    next = state->lrunext;
+
+    if (state->seg != keep && spill_segment (state->seg) < 0)
+      return -1;
+  }
+
+  return 0;
+} /* End of mstl3_budget_enforce() */
+
+/***************************************************************************
+ * Stop tracking a segment that is being removed or whose list no
+ * longer has a budget.  Released samples are not restored.
+ ***************************************************************************/
+void
+mstl3_budget_release (MS3TraceSeg *seg)
+{
+  TLBudget *budget;
+  TLSpill *state;
+
+  if (!seg || (state = (TLSpill *)seg->spill) == NULL)
+    return;
+
+  budget = (TLBudget *)state->mstl->budget;
+
+  if (state->filesize > 0)
+    spillfile_release (budget, state);
+
+  if (state->resident)
+    budget->resident -= state->accounted;
+
+  lru_unlink (budget, state);
+
+  libmseed_memory.free (state);
+  seg->spill = NULL;
+} /* End of mstl3_budget_release() */
+
+/***************************************************************************
+ * Free the budget state of a trace list, closing the spill file.  All
+ * segments must already be released.
+ ***************************************************************************/
+void
+mstl3_budget_free (MS3TraceList *mstl)
+{
+  TLBudget *budget;
+
+  if (!mstl || (budget = (TLBudget *)mstl->budget) == NULL)
+    return;
+
+#if !defined(LMP_WIN)
+  if (budget->fd >= 0)
+    close (budget->fd);
+#endif
+
+  if (budget->freeregions)
+    libmseed_memory.free (budget->freeregions);
+
+  libmseed_memory.free (budget);
+  mstl->budget = NULL;
+} /* End of mstl3_budget_free() */
+
+/***************************************************************************
+ * Determine if the samples of a segment are released.
+ *
+ * Returns 1 if released, otherwise 0.
+ ***************************************************************************/
+int
+mstl3_budget_released (const MS3TraceSeg *seg)
+{
+  const TLSpill *state;
+
+  if (!seg || (state = (const TLSpill *)seg->spill) == NULL)
+    return 0;
+
+  return (state->resident) ? 0 : 1;
+} /* End of mstl3_budget_released() */
+
+/***************************************************************************
+ * Release the samples of a resident segment, preferring an existing
+ * copy in the spill file, then decoding again from the record list,
+ * and finally writing a new copy to the spill file.
+ *
+ * Returns 0 when released, 1 when the segment cannot be released and
+ * -1 on error.
+ ***************************************************************************/
+static int
+spill_segment (MS3TraceSeg *seg)
+{
+  TLSpill *state = (TLSpill *)seg->spill;
+  TLBudget *budget = (TLBudget *)state->mstl->budget;
+  int rv;
+
+  if (!state->resident || !seg->datasamples)
+    return 1;
+
+  if (state->filesize == 0 && (state->modified || !redecodable (seg)))
+  {
+    rv = spillfile_write (budget, state, seg->datasamples,
+                          (uint64_t)seg->numsamples * ms_samplesize (seg->sampletype));
+
+    if (rv)
+      return rv;
+  }
+
+  state->numsamples = seg->numsamples;
+  state->resident = 0;
+  budget->resident -= state->accounted;
+  state->accounted = 0;
+  lru_unlink (budget, state);
+
+  libmseed_memory.free (seg->datasamples);
+  seg->datasamples = NULL;
+  seg->datasize = 0;
+  seg->numsamples = 0;
+
+  return 0;
+} /* End of spill_segment() */
+
+/***************************************************************************
+ * Determine if the samples of a segment can be decoded again from its
+ * record list, i.e. the records cover exactly the segment's samples,
+ * decode to the same sample type and the record locations are
+ * available.
+ *
+ * Returns 1 if the segment can be decoded again, otherwise 0.
+ ***************************************************************************/
+static int
+redecodable (MS3TraceSeg *seg)
+{
+  MS3RecordPtr *recordptr;
+  MS3RecordPtr view;
+  MS3Record viewmsr;
+  uint64_t index = 0;
+  const char *lastfilename = NULL;
+  int64_t samplecnt = 0;
+  char sampletype = 0;
+
+  if (!seg->recordlist || seg->recordlist->recordcnt == 0 || seg->numsamples != seg->samplecnt)
+    return 0;
+
+  for (recordptr = mstl3_reclist_next (seg->recordlist, NULL, &index, &view, &viewmsr); recordptr;
+       recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr))
+  {
+    if (!recordptr->msr)
+      return 0;
+
+    if (recordptr->msr->samplecnt == 0)
+      continue;
+
+    if (ms_encoding_sizetype ((uint8_t)recordptr->msr->encoding, NULL, &sampletype) ||
+        sampletype != seg->sampletype)
+      return 0;
+
+    if (!recordptr->bufferptr && !recordptr->fileptr)
+    {
+      if (!recordptr->filename)
+        return 0;
+
+#if !defined(LMP_WIN)
+      if (recordptr->filename != lastfilename && access (recordptr->filename, R_OK))
+        return 0;
+#endif
+
+      lastfilename = recordptr->filename;
+    }
+
+    samplecnt += recordptr->msr->samplecnt;
+  }
+
+  return (samplecnt == seg->samplecnt) ? 1 : 0;
+} /* End of redecodable() */
+
+/***************************************************************************
+ * Write samples to a page-aligned region of the spill file via a
+ * memory mapping, creating the file if needed.  The first free region
+ * large enough is reused, otherwise the file is extended.
+ *
+ * Returns 0 on success, 1 if spilling is not supported and -1 on error.
+ ***************************************************************************/
+static int
+spillfile_write (TLBudget *budget, TLSpill *state, const void *data, uint64_t size)
+{
+#if defined(LMP_WIN)
+  (void)budget;
+  (void)state;
+  (void)data;
+  (void)size;
+  return 1;
+#else
+  char path[sizeof (budget->spilldir) + 32];
+  const char *dir;
+  uint64_t pagesize;
+  uint64_t offset;
+  uint64_t alloc;
+  uint32_t idx;
+  void *map;
+
+  if (size == 0)
+    return 1;
+
+  if (budget->fd < 0)
+  {
+    if ((dir = budget->spilldir)[0] == '\0' && (dir = getenv ("TMPDIR")) == NULL)
+      dir = "/tmp";
+
+    snprintf (path, sizeof (path), "%s/libmseed-spill-XXXXXX", dir);
+
+    if ((budget->fd = mkstemp (path)) < 0)
+    {
+      ms_log (2, "Cannot create spill file %s: %s\n", path, strerror (errno));
+      return -1;
+    }
+
+    /* Remove name, the file is removed when closed */
+    unlink (path);
+  }
+
+  pagesize = (uint64_t)sysconf (_SC_PAGESIZE);
+  alloc = (size + pagesize - 1) / pagesize * pagesize;
+
+  for (idx = 0; idx < budget->freecount && budget->freeregions[idx].size < alloc; idx++)
+    ;
+
+  /* Reuse start of free region */
+  if (idx < budget->freecount)
+  {
+    offset = budget->freeregions[idx].offset;
+    budget->freeregions[idx].offset += alloc;
+    budget->freeregions[idx].size -= alloc;
+
+    if (budget->freeregions[idx].size == 0)
+    {
+      budget->freecount--;
+      memmove (&budget->freeregions[idx], &budget->freeregions[idx + 1],
+               (budget->freecount - idx) * sizeof (TLRegion));
+    }
+  }
+  /* Extend file */
+  else
+  {
+    offset = budget->fileend;
+
+    if (ftruncate (budget->fd, (off_t) (offset + alloc)))
+    {
+      ms_log (2, "Cannot extend spill file: %s\n", strerror (errno));
+      return -1;
+    }
+
+    budget->fileend = offset + alloc;
+  }
+
+  map = mmap (NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, budget->fd, (off_t)offset);
+
+  if (map == MAP_FAILED)
+  {
+    ms_log (2, "Cannot map spill file: %s\n", strerror (errno));
+    spillfile_reclaim (budget, offset, alloc);
+    return -1;
+  }
+
+  memcpy (map, data, (size_t)size);
+  munmap (map, (size_t)size);
+
+  state->fileoffset = offset;
+  state->filesize = size;
+
+  return 0;
+#endif
+} /* End of spillfile_write() */
+
+/***************************************************************************
+ * Read the samples of a segment from the spill file via a memory mapping.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+spillfile_read (TLBudget *budget, TLSpill *state, void *data)
+{
+#if defined(LMP_WIN)
+  (void)budget;
+  (void)state;
+  (void)data;
+  return -1;
+#else
+  void *map;
+
+  map = mmap (NULL, (size_t)state->filesize, PROT_READ, MAP_SHARED, budget->fd, (off_t)state->fileoffset);
+
+  if (map == MAP_FAILED)
+  {
+    ms_log (2, "%s: Cannot map spill file: %s\n", state->id->sid, strerror (errno));
+    return -1;
+  }
+
+  memcpy (data, map, (size_t)state->filesize);
+  munmap (map, (size_t)state->filesize);
+
+  return 0;
+#endif
+} /* End of spillfile_read() */
+
+/***************************************************************************
+ * Discard the spill file copy of a segment, returning its region to
+ * the free regions of the file.
+ ***************************************************************************/
+static void
+spillfile_release (TLBudget *budget, TLSpill *state)
+{
+#if !defined(LMP_WIN)
+  uint64_t pagesize = (uint64_t)sysconf (_SC_PAGESIZE);
+
+  if (state->filesize > 0)
+    spillfile_reclaim (budget, state->fileoffset,
+                       (state->filesize + pagesize - 1) / pagesize * pagesize);
+#else
+  (void)budget;
+#endif
+
+  state->fileoffset = 0;
+  state->filesize = 0;
+} /* End of spillfile_release() */
+
+/***************************************************************************
+ * Add a region to the free regions of the spill file, merging it with
+ * adjacent free regions.  Free space at the end of the file is
+ * truncated.  If the free regions cannot grow the region is not
+ * reused.
+ ***************************************************************************/
+static void
+spillfile_reclaim (TLBudget *budget, uint64_t offset, uint64_t size)
+{
+  TLRegion *regions;
+  uint32_t idx;
+
+  /* Find first free region after the released region */
+  for (idx = 0; idx < budget->freecount && budget->freeregions[idx].offset < offset; idx++)
+    ;
+
+  /* Merge with preceding and following regions */
+  if (idx > 0 && budget->freeregions[idx - 1].offset + budget->freeregions[idx - 1].size == offset)
+  {
+    budget->freeregions[idx - 1].size += size;
+
+    if (idx < budget->freecount && offset + size == budget->freeregions[idx].offset)
+    {
+      budget->freeregions[idx - 1].size += budget->freeregions[idx].size;
+      budget->freecount--;
+      memmove (&budget->freeregions[idx], &budget->freeregions[idx + 1],
+               (budget->freecount - idx) * sizeof (TLRegion));
+    }
+  }
+  else if (idx < budget->freecount && offset + size == budget->freeregions[idx].offset)
+  {
+    budget->freeregions[idx].offset = offset;
+    budget->freeregions[idx].size += size;
+  }
+  else
+  {
+    if (budget->freecount == budget->freemax)
+    {
+      regions = (TLRegion *)lm_realloc (budget->freeregions,
+                                        (budget->freemax + 16) * sizeof (TLRegion));
+
+      if (regions == NULL)
+        return;
+
+      budget->freeregions = regions;
+      budget->freemax += 16;
+    }
+
+    memmove (&budget->freeregions[idx + 1], &budget->freeregions[idx],
+             (budget->freecount - idx) * sizeof (TLRegion));
+    budget->freeregions[idx].offset = offset;
+    budget->freeregions[idx].size = size;
+    budget->freecount++;
+  }
+
+  /* Truncate free space at end of file */
+  if (budget->freecount > 0 &&
+      budget->freeregions[budget->freecount - 1].offset + budget->freeregions[budget->freecount - 1].size == budget->fileend)
+  {
+    budget->freecount--;
+    budget->fileend = budget->freeregions[budget->freecount].offset;
+
+#if !defined(LMP_WIN)
+    if (budget->fd >= 0 && ftruncate (budget->fd, (off_t)budget->fileend))
+      ms_log (1, "Cannot truncate spill file: %s\n", strerror (errno));
+#endif
+  }
+} /* End of spillfile_reclaim() */
+
+/* Append a resident segment to the LRU list as most recently used */
+static void
+lru_append (TLBudget *budget, TLSpill *state)
+{
+  lru_unlink (budget, state);
+
+  state->lruprev = budget->lrutail;
+
+  if (budget->lrutail)
+    budget->lrutail->lrunext = state;
+  else
+    budget->lruhead = state;
+
+  budget->lrutail = state;
+}
+
+/* Remove a segment from the LRU list if linked */
+static void
+lru_unlink (TLBudget *budget, TLSpill *state)
+{
+  if (!state->lruprev && budget->lruhead != state)
+    return;
+
+  if (state->lruprev)
+    state->lruprev->lrunext = state->lrunext;
+  else
+    budget->lruhead = state->lrunext;
+
+  if (state->lrunext)
+    state->lrunext->lruprev = state->lruprev;
+  else
+    budget->lrutail = state->lruprev;
+
+  state->lruprev = NULL;
+  state->lrunext = NULL;
+}
+
+/** @endcond */
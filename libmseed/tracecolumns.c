@@ -0,0 +1,533 @@
+/***************************************************************************
+ * Routines to export the data samples of a trace list as columns of
+ * little-endian typed values with a binary index.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_IO
+#include "memprofile.h"
+
+#if !defined(LMP_WIN) && !defined(LIBMSEED_NO_THREADING)
+#define LM_COLUMN_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+/* Size of buffer used to byte swap samples on big endian hosts */
+#define COLUMN_SWAPBUFFER 65536
+
+/* A column to write: segment, sample values and index entry */
+typedef struct ColumnJob
+{
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  const void *samples;
+  MS3ColumnEntry entry;
+  int result;
+} ColumnJob;
+
+/* Shared state for column writing workers */
+typedef struct ColumnWork
+{
+  const char *datafile;
+  ColumnJob *jobs;
+  uint64_t jobcount;
+  uint64_t nextjob;
+  int failed;
+#if defined(LM_COLUMN_THREADS)
+  pthread_mutex_t lock;
+#endif
+} ColumnWork;
+
+int mstl3_budget_released (const MS3TraceSeg *seg);
+
+static const char *column_dtype (char sampletype);
+static int write_column (FILE *fp, const char *datafile, ColumnJob *job);
+static int write_index (const char *indexfile, ColumnJob *jobs, uint64_t jobcount);
+#if defined(LM_COLUMN_THREADS)
+static void *column_worker (void *arg);
+#endif
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Export the data samples of a ::MS3TraceList as typed columns
+ *
+ * The data samples of each segment are written to \a datafile as a
+ * contiguous column of little-endian values, each column starting
+ * at an offset that is a multiple of @ref MS_COLUMN_ALIGN bytes.  No
+ * other content is written to the data file, the space between
+ * columns is zero-filled.
+ *
+ * An index describing the columns is written to \a indexfile, the
+ * index is composed of a 16-byte header followed by a ::MS3ColumnEntry
+ * for each column in trace list order.  The header contains the
+ * 8-byte identifier \c "MSCOLIDX", a 4-byte version (currently 1)
+ * and a 4-byte size of each index entry.  All integer and floating
+ * point values in the index are little-endian.
+ *
+ * Consumers can map both files directly, e.g. with NumPy the index
+ * can be read using a structured dtype at offset 16 and each column
+ * read with \c numpy.memmap() using the \c dtype and \c offset of the
+ * entry.
+ *
+ * Segments without data samples are not exported, usually this
+ * means the trace list was not created with ::MSF_UNPACKDATA.
+ *
+ * Columns are written in parallel by \a threads threads, or a thread
+ * for each online processor if \a threads is 0.  Columns are written
+ * by a single thread if the library is built without threading
+ * support, on Windows or if the trace list has a memory budget set
+ * with mstl3_set_budget(), in which case samples released to stay
+ * within the budget are restored one segment at a time.
+ *
+ * @param[in] mstl ::MS3TraceList to export
+ * @param[in] datafile File to write data sample columns to
+ * @param[in] indexfile File to write column index to
+ * @param[in] threads Number of threads to use, 0 to use all processors
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of columns written or -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+mstl3_export_columns (MS3TraceList *mstl, const char *datafile, const char *indexfile,
+                      int threads, int8_t verbose)
+{
+  ColumnWork work;
+  ColumnJob *job;
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  FILE *fp = NULL;
+  uint64_t jobcount = 0;
+  uint64_t offset = 0;
+  uint64_t idx;
+  int samplesize;
+  int retval = 0;
+#if defined(LM_COLUMN_THREADS)
+  pthread_t *tids = NULL;
+  int started = 0;
+  int tidx;
+  int rv;
+#endif
+
+  if (!mstl || !datafile || !indexfile)
+  {
+    ms_log (2, "%s(): Required input not defined: 'mstl', 'datafile' or 'indexfile'\n", __func__);
+    return -1;
+  }
+
+  memset (&work, 0, sizeof (work));
+  work.datafile = datafile;
+
+  /* Count segments with samples, including those released by a memory budget */
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+    for (seg = id->first; seg; seg = seg->next)
+      if (seg->numsamples > 0 || mstl3_budget_released (seg))
+        jobcount++;
+
+  if (jobcount > 0 &&
+      (work.jobs = (ColumnJob *)lm_malloc ((size_t)jobcount * sizeof (ColumnJob))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if (!(seg->numsamples > 0 || mstl3_budget_released (seg)))
+        continue;
+
+      job = &work.jobs[work.jobcount++];
+      memset (job, 0, sizeof (ColumnJob));
+      job->id = id;
+      job->seg = seg;
+      job->samples = seg->datasamples;
+    }
+  }
+
+  /* Truncate or create data file */
+  if ((fp = fopen (datafile, "wb")) == NULL)
+  {
+    ms_log (2, "Cannot open output file: %s (%s)\n", datafile, strerror (errno));
+    libmseed_memory.free (work.jobs);
+    return -1;
+  }
+
+  if (mstl->budget)
+    threads = 1;
+
+#if defined(LM_COLUMN_THREADS)
+  if (threads <= 0)
+    threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#else
+  threads = 1;
+#endif
+
+  if (threads <= 0 || (uint64_t)threads > work.jobcount)
+    threads = (work.jobcount > 0) ? (int)work.jobcount : 1;
+
+  /* Single thread: restore budgeted samples as needed, assign offsets and write */
+  if (threads == 1)
+  {
+    for (idx = 0; idx < work.jobcount && retval == 0; idx++)
+    {
+      job = &work.jobs[idx];
+
+      if ((job->samples = mstl3_segment_samples (job->seg, 0)) == NULL ||
+          !(samplesize = ms_samplesize (job->seg->sampletype)))
+      {
+        ms_log (2, "%s: Cannot determine samples of segment\n", job->id->sid);
+        retval = -1;
+        break;
+      }
+
+      job->entry.offset = offset;
+      job->entry.numsamples = job->seg->numsamples;
+      offset += ((uint64_t)job->seg->numsamples * samplesize + MS_COLUMN_ALIGN - 1) /
+                MS_COLUMN_ALIGN * MS_COLUMN_ALIGN;
+
+      retval = write_column (fp, datafile, job);
+    }
+  }
+  /* Multiple threads: assign offsets, then write columns in parallel */
+  else
+  {
+    for (idx = 0; idx < work.jobcount; idx++)
+    {
+      job = &work.jobs[idx];
+
+      if (!(samplesize = ms_samplesize (job->seg->sampletype)))
+      {
+        ms_log (2, "%s: Unknown sample size for sample type: %c\n", job->id->sid, job->seg->sampletype);
+        retval = -1;
+        break;
+      }
+
+      job->entry.offset = offset;
+      job->entry.numsamples = job->seg->numsamples;
+      offset += ((uint64_t)job->seg->numsamples * samplesize + MS_COLUMN_ALIGN - 1) /
+                MS_COLUMN_ALIGN * MS_COLUMN_ALIGN;
+    }
+
+#if defined(LM_COLUMN_THREADS)
+    if (retval == 0)
+    {
+      pthread_mutex_init (&work.lock, NULL);
+
+      if ((tids = (pthread_t *)lm_malloc (threads * sizeof (pthread_t))) == NULL)
+      {
+        ms_log (2, "Cannot allocate memory\n");
+        retval = -1;
+      }
+
+      for (tidx = 0; retval == 0 && tidx < threads; tidx++)
+      {
+        if ((rv = pthread_create (&tids[tidx], NULL, column_worker, &work)))
+        {
+          ms_log (2, "Cannot create column writing thread: %s\n", strerror (rv));
+          retval = -1;
+          break;
+        }
+
+        started++;
+      }
+
+      /* Workers stop when no jobs remain, jobs are not started after a failure */
+      if (retval)
+      {
+        pthread_mutex_lock (&work.lock);
+        work.nextjob = work.jobcount;
+        pthread_mutex_unlock (&work.lock);
+      }
+
+      for (tidx = 0; tidx < started; tidx++)
+        pthread_join (tids[tidx], NULL);
+
+      if (tids)
+        libmseed_memory.free (tids);
+
+      pthread_mutex_destroy (&work.lock);
+
+      if (work.failed)
+        retval = -1;
+
+      for (idx = 0; idx < work.jobcount; idx++)
+        if (work.jobs[idx].result)
+          retval = -1;
+    }
+#endif
+  }
+
+  if (fclose (fp))
+  {
+    ms_log (2, "Cannot write output file: %s (%s)\n", datafile, strerror (errno));
+    retval = -1;
+  }
+
+  if (retval == 0)
+    retval = write_index (indexfile, work.jobs, work.jobcount);
+
+  if (retval == 0 && verbose)
+    ms_log (0, "Exported %" PRIu64 " columns (%" PRIu64 " bytes) to %s using %d thread(s)\n",
+            work.jobcount, offset, datafile, threads);
+
+  if (work.jobs)
+    libmseed_memory.free (work.jobs);
+
+  return (retval) ? -1 : (int64_t)work.jobcount;
+} /* End of mstl3_export_columns() */
+
+/** @cond UNDOCUMENTED */
+
+/***************************************************************************
+ * Map a sample type to a NumPy array-protocol type string.
+ *
+ * Returns a type string or NULL if the sample type is not supported.
+ ***************************************************************************/
+static const char *
+column_dtype (char sampletype)
+{
+  switch (sampletype)
+  {
+  case 'i':
+    return "<i4";
+  case 'f':
+    return "<f4";
+  case 'd':
+    return "<f8";
+  case 't':
+    return "|S1";
+  }
+
+  return NULL;
+} /* End of column_dtype() */
+
+/***************************************************************************
+ * Write the samples of a job as a little-endian column at the
+ * assigned offset and populate the index entry.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+write_column (FILE *fp, const char *datafile, ColumnJob *job)
+{
+  const char *dtype;
+  uint8_t *swapbuffer = NULL;
+  uint64_t size;
+  uint64_t done;
+  size_t chunk;
+  size_t idx;
+  int samplesize;
+
+  if ((dtype = column_dtype (job->seg->sampletype)) == NULL)
+  {
+    ms_log (2, "%s: Unsupported sample type for column: %c\n", job->id->sid, job->seg->sampletype);
+    return job->result = -1;
+  }
+
+  samplesize = ms_samplesize (job->seg->sampletype);
+  size = (uint64_t)job->entry.numsamples * samplesize;
+
+  memcpy (job->entry.sid, job->id->sid, sizeof (job->entry.sid));
+  memcpy (job->entry.dtype, dtype, strlen (dtype) + 1);
+  job->entry.pubversion = job->id->pubversion;
+  job->entry.starttime = job->seg->starttime;
+  job->entry.samprate = job->seg->samprate;
+
+  if (lmp_fseek64 (fp, (int64_t)job->entry.offset, SEEK_SET))
+  {
+    ms_log (2, "Cannot seek in output file: %s (%s)\n", datafile, strerror (errno));
+    return job->result = -1;
+  }
+
+  /* Write directly on little endian hosts or for single byte samples */
+  if (!ms_bigendianhost () || samplesize == 1)
+  {
+    if (size > 0 && fwrite (job->samples, (size_t)size, 1, fp) != 1)
+    {
+      ms_log (2, "Cannot write to output file: %s (%s)\n", datafile, strerror (errno));
+      return job->result = -1;
+    }
+
+    return job->result = 0;
+  }
+
+  /* Otherwise swap samples to little endian in chunks */
+  if ((swapbuffer = (uint8_t *)lm_malloc (COLUMN_SWAPBUFFER)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return job->result = -1;
+  }
+
+  for (done = 0; done < size; done += chunk)
+  {
+    chunk = (size - done < COLUMN_SWAPBUFFER) ? (size_t) (size - done) : COLUMN_SWAPBUFFER;
+    memcpy (swapbuffer, (const uint8_t *)job->samples + done, chunk);
+
+    for (idx = 0; idx < chunk; idx += samplesize)
+    {
+      if (samplesize == 4)
+        ms_gswap4 (swapbuffer + idx);
+      else
+        ms_gswap8 (swapbuffer + idx);
+    }
+
+    if (fwrite (swapbuffer, chunk, 1, fp) != 1)
+    {
+      ms_log (2, "Cannot write to output file: %s (%s)\n", datafile, strerror (errno));
+      job->result = -1;
+      break;
+    }
+  }
+
+  libmseed_memory.free (swapbuffer);
+
+  return job->result;
+} /* End of write_column() */
+
+/***************************************************************************
+ * Write the column index: header followed by little-endian entries.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+write_index (const char *indexfile, ColumnJob *jobs, uint64_t jobcount)
+{
+  MS3ColumnEntry entry;
+  uint8_t header[16];
+  uint32_t value;
+  uint64_t idx;
+  FILE *fp;
+  int swapflag = ms_bigendianhost ();
+
+  if ((fp = fopen (indexfile, "wb")) == NULL)
+  {
+    ms_log (2, "Cannot open output file: %s (%s)\n", indexfile, strerror (errno));
+    return -1;
+  }
+
+  memcpy (header, "MSCOLIDX", 8);
+  value = 1;
+  if (swapflag)
+    ms_gswap4 (&value);
+  memcpy (header + 8, &value, 4);
+  value = sizeof (MS3ColumnEntry);
+  if (swapflag)
+    ms_gswap4 (&value);
+  memcpy (header + 12, &value, 4);
+
+  if (fwrite (header, sizeof (header), 1, fp) != 1)
+  {
+    ms_log (2, "Cannot write to output file: %s (%s)\n", indexfile, strerror (errno));
+    fclose (fp);
+    return -1;
+  }
+
+  for (idx = 0; idx < jobcount; idx++)
+  {
+    entry = jobs[idx].entry;
+
+    if (swapflag)
+    {
+      ms_gswap8 (&entry.starttime);
+      ms_gswap8 (&entry.samprate);
+      ms_gswap8 (&entry.numsamples);
+      ms_gswap8 (&entry.offset);
+    }
+
+    if (fwrite (&entry, sizeof (entry), 1, fp) != 1)
+    {
+      ms_log (2, "Cannot write to output file: %s (%s)\n", indexfile, strerror (errno));
+      fclose (fp);
+      return -1;
+    }
+  }
+
+  if (fclose (fp))
+  {
+    ms_log (2, "Cannot write output file: %s (%s)\n", indexfile, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+} /* End of write_index() */
+
+#if defined(LM_COLUMN_THREADS)
+/***************************************************************************
+ * Worker thread: claim and write columns until none remain, using an
+ * independent stream for the data file.
+ ***************************************************************************/
+static void *
+column_worker (void *arg)
+{
+  ColumnWork *work = (ColumnWork *)arg;
+  ColumnJob *job;
+  FILE *fp;
+
+  if ((fp = fopen (work->datafile, "r+b")) == NULL)
+  {
+    ms_log (2, "Cannot open output file: %s (%s)\n", work->datafile, strerror (errno));
+
+    /* Stop all workers from claiming further jobs */
+    pthread_mutex_lock (&work->lock);
+    work->failed = 1;
+    work->nextjob = work->jobcount;
+    pthread_mutex_unlock (&work->lock);
+
+    return NULL;
+  }
+
+  for (;;)
+  {
+    pthread_mutex_lock (&work->lock);
+    job = (work->nextjob < work->jobcount) ? &work->jobs[work->nextjob++] : NULL;
+    pthread_mutex_unlock (&work->lock);
+
+    if (job == NULL)
+      break;
+
+    write_column (fp, work->datafile, job);
+  }
+
+  if (fclose (fp))
+  {
+    ms_log (2, "Cannot write output file: %s (%s)\n", work->datafile, strerror (errno));
+
+    pthread_mutex_lock (&work->lock);
+    work->failed = 1;
+    pthread_mutex_unlock (&work->lock);
+  }
+
+  return NULL;
+} /* End of column_worker() */
+#endif
+
+/** @endcond */
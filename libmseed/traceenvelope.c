@@ -0,0 +1,413 @@
+/***************************************************************************
+ * Routines to export multi-resolution min/max envelopes of the data
+ * samples of a trace list.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_IO
+#include "memprofile.h"
+
+/** @cond UNDOCUMENTED */
+
+int mstl3_budget_released (const MS3TraceSeg *seg);
+
+/* Size of the envelope file header */
+#define ENVELOPE_HEADER 32
+
+/* Generate a routine to build all levels of an envelope for a sample
+ * type.  Level 0 pairs are the minimum and maximum of each bucket of
+ * samples, each following level combines adjacent pairs of the
+ * previous level.  The last bucket of a level may be partial. */
+#define ENVELOPE_BUILD(NAME, TYPE)                                          \
+  static void NAME (const TYPE *samples, int64_t numsamples,                \
+                    uint64_t bucketsamples, const uint64_t *buckets,        \
+                    int levels, TYPE *pairs)                                \
+  {                                                                         \
+    const TYPE *previous;                                                   \
+    TYPE min;                                                               \
+    TYPE max;                                                               \
+    uint64_t bucket;                                                        \
+    uint64_t end;                                                           \
+    uint64_t idx;                                                           \
+    int level;                                                              \
+                                                                            \
+    for (bucket = 0; bucket < buckets[0]; bucket++)                         \
+    {                                                                       \
+      idx = bucket * bucketsamples;                                         \
+      end = idx + bucketsamples;                                            \
+      if (end > (uint64_t)numsamples)                                       \
+        end = (uint64_t)numsamples;                                         \
+                                                                            \
+      min = max = samples[idx];                                             \
+      for (idx++; idx < end; idx++)                                         \
+      {                                                                     \
+        min = (samples[idx] < min) ? samples[idx] : min;                    \
+        max = (samples[idx] > max) ? samples[idx] : max;                    \
+      }                                                                     \
+                                                                            \
+      pairs[2 * bucket] = min;                                              \
+      pairs[2 * bucket + 1] = max;                                          \
+    }                                                                       \
+                                                                            \
+    for (level = 1; level < levels; level++)                                \
+    {                                                                       \
+      previous = pairs;                                                     \
+      pairs += 2 * buckets[level - 1];                                      \
+                                                                            \
+      for (bucket = 0; bucket < buckets[level]; bucket++)                   \
+      {                                                                     \
+        min = previous[4 * bucket];                                         \
+        max = previous[4 * bucket + 1];                                     \
+                                                                            \
+        if (2 * bucket + 1 < buckets[level - 1])                            \
+        {                                                                   \
+          min = (previous[4 * bucket + 2] < min) ? previous[4 * bucket + 2] : min; \
+          max = (previous[4 * bucket + 3] > max) ? previous[4 * bucket + 3] : max; \
+        }                                                                   \
+                                                                            \
+        pairs[2 * bucket] = min;                                            \
+        pairs[2 * bucket + 1] = max;                                        \
+      }                                                                     \
+    }                                                                       \
+  }
+
+ENVELOPE_BUILD (envelope_int32, int32_t)
+ENVELOPE_BUILD (envelope_float32, float)
+ENVELOPE_BUILD (envelope_float64, double)
+
+static int envelope_levels (int64_t numsamples, uint64_t bucketsamples, uint64_t *buckets);
+static int write_envelope (const char *path, MS3TraceID *id, uint64_t bucketsamples);
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Export min/max envelopes of the data samples of a ::MS3TraceList
+ *
+ * For each trace ID a file is written containing a pyramid of
+ * minimum and maximum sample values for each segment.  At level 0
+ * each bucket covers \a bucketsamples samples and the bucket size
+ * doubles at each following level, up to the level containing a
+ * single bucket.  A viewer can read any zoom level of a trace by
+ * reading only the index and the buckets of that level instead of
+ * decoding the samples.
+ *
+ * Each file is named by appending the source identifier and \c ".env"
+ * to \a prefix, e.g. a prefix of \c "envelopes/" writes the files to
+ * an existing directory named \c envelopes.  Characters of the source
+ * identifier other than letters, digits, \c '_', \c '.' and \c '-'
+ * are replaced with \c '_' in file names, e.g. the file of
+ * \c "FDSN:IU_COLA_00_B_H_Z" is \c "FDSN_IU_COLA_00_B_H_Z.env".  The
+ * unchanged source identifier is stored in the index entries.
+ *
+ * A file is composed of a 32-byte header, a ::MS3EnvelopeEntry for
+ * each level of each segment, and the min/max pairs of each level.
+ * The header contains the 8-byte identifier \c "MSENVIDX", a 4-byte
+ * version (currently 1), a 4-byte size of each entry, an 8-byte count
+ * of entries and 8 reserved bytes.  The pairs of a level are stored
+ * as consecutive minimum and maximum values of the segment's sample
+ * type starting at the \a offset of the entry.  All integer and
+ * floating point values are little-endian.
+ *
+ * Segments without integer, float or double samples are not
+ * included, usually this means the trace list was not created with
+ * ::MSF_UNPACKDATA.  No file is written for a trace ID without such
+ * segments.  Trace IDs are expected to be unique per source
+ * identifier, i.e. publication versions were not split when the list
+ * was created.
+ *
+ * @param[in] mstl ::MS3TraceList to export
+ * @param[in] prefix Prefix for output file names
+ * @param[in] bucketsamples Number of samples per bucket at level 0,
+ * 0 for the default of @ref MS_ENVELOPE_BUCKET
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of files written or -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+mstl3_export_envelopes (MS3TraceList *mstl, const char *prefix, uint32_t bucketsamples,
+                        int8_t verbose)
+{
+  MS3TraceID *id;
+  char path[1024];
+  char *name;
+  int64_t files = 0;
+  size_t idx;
+  int rv;
+
+  if (!mstl || !prefix)
+  {
+    ms_log (2, "%s(): Required input not defined: 'mstl' or 'prefix'\n", __func__);
+    return -1;
+  }
+
+  if (bucketsamples == 0)
+    bucketsamples = MS_ENVELOPE_BUCKET;
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    if (snprintf (path, sizeof (path), "%s%s.env", prefix, id->sid) >= (int)sizeof (path))
+    {
+      ms_log (2, "%s: Envelope file name is too long\n", id->sid);
+      return -1;
+    }
+
+    /* Replace characters not portable in file names, e.g. ':' */
+    name = path + strlen (prefix);
+    for (idx = 0; id->sid[idx]; idx++)
+    {
+      if (!isalnum ((unsigned char)name[idx]) && name[idx] != '_' && name[idx] != '.' && name[idx] != '-')
+        name[idx] = '_';
+    }
+
+    if ((rv = write_envelope (path, id, bucketsamples)) < 0)
+      return -1;
+
+    if (rv > 0)
+    {
+      files++;
+
+      if (verbose)
+        ms_log (0, "%s: Exported envelope with %d entries to %s\n", id->sid, rv, path);
+    }
+  }
+
+  return files;
+} /* End of mstl3_export_envelopes() */
+
+/** @cond UNDOCUMENTED */
+
+/***************************************************************************
+ * Determine the number of buckets at each level of an envelope.
+ *
+ * Returns the number of levels.
+ ***************************************************************************/
+static int
+envelope_levels (int64_t numsamples, uint64_t bucketsamples, uint64_t *buckets)
+{
+  int levels = 0;
+
+  buckets[levels] = ((uint64_t)numsamples + bucketsamples - 1) / bucketsamples;
+
+  while (buckets[levels] > 1)
+  {
+    buckets[levels + 1] = (buckets[levels] + 1) / 2;
+    levels++;
+  }
+
+  return levels + 1;
+} /* End of envelope_levels() */
+
+/***************************************************************************
+ * Write the envelope file of a trace ID.
+ *
+ * Returns the number of entries written, 0 if no segment has
+ * supported samples, and -1 on error.
+ ***************************************************************************/
+static int
+write_envelope (const char *path, MS3TraceID *id, uint64_t bucketsamples)
+{
+  MS3EnvelopeEntry entry;
+  MS3TraceSeg *seg;
+  const char *dtype;
+  const void *samples;
+  uint8_t header[ENVELOPE_HEADER];
+  uint64_t buckets[66];
+  uint64_t entrycount = 0;
+  uint64_t offset;
+  uint64_t pairbytes;
+  uint64_t value;
+  uint32_t value32;
+  uint8_t *pairs = NULL;
+  size_t pairsize;
+  size_t idx;
+  int samplesize;
+  int levels;
+  int level;
+  int pass;
+  int swapflag = ms_bigendianhost ();
+  int retval = 0;
+  FILE *fp = NULL;
+
+  /* Pass 0 counts entries, pass 1 writes header and entries, pass 2 writes pairs */
+  for (pass = 0; pass < 3 && retval == 0; pass++)
+  {
+    if (pass == 1)
+    {
+      if (entrycount == 0)
+        return 0;
+
+      if ((fp = fopen (path, "wb")) == NULL)
+      {
+        ms_log (2, "Cannot open output file: %s (%s)\n", path, strerror (errno));
+        return -1;
+      }
+
+      memset (header, 0, sizeof (header));
+      memcpy (header, "MSENVIDX", 8);
+      value32 = 1;
+      if (swapflag)
+        ms_gswap4 (&value32);
+      memcpy (header + 8, &value32, 4);
+      value32 = sizeof (MS3EnvelopeEntry);
+      if (swapflag)
+        ms_gswap4 (&value32);
+      memcpy (header + 12, &value32, 4);
+      value = entrycount;
+      if (swapflag)
+        ms_gswap8 (&value);
+      memcpy (header + 16, &value, 8);
+
+      if (fwrite (header, sizeof (header), 1, fp) != 1)
+      {
+        ms_log (2, "Cannot write to output file: %s (%s)\n", path, strerror (errno));
+        retval = -1;
+        break;
+      }
+    }
+
+    offset = ENVELOPE_HEADER + entrycount * sizeof (MS3EnvelopeEntry);
+
+    for (seg = id->first; seg && retval == 0; seg = seg->next)
+    {
+      if (seg->sampletype == 'i')
+        dtype = "<i4";
+      else if (seg->sampletype == 'f')
+        dtype = "<f4";
+      else if (seg->sampletype == 'd')
+        dtype = "<f8";
+      else
+        continue;
+
+      if (seg->numsamples <= 0 && !mstl3_budget_released (seg))
+        continue;
+
+      /* Restore samples released by memory budget */
+      if ((samples = mstl3_segment_samples (seg, 0)) == NULL || seg->numsamples <= 0)
+        continue;
+
+      samplesize = ms_samplesize (seg->sampletype);
+      levels = envelope_levels (seg->numsamples, bucketsamples, buckets);
+
+      if (pass == 0)
+      {
+        entrycount += levels;
+        continue;
+      }
+
+      for (level = 0, pairbytes = 0; level < levels; level++)
+        pairbytes += buckets[level] * 2 * samplesize;
+
+      if (pass == 1)
+      {
+        for (level = 0; level < levels; level++)
+        {
+          memset (&entry, 0, sizeof (entry));
+          memcpy (entry.sid, id->sid, sizeof (entry.sid));
+          memcpy (entry.dtype, dtype, strlen (dtype) + 1);
+          entry.starttime = seg->starttime;
+          entry.samprate = seg->samprate;
+          entry.numsamples = seg->numsamples;
+          entry.bucketsamples = bucketsamples << level;
+          entry.buckets = buckets[level];
+          entry.offset = offset;
+          entry.level = (uint8_t)level;
+
+          offset += buckets[level] * 2 * samplesize;
+
+          if (swapflag)
+          {
+            ms_gswap8 (&entry.starttime);
+            ms_gswap8 (&entry.samprate);
+            ms_gswap8 (&entry.numsamples);
+            ms_gswap8 (&entry.bucketsamples);
+            ms_gswap8 (&entry.buckets);
+            ms_gswap8 (&entry.offset);
+          }
+
+          if (fwrite (&entry, sizeof (entry), 1, fp) != 1)
+          {
+            ms_log (2, "Cannot write to output file: %s (%s)\n", path, strerror (errno));
+            retval = -1;
+            break;
+          }
+        }
+
+        continue;
+      }
+
+      /* Build and write the pairs of all levels of the segment */
+      pairsize = (size_t)pairbytes;
+
+      if ((pairs = (uint8_t *)lm_malloc (pairsize)) == NULL)
+      {
+        ms_log (2, "Cannot allocate memory\n");
+        retval = -1;
+        break;
+      }
+
+      if (seg->sampletype == 'i')
+        envelope_int32 ((const int32_t *)samples, seg->numsamples, bucketsamples,
+                        buckets, levels, (int32_t *)pairs);
+      else if (seg->sampletype == 'f')
+        envelope_float32 ((const float *)samples, seg->numsamples, bucketsamples,
+                          buckets, levels, (float *)pairs);
+      else
+        envelope_float64 ((const double *)samples, seg->numsamples, bucketsamples,
+                          buckets, levels, (double *)pairs);
+
+      if (swapflag)
+      {
+        for (idx = 0; idx < pairsize; idx += samplesize)
+        {
+          if (samplesize == 4)
+            ms_gswap4 (pairs + idx);
+          else
+            ms_gswap8 (pairs + idx);
+        }
+      }
+
+      if (fwrite (pairs, pairsize, 1, fp) != 1)
+      {
+        ms_log (2, "Cannot write to output file: %s (%s)\n", path, strerror (errno));
+        retval = -1;
+      }
+
+      libmseed_memory.free (pairs);
+    }
+  }
+
+  if (fp && fclose (fp) && retval == 0)
+  {
+    ms_log (2, "Cannot write output file: %s (%s)\n", path, strerror (errno));
+    retval = -1;
+  }
+
+  return (retval) ? -1 : (int)entrycount;
+} /* End of write_envelope() */
+
+/** @endcond */
@@ -19,6 +19,7 @@
  ***************************************************************************/
 
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,11 +27,55 @@
 
 #include "libmseed.h"
 
-MS3TraceSeg *mstl3_msr2seg (const MS3Record *msr, nstime_t endtime);
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+MS3TraceSeg *mstl3_msr2seg (MS3TraceList *mstl, MS3TraceID *id, const MS3Record *msr, nstime_t endtime);
 MS3TraceSeg *mstl3_addmsrtoseg (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int8_t whence);
 MS3TraceSeg *mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2);
 MS3RecordPtr *mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int8_t whence);
-
+MS3TraceID *mstl3_newID (MS3TraceList *mstl);
+MS3TraceSeg *mstl3_newseg (MS3TraceList *mstl, MS3TraceID *id);
+
+int mstl3_budget_fault (MS3TraceSeg *seg, int8_t modify);
+int mstl3_budget_track (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
+void mstl3_budget_account (MS3TraceSeg *seg);
+int mstl3_budget_enforce (MS3TraceList *mstl, MS3TraceSeg *keep);
+void mstl3_budget_release (MS3TraceSeg *seg);
+void mstl3_budget_free (MS3TraceList *mstl);
+
+int mstl3_stats_init (MS3TraceList *mstl, MS3TraceSeg *seg);
+void mstl3_stats_add (MS3TraceSeg *seg, const void *samples, int64_t count,
+                      char sampletype, int8_t whence);
+void mstl3_stats_merge (MS3TraceSeg *seg1, const MS3TraceSeg *seg2);
+
+int mstl3_reclist_source (MS3TraceList *mstl, const char *filename, const char *buffer,
+                          int64_t offset, uint32_t dataoffset);
+int mstl3_reclist_add (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                       nstime_t endtime, int8_t whence);
+int mstl3_reclist_keep (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                        nstime_t endtime, int8_t whence);
+int mstl3_reclist_merge (MS3RecordList *recordlist1, MS3RecordList *recordlist2);
+void mstl3_reclist_release (MS3RecordList *recordlist);
+void mstl3_reclist_free (MS3TraceList *mstl);
+MS3RecordPtr *mstl3_reclist_next (const MS3RecordList *recordlist, const MS3RecordPtr *recordptr,
+                                  uint64_t *index, MS3RecordPtr *view, MS3Record *viewmsr);
+uint32_t mstl3_reclist_dataoffset (const char *record);
+
+int ms_blockcache_fileid (FILE *fileptr, uint64_t fileid[4]);
+int64_t ms_blockcache_get (const uint64_t fileid[4], int64_t offset, int64_t numsamples,
+                           void *output, uint64_t outputsize, char *sampletype);
+void ms_blockcache_put (const uint64_t fileid[4], int64_t offset, int64_t numsamples,
+                        const void *samples, char sampletype);
+
+static int add_record (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                       MS3RecordPtr **pprecptr, nstime_t endtime, int8_t whence, uint32_t flags);
+static int64_t unpack_records (MS3TraceID *id, MS3TraceSeg *seg, uint64_t first, uint64_t count,
+                               uint64_t samplecount, void *output, uint64_t outputsize, int8_t verbose);
+static MS3TraceID *alloc_id (MS3TraceList *mstl);
+static MS3TraceSeg *alloc_seg (MS3TraceList *mstl, MS3TraceID *id);
+static void free_seg (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
+static void free_segpool (MS3TraceID *id);
 static uint32_t lm_lcg_r (uint64_t *state);
 static uint8_t lm_random_height (uint8_t maximum, uint64_t *state);
 
@@ -55,7 +100,7 @@ mstl3_init (MS3TraceList *mstl)
     mstl3_free (&mstl, 1);
   }
 
-  mstl = (MS3TraceList *)libmseed_memory.malloc (sizeof (MS3TraceList));
+  mstl = (MS3TraceList *)lm_malloc (sizeof (MS3TraceList));
 
   if (mstl == NULL)
   {
@@ -115,9 +160,19 @@ mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr)
       if (seg->datasamples)
         libmseed_memory.free (seg->datasamples);
 
+      /* Free memory budget state */
+      if (seg->spill)
+        mstl3_budget_release (seg);
+
+      /* Free sample statistics */
+      if (seg->stats)
+        libmseed_memory.free (seg->stats);
+
       /* Free associated record list and related private pointers */
       if (seg->recordlist)
       {
+        mstl3_reclist_release (seg->recordlist);
+
         recordptr = seg->recordlist->first;
         while (recordptr)
         {
@@ -137,10 +192,15 @@ mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr)
         libmseed_memory.free (seg->recordlist);
       }
 
-      libmseed_memory.free (seg);
+      /* Segments of compact nodes are freed with the pool */
+      if (!id->segpool)
+        libmseed_memory.free (seg);
+
       seg = nextseg;
     }
 
+    free_segpool (id);
+
     /* Free private pointer data if present and requested */
     if (freeprvtptr && id->prvtptr)
       libmseed_memory.free (id->prvtptr);
@@ -150,6 +210,12 @@ mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr)
     id = nextid;
   }
 
+  mstl3_budget_free (*ppmstl);
+  mstl3_reclist_free (*ppmstl);
+
+  if ((*ppmstl)->stats)
+    libmseed_memory.free ((*ppmstl)->stats);
+
   libmseed_memory.free (*ppmstl);
 
   *ppmstl = NULL;
@@ -264,15 +330,19 @@ mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev)
     prev = local_prev;
   }
 
-  /* Set level of new entry to a random level within head height */
-  id->height = lm_random_height (MSTRACEID_SKIPLIST_HEIGHT, &(mstl->prngstate));
-
-  /* Set all pointers above new entry level to NULL */
-  for (level = MSTRACEID_SKIPLIST_HEIGHT - 1;
-       level > id->height;
-       level--)
+  /* Compact nodes are allocated to their height, which is kept */
+  if (!mstl->compact || id->height == 0 || id->height > MSTRACEID_SKIPLIST_HEIGHT)
   {
-    id->next[level] = NULL;
+    /* Set level of new entry to a random level within head height */
+    id->height = lm_random_height (MSTRACEID_SKIPLIST_HEIGHT, &(mstl->prngstate));
+
+    /* Set all pointers above new entry level to NULL */
+    for (level = MSTRACEID_SKIPLIST_HEIGHT - 1;
+         level > id->height;
+         level--)
+    {
+      id->next[level] = NULL;
+    }
   }
 
   /* Connect previous and new ID pointers */
@@ -297,6 +367,50 @@ mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev)
 } /* End of mstl3_addID() */
 
 
+/**********************************************************************/ /**
+ * @brief Select compact node allocation for a ::MS3TraceList
+ *
+ * With compact nodes each ::MS3TraceID is allocated only to the
+ * height of its skip list entry, such that only \a next[0] through
+ * \a next[height-1] exist, instead of the full
+ * ::MSTRACEID_SKIPLIST_HEIGHT pointers.  The ::MS3TraceSeg entries
+ * of each ID are allocated from arrays that grow as segments are
+ * added, keeping the segments of an ID adjacent in memory, and
+ * segments removed when merging are reused.  All memory is released
+ * by mstl3_free().
+ *
+ * Compact nodes can only be selected for an empty trace list, as
+ * returned by mstl3_init().  Trace IDs added with mstl3_addID() by the
+ * caller must be allocated as a full ::MS3TraceID with \a height set
+ * to 0, and segments must not be added to trace IDs by the caller.
+ *
+ * @param[in] mstl Empty ::MS3TraceList to use compact nodes
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+mstl3_set_compact (MS3TraceList *mstl)
+{
+  if (!mstl)
+  {
+    ms_log (2, "%s(): Required input not defined: 'mstl'\n", __func__);
+    return -1;
+  }
+
+  if (mstl->numtraceids > 0)
+  {
+    ms_log (2, "Compact nodes can only be selected for an empty trace list\n");
+    return -1;
+  }
+
+  mstl->compact = 1;
+
+  return 0;
+} /* End of mstl3_set_compact() */
+
+
 /**********************************************************************/ /**
  * @brief Add data coverage from an ::MS3Record to a ::MS3TraceList
  *
@@ -335,6 +449,18 @@ mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev)
  * ::MS3RecordPtr.endtime will be set, all other fields should be set
  * by the caller.
  *
+ * If the ::MSF_COMPACTRECLIST flag is set in \a flags and \a pprecptr
+ * is NULL, an entry is added to a compact @ref record-list instead.
+ * The record location is only known when set by the library reading
+ * routines, this is intended for use by ms3_readtracelist() and
+ * mstl3_readbuffer().
+ *
+ * If the ::MSF_KEEPRECORDS flag is set in \a flags and \a pprecptr is
+ * NULL, a copy of the record at ::MS3Record.record is kept in the
+ * compact @ref record-list of the segment, so samples can be decoded
+ * later with mstl3_unpack_recordlist() or mstl3_unpack_timewindow()
+ * after the record buffer is reused.
+ *
  * The lists are always maintained in a sorted order.  An
  * ::MS3TraceList is maintained with the ::MS3TraceID entries in
  * ascending alphanumeric order of SID. If repeated SIDs are present
@@ -347,7 +473,7 @@ mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev)
  * @param[in] pprecptr Pointer to pointer to a ::MS3RecordPtr for @ref record-list
  * @param[in] splitversion Flag to control splitting of version/quality
  * @param[in] autoheal Flag to control automatic merging of segments
- * @param[in] flags Flags to control optional functionality (unused)
+ * @param[in] flags Flags to control optional functionality, see ::MSF_COMPACTRECLIST and ::MSF_KEEPRECORDS
  * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
  *
  * @returns a pointer to the ::MS3TraceSeg updated or NULL on error.
@@ -362,7 +488,6 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
                         int8_t splitversion, int8_t autoheal, uint32_t flags,
                         const MS3Tolerance *tolerance)
 {
-  (void)flags; /* Unused */
   MS3TraceID *id = 0;
   MS3TraceID *previd[MSTRACEID_SKIPLIST_HEIGHT] = {NULL};
 
@@ -400,6 +525,13 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
     return NULL;
   }
 
+  /* Release cold segments if over memory budget */
+  if (mstl->budget && mstl3_budget_enforce (mstl, NULL))
+  {
+    ms_log (2, "Cannot enforce trace list memory budget\n");
+    return NULL;
+  }
+
   /* Search for matching trace ID */
   id = mstl3_findID (mstl,
                      msr->sid,
@@ -409,12 +541,11 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
   /* If no matching ID was found create new MS3TraceID and MS3TraceSeg entries */
   if (!id)
   {
-    if (!(id = (MS3TraceID *)libmseed_memory.malloc (sizeof (MS3TraceID))))
+    if (!(id = alloc_id (mstl)))
     {
       ms_log (2, "Error allocating memory\n");
       return NULL;
     }
-    memset (id, 0, sizeof (MS3TraceID));
 
     /* Populate MS3TraceID */
     memcpy (id->sid, msr->sid, sizeof(id->sid));
@@ -423,14 +554,14 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
     id->latest = endtime;
     id->numsegments = 1;
 
-    if (!(seg = mstl3_msr2seg (msr, endtime)))
+    if (!(seg = mstl3_msr2seg (mstl, id, msr, endtime)))
     {
       return NULL;
     }
     id->first = id->last = seg;
 
-    /* Add MS3RecordPtr if requested */
-    if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 1)))
+    /* Add record list entry if requested */
+    if (add_record (mstl, seg, msr, pprecptr, endtime, 1, flags))
     {
       return NULL;
     }
@@ -500,7 +631,7 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
     /* Record coverage fits at end of last segment */
     if (lastgap <= nstimetol && lastgap >= nnstimetol && lastratecheck)
     {
-      if (!mstl3_addmsrtoseg (id->last, msr, endtime, 1))
+      if (mstl3_budget_fault (id->last, 1) || !mstl3_addmsrtoseg (id->last, msr, endtime, 1))
         return NULL;
 
       seg = id->last;
@@ -508,14 +639,14 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       if (endtime > id->latest)
         id->latest = endtime;
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 1)))
+      /* Add record list entry if requested */
+      if (add_record (mstl, seg, msr, pprecptr, endtime, 1, flags))
         return NULL;
     }
     /* Record coverage is after all other coverage */
     else if ((msr->starttime - nsdelta - nstimetol) > id->latest)
     {
-      if (!(seg = mstl3_msr2seg (msr, endtime)))
+      if (!(seg = mstl3_msr2seg (mstl, id, msr, endtime)))
         return NULL;
 
       /* Add to end of list */
@@ -527,14 +658,14 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       if (endtime > id->latest)
         id->latest = endtime;
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 0)))
+      /* Add record list entry if requested */
+      if (add_record (mstl, seg, msr, pprecptr, endtime, 0, flags))
         return NULL;
     }
     /* Record coverage is before all other coverage */
     else if ((endtime + nsdelta + nstimetol) < id->earliest)
     {
-      if (!(seg = mstl3_msr2seg (msr, endtime)))
+      if (!(seg = mstl3_msr2seg (mstl, id, msr, endtime)))
         return NULL;
 
       /* Add to beginning of list */
@@ -546,14 +677,14 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       if (msr->starttime < id->earliest)
         id->earliest = msr->starttime;
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 0)))
+      /* Add record list entry if requested */
+      if (add_record (mstl, seg, msr, pprecptr, endtime, 0, flags))
         return NULL;
     }
     /* Record coverage fits at beginning of first segment */
     else if (firstgap <= nstimetol && firstgap >= nnstimetol && firstratecheck)
     {
-      if (!mstl3_addmsrtoseg (id->first, msr, endtime, 2))
+      if (mstl3_budget_fault (id->first, 1) || !mstl3_addmsrtoseg (id->first, msr, endtime, 2))
         return NULL;
 
       seg = id->first;
@@ -561,8 +692,8 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       if (msr->starttime < id->earliest)
         id->earliest = msr->starttime;
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 2)))
+      /* Add record list entry if requested */
+      if (add_record (mstl, seg, msr, pprecptr, endtime, 2, flags))
         return NULL;
     }
     /* Search complete segment list for matches */
@@ -644,13 +775,13 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       /* Add MS3Record coverage to end of segment before */
       if (segbefore)
       {
-        if (!mstl3_addmsrtoseg (segbefore, msr, endtime, 1))
+        if (mstl3_budget_fault (segbefore, 1) || !mstl3_addmsrtoseg (segbefore, msr, endtime, 1))
         {
           return NULL;
         }
 
-        /* Add MS3RecordPtr if requested */
-        if (pprecptr && !(*pprecptr = mstl3_add_recordptr (segbefore, msr, endtime, 1)))
+        /* Add record list entry if requested */
+        if (add_record (mstl, segbefore, msr, pprecptr, endtime, 1, flags))
         {
           return NULL;
         }
@@ -659,7 +790,7 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
         if (autoheal && segafter && segbefore != segafter)
         {
           /* Add segafter coverage to segbefore */
-          if (!mstl3_addsegtoseg (segbefore, segafter))
+          if (mstl3_budget_fault (segafter, 1) || !mstl3_addsegtoseg (segbefore, segafter))
           {
             return NULL;
           }
@@ -674,17 +805,26 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
           if (segafter->next)
             segafter->next->prev = segafter->prev;
 
-          /* Free data samples, record list, private data and segment structure */
+          /* Free data samples, budget state, statistics, record list, private data and segment structure */
           if (segafter->datasamples)
             libmseed_memory.free (segafter->datasamples);
 
+          if (segafter->spill)
+            mstl3_budget_release (segafter);
+
+          if (segafter->stats)
+            libmseed_memory.free (segafter->stats);
+
           if (segafter->recordlist)
+          {
+            mstl3_reclist_release (segafter->recordlist);
             libmseed_memory.free (segafter->recordlist);
+          }
 
           if (segafter->prvtptr)
             libmseed_memory.free (segafter->prvtptr);
 
-          libmseed_memory.free (segafter);
+          free_seg (mstl, id, segafter);
 
           id->numsegments -= 1;
         }
@@ -694,13 +834,13 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       /* Add MS3Record coverage to beginning of segment after */
       else if (segafter)
       {
-        if (!mstl3_addmsrtoseg (segafter, msr, endtime, 2))
+        if (mstl3_budget_fault (segafter, 1) || !mstl3_addmsrtoseg (segafter, msr, endtime, 2))
         {
           return NULL;
         }
 
-        /* Add MS3RecordPtr if requested */
-        if (pprecptr && !(*pprecptr = mstl3_add_recordptr (segafter, msr, endtime, 2)))
+        /* Add record list entry if requested */
+        if (add_record (mstl, segafter, msr, pprecptr, endtime, 2, flags))
         {
           return NULL;
         }
@@ -711,13 +851,13 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       else
       {
         /* Create new segment */
-        if (!(seg = mstl3_msr2seg (msr, endtime)))
+        if (!(seg = mstl3_msr2seg (mstl, id, msr, endtime)))
         {
           return NULL;
         }
 
-        /* Add MS3RecordPtr if requested */
-        if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 0)))
+        /* Add record list entry if requested */
+        if (add_record (mstl, seg, msr, pprecptr, endtime, 0, flags))
         {
           return NULL;
         }
@@ -811,6 +951,11 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
       id->last = segbefore;
   }
 
+  /* Track modified segment in memory budget, the record is already added and tracking
+   * is retried on the next access */
+  if (mstl->budget && mstl3_budget_track (mstl, id, seg))
+    ms_log (1, "%s: Segment is not tracked in memory budget\n", id->sid);
+
   return seg;
 } /* End of mstl3_addmsr_recordptr() */
 
@@ -836,6 +981,8 @@ mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr *
  * @param[in] flags Flags to control parsing and optional functionality:
  * @parblock
  *  - \c ::MSF_RECORDLIST : Build a ::MS3RecordList for each ::MS3TraceSeg
+ *  - \c ::MSF_COMPACTRECLIST : Build compact record lists
+ *  - \c ::MSF_KEEPRECORDS : Keep a copy of each record in compact record lists
  *  - Flags supported by msr3_parse()
  *  - Flags supported by mstl3_addmsr()
  * @endparblock
@@ -884,6 +1031,8 @@ mstl3_readbuffer (MS3TraceList **ppmstl, const char *buffer, uint64_t bufferleng
  * @param[in] flags Flags to control parsing and optional functionality:
  * @parblock
  *  - \c ::MSF_RECORDLIST : Build a ::MS3RecordList for each ::MS3TraceSeg
+ *  - \c ::MSF_COMPACTRECLIST : Build compact record lists
+ *  - \c ::MSF_KEEPRECORDS : Keep a copy of each record in compact record lists
  *  - Flags supported by msr3_parse()
  *  - Flags supported by mstl3_addmsr()
  * @endparblock
@@ -977,8 +1126,20 @@ mstl3_readbuffer_selection (MS3TraceList **ppmstl, const char *buffer, uint64_t
       }
     }
 
+    /* Set record location for compact record list, unless a copy is kept */
+    if ((flags & MSF_COMPACTRECLIST) && !(flags & MSF_KEEPRECORDS))
+    {
+      if (msr3_data_bounds (msr, &dataoffset, &datasize) ||
+          mstl3_reclist_source (*ppmstl, NULL, buffer, offset, dataoffset))
+      {
+        msr3_free (&msr);
+        return MS_GENERROR;
+      }
+    }
+
     /* Add record to trace list */
-    seg = mstl3_addmsr_recordptr (*ppmstl, msr, (flags & MSF_RECORDLIST) ? &recordptr : NULL,
+    seg = mstl3_addmsr_recordptr (*ppmstl, msr,
+                                  (flags & MSF_RECORDLIST && !(flags & (MSF_COMPACTRECLIST | MSF_KEEPRECORDS))) ? &recordptr : NULL,
                                   splitversion, 1, flags, tolerance);
 
     if (seg == NULL)
@@ -1022,7 +1183,7 @@ mstl3_readbuffer_selection (MS3TraceList **ppmstl, const char *buffer, uint64_t
  * \ref MessageOnError - this function logs a message on error
  ***************************************************************************/
 MS3TraceSeg *
-mstl3_msr2seg (const MS3Record *msr, nstime_t endtime)
+mstl3_msr2seg (MS3TraceList *mstl, MS3TraceID *id, const MS3Record *msr, nstime_t endtime)
 {
   MS3TraceSeg *seg = 0;
   size_t datasize = 0;
@@ -1034,12 +1195,11 @@ mstl3_msr2seg (const MS3Record *msr, nstime_t endtime)
     return NULL;
   }
 
-  if (!(seg = (MS3TraceSeg *)libmseed_memory.malloc (sizeof (MS3TraceSeg))))
+  if (!(seg = alloc_seg (mstl, id)))
   {
     ms_log (2, "Error allocating memory\n");
     return NULL;
   }
-  memset (seg, 0, sizeof (MS3TraceSeg));
 
   /* Populate MS3TraceSeg */
   seg->starttime = msr->starttime;
@@ -1049,6 +1209,10 @@ mstl3_msr2seg (const MS3Record *msr, nstime_t endtime)
   seg->sampletype = msr->sampletype;
   seg->numsamples = msr->numsamples;
 
+  /* Allocate sample statistics if selected for the list */
+  if (mstl3_stats_init (mstl, seg))
+    return NULL;
+
   /* Allocate space for and copy datasamples */
   if (msr->datasamples && msr->numsamples)
   {
@@ -1060,7 +1224,7 @@ mstl3_msr2seg (const MS3Record *msr, nstime_t endtime)
 
     datasize = samplesize * msr->numsamples;
 
-    if (!(seg->datasamples = libmseed_memory.malloc ((size_t) (datasize))))
+    if (!(seg->datasamples = lm_malloc ((size_t) (datasize))))
     {
       ms_log (2, "Error allocating memory\n");
       return NULL;
@@ -1069,11 +1233,68 @@ mstl3_msr2seg (const MS3Record *msr, nstime_t endtime)
 
     /* Copy data samples from MS3Record to MS3TraceSeg */
     memcpy (seg->datasamples, msr->datasamples, datasize);
+
+    mstl3_stats_add (seg, msr->datasamples, msr->numsamples, msr->sampletype, 1);
   }
 
   return seg;
 } /* End of mstl3_msr2seg() */
 
+/***************************************************************************
+ * Allocate a zeroed MS3TraceID for a trace list, allocated as IDs
+ * created for records such that the list can be freed with
+ * mstl3_free().  The ID must be added with mstl3_addID().
+ *
+ * Return a pointer to a MS3TraceID otherwise NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+MS3TraceID *
+mstl3_newID (MS3TraceList *mstl)
+{
+  MS3TraceID *id;
+
+  if (!(id = alloc_id (mstl)))
+  {
+    ms_log (2, "Error allocating memory\n");
+    return NULL;
+  }
+
+  return id;
+} /* End of mstl3_newID() */
+
+/***************************************************************************
+ * Allocate a zeroed MS3TraceSeg and append it to the segments of a
+ * trace ID.  The time coverage of the ID is not updated.
+ *
+ * Return a pointer to a MS3TraceSeg otherwise NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+MS3TraceSeg *
+mstl3_newseg (MS3TraceList *mstl, MS3TraceID *id)
+{
+  MS3TraceSeg *seg;
+
+  if (!(seg = alloc_seg (mstl, id)))
+  {
+    ms_log (2, "Error allocating memory\n");
+    return NULL;
+  }
+
+  seg->prev = id->last;
+
+  if (id->last)
+    id->last->next = seg;
+  else
+    id->first = seg;
+
+  id->last = seg;
+  id->numsegments++;
+
+  return seg;
+} /* End of mstl3_newseg() */
+
 /***************************************************************************
  * Add data coverage from a MS3Record structure to a MS3TraceSeg structure.
  *
@@ -1120,12 +1341,12 @@ mstl3_addmsrtoseg (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int
     if (libmseed_prealloc_block_size)
     {
       size_t current_size = seg->datasize;
-      newdatasamples = libmseed_memory_prealloc (seg->datasamples, newdatasize, &current_size);
+      newdatasamples = lm_prealloc (seg->datasamples, newdatasize, &current_size);
       seg->datasize = current_size;
     }
     else
     {
-      newdatasamples = libmseed_memory.realloc (seg->datasamples, newdatasize);
+      newdatasamples = lm_realloc (seg->datasamples, newdatasize);
       seg->datasize = newdatasize;
     }
 
@@ -1151,6 +1372,8 @@ mstl3_addmsrtoseg (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int
               msr->datasamples,
               (size_t) (msr->numsamples * samplesize));
 
+      mstl3_stats_add (seg, msr->datasamples, msr->numsamples, msr->sampletype, 1);
+
       seg->numsamples += msr->numsamples;
     }
   }
@@ -1170,6 +1393,8 @@ mstl3_addmsrtoseg (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int
               msr->datasamples,
               (size_t) (msr->numsamples * samplesize));
 
+      mstl3_stats_add (seg, msr->datasamples, msr->numsamples, msr->sampletype, 2);
+
       seg->numsamples += msr->numsamples;
     }
   }
@@ -1223,12 +1448,12 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
     if (libmseed_prealloc_block_size)
     {
       size_t current_size = seg1->datasize;
-      newdatasamples = libmseed_memory_prealloc (seg1->datasamples, newdatasize, &current_size);
+      newdatasamples = lm_prealloc (seg1->datasamples, newdatasize, &current_size);
       seg1->datasize = current_size;
     }
     else
     {
-      newdatasamples = libmseed_memory.realloc (seg1->datasamples, newdatasize);
+      newdatasamples = lm_realloc (seg1->datasamples, newdatasize);
       seg1->datasize = newdatasize;
     }
 
@@ -1255,6 +1480,9 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
     seg1->numsamples += seg2->numsamples;
   }
 
+  /* Combine sample statistics */
+  mstl3_stats_merge (seg1, seg2);
+
   /* Add seg2 record list to end of seg1 record list */
   if (seg2->recordlist)
   {
@@ -1263,6 +1491,11 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
       seg1->recordlist = seg2->recordlist;
       seg2->recordlist = NULL;
     }
+    else if (seg1->recordlist->compact || seg2->recordlist->compact)
+    {
+      if (mstl3_reclist_merge (seg1->recordlist, seg2->recordlist))
+        return NULL;
+    }
     else
     {
       seg1->recordlist->last->next = seg2->recordlist->first;
@@ -1274,6 +1507,30 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
   return seg1;
 } /* End of mstl3_addsegtoseg() */
 
+/***************************************************************************
+ * Add an entry for a record to the record list of a segment, either a
+ * ::MS3RecordPtr returned at 'pprecptr' or, if 'pprecptr' is NULL and
+ * MSF_KEEPRECORDS or MSF_COMPACTRECLIST is set in 'flags', a compact
+ * entry with or without a kept copy of the record.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+add_record (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+            MS3RecordPtr **pprecptr, nstime_t endtime, int8_t whence, uint32_t flags)
+{
+  if (pprecptr)
+    return (*pprecptr = mstl3_add_recordptr (seg, msr, endtime, whence)) ? 0 : -1;
+
+  if (flags & MSF_KEEPRECORDS)
+    return mstl3_reclist_keep (mstl, seg, msr, endtime, whence);
+
+  if (flags & MSF_COMPACTRECLIST)
+    return mstl3_reclist_add (mstl, seg, msr, endtime, whence);
+
+  return 0;
+} /* End of add_record() */
+
 /**********************************************************************/ /**
  * @brief Add a ::MS3RecordPtr to the ::MS3RecordList of a ::MS3TraceSeg
  *
@@ -1316,7 +1573,7 @@ mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, i
     return NULL;
   }
 
-  recordptr = (MS3RecordPtr *)libmseed_memory.malloc (sizeof (MS3RecordPtr));
+  recordptr = (MS3RecordPtr *)lm_malloc (sizeof (MS3RecordPtr));
 
   if (recordptr == NULL)
   {
@@ -1338,7 +1595,7 @@ mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, i
   /* If no record list for the segment is present, allocate and add record pointer */
   if (seg->recordlist == NULL)
   {
-    seg->recordlist = (MS3RecordList *)libmseed_memory.malloc (sizeof (MS3RecordList));
+    seg->recordlist = (MS3RecordList *)lm_malloc (sizeof (MS3RecordList));
 
     if (seg->recordlist == NULL)
     {
@@ -1350,6 +1607,7 @@ mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, i
     seg->recordlist->recordcnt = 1;
     seg->recordlist->first     = recordptr;
     seg->recordlist->last      = recordptr;
+    seg->recordlist->compact   = NULL;
   }
   /* Otherwise, add record pointer to existing list */
   else
@@ -1430,6 +1688,10 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
     return -1;
   }
 
+  /* Restore samples released by memory budget */
+  if (mstl3_budget_fault (seg, 1))
+    return -1;
+
   idata = (int32_t *)seg->datasamples;
   fdata = (float *)seg->datasamples;
   ddata = (double *)seg->datasamples;
@@ -1470,7 +1732,7 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
       /* Reallocate buffer for reduced size needed, only if not pre-allocating */
       if (libmseed_prealloc_block_size == 0)
       {
-        if (!(seg->datasamples = libmseed_memory.realloc (seg->datasamples,
+        if (!(seg->datasamples = lm_realloc (seg->datasamples,
                                                           (size_t) (seg->numsamples * sizeof (int32_t)))))
         {
           ms_log (2, "Cannot re-allocate buffer for sample conversion\n");
@@ -1499,7 +1761,7 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
       /* Reallocate buffer for reduced size needed, only if not pre-allocating */
       if (libmseed_prealloc_block_size == 0)
       {
-        if (!(seg->datasamples = libmseed_memory.realloc (seg->datasamples,
+        if (!(seg->datasamples = lm_realloc (seg->datasamples,
                                                           (size_t) (seg->numsamples * sizeof (float)))))
         {
           ms_log (2, "Cannot re-allocate buffer after sample conversion\n");
@@ -1515,7 +1777,7 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
   /* Convert to 64-bit doubles */
   else if (type == 'd')
   {
-    if (!(ddata = (double *)libmseed_memory.malloc ((size_t) (seg->numsamples * sizeof (double)))))
+    if (!(ddata = (double *)lm_malloc ((size_t) (seg->numsamples * sizeof (double)))))
     {
       ms_log (2, "Cannot allocate buffer for sample conversion to doubles\n");
       return -1;
@@ -1541,6 +1803,8 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
     seg->sampletype = 'd';
   } /* Done converting to 64-bit doubles */
 
+  mstl3_budget_account (seg);
+
   return 0;
 } /* End of mstl3_convertsamples() */
 
@@ -1585,7 +1849,7 @@ mstl3_resize_buffers (MS3TraceList *mstl)
 
         if (seg->datasize > datasize)
         {
-          seg->datasamples = libmseed_memory.realloc (seg->datasamples, datasize);
+          seg->datasamples = lm_realloc (seg->datasamples, datasize);
 
           if (seg->datasamples == NULL)
           {
@@ -1594,6 +1858,7 @@ mstl3_resize_buffers (MS3TraceList *mstl)
           }
 
           seg->datasize = datasize;
+          mstl3_budget_account (seg);
         }
       }
 
@@ -1628,6 +1893,9 @@ mstl3_resize_buffers (MS3TraceList *mstl)
  *   -# Open file and offset (::MS3RecordPtr.fileptr and ::MS3RecordPtr.fileoffset)
  *   -# File name and offset (::MS3RecordPtr.filename and ::MS3RecordPtr.fileoffset)
  *
+ * Record lists of either the linked or compact (::MSF_COMPACTRECLIST)
+ * form are supported.
+ *
  * It would be unusual to build a record list outside of the library,
  * but should that ever occur note that the record list is assumed to
  * be in correct time order and represent a contiguous time series.
@@ -1650,8 +1918,145 @@ mstl3_resize_buffers (MS3TraceList *mstl)
 int64_t
 mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
                          uint64_t outputsize, int8_t verbose)
+{
+  if (!id || !seg)
+  {
+    ms_log (2, "%s(): Required input not defined: 'id' or 'seg'\n", __func__);
+    return -1;
+  }
+
+  return unpack_records (id, seg, 0, UINT64_MAX, (uint64_t)seg->samplecnt,
+                         output, outputsize, verbose);
+} /* End of mstl3_unpack_recordlist() */
+
+/**********************************************************************/ /**
+ * @brief Unpack the data samples of a ::MS3TraceSeg in a time window
+ * from its @ref record-list
+ *
+ * Only the records of the segment that contain samples between \a
+ * starttime and \a endtime, inclusive, are decoded, into the \a
+ * output buffer.  All samples of those records are returned, the
+ * first may be before \a starttime and the last after \a endtime.
+ * The time of the first returned sample is stored at \a firsttime and
+ * following samples are at the sample period of the segment.
+ *
+ * This is most useful with record lists built with the
+ * ::MSF_KEEPRECORDS flag, where a trace list holds copies of the
+ * encoded records instead of decoded samples and recent or selected
+ * data are decoded on access, e.g. for real-time buffers.  Record
+ * lists of any form are supported, see mstl3_unpack_recordlist().
+ *
+ * If \a output is NULL, nothing is decoded and the number of samples
+ * that would be returned is determined, for sizing the buffer.  The
+ * segment's ::MS3TraceSeg.datasamples are not used or changed.
+ *
+ * @param[in] id ::MS3TraceID for relevant ::MS3TraceSeg
+ * @param[in] seg ::MS3TraceSeg with associated @ref record-list to unpack
+ * @param[in] starttime Start of time window, ::NSTUNSET for the segment start
+ * @param[in] endtime End of time window, ::NSTUNSET for the segment end
+ * @param[out] output Output buffer for data samples, can be NULL
+ * @param[in] outputsize Size of \a output buffer
+ * @param[out] firsttime Time of first returned sample, can be NULL
+ * @param[in] verbose Controls logging verbosity, 0 is no diagnostic output
+ *
+ * @returns the number of samples unpacked, or that would be unpacked
+ * when \a output is NULL, 0 when no records are in the window, or -1
+ * on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_unpack_recordlist()
+ ***************************************************************************/
+int64_t
+mstl3_unpack_timewindow (MS3TraceID *id, MS3TraceSeg *seg, nstime_t starttime, nstime_t endtime,
+                         void *output, uint64_t outputsize, nstime_t *firsttime, int8_t verbose)
+{
+  MS3RecordPtr *recordptr = NULL;
+  MS3RecordPtr view;
+  MS3Record viewmsr;
+  uint64_t index = 0;
+  uint64_t entry = 0;
+  uint64_t first = 0;
+  uint64_t count = 0;
+  uint64_t samplecount = 0;
+  nstime_t recstart;
+  nstime_t span;
+  nstime_t start = NSTUNSET;
+
+  if (!id || !seg)
+  {
+    ms_log (2, "%s(): Required input not defined: 'id' or 'seg'\n", __func__);
+    return -1;
+  }
+
+  if (!seg->recordlist)
+  {
+    ms_log (2, "Required record list is not present (seg->recordlist)\n");
+    return -1;
+  }
+
+  /* Determine the range of records in the window */
+  for (recordptr = mstl3_reclist_next (seg->recordlist, NULL, &index, &view, &viewmsr); recordptr;
+       recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr), entry++)
+  {
+    if (recordptr->msr->samplecnt <= 0)
+      continue;
+
+    /* Start of record from end time, ms_sampletime() only supports positive offsets */
+    span = 0;
+    if (seg->samprate > 0.0)
+      span = (nstime_t)((double)(recordptr->msr->samplecnt - 1) / seg->samprate * NSTMODULUS + 0.5);
+    else if (seg->samprate < 0.0)
+      span = (nstime_t)((double)(recordptr->msr->samplecnt - 1) * -seg->samprate * NSTMODULUS + 0.5);
+
+    recstart = recordptr->endtime - span;
+
+    if ((endtime != NSTUNSET && recstart > endtime) ||
+        (starttime != NSTUNSET && recordptr->endtime < starttime))
+    {
+      if (count > 0)
+        break;
+
+      continue;
+    }
+
+    if (count == 0)
+    {
+      first = entry;
+      start = recstart;
+    }
+
+    count = entry - first + 1;
+    samplecount += (uint64_t)recordptr->msr->samplecnt;
+  }
+
+  if (firsttime)
+    *firsttime = start;
+
+  if (count == 0 || !output)
+    return (int64_t)samplecount;
+
+  return unpack_records (id, seg, first, count, samplecount, output, outputsize, verbose);
+} /* End of mstl3_unpack_timewindow() */
+
+/***************************************************************************
+ * Unpack the data samples of 'count' record list entries starting at
+ * entry 'first' of a segment, expected to contain 'samplecount'
+ * samples, into the output buffer or, if 'output' is NULL, into a new
+ * buffer associated with the segment.
+ *
+ * Returns the number of samples unpacked or -1 on error.
+ ***************************************************************************/
+static int64_t
+unpack_records (MS3TraceID *id, MS3TraceSeg *seg, uint64_t first, uint64_t count,
+                uint64_t samplecount, void *output, uint64_t outputsize, int8_t verbose)
 {
   MS3RecordPtr *recordptr = NULL;
+  MS3RecordPtr view;
+  MS3Record viewmsr;
+  uint64_t index = 0;
+  uint64_t entry = 0;
+  uint32_t dataoffset;
   int64_t unpackedsamples = 0;
   int64_t totalunpackedsamples = 0;
 
@@ -1665,30 +2070,39 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   char recsampletype = 0;
 
   FILE *fileptr = NULL;
+  FILE *idfileptr = NULL;
   const char *input = NULL;
+  uint64_t fileid[4];
+  int8_t cached = 0;
+  char cachedtype;
 
   /* Linked list of open file pointers */
   struct filelist_s {
     const char *filename;
     FILE *fileptr;
+    uint64_t fileid[4];
+    int8_t cached;
     struct filelist_s *next;
   };
   struct filelist_s *filelist = NULL;
   struct filelist_s *filelistptr = NULL;
 
-  if (!id || !seg)
+  if (!seg->recordlist)
   {
-    ms_log (2, "%s(): Required input not defined: 'id' or 'seg'\n", __func__);
+    ms_log (2, "Required record list is not present (seg->recordlist)\n");
     return -1;
   }
 
-  if (!seg->recordlist)
+  /* First entry of linked or compact record list */
+  if ((recordptr = mstl3_reclist_next (seg->recordlist, NULL, &index, &view, &viewmsr)) == NULL)
   {
-    ms_log (2, "Required record list is not present (seg->recordlist)\n");
+    ms_log (2, "%s: Record list is empty\n", id->sid);
     return -1;
   }
 
-  recordptr = seg->recordlist->first;
+  /* Restore samples released by memory budget, not replaceable below */
+  if (!output && mstl3_budget_fault (seg, 0))
+    return -1;
 
   if (ms_encoding_sizetype((uint8_t)recordptr->msr->encoding, &samplesize, &sampletype))
   {
@@ -1698,7 +2112,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   }
 
   /* Calculate buffer size needed for unpacked samples */
-  decodedsize = seg->samplecnt * samplesize;
+  decodedsize = samplecount * samplesize;
 
   /* If output buffer is supplied, check needed size */
   if (output)
@@ -1719,7 +2133,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   /* Otherwise allocate new buffer */
   else
   {
-    if ((output = libmseed_memory.malloc ((size_t)decodedsize)) == NULL)
+    if ((output = lm_malloc ((size_t)decodedsize)) == NULL)
     {
       ms_log (2, "%s: Cannot allocate memory for segment data samples\n", id->sid);
       return -1;
@@ -1731,12 +2145,12 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   }
 
   /* Iterate through record list and unpack data samples */
-  while (recordptr)
+  while (recordptr && (entry < first || entry - first < count))
   {
-    /* Skip records with no samples */
-    if (recordptr->msr->samplecnt == 0)
+    /* Skip records before the range and records with no samples */
+    if (entry++ < first || recordptr->msr->samplecnt == 0)
     {
-      recordptr = recordptr->next;
+      recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr);
       continue;
     }
 
@@ -1759,7 +2173,9 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
     /* Decode data from buffer */
     if (recordptr->bufferptr)
     {
-      input = recordptr->bufferptr + recordptr->dataoffset;
+      input = recordptr->bufferptr;
+      cached = 0;
+      idfileptr = NULL;
     }
     /* Decode data from a file at a byte offset */
     else if (recordptr->fileptr || recordptr->filename)
@@ -1767,6 +2183,13 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
       if (recordptr->fileptr)
       {
         fileptr = recordptr->fileptr;
+
+        /* Identify file for decoded block cache when it changes */
+        if (fileptr != idfileptr)
+        {
+          cached = (ms_blockcache_fileid (fileptr, fileid) == 0);
+          idfileptr = fileptr;
+        }
       }
       else
       {
@@ -1783,7 +2206,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
         /* Add new entry to list and open file if needed */
         if (filelistptr == NULL)
         {
-          if ((filelistptr = libmseed_memory.malloc (sizeof (struct filelist_s))) == NULL)
+          if ((filelistptr = lm_malloc (sizeof (struct filelist_s))) == NULL)
           {
             ms_log (2, "%s: Cannot allocate memory for file list entry for %s\n", id->sid, recordptr->filename);
 
@@ -1800,18 +2223,36 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
           }
 
           filelistptr->filename = recordptr->filename;
+          filelistptr->cached = (ms_blockcache_fileid (filelistptr->fileptr, filelistptr->fileid) == 0);
           filelistptr->next = filelist;
 
           filelist = filelistptr;
         }
 
         fileptr = filelistptr->fileptr;
+        cached = filelistptr->cached;
+        memcpy (fileid, filelistptr->fileid, sizeof (fileid));
+        idfileptr = NULL;
+      }
+
+      /* Copy samples from decoded block cache if present */
+      if (cached &&
+          (unpackedsamples = ms_blockcache_get (fileid, recordptr->fileoffset, recordptr->msr->samplecnt,
+                                                (unsigned char *)output + outputoffset,
+                                                decodedsize - outputoffset, &cachedtype)) >= 0 &&
+          cachedtype == sampletype)
+      {
+        outputoffset += unpackedsamples * samplesize;
+        totalunpackedsamples += unpackedsamples;
+
+        recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr);
+        continue;
       }
 
       /* Allocate memory if needed, over-allocating (x2) to minimize reallocation */
       if (recordptr->msr->reclen > filebuffersize)
       {
-        if ((filebuffer = libmseed_memory.realloc (filebuffer, recordptr->msr->reclen * 2)) == NULL)
+        if ((filebuffer = lm_realloc (filebuffer, recordptr->msr->reclen * 2)) == NULL)
         {
           ms_log (2, "%s: Cannot allocate memory for file read buffer\n", id->sid);
 
@@ -1847,7 +2288,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
 
       }
 
-      input = filebuffer + recordptr->dataoffset;
+      input = filebuffer;
     } /* Done reading from file */
     else
     {
@@ -1857,8 +2298,20 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
       break;
     }
 
+    /* Determine data offset from header if not stored in compact entry */
+    if ((dataoffset = recordptr->dataoffset) == 0 &&
+        (dataoffset = mstl3_reclist_dataoffset (input)) == 0)
+    {
+      ms_log (2, "%s: Cannot determine offset to data in record\n", id->sid);
+
+      totalunpackedsamples = -1;
+      break;
+    }
+
+    input += dataoffset;
+
     /* Decode data from buffer */
-    unpackedsamples = ms_decode_data (input, recordptr->msr->reclen - recordptr->dataoffset,
+    unpackedsamples = ms_decode_data (input, recordptr->msr->reclen - dataoffset,
                                       (uint8_t)recordptr->msr->encoding, recordptr->msr->samplecnt,
                                       (unsigned char *)output + outputoffset, decodedsize - outputoffset,
                                       &sampletype, recordptr->msr->swapflag, id->sid, verbose);
@@ -1869,10 +2322,15 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
       break;
     }
 
+    /* Add samples decoded from a file to decoded block cache */
+    if (cached)
+      ms_blockcache_put (fileid, recordptr->fileoffset, unpackedsamples,
+                         (unsigned char *)output + outputoffset, sampletype);
+
     outputoffset += unpackedsamples * samplesize;
     totalunpackedsamples += unpackedsamples;
 
-    recordptr = recordptr->next;
+    recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr);
   } /* Done with record list entries */
 
   /* Free file read buffer if used */
@@ -1901,6 +2359,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
     else
     {
       seg->numsamples = totalunpackedsamples;
+      mstl3_budget_account (seg);
     }
   }
 
@@ -1908,7 +2367,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
     seg->sampletype = sampletype;
 
   return totalunpackedsamples;
-} /* End of mstl3_unpack_recordlist() */
+} /* End of unpack_records() */
 
 /**********************************************************************/ /**
  * @brief Pack ::MS3TraceList data into miniSEED records
@@ -2021,6 +2480,8 @@ mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
     if (extralength > UINT16_MAX)
     {
       ms_log (2, "Extra headers are too long: %"PRIsize_t"\n", extralength);
+      msr->extra = NULL;
+      msr3_free (&msr);
       return -1;
     }
 
@@ -2038,6 +2499,15 @@ mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
     seg = id->first;
     while (seg)
     {
+      /* Restore samples released by memory budget */
+      if (mstl3_budget_fault (seg, (flags & MSF_MAINTAINMSTL) ? 0 : 1))
+      {
+        msr->datasamples = NULL;
+        msr->extra       = NULL;
+        msr3_free (&msr);
+        return -1;
+      }
+
       msr->starttime = seg->starttime;
       msr->samprate = seg->samprate;
       msr->samplecnt = seg->samplecnt;
@@ -2095,7 +2565,7 @@ mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
           /* Reallocate buffer for reduced size needed, only if not pre-allocating */
           if (libmseed_prealloc_block_size == 0)
           {
-            seg->datasamples = libmseed_memory.realloc (seg->datasamples, bufsize);
+            seg->datasamples = lm_realloc (seg->datasamples, bufsize);
 
             if (seg->datasamples == NULL)
             {
@@ -2121,14 +2591,25 @@ mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
       totalpackedrecords += segpackedrecords;
       totalpackedsamples += segpackedsamples;
 
+      /* Track packed segment and release cold segments if over memory budget */
+      if (mstl->budget &&
+          (mstl3_budget_track (mstl, id, seg) || mstl3_budget_enforce (mstl, NULL)))
+      {
+        msr->datasamples = NULL;
+        msr->extra       = NULL;
+        msr3_free (&msr);
+        return -1;
+      }
+
       seg = seg->next;
     }
 
     id = id->next[0];
   }
 
-  /* The record structure never owns the actual data so it should not free it */
+  /* The record structure never owns the actual data or extra headers so it should not free them */
   msr->datasamples = NULL;
+  msr->extra       = NULL;
   msr3_free (&msr);
 
   if (packedsamples)
@@ -2458,6 +2939,148 @@ mstl3_printgaplist (const MS3TraceList *mstl, ms_timeformat_t timeformat,
   return;
 } /* End of mstl3_printgaplist() */
 
+/* Array of trace segments for a trace ID with compact nodes, the
+ * segments follow the header.  Chunks are linked from the newest at
+ * MS3TraceID.segpool, which holds the list of released segments. */
+typedef struct SegChunk
+{
+  struct SegChunk *next;  /* Previously allocated chunk */
+  MS3TraceSeg *freelist;  /* Released segments linked by 'next', newest chunk only */
+  uint32_t capacity;      /* Number of segments in chunk */
+  uint32_t used;          /* Number of segments used in chunk */
+} SegChunk;
+
+/* Maximum number of segments in a chunk, chunks double up to this */
+#define SEGCHUNK_MAXIMUM 64
+
+/***************************************************************************
+ * Allocate a zeroed MS3TraceID.  For compact nodes the skip list
+ * height is set and the ID is only allocated to that height.
+ *
+ * Returns a pointer to the MS3TraceID on success and NULL on error.
+ ***************************************************************************/
+static MS3TraceID *
+alloc_id (MS3TraceList *mstl)
+{
+  MS3TraceID *id;
+  size_t size = sizeof (MS3TraceID);
+  uint8_t height = 0;
+
+  if (mstl->compact)
+  {
+    height = lm_random_height (MSTRACEID_SKIPLIST_HEIGHT, &(mstl->prngstate));
+    size = offsetof (MS3TraceID, next) + height * sizeof (MS3TraceID *);
+  }
+
+  if (!(id = (MS3TraceID *)lm_malloc (size)))
+    return NULL;
+
+  memset (id, 0, size);
+  id->height = height;
+
+  return id;
+} /* End of alloc_id() */
+
+/***************************************************************************
+ * Allocate a zeroed MS3TraceSeg for a trace ID.  For compact nodes
+ * the segment is taken from the released segments or the chunks of
+ * the ID, adding a chunk if needed.
+ *
+ * Returns a pointer to the MS3TraceSeg on success and NULL on error.
+ ***************************************************************************/
+static MS3TraceSeg *
+alloc_seg (MS3TraceList *mstl, MS3TraceID *id)
+{
+  SegChunk *chunk;
+  SegChunk *newchunk;
+  MS3TraceSeg *seg;
+  uint32_t capacity;
+
+  if (!mstl->compact)
+  {
+    if (!(seg = (MS3TraceSeg *)lm_malloc (sizeof (MS3TraceSeg))))
+      return NULL;
+
+    memset (seg, 0, sizeof (MS3TraceSeg));
+
+    return seg;
+  }
+
+  chunk = (SegChunk *)id->segpool;
+
+  if (chunk && chunk->freelist)
+  {
+    seg = chunk->freelist;
+    chunk->freelist = seg->next;
+  }
+  else
+  {
+    if (!chunk || chunk->used >= chunk->capacity)
+    {
+      capacity = (chunk) ? chunk->capacity * 2 : 1;
+
+      if (capacity > SEGCHUNK_MAXIMUM)
+        capacity = SEGCHUNK_MAXIMUM;
+
+      if (!(newchunk = (SegChunk *)lm_malloc (sizeof (SegChunk) + capacity * sizeof (MS3TraceSeg))))
+        return NULL;
+
+      newchunk->next = chunk;
+      newchunk->freelist = NULL;
+      newchunk->capacity = capacity;
+      newchunk->used = 0;
+
+      id->segpool = chunk = newchunk;
+    }
+
+    seg = (MS3TraceSeg *)(chunk + 1) + chunk->used;
+    chunk->used++;
+  }
+
+  memset (seg, 0, sizeof (MS3TraceSeg));
+
+  return seg;
+} /* End of alloc_seg() */
+
+/***************************************************************************
+ * Free a MS3TraceSeg of a trace ID, for compact nodes the segment is
+ * added to the released segments for reuse.  Data associated with
+ * the segment must already be freed.
+ ***************************************************************************/
+static void
+free_seg (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg)
+{
+  SegChunk *chunk = (SegChunk *)id->segpool;
+
+  if (!mstl->compact || !chunk)
+  {
+    libmseed_memory.free (seg);
+    return;
+  }
+
+  seg->next = chunk->freelist;
+  chunk->freelist = seg;
+} /* End of free_seg() */
+
+/***************************************************************************
+ * Free all segment chunks of a trace ID with compact nodes.
+ ***************************************************************************/
+static void
+free_segpool (MS3TraceID *id)
+{
+  SegChunk *chunk = (SegChunk *)id->segpool;
+  SegChunk *nextchunk;
+
+  while (chunk)
+  {
+    nextchunk = chunk->next;
+    libmseed_memory.free (chunk);
+    chunk = nextchunk;
+  }
+
+  id->segpool = NULL;
+} /* End of free_segpool() */
+
 /* Pseudo random number generator, as a linear congruential generator (LCG):
  * https://en.wikipedia.org/wiki/Linear_congruential_generator
  *
@@ -0,0 +1,950 @@
+/***************************************************************************
+ * Routines to write and load binary snapshots of trace lists and their
+ * record lists, and to update loaded snapshots with data appended to
+ * the files they refer to.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+#if !defined(LMP_WIN)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/** @cond UNDOCUMENTED */
+
+MS3TraceID *mstl3_newID (MS3TraceList *mstl);
+MS3TraceID *mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev);
+MS3TraceSeg *mstl3_newseg (MS3TraceList *mstl, MS3TraceID *id);
+int64_t mstl3_reclist_addfile (MS3TraceList *mstl, const char *filename);
+int mstl3_reclist_append (MS3TraceList *mstl, MS3TraceSeg *seg, uint32_t sourceid, int64_t offset,
+                          uint32_t dataoffset, const MS3Record *msr, nstime_t endtime);
+MS3RecordPtr *mstl3_reclist_next (const MS3RecordList *recordlist, const MS3RecordPtr *recordptr,
+                                  uint64_t *index, MS3RecordPtr *view, MS3Record *viewmsr);
+
+/* Snapshot identifier and version */
+#define SNAPSHOT_MAGIC "MSTLSNAP"
+#define SNAPSHOT_VERSION 1
+
+/* Byte order marker, snapshots are in the byte order of the writer */
+#define SNAPSHOT_BYTEORDER 0x01020304
+
+/* Snapshot file layout, each section follows the previous:
+ *   SnapHeader
+ *   SnapFile[filecount]
+ *   SnapID[idcount]
+ *   SnapSeg[segcount], in order of IDs
+ *   SnapRecord[recordcount], in order of segments
+ *   File names, NUL-terminated, 'stringsize' bytes
+ *
+ * All structures are multiples of 8 bytes such that a mapped snapshot
+ * is aligned for direct access. */
+typedef struct SnapHeader
+{
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t version;
+  uint64_t filecount;
+  uint64_t idcount;
+  uint64_t segcount;
+  uint64_t recordcount;
+  uint64_t stringsize;
+} SnapHeader;
+
+typedef struct SnapFile
+{
+  uint64_t nameoffset;   /* Offset of name in string section */
+  int64_t size;          /* Size of file when snapshot was written */
+  int64_t mtime;         /* Modification time of file in seconds */
+  int64_t datalength;    /* End of last record of file in snapshot */
+} SnapFile;
+
+typedef struct SnapID
+{
+  char sid[LM_SIDLEN];
+  nstime_t earliest;
+  nstime_t latest;
+  uint32_t numsegments;
+  uint8_t pubversion;
+  uint8_t reserved[3];
+} SnapID;
+
+typedef struct SnapSeg
+{
+  nstime_t starttime;
+  nstime_t endtime;
+  double samprate;
+  int64_t samplecnt;
+  uint64_t recordcnt;
+  char sampletype;
+  uint8_t reserved[7];
+} SnapSeg;
+
+typedef struct SnapRecord
+{
+  int64_t offset;        /* Offset to record in file */
+  nstime_t endtime;      /* Time of last sample in record */
+  uint32_t fileid;       /* Index into file section */
+  uint32_t reclen;
+  uint32_t samplecnt;
+  uint32_t dataoffset;
+  int8_t encoding;
+  uint8_t swapflag;
+  uint8_t reserved[6];
+} SnapRecord;
+
+/* Table of files referenced by record lists, hashed by name */
+typedef struct SnapFiles
+{
+  SnapFile *files;
+  const char **names;
+  uint32_t *slots;       /* File index + 1 for each slot, 0 if empty */
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t slotcount;    /* Number of slots, a power of 2 */
+  uint64_t stringsize;
+  const char *lastname;  /* Most recently found name and its index */
+  uint32_t lastid;
+} SnapFiles;
+
+static int64_t find_file (SnapFiles *table, const char *name);
+static void free_files (SnapFiles *table);
+static int write_snapshot (FILE *fp, MS3TraceList *mstl, SnapFiles *table,
+                           const SnapHeader *header);
+static int load_snapshot (MS3TraceList *mstl, const char *map, uint64_t mapsize,
+                          const char *path, SnapFile **ppfiles, const char ***ppnames,
+                          uint64_t *filecount);
+static int update_file (MS3TraceList **ppmstl, const SnapFile *file, const char *name,
+                        uint32_t flags, int8_t verbose);
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Write a snapshot of a ::MS3TraceList to a file
+ *
+ * A snapshot contains the trace IDs, segments and record lists of a
+ * trace list in a binary form that can be loaded quickly with
+ * mstl3_read_snapshot(), avoiding reading and parsing the records
+ * again, for example when a service is restarted.  Data samples are
+ * not included.
+ *
+ * All record list entries, linked or compact, must refer to records in
+ * files; entries for records in buffers cannot be written.  The size
+ * and modification time of each file are stored to validate the
+ * snapshot when loaded.
+ *
+ * The snapshot is written to a temporary file that replaces \a path
+ * when complete, such that readers never see a partial snapshot.
+ * Snapshots use the byte order of the host and can only be loaded on
+ * hosts with the same byte order.
+ *
+ * @param[in] mstl ::MS3TraceList to write
+ * @param[in] path File to write snapshot to
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of record list entries written on success, or
+ * -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_read_snapshot()
+ ***************************************************************************/
+int64_t
+mstl3_write_snapshot (MS3TraceList *mstl, const char *path, int8_t verbose)
+{
+  SnapFiles table;
+  SnapHeader header;
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  MS3RecordPtr *recordptr;
+  MS3RecordPtr view;
+  MS3Record viewmsr;
+  struct stat sb;
+  char *tmppath = NULL;
+  FILE *fp = NULL;
+  int64_t fileid;
+  int64_t end;
+  uint64_t index = 0;
+  uint64_t idx;
+  int rv = -1;
+
+  if (!mstl || !path)
+  {
+    ms_log (2, "%s(): Required input not defined: 'mstl' or 'path'\n", __func__);
+    return -1;
+  }
+
+  memset (&table, 0, sizeof (table));
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+  header.byteorder = SNAPSHOT_BYTEORDER;
+  header.version = SNAPSHOT_VERSION;
+
+  /* Count entries and build the file table */
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    header.idcount++;
+
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      header.segcount++;
+
+      if (!seg->recordlist)
+        continue;
+
+      for (recordptr = mstl3_reclist_next (seg->recordlist, NULL, &index, &view, &viewmsr); recordptr;
+           recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr))
+      {
+        if (!recordptr->filename || !recordptr->msr)
+        {
+          ms_log (2, "%s: Record list entry not in a file, cannot write snapshot\n", id->sid);
+          goto cleanup;
+        }
+
+        if ((fileid = find_file (&table, recordptr->filename)) < 0)
+          goto cleanup;
+
+        end = recordptr->fileoffset + recordptr->msr->reclen;
+
+        if (end > table.files[fileid].datalength)
+          table.files[fileid].datalength = end;
+
+        header.recordcount++;
+      }
+    }
+  }
+
+  /* Record current size and modification time of each file */
+  for (idx = 0; idx < table.count; idx++)
+  {
+    if (stat (table.names[idx], &sb))
+    {
+      ms_log (2, "Cannot stat %s: %s\n", table.names[idx], strerror (errno));
+      goto cleanup;
+    }
+
+    table.files[idx].size = (int64_t)sb.st_size;
+    table.files[idx].mtime = (int64_t)sb.st_mtime;
+  }
+
+  header.filecount = table.count;
+  header.stringsize = table.stringsize;
+
+  if ((tmppath = (char *)lm_malloc (strlen (path) + 5)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    goto cleanup;
+  }
+
+  sprintf (tmppath, "%s.tmp", path);
+
+  if ((fp = fopen (tmppath, "wb")) == NULL)
+  {
+    ms_log (2, "Cannot open snapshot file %s: %s\n", tmppath, strerror (errno));
+    goto cleanup;
+  }
+
+  if (write_snapshot (fp, mstl, &table, &header))
+  {
+    ms_log (2, "Error writing snapshot file %s: %s\n", tmppath, strerror (errno));
+    fclose (fp);
+    remove (tmppath);
+    goto cleanup;
+  }
+
+  if (fclose (fp))
+  {
+    ms_log (2, "Error closing snapshot file %s: %s\n", tmppath, strerror (errno));
+    remove (tmppath);
+    goto cleanup;
+  }
+
+#if defined(LMP_WIN)
+  /* Windows rename() does not replace existing files */
+  remove (path);
+#endif
+
+  if (rename (tmppath, path))
+  {
+    ms_log (2, "Cannot rename %s to %s: %s\n", tmppath, path, strerror (errno));
+    remove (tmppath);
+    goto cleanup;
+  }
+
+  if (verbose)
+    ms_log (0, "Wrote snapshot %s: %" PRIu64 " IDs, %" PRIu64 " segments, %" PRIu64
+               " records in %" PRIu64 " files\n",
+            path, header.idcount, header.segcount, header.recordcount, header.filecount);
+
+  rv = 0;
+
+cleanup:
+  free_files (&table);
+
+  if (tmppath)
+    libmseed_memory.free (tmppath);
+
+  return (rv) ? -1 : (int64_t)header.recordcount;
+} /* End of mstl3_write_snapshot() */
+
+/**********************************************************************/ /**
+ * @brief Load a ::MS3TraceList from a snapshot file
+ *
+ * Load a snapshot written by mstl3_write_snapshot().  The snapshot is
+ * memory mapped, where supported, and the trace IDs and segments are
+ * created with compact record lists (as built with
+ * ::MSF_COMPACTRECLIST), which only refer to the files containing
+ * the records.  Samples are not loaded, they are available with
+ * mstl3_unpack_recordlist().
+ *
+ * If \a ppmstl points to an existing ::MS3TraceList it must be empty,
+ * this allows a list to be configured, e.g. with mstl3_set_compact(),
+ * before loading.  Otherwise a new list is allocated.
+ *
+ * After loading, each file referenced by the snapshot is validated:
+ * - smaller size, same size with a different modification time, or
+ *   a missing file: the snapshot is stale and an error is returned
+ * - otherwise, if the file extends beyond the last record in the
+ *   snapshot, data has been appended, possibly before the snapshot was
+ *   written, and records after the last record in the snapshot are
+ *   read into the trace list
+ * - otherwise the file is current
+ *
+ * Appended records are added as with ms3_readtracelist() using the
+ * default tolerances and without splitting publication versions.
+ * Supported \a flags for reading appended records:
+ *  - ::MSF_SKIPNOTDATA - skip input that cannot be identified as miniSEED
+ *  - ::MSF_VALIDATECRC - validate CRC (if present in format)
+ *
+ * Write a new snapshot after loading to include appended data in
+ * future loads.
+ *
+ * @param[in,out] ppmstl Pointer-to-pointer of ::MS3TraceList to load into
+ * @param[in] path Snapshot file to load
+ * @param[in] flags Flags for reading appended records
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns the number of files with appended data on success, or -1
+ * on error, including a stale snapshot, in which case the trace list
+ * is freed and \a *ppmstl set to NULL, and the list should be rebuilt
+ * from the data files.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_write_snapshot()
+ ***************************************************************************/
+int64_t
+mstl3_read_snapshot (MS3TraceList **ppmstl, const char *path, uint32_t flags, int8_t verbose)
+{
+  MS3TraceList *mstl;
+  SnapFile *files = NULL;
+  const char **names = NULL;
+  struct stat sb;
+  char *map = NULL;
+  uint64_t mapsize = 0;
+  uint64_t filecount = 0;
+  uint64_t idx;
+  int64_t updated = 0;
+  int rv;
+#if defined(LMP_WIN)
+  FILE *fp;
+#else
+  int fd;
+#endif
+
+  if (!ppmstl || !path)
+  {
+    ms_log (2, "%s(): Required input not defined: 'ppmstl' or 'path'\n", __func__);
+    return -1;
+  }
+
+  if (*ppmstl && (*ppmstl)->numtraceids > 0)
+  {
+    ms_log (2, "%s(): Trace list is not empty\n", __func__);
+    return -1;
+  }
+
+  if (stat (path, &sb))
+  {
+    ms_log (2, "Cannot stat snapshot %s: %s\n", path, strerror (errno));
+    return -1;
+  }
+
+  mapsize = (uint64_t)sb.st_size;
+
+  if (mapsize < sizeof (SnapHeader))
+  {
+    ms_log (2, "Snapshot %s is too short\n", path);
+    return -1;
+  }
+
+#if defined(LMP_WIN)
+  if ((fp = fopen (path, "rb")) == NULL)
+  {
+    ms_log (2, "Cannot open snapshot %s: %s\n", path, strerror (errno));
+    return -1;
+  }
+
+  if ((map = (char *)lm_malloc ((size_t)mapsize)) == NULL ||
+      fread (map, (size_t)mapsize, 1, fp) != 1)
+  {
+    ms_log (2, "Cannot read snapshot %s\n", path);
+    fclose (fp);
+    if (map)
+      libmseed_memory.free (map);
+    return -1;
+  }
+
+  fclose (fp);
+#else
+  if ((fd = open (path, O_RDONLY)) < 0)
+  {
+    ms_log (2, "Cannot open snapshot %s: %s\n", path, strerror (errno));
+    return -1;
+  }
+
+  map = (char *)mmap (NULL, (size_t)mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+
+  if (map == (char *)MAP_FAILED)
+  {
+    ms_log (2, "Cannot map snapshot %s: %s\n", path, strerror (errno));
+    return -1;
+  }
+#endif
+
+  if (!*ppmstl)
+  {
+    if ((*ppmstl = mstl3_init (NULL)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      updated = -1;
+    }
+  }
+
+  mstl = *ppmstl;
+
+  if (mstl)
+  {
+    rv = load_snapshot (mstl, map, mapsize, path, &files, &names, &filecount);
+
+    if (rv == 0 && verbose)
+      ms_log (0, "Loaded snapshot %s: %u IDs, %" PRIu64 " files\n", path, mstl->numtraceids, filecount);
+
+    /* Validate files and read appended data */
+    for (idx = 0; rv == 0 && idx < filecount; idx++)
+    {
+      if ((rv = update_file (ppmstl, &files[idx], names[idx], flags, verbose)) > 0)
+      {
+        updated++;
+        rv = 0;
+      }
+    }
+
+    if (rv)
+      updated = -1;
+  }
+
+  if (files)
+    libmseed_memory.free (files);
+  if (names)
+    libmseed_memory.free (names);
+
+#if defined(LMP_WIN)
+  libmseed_memory.free (map);
+#else
+  munmap (map, (size_t)mapsize);
+#endif
+
+  /* Release partially loaded list */
+  if (updated < 0 && *ppmstl)
+    mstl3_free (ppmstl, 0);
+
+  return updated;
+} /* End of mstl3_read_snapshot() */
+
+/***************************************************************************
+ * Find a file name in the file table, adding it if not present.
+ *
+ * Returns the index of the file on success and -1 on error.
+ ***************************************************************************/
+static int64_t
+find_file (SnapFiles *table, const char *name)
+{
+  const char **names;
+  SnapFile *files;
+  uint32_t *slots;
+  uint64_t slotcount;
+  uint64_t slot;
+  uint64_t idx;
+  uint64_t hash;
+  const char *cp;
+
+  /* Consecutive records are usually from the same file */
+  if (table->lastname && (name == table->lastname || !strcmp (name, table->lastname)))
+  {
+    table->lastname = name;
+    return table->lastid;
+  }
+
+  /* Grow and rehash slots when more than half full */
+  if ((table->count + 1) * 2 > table->slotcount)
+  {
+    slotcount = (table->slotcount) ? table->slotcount * 2 : 64;
+
+    if ((slots = (uint32_t *)lm_malloc ((size_t)(slotcount * sizeof (uint32_t)))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+
+    memset (slots, 0, (size_t)(slotcount * sizeof (uint32_t)));
+
+    for (idx = 0; idx < table->count; idx++)
+    {
+      for (hash = 14695981039346656037ULL, cp = table->names[idx]; *cp; cp++)
+        hash = (hash ^ (uint8_t)*cp) * 1099511628211ULL;
+
+      for (slot = hash & (slotcount - 1); slots[slot]; slot = (slot + 1) & (slotcount - 1))
+        ;
+
+      slots[slot] = (uint32_t)(idx + 1);
+    }
+
+    if (table->slots)
+      libmseed_memory.free (table->slots);
+
+    table->slots = slots;
+    table->slotcount = slotcount;
+  }
+
+  /* FNV-1a hash of name */
+  for (hash = 14695981039346656037ULL, cp = name; *cp; cp++)
+    hash = (hash ^ (uint8_t)*cp) * 1099511628211ULL;
+
+  for (slot = hash & (table->slotcount - 1); table->slots[slot];
+       slot = (slot + 1) & (table->slotcount - 1))
+  {
+    idx = table->slots[slot] - 1;
+
+    if (!strcmp (table->names[idx], name))
+    {
+      table->lastname = name;
+      table->lastid = (uint32_t)idx;
+      return (int64_t)idx;
+    }
+  }
+
+  if (table->count >= UINT32_MAX - 1)
+  {
+    ms_log (2, "Too many files for snapshot\n");
+    return -1;
+  }
+
+  if (table->count == table->capacity)
+  {
+    table->capacity = (table->capacity) ? table->capacity * 2 : 64;
+
+    if ((files = (SnapFile *)lm_realloc (table->files, (size_t)(table->capacity * sizeof (SnapFile)))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+    table->files = files;
+
+    if ((names = (const char **)lm_realloc ((void *)table->names, (size_t)(table->capacity * sizeof (char *)))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+    table->names = names;
+  }
+
+  idx = table->count++;
+  memset (&table->files[idx], 0, sizeof (SnapFile));
+  table->files[idx].nameoffset = table->stringsize;
+  table->names[idx] = name;
+  table->stringsize += strlen (name) + 1;
+  table->slots[slot] = (uint32_t)(idx + 1);
+  table->lastname = name;
+  table->lastid = (uint32_t)idx;
+
+  return (int64_t)idx;
+} /* End of find_file() */
+
+/***************************************************************************
+ * Free the allocated arrays of a file table.
+ ***************************************************************************/
+static void
+free_files (SnapFiles *table)
+{
+  if (table->files)
+    libmseed_memory.free (table->files);
+  if (table->names)
+    libmseed_memory.free ((void *)table->names);
+  if (table->slots)
+    libmseed_memory.free (table->slots);
+
+  memset (table, 0, sizeof (SnapFiles));
+} /* End of free_files() */
+
+/***************************************************************************
+ * Write all sections of a snapshot to an open file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+write_snapshot (FILE *fp, MS3TraceList *mstl, SnapFiles *table, const SnapHeader *header)
+{
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  MS3RecordPtr *recordptr;
+  MS3RecordPtr view;
+  MS3Record viewmsr;
+  SnapID snapid;
+  SnapSeg snapseg;
+  SnapRecord snaprecord;
+  uint64_t index = 0;
+  uint64_t idx;
+
+  if (fwrite (header, sizeof (SnapHeader), 1, fp) != 1)
+    return -1;
+
+  if (table->count && fwrite (table->files, sizeof (SnapFile), (size_t)table->count, fp) != table->count)
+    return -1;
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    memset (&snapid, 0, sizeof (snapid));
+    memcpy (snapid.sid, id->sid, sizeof (snapid.sid));
+    snapid.earliest = id->earliest;
+    snapid.latest = id->latest;
+    snapid.numsegments = id->numsegments;
+    snapid.pubversion = id->pubversion;
+
+    if (fwrite (&snapid, sizeof (snapid), 1, fp) != 1)
+      return -1;
+  }
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      memset (&snapseg, 0, sizeof (snapseg));
+      snapseg.starttime = seg->starttime;
+      snapseg.endtime = seg->endtime;
+      snapseg.samprate = seg->samprate;
+      snapseg.samplecnt = seg->samplecnt;
+      snapseg.recordcnt = (seg->recordlist) ? seg->recordlist->recordcnt : 0;
+      snapseg.sampletype = seg->sampletype;
+
+      if (fwrite (&snapseg, sizeof (snapseg), 1, fp) != 1)
+        return -1;
+    }
+  }
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if (!seg->recordlist)
+        continue;
+
+      for (recordptr = mstl3_reclist_next (seg->recordlist, NULL, &index, &view, &viewmsr); recordptr;
+           recordptr = mstl3_reclist_next (seg->recordlist, recordptr, &index, &view, &viewmsr))
+      {
+        memset (&snaprecord, 0, sizeof (snaprecord));
+        snaprecord.offset = recordptr->fileoffset;
+        snaprecord.endtime = recordptr->endtime;
+        snaprecord.fileid = (uint32_t)find_file (table, recordptr->filename);
+        snaprecord.reclen = (uint32_t)recordptr->msr->reclen;
+        snaprecord.samplecnt = (uint32_t)recordptr->msr->samplecnt;
+        snaprecord.dataoffset = recordptr->dataoffset;
+        snaprecord.encoding = recordptr->msr->encoding;
+        snaprecord.swapflag = recordptr->msr->swapflag;
+
+        if (fwrite (&snaprecord, sizeof (snaprecord), 1, fp) != 1)
+          return -1;
+      }
+    }
+  }
+
+  for (idx = 0; idx < table->count; idx++)
+  {
+    if (fwrite (table->names[idx], strlen (table->names[idx]) + 1, 1, fp) != 1)
+      return -1;
+  }
+
+  return 0;
+} /* End of write_snapshot() */
+
+/***************************************************************************
+ * Validate a mapped snapshot and load its IDs, segments and record
+ * lists into an empty trace list.  The file section and an array of
+ * file names in the map are returned for validation of the files.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+load_snapshot (MS3TraceList *mstl, const char *map, uint64_t mapsize,
+               const char *path, SnapFile **ppfiles, const char ***ppnames,
+               uint64_t *filecount)
+{
+  const SnapHeader *header = (const SnapHeader *)map;
+  const SnapFile *files;
+  const SnapID *snapids;
+  const SnapSeg *snapsegs;
+  const SnapRecord *snaprecords;
+  const char *strings;
+  MS3TraceID *prev[MSTRACEID_SKIPLIST_HEIGHT];
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  MS3Record msr;
+  int64_t sourceid;
+  int64_t basesourceid = -1;
+  uint64_t segidx = 0;
+  uint64_t recidx = 0;
+  uint64_t idx;
+  uint64_t sidx;
+  uint64_t ridx;
+  int level;
+
+  if (memcmp (header->magic, SNAPSHOT_MAGIC, sizeof (header->magic)))
+  {
+    ms_log (2, "%s is not a trace list snapshot\n", path);
+    return -1;
+  }
+
+  if (header->byteorder != SNAPSHOT_BYTEORDER || header->version != SNAPSHOT_VERSION)
+  {
+    ms_log (2, "Snapshot %s is version %u or a different byte order, not supported\n",
+            path, header->version);
+    return -1;
+  }
+
+  /* Check that section sizes match snapshot size, avoiding overflow */
+  if (header->filecount > mapsize / sizeof (SnapFile) ||
+      header->idcount > mapsize / sizeof (SnapID) ||
+      header->segcount > mapsize / sizeof (SnapSeg) ||
+      header->recordcount > mapsize / sizeof (SnapRecord) ||
+      header->stringsize > mapsize ||
+      sizeof (SnapHeader) + header->filecount * sizeof (SnapFile) +
+              header->idcount * sizeof (SnapID) + header->segcount * sizeof (SnapSeg) +
+              header->recordcount * sizeof (SnapRecord) + header->stringsize !=
+          mapsize)
+  {
+    ms_log (2, "Snapshot %s is truncated or corrupt\n", path);
+    return -1;
+  }
+
+  files = (const SnapFile *)(map + sizeof (SnapHeader));
+  snapids = (const SnapID *)(files + header->filecount);
+  snapsegs = (const SnapSeg *)(snapids + header->idcount);
+  snaprecords = (const SnapRecord *)(snapsegs + header->segcount);
+  strings = (const char *)(snaprecords + header->recordcount);
+
+  if (header->stringsize && strings[header->stringsize - 1] != '\0')
+  {
+    ms_log (2, "Snapshot %s is corrupt, file names not terminated\n", path);
+    return -1;
+  }
+
+  if ((*ppfiles = (SnapFile *)lm_malloc ((size_t)(header->filecount * sizeof (SnapFile) + 1))) == NULL ||
+      (*ppnames = (const char **)lm_malloc ((size_t)(header->filecount * sizeof (char *) + 1))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  /* Add files to the record source table, in order */
+  for (idx = 0; idx < header->filecount; idx++)
+  {
+    if (files[idx].nameoffset >= header->stringsize)
+    {
+      ms_log (2, "Snapshot %s is corrupt, invalid file name offset\n", path);
+      return -1;
+    }
+
+    (*ppfiles)[idx] = files[idx];
+    (*ppnames)[idx] = strings + files[idx].nameoffset;
+
+    if ((sourceid = mstl3_reclist_addfile (mstl, (*ppnames)[idx])) < 0)
+      return -1;
+
+    if (basesourceid < 0)
+      basesourceid = sourceid;
+  }
+
+  *filecount = header->filecount;
+
+  /* IDs are in list order, append each at the end of the skip list */
+  for (level = 0; level < MSTRACEID_SKIPLIST_HEIGHT; level++)
+    prev[level] = &(mstl->traces);
+
+  memset (&msr, 0, sizeof (MS3Record));
+
+  for (idx = 0; idx < header->idcount; idx++)
+  {
+    if (idx > 0 && strcmp (snapids[idx - 1].sid, snapids[idx].sid) > 0)
+    {
+      ms_log (2, "Snapshot %s is corrupt, IDs are not in order\n", path);
+      return -1;
+    }
+
+    if (snapids[idx].numsegments > header->segcount - segidx)
+    {
+      ms_log (2, "Snapshot %s is corrupt, segment count exceeded\n", path);
+      return -1;
+    }
+
+    if ((id = mstl3_newID (mstl)) == NULL)
+      return -1;
+
+    memcpy (id->sid, snapids[idx].sid, sizeof (id->sid));
+    id->sid[sizeof (id->sid) - 1] = '\0';
+    id->pubversion = snapids[idx].pubversion;
+    id->earliest = snapids[idx].earliest;
+    id->latest = snapids[idx].latest;
+
+    if (mstl3_addID (mstl, id, prev) == NULL)
+    {
+      libmseed_memory.free (id);
+      return -1;
+    }
+
+    for (level = 0; level < id->height; level++)
+      prev[level] = id;
+
+    memcpy (msr.sid, id->sid, sizeof (msr.sid));
+
+    for (sidx = 0; sidx < snapids[idx].numsegments; sidx++, segidx++)
+    {
+      if ((seg = mstl3_newseg (mstl, id)) == NULL)
+        return -1;
+
+      seg->starttime = snapsegs[segidx].starttime;
+      seg->endtime = snapsegs[segidx].endtime;
+      seg->samprate = snapsegs[segidx].samprate;
+      seg->samplecnt = snapsegs[segidx].samplecnt;
+      seg->sampletype = snapsegs[segidx].sampletype;
+
+      if (snapsegs[segidx].recordcnt > header->recordcount - recidx)
+      {
+        ms_log (2, "Snapshot %s is corrupt, record count exceeded\n", path);
+        return -1;
+      }
+
+      for (ridx = 0; ridx < snapsegs[segidx].recordcnt; ridx++, recidx++)
+      {
+        const SnapRecord *record = &snaprecords[recidx];
+
+        if (record->fileid >= header->filecount)
+        {
+          ms_log (2, "Snapshot %s is corrupt, invalid file index\n", path);
+          return -1;
+        }
+
+        msr.reclen = (int32_t)record->reclen;
+        msr.samplecnt = record->samplecnt;
+        msr.encoding = record->encoding;
+        msr.swapflag = record->swapflag;
+
+        if (mstl3_reclist_append (mstl, seg, (uint32_t)(basesourceid + record->fileid),
+                                  record->offset, record->dataoffset, &msr, record->endtime))
+          return -1;
+      }
+    }
+  }
+
+  return 0;
+} /* End of load_snapshot() */
+
+/***************************************************************************
+ * Validate a file of a loaded snapshot by size and modification time,
+ * and read records after the last record in the snapshot.
+ *
+ * Returns 1 if appended data was read, 0 if the file is current and
+ * -1 if the snapshot is stale or on error.
+ ***************************************************************************/
+static int
+update_file (MS3TraceList **ppmstl, const SnapFile *file, const char *name,
+             uint32_t flags, int8_t verbose)
+{
+  struct stat sb;
+  char *rangepath;
+  int rv;
+
+  if (stat (name, &sb))
+  {
+    ms_log (2, "Snapshot is stale, cannot stat %s: %s\n", name, strerror (errno));
+    return -1;
+  }
+
+  if ((int64_t)sb.st_size < file->size ||
+      ((int64_t)sb.st_size == file->size && (int64_t)sb.st_mtime != file->mtime))
+  {
+    ms_log (2, "Snapshot is stale, %s has been modified\n", name);
+    return -1;
+  }
+
+  /* Data beyond the last record in the snapshot may have been appended before
+   * the snapshot was written, freshness is decided on the end of the records */
+  if ((int64_t)sb.st_size <= file->datalength)
+    return 0;
+
+  /* Read records after the last record in the snapshot */
+  if ((rangepath = (char *)lm_malloc (strlen (name) + 24)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  sprintf (rangepath, "%s@%" PRId64, name, file->datalength);
+
+  if (verbose)
+    ms_log (0, "Reading %" PRId64 " bytes appended to %s\n",
+            (int64_t)sb.st_size - file->datalength, name);
+
+  flags &= ~(uint32_t)MSF_UNPACKDATA;
+  flags |= MSF_RECORDLIST | MSF_COMPACTRECLIST | MSF_PNAMERANGE;
+
+  rv = ms3_readtracelist_selection (ppmstl, rangepath, NULL, NULL, 0, flags, verbose);
+
+  libmseed_memory.free (rangepath);
+
+  if (rv != MS_NOERROR)
+  {
+    ms_log (2, "Cannot read data appended to %s: %s\n", name, ms_errorstr (rv));
+    return -1;
+  }
+
+  return 1;
+} /* End of update_file() */
@@ -0,0 +1,390 @@
+/***************************************************************************
+ * Routines to accumulate sample statistics of trace segments as data
+ * are added to a trace list.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2024 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmseed.h"
+
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_TRACELIST
+#include "memprofile.h"
+
+/** @cond UNDOCUMENTED */
+
+int mstl3_stats_init (MS3TraceList *mstl, MS3TraceSeg *seg);
+void mstl3_stats_add (MS3TraceSeg *seg, const void *samples, int64_t count,
+                      char sampletype, int8_t whence);
+void mstl3_stats_merge (MS3TraceSeg *seg1, const MS3TraceSeg *seg2);
+
+static void stats_int32 (MS3SampleStats *stats, const int32_t *samples, int64_t count);
+static void stats_float32 (MS3SampleStats *stats, const float *samples, int64_t count);
+static void stats_float64 (MS3SampleStats *stats, const double *samples, int64_t count);
+static void stats_combine (MS3SampleStats *stats, const MS3SampleStats *next);
+
+/** @endcond */
+
+/**********************************************************************/ /**
+ * @brief Accumulate sample statistics for the segments of a ::MS3TraceList
+ *
+ * When set, each ::MS3TraceSeg created for the list is given a
+ * ::MS3SampleStats at ::MS3TraceSeg.stats that is updated as data
+ * samples are added, in the same pass that copies the samples into the
+ * segment.  No further pass over the samples is needed to determine
+ * the minimum, maximum, mean, RMS, clipped and constant sample counts
+ * of a segment, e.g. for quality control.
+ *
+ * Statistics of joined data are combined in time order when records
+ * are added to either end of a segment and when segments are merged,
+ * so the results match a single pass over the samples of the final
+ * segment, apart from rounding of the floating point sums.  Only
+ * integer, float and double samples are included, records without
+ * unpacked samples (e.g. read without ::MSF_UNPACKDATA) do not change
+ * the statistics.
+ *
+ * Samples at or below \a clipmin, or at or above \a clipmax, are
+ * counted in ::MS3SampleStats.clipped.  If \a clipmin is not less
+ * than \a clipmax clipped samples are not counted.
+ *
+ * Statistics describe all samples added to a segment, they are not
+ * updated when samples are removed or modified by the caller,
+ * mstl3_pack() or mstl3_convertsamples() with truncation.
+ *
+ * Statistics can only be selected for an empty trace list, as
+ * returned by mstl3_init(), and are not available for segments
+ * loaded with mstl3_read_snapshot().
+ *
+ * @param[in] mstl Empty ::MS3TraceList to accumulate statistics for
+ * @param[in] clipmin Lower clip limit
+ * @param[in] clipmax Upper clip limit
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+mstl3_set_stats (MS3TraceList *mstl, double clipmin, double clipmax)
+{
+  MS3SampleStats *limits;
+
+  if (!mstl)
+  {
+    ms_log (2, "%s(): Required input not defined: 'mstl'\n", __func__);
+    return -1;
+  }
+
+  if (mstl->numtraceids > 0)
+  {
+    ms_log (2, "Statistics can only be selected for an empty trace list\n");
+    return -1;
+  }
+
+  if ((limits = (MS3SampleStats *)mstl->stats) == NULL)
+  {
+    if ((limits = (MS3SampleStats *)lm_malloc (sizeof (MS3SampleStats))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+
+    memset (limits, 0, sizeof (MS3SampleStats));
+
+    mstl->stats = limits;
+  }
+
+  limits->clipmin = clipmin;
+  limits->clipmax = clipmax;
+
+  return 0;
+} /* End of mstl3_set_stats() */
+
+/** @cond UNDOCUMENTED */
+
+/***************************************************************************
+ * Allocate statistics for a new segment of a trace list that has
+ * statistics selected, the clip limits are copied from the list.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl3_stats_init (MS3TraceList *mstl, MS3TraceSeg *seg)
+{
+  if (!mstl->stats)
+    return 0;
+
+  if ((seg->stats = (MS3SampleStats *)lm_malloc (sizeof (MS3SampleStats))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  memset (seg->stats, 0, sizeof (MS3SampleStats));
+  seg->stats->clipmin = ((MS3SampleStats *)mstl->stats)->clipmin;
+  seg->stats->clipmax = ((MS3SampleStats *)mstl->stats)->clipmax;
+
+  return 0;
+} /* End of mstl3_stats_init() */
+
+/***************************************************************************
+ * Add statistics of 'count' samples to the statistics of a segment,
+ * the samples are added to the end (whence 1) or the beginning
+ * (whence 2) of the segment.  Segments without statistics and sample
+ * types other than integer, float and double are ignored.
+ ***************************************************************************/
+void
+mstl3_stats_add (MS3TraceSeg *seg, const void *samples, int64_t count,
+                 char sampletype, int8_t whence)
+{
+  MS3SampleStats stats;
+
+  if (!seg->stats || !samples || count <= 0)
+    return;
+
+  memset (&stats, 0, sizeof (MS3SampleStats));
+  stats.clipmin = seg->stats->clipmin;
+  stats.clipmax = seg->stats->clipmax;
+
+  switch (sampletype)
+  {
+  case 'i':
+    stats_int32 (&stats, (const int32_t *)samples, count);
+    break;
+  case 'f':
+    stats_float32 (&stats, (const float *)samples, count);
+    break;
+  case 'd':
+    stats_float64 (&stats, (const double *)samples, count);
+    break;
+  default:
+    return;
+  }
+
+  if (whence == 2)
+  {
+    stats_combine (&stats, seg->stats);
+    *seg->stats = stats;
+  }
+  else
+  {
+    stats_combine (seg->stats, &stats);
+  }
+} /* End of mstl3_stats_add() */
+
+/***************************************************************************
+ * Combine statistics of seg2 into seg1, seg2 follows seg1 in time.
+ ***************************************************************************/
+void
+mstl3_stats_merge (MS3TraceSeg *seg1, const MS3TraceSeg *seg2)
+{
+  if (seg1->stats && seg2->stats)
+    stats_combine (seg1->stats, seg2->stats);
+} /* End of mstl3_stats_merge() */
+
+/***************************************************************************
+ * Combine statistics of samples in 'next' into 'stats', the samples of
+ * 'next' follow those of 'stats' in time.
+ ***************************************************************************/
+static void
+stats_combine (MS3SampleStats *stats, const MS3SampleStats *next)
+{
+  if (next->count == 0)
+    return;
+
+  if (stats->count == 0)
+  {
+    *stats = *next;
+    return;
+  }
+
+  if (next->min < stats->min)
+    stats->min = next->min;
+  if (next->max > stats->max)
+    stats->max = next->max;
+
+  stats->sum += next->sum;
+  stats->sumsq += next->sumsq;
+  stats->clipped += next->clipped;
+  stats->constant += next->constant;
+
+  /* First sample of 'next' repeats the last sample of 'stats' */
+  if (next->first == stats->last)
+    stats->constant++;
+
+  stats->last = next->last;
+  stats->count += next->count;
+} /* End of stats_combine() */
+
+/***************************************************************************
+ * Statistics of integer samples.
+ *
+ * The loop is branch free with independent accumulators, integer sums
+ * are exact and the comparisons are counted as 0/1 values, allowing
+ * compilers to vectorize it.
+ ***************************************************************************/
+static void
+stats_int32 (MS3SampleStats *stats, const int32_t *samples, int64_t count)
+{
+  int32_t min = samples[0];
+  int32_t max = samples[0];
+  int64_t sum = 0;
+  double sumsq[4] = {0.0, 0.0, 0.0, 0.0};
+  int64_t clipped = 0;
+  int64_t constant = 0;
+  int64_t clipmin = INT64_MIN;
+  int64_t clipmax = INT64_MAX;
+  int64_t idx;
+  int clip;
+
+  /* Integer limits equivalent to the clip limits, i.e. floor(clipmin) and ceil(clipmax) */
+  clip = (stats->clipmin < stats->clipmax);
+
+  if (clip)
+  {
+    clipmin = (stats->clipmin < -4294967296.0) ? -4294967296 : (int64_t)stats->clipmin;
+    clipmax = (stats->clipmax > 4294967296.0) ? 4294967296 : (int64_t)stats->clipmax;
+
+    if ((double)clipmin > stats->clipmin)
+      clipmin--;
+    if ((double)clipmax < stats->clipmax)
+      clipmax++;
+  }
+
+  for (idx = 0; idx < count; idx++)
+  {
+    min = (samples[idx] < min) ? samples[idx] : min;
+    max = (samples[idx] > max) ? samples[idx] : max;
+    sum += samples[idx];
+    clipped += (samples[idx] <= clipmin) | (samples[idx] >= clipmax);
+  }
+
+  for (idx = 1; idx < count; idx++)
+    constant += (samples[idx] == samples[idx - 1]);
+
+  for (idx = 0; idx + 4 <= count; idx += 4)
+  {
+    sumsq[0] += (double)samples[idx] * samples[idx];
+    sumsq[1] += (double)samples[idx + 1] * samples[idx + 1];
+    sumsq[2] += (double)samples[idx + 2] * samples[idx + 2];
+    sumsq[3] += (double)samples[idx + 3] * samples[idx + 3];
+  }
+  for (; idx < count; idx++)
+    sumsq[0] += (double)samples[idx] * samples[idx];
+
+  stats->count = count;
+  stats->min = min;
+  stats->max = max;
+  stats->sum = (double)sum;
+  stats->sumsq = (sumsq[0] + sumsq[1]) + (sumsq[2] + sumsq[3]);
+  stats->clipped = (clip) ? clipped : 0;
+  stats->constant = constant;
+  stats->first = samples[0];
+  stats->last = samples[count - 1];
+} /* End of stats_int32() */
+
+/***************************************************************************
+ * Statistics of float samples, accumulated in double precision.
+ ***************************************************************************/
+static void
+stats_float32 (MS3SampleStats *stats, const float *samples, int64_t count)
+{
+  float min = samples[0];
+  float max = samples[0];
+  double sum[4] = {0.0, 0.0, 0.0, 0.0};
+  double sumsq[4] = {0.0, 0.0, 0.0, 0.0};
+  int64_t clipped = 0;
+  int64_t constant = 0;
+  double value;
+  int64_t idx;
+  int lane;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    min = (samples[idx] < min) ? samples[idx] : min;
+    max = (samples[idx] > max) ? samples[idx] : max;
+    clipped += (samples[idx] <= stats->clipmin) | (samples[idx] >= stats->clipmax);
+  }
+
+  for (idx = 1; idx < count; idx++)
+    constant += (samples[idx] == samples[idx - 1]);
+
+  for (idx = 0; idx < count; idx++)
+  {
+    lane = idx & 3;
+    value = samples[idx];
+    sum[lane] += value;
+    sumsq[lane] += value * value;
+  }
+
+  stats->count = count;
+  stats->min = min;
+  stats->max = max;
+  stats->sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+  stats->sumsq = (sumsq[0] + sumsq[1]) + (sumsq[2] + sumsq[3]);
+  stats->clipped = (stats->clipmin < stats->clipmax) ? clipped : 0;
+  stats->constant = constant;
+  stats->first = samples[0];
+  stats->last = samples[count - 1];
+} /* End of stats_float32() */
+
+/***************************************************************************
+ * Statistics of double samples.
+ ***************************************************************************/
+static void
+stats_float64 (MS3SampleStats *stats, const double *samples, int64_t count)
+{
+  double min = samples[0];
+  double max = samples[0];
+  double sum[4] = {0.0, 0.0, 0.0, 0.0};
+  double sumsq[4] = {0.0, 0.0, 0.0, 0.0};
+  int64_t clipped = 0;
+  int64_t constant = 0;
+  int64_t idx;
+  int lane;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    min = (samples[idx] < min) ? samples[idx] : min;
+    max = (samples[idx] > max) ? samples[idx] : max;
+    clipped += (samples[idx] <= stats->clipmin) | (samples[idx] >= stats->clipmax);
+  }
+
+  for (idx = 1; idx < count; idx++)
+    constant += (samples[idx] == samples[idx - 1]);
+
+  for (idx = 0; idx < count; idx++)
+  {
+    lane = idx & 3;
+    sum[lane] += samples[idx];
+    sumsq[lane] += samples[idx] * samples[idx];
+  }
+
+  stats->count = count;
+  stats->min = min;
+  stats->max = max;
+  stats->sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+  stats->sumsq = (sumsq[0] + sumsq[1]) + (sumsq[2] + sumsq[3]);
+  stats->clipped = (stats->clipmin < stats->clipmax) ? clipped : 0;
+  stats->constant = constant;
+  stats->first = samples[0];
+  stats->last = samples[count - 1];
+} /* End of stats_float64() */
+
+/** @endcond */
@@ -35,6 +35,9 @@
 #include "unpack.h"
 #include "unpackdata.h"
 
+#define LM_MEMPROF_SUBSYSTEM MS_MEMPROF_PARSE
+#include "memprofile.h"
+
 /* Function(s) internal to this file */
 static nstime_t ms_btime2nstime (uint8_t *btime, int8_t swapflag);
 
@@ -181,7 +184,7 @@ msr3_unpack_mseed3 (const char *record, int reclen, MS3Record **ppmsr,
   msr->extralength = HO2u (*pMS3FSDH_EXTRALENGTH (record), msr->swapflag);
   if (msr->extralength)
   {
-    if ((msr->extra = (char *)libmseed_memory.malloc (msr->extralength + 1)) == NULL)
+    if ((msr->extra = (char *)lm_malloc (msr->extralength + 1)) == NULL)
     {
       ms_log (2, "%s: Cannot allocate memory for extra headers\n", msr->sid);
       return MS_GENERROR;
@@ -845,7 +848,7 @@ msr3_unpack_mseed2 (const char *record, int reclen, MS3Record **ppmsr,
         length = snprintf (sval, sizeof(sval), "{\"FDSN\":{\"Time\":{\"Quality\":%d}}}",
                            *pMS2B1001_TIMINGQUALITY (record + blkt_offset));
 
-        if (!(msr->extra = (char *)libmseed_memory.malloc (length + 1)))
+        if (!(msr->extra = (char *)lm_malloc (length + 1)))
         {
           ms_log (2, "%s: Cannot allocate memory for extra headers\n", msr->sid);
           return MS_GENERROR;
@@ -1192,7 +1195,7 @@ msr3_unpack_data (MS3Record *msr, int8_t verbose)
   /* Copy encoded data to aligned/malloc'd buffer if not aligned for sample size */
   if (samplesize && !is_aligned (encoded, samplesize))
   {
-    if ((encoded_allocated = (char *) libmseed_memory.malloc (datasize)) == NULL)
+    if ((encoded_allocated = (char *) lm_malloc (datasize)) == NULL)
     {
       ms_log (2, "Cannot allocate memory for encoded data\n");
       return MS_GENERROR;
@@ -1211,12 +1214,12 @@ msr3_unpack_data (MS3Record *msr, int8_t verbose)
     if (libmseed_prealloc_block_size)
     {
       size_t current_size  = msr->datasize;
-      msr->datasamples = libmseed_memory_prealloc (msr->datasamples, unpacksize, &current_size);
+      msr->datasamples = lm_prealloc (msr->datasamples, unpacksize, &current_size);
       msr->datasize = current_size;
     }
     else
     {
-      msr->datasamples = libmseed_memory.realloc (msr->datasamples, unpacksize);
+      msr->datasamples = lm_realloc (msr->datasamples, unpacksize);
       msr->datasize = unpacksize;
     }
 
@@ -1443,6 +1446,137 @@ ms_decode_data (const void *input, uint64_t inputsize, uint8_t encoding,
   return nsamples;
 } /* End of ms_decode_data() */
 
+/*******************************************************************/ /**
+ * @brief Verify the integrity of a miniSEED record
+ *
+ * The record in \a record is parsed and checked without producing
+ * any output, intended for scrubbing stored data:
+ *
+ *  - the CRC of miniSEED 3.x records is validated
+ *  - header fields are checked with ms_parse_raw3() or ms_parse_raw2(),
+ *    for miniSEED 2.x this includes the blockette chain and the
+ *    consistency of the 1000 blockette record length with data and
+ *    blockette offsets
+ *  - the data payload is decoded, Steim frames are decoded directly
+ *    to compare the number of encoded samples to the sample count in
+ *    the header and the last sample to the reverse integration
+ *    constant (Xn) in the first frame
+ *
+ * The buffer length is used as the record length when it cannot be
+ * determined from the record, i.e. version 2 without a 1000 blockette.
+ *
+ * The ::MS3Record at \a ppmsr is re-used for parsing and decoding
+ * and should be freed with msr3_free() by the caller.  A new
+ * ::MS3Record is allocated if it points to NULL.
+ *
+ * @param[in] record Buffer containing record to verify
+ * @param[in] recbuflen Buffer length in bytes
+ * @param[in,out] ppmsr Pointer-to-pointer to a ::MS3Record for parsing
+ * @param[in] verbose Flag to control verbosity, 0 means no diagnostic output
+ *
+ * @returns A bitmask of problems detected, see @ref verify-flags, 0
+ * when the record is intact or ::MS_GENERROR on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ************************************************************************/
+int
+ms3_verify_record (const char *record, uint64_t recbuflen, MS3Record **ppmsr, int8_t verbose)
+{
+  MS3Record *msr;
+  uint32_t dataoffset;
+  uint32_t datasize;
+  size_t unpacksize;
+  int64_t nsamples;
+  int32_t Xn;
+  int problems = 0;
+  int retcode;
+
+  if (!record || !ppmsr)
+  {
+    ms_log (2, "%s(): Required input not defined: 'record' or 'ppmsr'\n", __func__);
+    return MS_GENERROR;
+  }
+
+  /* Parse header, without CRC validation if the CRC does not match */
+  retcode = msr3_parse (record, recbuflen, ppmsr, MSF_VALIDATECRC | MSF_ATENDOFFILE, verbose);
+
+  if (retcode == MS_INVALIDCRC)
+  {
+    problems |= MSV_CRC;
+    retcode = msr3_parse (record, recbuflen, ppmsr, MSF_ATENDOFFILE, verbose);
+  }
+
+  if (retcode != MS_NOERROR)
+    return problems | MSV_UNPARSABLE;
+
+  msr = *ppmsr;
+
+  /* Check header fields and the version 2 blockette chain */
+  if (msr->formatversion == 3 && ms_parse_raw3 (record, msr->reclen, 0))
+    problems |= MSV_STRUCTURE;
+  else if (msr->formatversion == 2 && ms_parse_raw2 (record, msr->reclen, 0, -1))
+    problems |= MSV_STRUCTURE;
+
+  if (msr->samplecnt <= 0)
+    return problems;
+
+  if (msr->encoding != DE_STEIM1 && msr->encoding != DE_STEIM2)
+  {
+    if (msr3_unpack_data (msr, verbose) < 0)
+      problems |= MSV_DECODE;
+
+    return problems;
+  }
+
+  /* Decode Steim frames directly, a short decode is a sample count problem */
+  if (msr->samplecnt > INT32_MAX || msr3_data_bounds (msr, &dataoffset, &datasize) ||
+      dataoffset < MINRECLEN || dataoffset >= (uint32_t)msr->reclen)
+    return problems | MSV_DECODE;
+
+  unpacksize = (size_t)msr->samplecnt * sizeof (int32_t);
+
+  if (msr->datasize < unpacksize)
+  {
+    if ((msr->datasamples = lm_realloc (msr->datasamples, unpacksize)) == NULL)
+    {
+      ms_log (2, "%s: Cannot (re)allocate memory\n", msr->sid);
+      msr->datasize = 0;
+      return MS_GENERROR;
+    }
+
+    msr->datasize = unpacksize;
+  }
+
+  if (msr->encoding == DE_STEIM1)
+    nsamples = msr_decode_steim1 ((int32_t *)(record + dataoffset), datasize, msr->samplecnt,
+                                  (int32_t *)msr->datasamples, msr->datasize, msr->sid,
+                                  (msr->swapflag & MSSWAP_PAYLOAD));
+  else
+    nsamples = msr_decode_steim2 ((int32_t *)(record + dataoffset), datasize, msr->samplecnt,
+                                  (int32_t *)msr->datasamples, msr->datasize, msr->sid,
+                                  (msr->swapflag & MSSWAP_PAYLOAD));
+
+  msr->numsamples = (nsamples > 0) ? nsamples : 0;
+  msr->sampletype = 'i';
+
+  if (nsamples < 0)
+    return problems | MSV_DECODE;
+
+  if (nsamples != msr->samplecnt)
+    return problems | MSV_SAMPLECOUNT;
+
+  /* Compare last sample to reverse integration constant, word 2 of the first frame */
+  memcpy (&Xn, record + dataoffset + 8, sizeof (int32_t));
+
+  if (msr->swapflag & MSSWAP_PAYLOAD)
+    ms_gswap4 (&Xn);
+
+  if (((int32_t *)msr->datasamples)[nsamples - 1] != Xn)
+    problems |= MSV_INTEGRATION;
+
+  return problems;
+} /* End of ms3_verify_record() */
+
 /***************************************************************************
  * Calculate a sample rate from SEED sample rate factor and multiplier
  * as stored in the fixed section header of data records.
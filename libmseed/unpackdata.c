@@ -25,6 +25,7 @@
 #include <stdlib.h>
 
 #include "libmseed.h"
+#include "packdata.h"
 #include "unpackdata.h"
 
 /* Extract bit range.  Byte order agnostic & defined when used with unsigned values */
@@ -193,11 +194,14 @@ msr_decode_steim1 (int32_t *input, uint64_t inputlength, uint64_t samplecount,
                    int swapflag)
 {
   uint32_t frame[16]; /* Frame, 16 x 32-bit quantities = 64 bytes */
+  uint32_t zeroframe[16]; /* Image of a frame with zero differences */
   int32_t diff[60];   /* Difference values for a frame, max is 15 x 4 (8-bit samples) */
   int32_t Xn = 0;     /* Reverse integration constant, aka last sample */
   uint64_t outputidx;
   uint64_t maxframes = inputlength / 64;
   uint64_t frameidx;
+  uint64_t fillidx;
+  int32_t fillvalue;
   int diffidx;
   int startnibble;
   int nibble;
@@ -224,6 +228,8 @@ msr_decode_steim1 (int32_t *input, uint64_t inputlength, uint64_t samplecount,
     return -1;
   }
 
+  steim_zeroframe (zeroframe, STEIM1_ZERO_NIBBLES, STEIM1_ZERO_WORD, swapflag);
+
 #if DECODE_DEBUG
   ms_log (0, "Decoding %"PRIu64" Steim1 frames, swapflag: %d, srcname: %s\n",
           maxframes, swapflag, (srcname) ? srcname : "");
@@ -237,6 +243,20 @@ msr_decode_steim1 (int32_t *input, uint64_t inputlength, uint64_t samplecount,
     memcpy (frame, input + (16 * frameidx), 64);
     diffidx = 0;
 
+    /* Fill a run of zero differences by repeating the last sample */
+    if (frameidx > 0 && !memcmp (frame, zeroframe, 64))
+    {
+      fillvalue = output[outputidx - 1];
+      fillidx   = outputidx + STEIM1_FRAME_MAX_SAMPLES;
+      if (fillidx > samplecount)
+        fillidx = samplecount;
+
+      for (; outputidx < fillidx; outputidx++)
+        output[outputidx] = fillvalue;
+
+      continue;
+    }
+
     /* Save forward integration constant (X0) and reverse integration constant (Xn)
        and set the starting nibble index depending on frame. */
     if (frameidx == 0)
@@ -363,11 +383,14 @@ msr_decode_steim2 (int32_t *input, uint64_t inputlength, uint64_t samplecount,
                    int swapflag)
 {
   uint32_t frame[16]; /* Frame, 16 x 32-bit quantities = 64 bytes */
+  uint32_t zeroframe[16]; /* Image of a frame with zero differences */
   int32_t diff[105];  /* Difference values for a frame, max is 15 x 7 (4-bit samples) */
   int32_t Xn = 0;     /* Reverse integration constant, aka last sample */
   uint64_t outputidx;
   uint64_t maxframes = inputlength / 64;
   uint64_t frameidx;
+  uint64_t fillidx;
+  int32_t fillvalue;
   int diffidx;
   int startnibble;
   int nibble;
@@ -402,6 +425,8 @@ msr_decode_steim2 (int32_t *input, uint64_t inputlength, uint64_t samplecount,
     return -1;
   }
 
+  steim_zeroframe (zeroframe, STEIM2_ZERO_NIBBLES, STEIM2_ZERO_WORD, swapflag);
+
 #if DECODE_DEBUG
   ms_log (0, "Decoding %"PRIu64" Steim2 frames, swapflag: %d, srcname: %s\n",
           maxframes, swapflag, (srcname) ? srcname : "");
@@ -415,6 +440,20 @@ msr_decode_steim2 (int32_t *input, uint64_t inputlength, uint64_t samplecount,
     memcpy (frame, input + (16 * frameidx), 64);
     diffidx = 0;
 
+    /* Fill a run of zero differences by repeating the last sample */
+    if (frameidx > 0 && !memcmp (frame, zeroframe, 64))
+    {
+      fillvalue = output[outputidx - 1];
+      fillidx   = outputidx + STEIM2_FRAME_MAX_SAMPLES;
+      if (fillidx > samplecount)
+        fillidx = samplecount;
+
+      for (; outputidx < fillidx; outputidx++)
+        output[outputidx] = fillvalue;
+
+      continue;
+    }
+
     /* Save forward integration constant (X0) and reverse integration constant (Xn)
        and set the starting nibble index depending on frame. */
     if (frameidx == 0)
@@ -12,10 +12,15 @@
  ***************************************************************************/
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <libmseed.h>
 #include <mseedformat.h>
@@ -24,14 +29,49 @@
 #define VERSION "1.0.2"
 #define PACKAGE "mseedconvert"
 
+/* Output buffer size and amount written between page cache releases with -nocache */
+#define NOCACHE_BUFFERSIZE 8388608
+#define NOCACHE_RELEASESIZE 67108864
+
+/* Conversion needed for an input file according to the sync manifest */
+#define SYNC_SKIP 0
+#define SYNC_FULL 1
+#define SYNC_APPEND 2
+
+/* Size of buffer used to hash input files */
+#define SYNC_HASHBUFFER 1048576
+
 static int8_t verbose = 0;
 static int packreclen = -1;
 static int packencoding = -1;
 static int packversion = 3;
 static int8_t forcerepack = 0;
+static int8_t inplace = 0;
+static int8_t memprofile = 0;
+static int8_t coalesce = 0;
+static int8_t nocache = 0;
+static int packpubversion = -1;
+static int threads = 0;
 static char *inputfile = NULL;
 static char *outputfile = NULL;
+static char *columnbase = NULL;
+static char *envelopeprefix = NULL;
+static uint32_t envelopebucket = 0;
 static FILE *outfile = NULL;
+static int64_t outfilewritten = 0;
+static int64_t outfilereleased = 0;
+
+static char *shmringname = NULL;
+static uint32_t shmringslots = 1024;
+static uint32_t shmringslotsize = 65536;
+static int8_t shmringreset = 0;
+static MS3ShmRing *shmring = NULL;
+
+static char *checkreport = NULL;
+
+static char *syncmanifest = NULL;
+static yyjson_mut_doc *syncdoc = NULL;
+static int synclockfd = -1;
 
 static char *extraheaderfile = NULL;
 static char *extraheaderpatch = NULL;
@@ -40,6 +80,20 @@ static char insertV2seqnum[6] = {0};
 static char insertV2dataquality = 0;
 
 static int extraheader_init (char *file);
+static int apply_header_changes (MS3Record *msr);
+static int update_inplace (const char *path, uint32_t flags);
+static int update_records (const char *path, uint32_t flags, int fd, char *header, size_t headersize,
+                           uint64_t *updated, uint64_t *total);
+static int export_tracelist (uint32_t flags);
+static int coalesce_records (uint32_t flags);
+static int hash_file (const char *path, int64_t start, int64_t end, uint32_t *crc);
+static int sync_lock (void);
+static void sync_unlock (void);
+static yyjson_mut_val *sync_load (void);
+static int sync_plan (struct stat *input, struct stat *output, int64_t *offset, uint32_t *prefixcrc);
+static int sync_update (const struct stat *input, const struct stat *output,
+                        int64_t streampos, uint32_t crc);
+static int check_records (uint32_t flags);
 static int convertsamples (MS3Record *msr, int packencoding);
 static int retired_encoding (int8_t encoding);
 static int parameter_proc (int argcount, char **argvec);
@@ -52,7 +106,7 @@ main (int argc, char **argv)
 {
   MS3Record *msr = 0;
   char *rawrec = NULL;
-  int retcode;
+  int retcode = MS_NOERROR;
   int reclen;
   uint32_t flags = 0;
 
@@ -60,260 +114,2422 @@ main (int argc, char **argv)
   int64_t packedrecords;
   uint64_t totalpackedsamples = 0;
   uint64_t totalpackedrecords = 0;
-  int bigendianhost = ms_bigendianhost ();
   int repackheaderV3 = 0;
+  char tmpfile[1024] = {0};
+
+  MS3FileParam *msfp = NULL;
+  char syncpath[1024] = {0};
+  const char *readpath;
+  struct stat inputstat;
+  struct stat syncinput;
+  struct stat syncoutput;
+  int64_t syncoutputsize = 0;
+  int64_t syncoffset = 0;
+  int64_t streampos = 0;
+  uint32_t synccrc = 0;
+  int syncmode = SYNC_FULL;
+  int exitcode = 0;
 
   /* Process given parameters (command line and parameter file) */
   if (parameter_proc (argc, argv) < 0)
     return -1;
 
-  /* Redirect libmseed logging facility to stderr and set error message prefix */
-  ms_loginit (print_stderr, NULL, print_stderr, "ERROR: ");
+  /* Redirect libmseed logging facility to stderr and set error message prefix */
+  ms_loginit (print_stderr, NULL, print_stderr, "ERROR: ");
+
+  /* Profile library memory allocation if requested */
+  if (memprofile && ms_memprofile_enable ())
+    return 1;
+
+  /* Set flags to validate CRCs, check for range in path names, and skip non-data */
+  flags |= MSF_VALIDATECRC;
+  flags |= MSF_PNAMERANGE;
+  flags |= MSF_SKIPNOTDATA;
+
+  /* Release input and output data from the page cache for one-pass bulk conversion */
+  if (nocache)
+    flags |= MSF_NOCACHE;
+
+  /* Export decoded samples as columns or envelopes instead of converting records */
+  if (columnbase || envelopeprefix)
+  {
+    retcode = export_tracelist (flags);
+
+    if (memprofile)
+      ms_memprofile_print ();
+
+    return (retcode) ? 1 : 0;
+  }
+
+  /* Verify records of the input file instead of converting */
+  if (checkreport)
+  {
+    retcode = check_records (flags);
+
+    if (memprofile)
+      ms_memprofile_print ();
+
+    return (retcode < 0) ? 1 : (retcode > 0) ? 2 : 0;
+  }
+
+  /* Determine which part of the input needs converting according to the sync manifest */
+  readpath = inputfile;
+
+  if (syncmanifest)
+  {
+    if ((syncmode = sync_plan (&syncinput, &syncoutput, &syncoffset, &synccrc)) < 0)
+      return 1;
+
+    if (syncmode == SYNC_SKIP)
+    {
+      if (verbose)
+        ms_log (1, "%s is unchanged, skipping conversion\n", inputfile);
+
+      /* Record a new modification time of unchanged content */
+      if (syncoffset > 0 && sync_update (&syncinput, &syncoutput, syncoffset, synccrc))
+        return 1;
+
+      return 0;
+    }
+
+    /* Convert only data appended since the previous conversion */
+    if (syncmode == SYNC_APPEND)
+    {
+      syncoutputsize = (int64_t)syncoutput.st_size;
+
+      snprintf (syncpath, sizeof (syncpath), "%s@%" PRId64, inputfile, syncoffset);
+      readpath = syncpath;
+
+      if (verbose)
+        ms_log (1, "%s has grown, converting from byte offset %" PRId64 "\n", inputfile, syncoffset);
+    }
+    else
+    {
+      synccrc = 0;
+    }
+  }
+
+  /* Update input file in place, or fall back to a rewrite via a temporary file */
+  if (inplace)
+  {
+    retcode = update_inplace (inputfile, flags);
+
+    if (retcode < 0)
+      return 1;
+    if (retcode == 0)
+      return 0;
+
+    snprintf (tmpfile, sizeof (tmpfile), "%s.tmp%ld", inputfile, (long)getpid ());
+    outputfile = tmpfile;
+
+    if (verbose)
+      ms_log (1, "Record lengths change, rewriting %s via %s\n", inputfile, tmpfile);
+  }
+
+  /* Open output file if specified, default is STDOUT unless publishing to a ring */
+  if (outputfile && strcmp (outputfile, "-"))
+  {
+    if ((outfile = fopen (outputfile, (syncmode == SYNC_APPEND) ? "ab" : "wb")) == NULL)
+    {
+      ms_log (2, "Cannot open output file: %s (%s)\n", outputfile, strerror (errno));
+
+      return 1;
+    }
+
+    /* Rewritten input retains its permissions when renamed over the original */
+    if (tmpfile[0] && (stat (inputfile, &inputstat) || fchmod (fileno (outfile), inputstat.st_mode & 07777)))
+    {
+      ms_log (2, "Cannot copy permissions of %s to %s (%s)\n", inputfile, tmpfile, strerror (errno));
+      fclose (outfile);
+      remove (tmpfile);
+
+      return 1;
+    }
+
+    /* Write in large sequential requests */
+    if (nocache)
+      setvbuf (outfile, NULL, _IOFBF, NOCACHE_BUFFERSIZE);
+
+    /* Appended records follow the existing output */
+    if (syncmode == SYNC_APPEND)
+      outfilewritten = outfilereleased = syncoutputsize;
+  }
+  else if (outputfile || !shmringname)
+  {
+    outfile = stdout;
+  }
+
+  /* Create or attach to shared memory ring if specified */
+  if (shmringname)
+  {
+    /* Remove an existing ring, attached readers keep the removed ring */
+    if (shmringreset && ms3_shmring_unlink (shmringname))
+      return 1;
+
+    if ((shmring = ms3_shmring_create (shmringname, shmringslots, shmringslotsize, verbose)) == NULL)
+    {
+      ms_log (2, "Cannot create shared memory ring: %s\n", shmringname);
+
+      return 1;
+    }
+  }
+
+  /* Coalesce records of each source ID into full records using worker threads */
+  if (coalesce)
+    retcode = (coalesce_records (flags)) ? MS_GENERROR : MS_ENDOFFILE;
+
+  /* Loop over the input file, records are converted independently */
+  while (!coalesce && (retcode = ms3_readmsr_r (&msfp, &msr, readpath, flags, verbose)) == MS_NOERROR)
+  {
+    if (verbose >= 1)
+      msr3_print (msr, verbose - 1);
+
+    /* Retain v2 sequence number of data quality indicator if input and output are v2.
+     * Setting these insertion values triggers them to be inserted post-record creation */
+    if (msr->formatversion == 2 && packversion == 2 && msr->record)
+    {
+      memcpy (insertV2seqnum, pMS2FSDH_SEQNUM (msr->record), 6);
+      insertV2dataquality = (packpubversion < 0) ? *pMS2FSDH_DATAQUALITY (msr->record) : 0;
+    }
+    else
+    {
+      insertV2seqnum[0]   = '\0';
+      insertV2dataquality = 0;
+    }
+
+    /* Determine if unpacking data is not needed when converting to version 3,
+     * encoded data in the wrong byte order are swapped by msr3_repack_mseed3() */
+    repackheaderV3 = 0;
+
+    if (forcerepack == 0 && packversion == 3 &&
+        (packencoding < 0 || packencoding == msr->encoding))
+    {
+      if (msr->encoding == DE_STEIM1 || msr->encoding == DE_STEIM2 ||
+          msr->encoding == DE_INT16 || msr->encoding == DE_INT32 ||
+          msr->encoding == DE_FLOAT32 || msr->encoding == DE_FLOAT64 ||
+          msr->encoding == DE_TEXT)
+        repackheaderV3 = 1;
+    }
+
+    /* Apply publication version and merge patch to extra headers */
+    if (apply_header_changes (msr))
+      break;
+
+    /* Avoid re-packing of data payload if not needed for version 3 output */
+    if (packversion == 3 && (repackheaderV3 || msr->samplecnt == 0))
+    {
+      if (verbose)
+        ms_log (1, "Re-packing record without re-packing encoded data payload\n");
+
+      if (!rawrec && (rawrec = (char *)malloc (MAXRECLEN)) == NULL)
+      {
+        ms_log (2, "Cannot allocate memory for record buffer\n");
+        break;
+      }
+
+      /* Re-packed a parsed record into a version 3 header using raw encoded data */
+      reclen = msr3_repack_mseed3 (msr, rawrec, MAXRECLEN, verbose);
+
+      if (reclen < 0)
+      {
+        ms_log (2, "%s: Cannot repack record\n", msr->sid);
+        break;
+      }
+
+      record_handler (rawrec, reclen, NULL);
+
+      packedsamples = msr->samplecnt;
+      packedrecords = 1;
+    }
+    /* Otherwise, unpack samples and repack record */
+    else
+    {
+      if (verbose)
+        ms_log (1, "Re-packing record with decoded data\n");
+
+      msr->numsamples = msr3_unpack_data (msr, verbose);
+
+      if (msr->numsamples < 0)
+      {
+        ms_log (2, "%s: Cannot unpack data samples\n", msr->sid);
+        break;
+      }
+
+      msr->formatversion = packversion;
+
+      if (packreclen >= 0)
+        msr->reclen = packreclen;
+      else if (msr->formatversion == 3 && shmring)
+        msr->reclen = shmringslotsize;
+      else if (msr->formatversion == 3)
+        msr->reclen = MAXRECLEN;
+
+      if (retired_encoding ((packencoding >= 0) ? packencoding : msr->encoding))
+      {
+        ms_log (2, "Packing for encoding %d not allowed, specify supported encoding with -E\n",
+                msr->encoding);
+        break;
+      }
+
+      /* Convert sample type as needed for packencoding */
+      if (packencoding >= 0 && msr->encoding != packencoding)
+      {
+        if (convertsamples (msr, packencoding))
+        {
+          ms_log (2, "Cannot convert samples for encoding %d\n", packencoding);
+          break;
+        }
+      }
+
+      if (packencoding >= 0)
+        msr->encoding = packencoding;
+
+      packedrecords = msr3_pack (msr, &record_handler, NULL, &packedsamples, MSF_FLUSHDATA, verbose);
+    }
+
+    if (packedrecords == -1)
+      ms_log (2, "Cannot pack records\n");
+    else if (verbose >= 2)
+      ms_log (1, "Packed %" PRId64 " records\n", packedrecords);
+
+    totalpackedrecords += packedrecords;
+    totalpackedsamples += packedsamples;
+  }
+
+  if (retcode != MS_ENDOFFILE && !coalesce)
+    ms_log (2, "Error reading %s: %s\n", inputfile, ms_errorstr (retcode));
+
+  if (verbose && !coalesce)
+    ms_log (0, "Packed %" PRIu64 " samples into %" PRIu64 " records\n",
+            totalpackedsamples, totalpackedrecords);
+
+  /* Make sure everything is cleaned up, retaining the end of the data read */
+  if (msfp)
+    streampos = msfp->streampos;
+
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+
+  if (memprofile)
+    ms_memprofile_print ();
+
+  if (rawrec)
+    free (rawrec);
+
+  if (outfile)
+  {
+    if (nocache && outfile != stdout)
+      lmp_fdropcache (outfile, 0, 0, 1);
+
+    fclose (outfile);
+  }
+
+  /* Replace input file with rewritten version */
+  if (tmpfile[0])
+  {
+    if (retcode != MS_ENDOFFILE)
+    {
+      ms_log (2, "Leaving %s unchanged, removing %s\n", inputfile, tmpfile);
+      remove (tmpfile);
+    }
+    else if (rename (tmpfile, inputfile))
+    {
+      ms_log (2, "Cannot rename %s to %s (%s)\n", tmpfile, inputfile, strerror (errno));
+    }
+  }
+
+  /* Record the converted input in the sync manifest */
+  if (syncmanifest)
+  {
+    if (retcode == MS_ENDOFFILE)
+    {
+      if (stat (outputfile, &syncoutput))
+      {
+        ms_log (2, "Cannot stat %s (%s)\n", outputfile, strerror (errno));
+        retcode = MS_GENERROR;
+      }
+      else if (hash_file (inputfile, syncoffset, streampos, &synccrc) ||
+               sync_update (&syncinput, &syncoutput, streampos, synccrc))
+      {
+        retcode = MS_GENERROR;
+      }
+    }
+
+    if (retcode != MS_ENDOFFILE)
+    {
+      ms_log (2, "Not updating sync manifest %s\n", syncmanifest);
+
+      /* Remove partially appended output, the next run appends it again */
+      if (syncmode == SYNC_APPEND && truncate (outputfile, syncoutputsize))
+        ms_log (2, "Cannot truncate %s (%s)\n", outputfile, strerror (errno));
+
+      exitcode = 1;
+    }
+
+    yyjson_mut_doc_free (syncdoc);
+  }
+
+  if (shmring)
+    ms3_shmring_close (&shmring);
+
+  if (extraheaderpatch)
+    free (extraheaderpatch);
+
+  return exitcode;
+} /* End of main() */
+
+/***************************************************************************
+ * extraheader_init:
+ *
+ * Validate extra header merge patch by reading specified file and
+ * parsing the JSON, and re-serializing in preparation for merge patch.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+extraheader_init (char *file)
+{
+  yyjson_doc *doc;
+  yyjson_read_flag rflg = YYJSON_READ_NOFLAG;
+  yyjson_read_err rerr;
+  yyjson_write_flag wflg = YYJSON_WRITE_NOFLAG;
+  yyjson_write_err werr;
+
+  doc = yyjson_read_file (file, rflg, NULL, &rerr);
+
+  if (doc == NULL)
+  {
+    ms_log (2, "Cannot read JSON file %s: (%u) %s at position: %ld\n",
+            file, rerr.code, rerr.msg, rerr.pos);
+    return -1;
+  }
+
+  extraheaderpatch = yyjson_write_opts (doc, wflg, NULL, NULL, &werr);
+
+  yyjson_doc_free (doc);
+
+  if (extraheaderpatch == NULL)
+  {
+    ms_log (2, "Cannot serialize extra header JSON: (%u) %s\n",
+            werr.code, werr.msg);
+    return -1;
+  }
+
+  return 0;
+} /* End of extraheader_init() */
+
+/***************************************************************************
+ * apply_header_changes:
+ *
+ * Apply the specified publication version and extra header merge patch
+ * to a record.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+apply_header_changes (MS3Record *msr)
+{
+  if (packpubversion >= 0)
+    msr->pubversion = (uint8_t)packpubversion;
+
+  if (!extraheaderpatch)
+    return 0;
+
+  /* Allocate empty object container if no headers present */
+  if (msr->extra == NULL)
+  {
+    if ((msr->extra = libmseed_memory.malloc (2)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+    msr->extralength = 2;
+    memcpy (msr->extra, "{}", 2);
+  }
+
+  /* Apply merge patch at root of container */
+  if (mseh_set_ptr_r (msr, "", extraheaderpatch, 'M', NULL))
+  {
+    ms_log (2, "Cannot apply merge patch to extra headers\n");
+    return -1;
+  }
+
+  /* Remove empty headers container */
+  if (!strncmp (msr->extra, "{}", msr->extralength))
+  {
+    libmseed_memory.free (msr->extra);
+    msr->extra       = NULL;
+    msr->extralength = 0;
+  }
+
+  return 0;
+} /* End of apply_header_changes() */
+
+/***************************************************************************
+ * export_tracelist:
+ *
+ * Read the input file into a trace list with decoded samples and
+ * export each segment as a column of little-endian samples to
+ * <columnbase>.dat with an index of the columns in <columnbase>.idx,
+ * and/or min/max envelopes of each source ID to <envelopeprefix><SID>.env.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+export_tracelist (uint32_t flags)
+{
+  MS3TraceList *mstl = NULL;
+  char datafile[1024];
+  char indexfile[1024];
+  int64_t columns = 0;
+  int64_t envelopes = 0;
+  int retcode;
+
+  retcode = ms3_readtracelist (&mstl, inputfile, NULL, 0, flags | MSF_UNPACKDATA, verbose);
+
+  if (retcode != MS_NOERROR)
+  {
+    ms_log (2, "Error reading %s: %s\n", inputfile, ms_errorstr (retcode));
+    mstl3_free (&mstl, 0);
+    return -1;
+  }
+
+  if (columnbase)
+  {
+    snprintf (datafile, sizeof (datafile), "%s.dat", columnbase);
+    snprintf (indexfile, sizeof (indexfile), "%s.idx", columnbase);
+
+    columns = mstl3_export_columns (mstl, datafile, indexfile, threads, verbose);
+
+    if (columns >= 0 && verbose)
+      ms_log (0, "Exported %" PRId64 " columns to %s, index in %s\n",
+              columns, datafile, indexfile);
+  }
+
+  if (envelopeprefix && columns >= 0)
+  {
+    envelopes = mstl3_export_envelopes (mstl, envelopeprefix, envelopebucket, verbose);
+
+    if (envelopes >= 0 && verbose)
+      ms_log (0, "Exported %" PRId64 " envelope files to %s*.env\n",
+              envelopes, envelopeprefix);
+  }
+
+  mstl3_free (&mstl, 0);
+
+  return (columns < 0 || envelopes < 0) ? -1 : 0;
+} /* End of export_tracelist() */
+
+/* Number of records routed to a coalescing worker at a time */
+#define COALESCE_BATCH 64
+
+/* Maximum number of batches queued for each coalescing worker */
+#define COALESCE_QUEUE 4
+
+/* Number of records read between writing completed time buckets */
+#define COALESCE_FLUSH 65536
+
+/* Time span of the output buckets, records are ordered by source ID within a bucket */
+#define COALESCE_BUCKET ((nstime_t)3600 * NSTMODULUS)
+
+/* Batch of raw records routed to a coalescing worker */
+typedef struct CoalesceBatch
+{
+  char *buffer;
+  size_t used;
+  size_t size;
+  int reclen[COALESCE_BATCH];
+  int count;
+  struct CoalesceBatch *next;
+} CoalesceBatch;
+
+/* Packed output record of a coalescing worker */
+typedef struct CoalesceRecord
+{
+  char sid[LM_SIDLEN];
+  int64_t bucket;
+  nstime_t starttime;
+  uint64_t sequence;
+  int reclen;
+  char *record;
+} CoalesceRecord;
+
+/* Coalescing worker, owning the trace lists of the source IDs routed to it */
+typedef struct CoalesceWorker
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  CoalesceBatch *head;
+  CoalesceBatch *tail;
+  int queued;
+  int active;
+  int done;
+  int error;
+  MS3TraceList *mstl[DE_STEIM2 + 1]; /* Trace list per output encoding */
+  MS3Record *parsed;
+  CoalesceRecord *records;           /* Packed records not yet written */
+  uint64_t recordcount;
+  uint64_t recordsize;
+  uint64_t packedrecords;
+  int64_t packedsamples;
+  int reclen;
+  uint32_t packflags;
+  char *extra;
+} CoalesceWorker;
+
+/***************************************************************************
+ * coalesce_bucket:
+ *
+ * Return the index of the output bucket containing a time.
+ ***************************************************************************/
+static int64_t
+coalesce_bucket (nstime_t time)
+{
+  if (time >= 0)
+    return time / COALESCE_BUCKET;
+
+  return -((-time + COALESCE_BUCKET - 1) / COALESCE_BUCKET);
+} /* End of coalesce_bucket() */
+
+/***************************************************************************
+ * coalesce_collect:
+ *
+ * Record handler for coalescing workers, keeps a copy of each packed
+ * record with the source ID and start time for ordering.
+ ***************************************************************************/
+static void
+coalesce_collect (char *record, int reclen, void *handlerdata)
+{
+  CoalesceWorker *worker = (CoalesceWorker *)handlerdata;
+  CoalesceRecord *entry;
+  CoalesceRecord *records;
+
+  if (worker->error)
+    return;
+
+  if (worker->recordcount == worker->recordsize)
+  {
+    worker->recordsize = (worker->recordsize) ? worker->recordsize * 2 : 1024;
+
+    if ((records = (CoalesceRecord *)realloc (worker->records,
+                                              worker->recordsize * sizeof (CoalesceRecord))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for packed records\n");
+      worker->error = 1;
+      return;
+    }
+
+    worker->records = records;
+  }
+
+  if (msr3_parse (record, reclen, &worker->parsed, 0, 0) != MS_NOERROR)
+  {
+    ms_log (2, "Cannot parse packed record\n");
+    worker->error = 1;
+    return;
+  }
+
+  entry = &worker->records[worker->recordcount];
+
+  if ((entry->record = (char *)malloc (reclen)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for packed record\n");
+    worker->error = 1;
+    return;
+  }
+
+  memcpy (entry->record, record, reclen);
+  memcpy (entry->sid, worker->parsed->sid, sizeof (entry->sid));
+  entry->starttime = worker->parsed->starttime;
+  entry->bucket    = coalesce_bucket (entry->starttime);
+  entry->sequence  = worker->packedrecords;
+  entry->reclen    = reclen;
+
+  worker->recordcount++;
+  worker->packedrecords++;
+} /* End of coalesce_collect() */
+
+/***************************************************************************
+ * coalesce_segment:
+ *
+ * Pack the samples of a segment with the record template 'msr', only
+ * full records unless MSF_FLUSHDATA is included in flags, and remove
+ * the packed samples from the segment, as by mstl3_pack().  Empty
+ * segments are skipped, as packing them would produce records without
+ * samples.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+coalesce_segment (CoalesceWorker *worker, MS3Record *msr, MS3TraceID *id, MS3TraceSeg *seg,
+                  int encoding, uint32_t flags)
+{
+  int64_t packedsamples = 0;
+  size_t samplesize;
+
+  if (seg->numsamples <= 0)
+    return 0;
+
+  memcpy (msr->sid, id->sid, sizeof (msr->sid));
+  msr->pubversion  = id->pubversion;
+  msr->starttime   = seg->starttime;
+  msr->samprate    = seg->samprate;
+  msr->samplecnt   = seg->samplecnt;
+  msr->datasamples = seg->datasamples;
+  msr->numsamples  = seg->numsamples;
+  msr->sampletype  = seg->sampletype;
+
+  /* Set encoding for data types with only one encoding, as by mstl3_pack() */
+  switch (seg->sampletype)
+  {
+  case 't':
+    msr->encoding = DE_TEXT;
+    break;
+  case 'f':
+    msr->encoding = DE_FLOAT32;
+    break;
+  case 'd':
+    msr->encoding = DE_FLOAT64;
+    break;
+  default:
+    msr->encoding = encoding;
+  }
+
+  if (msr3_pack (msr, coalesce_collect, worker, &packedsamples,
+                 worker->packflags | flags, verbose) < 0 || worker->error)
+  {
+    worker->error = 1;
+    return -1;
+  }
+
+  if (packedsamples <= 0)
+    return 0;
+
+  worker->packedsamples += packedsamples;
+
+  /* Segment is left empty at its end when all samples are packed */
+  if (packedsamples == seg->numsamples)
+  {
+    libmseed_memory.free (seg->datasamples);
+    seg->datasamples = NULL;
+    seg->datasize    = 0;
+    seg->starttime   = seg->endtime;
+  }
+  else
+  {
+    samplesize     = ms_samplesize (seg->sampletype);
+    seg->starttime = ms_sampletime (seg->starttime, packedsamples, seg->samprate);
+
+    memmove (seg->datasamples, (char *)seg->datasamples + (size_t)packedsamples * samplesize,
+             (size_t)(seg->numsamples - packedsamples) * samplesize);
+  }
+
+  seg->samplecnt -= packedsamples;
+  seg->numsamples -= packedsamples;
+
+  return 0;
+} /* End of coalesce_segment() */
+
+/***************************************************************************
+ * coalesce_pack:
+ *
+ * Pack the trace lists of a coalescing worker, only full records
+ * unless MSF_FLUSHDATA is included in flags.
+ *
+ * If 'newest' is set, instead pack all remaining samples of segments
+ * that end at least a bucket span before the latest data of the same
+ * source ID, and of the last segment of source IDs whose latest data
+ * is at least a bucket span before 'newest', the latest data of all
+ * source IDs.  Input of each source ID is expected in time order, so
+ * these segments will not grow and their last, partial record would
+ * otherwise be held until the end of input.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+coalesce_pack (CoalesceWorker *worker, uint32_t flags, nstime_t newest)
+{
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  MS3Record *msr;
+  int encoding;
+
+  if ((msr = msr3_init (NULL)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for record\n");
+    return -1;
+  }
+
+  msr->reclen = worker->reclen;
+
+  if (worker->extra)
+  {
+    msr->extra       = worker->extra;
+    msr->extralength = (uint16_t)strlen (worker->extra);
+  }
+
+  for (encoding = 0; encoding <= DE_STEIM2 && !worker->error; encoding++)
+  {
+    if (!worker->mstl[encoding])
+      continue;
+
+    for (id = worker->mstl[encoding]->traces.next[0]; id && !worker->error; id = id->next[0])
+    {
+      for (seg = id->first; seg && !worker->error; seg = seg->next)
+      {
+        if (newest == NSTUNSET)
+        {
+          coalesce_segment (worker, msr, id, seg, encoding, flags);
+        }
+        /* The last segment may grow until the source ID is quiet */
+        else if (seg == id->last)
+        {
+          if (id->latest <= newest - COALESCE_BUCKET)
+            coalesce_segment (worker, msr, id, seg, encoding, MSF_FLUSHDATA);
+        }
+        else if (seg->endtime <= id->latest - COALESCE_BUCKET)
+        {
+          coalesce_segment (worker, msr, id, seg, encoding, MSF_FLUSHDATA);
+        }
+      }
+    }
+  }
+
+  msr->datasamples = NULL;
+  msr->extra       = NULL;
+  msr3_free (&msr);
+
+  return (worker->error) ? -1 : 0;
+} /* End of coalesce_pack() */
+
+/***************************************************************************
+ * coalesce_add:
+ *
+ * Decode a raw record, convert samples for the pack encoding and add
+ * it to the trace list of a coalescing worker.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+coalesce_add (CoalesceWorker *worker, MS3Record **ppmsr, char *record, int reclen)
+{
+  MS3Record *msr;
+  int encoding;
+
+  if (msr3_parse (record, reclen, ppmsr, MSF_UNPACKDATA, verbose) != MS_NOERROR)
+  {
+    ms_log (2, "Cannot parse and decode record\n");
+    return -1;
+  }
+
+  msr      = *ppmsr;
+  encoding = (packencoding >= 0) ? packencoding : msr->encoding;
+
+  if (encoding < 0 || encoding > DE_STEIM2 || retired_encoding (encoding))
+  {
+    ms_log (2, "Packing for encoding %d not allowed, specify supported encoding with -E\n",
+            encoding);
+    return -1;
+  }
+
+  if (msr->encoding != encoding && convertsamples (msr, encoding))
+  {
+    ms_log (2, "Cannot convert samples for encoding %d\n", encoding);
+    return -1;
+  }
+
+  if (packpubversion >= 0)
+    msr->pubversion = (uint8_t)packpubversion;
+
+  if (!worker->mstl[encoding] && (worker->mstl[encoding] = mstl3_init (NULL)) == NULL)
+  {
+    ms_log (2, "Cannot allocate trace list\n");
+    return -1;
+  }
+
+  if (mstl3_addmsr (worker->mstl[encoding], msr, 0, 1, 0, NULL) == NULL)
+  {
+    ms_log (2, "%s: Cannot add record to trace list\n", msr->sid);
+    return -1;
+  }
+
+  return 0;
+} /* End of coalesce_add() */
+
+/***************************************************************************
+ * coalesce_worker:
+ *
+ * Thread function of a coalescing worker: add records of each routed
+ * batch to the trace lists and pack full records, flushing all
+ * remaining data when the input is done.
+ ***************************************************************************/
+static void *
+coalesce_worker (void *arg)
+{
+  CoalesceWorker *worker = (CoalesceWorker *)arg;
+  CoalesceBatch *batch;
+  MS3Record *msr = NULL;
+  size_t offset;
+  int idx;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&worker->lock);
+    while (!worker->head && !worker->done)
+      pthread_cond_wait (&worker->cond, &worker->lock);
+
+    if ((batch = worker->head) != NULL)
+    {
+      worker->head = batch->next;
+      if (!worker->head)
+        worker->tail = NULL;
+      worker->queued--;
+      worker->active = 1;
+      pthread_cond_broadcast (&worker->cond);
+    }
+    pthread_mutex_unlock (&worker->lock);
+
+    if (!batch)
+      break;
+
+    for (idx = 0, offset = 0; idx < batch->count && !worker->error; idx++)
+    {
+      if (coalesce_add (worker, &msr, batch->buffer + offset, batch->reclen[idx]))
+        worker->error = 1;
+
+      offset += batch->reclen[idx];
+    }
+
+    free (batch->buffer);
+    free (batch);
+
+    if (!worker->error && coalesce_pack (worker, 0, NSTUNSET))
+      worker->error = 1;
+
+    pthread_mutex_lock (&worker->lock);
+    worker->active = 0;
+    pthread_cond_broadcast (&worker->cond);
+    pthread_mutex_unlock (&worker->lock);
+  }
+
+  if (!worker->error && coalesce_pack (worker, MSF_FLUSHDATA, NSTUNSET))
+    worker->error = 1;
+
+  msr3_free (&msr);
+
+  return NULL;
+} /* End of coalesce_worker() */
+
+/***************************************************************************
+ * coalesce_queue:
+ *
+ * Queue a batch for a coalescing worker, waiting while the worker
+ * queue is full.
+ ***************************************************************************/
+static void
+coalesce_queue (CoalesceWorker *worker, CoalesceBatch *batch)
+{
+  pthread_mutex_lock (&worker->lock);
+  while (worker->queued >= COALESCE_QUEUE)
+    pthread_cond_wait (&worker->cond, &worker->lock);
+
+  if (worker->tail)
+    worker->tail->next = batch;
+  else
+    worker->head = batch;
+  worker->tail = batch;
+  worker->queued++;
+
+  pthread_cond_broadcast (&worker->cond);
+  pthread_mutex_unlock (&worker->lock);
+} /* End of coalesce_queue() */
+
+/***************************************************************************
+ * coalesce_drain:
+ *
+ * Wait until a coalescing worker has processed all queued batches.
+ ***************************************************************************/
+static void
+coalesce_drain (CoalesceWorker *worker)
+{
+  pthread_mutex_lock (&worker->lock);
+  while (worker->queued > 0 || worker->active)
+    pthread_cond_wait (&worker->cond, &worker->lock);
+  pthread_mutex_unlock (&worker->lock);
+} /* End of coalesce_drain() */
+
+/***************************************************************************
+ * coalesce_compare:
+ *
+ * qsort() comparison of packed records by time bucket, source ID,
+ * start time and packing sequence.
+ ***************************************************************************/
+static int
+coalesce_compare (const void *a, const void *b)
+{
+  const CoalesceRecord *ra = (const CoalesceRecord *)a;
+  const CoalesceRecord *rb = (const CoalesceRecord *)b;
+  int cmp;
+
+  if (ra->bucket != rb->bucket)
+    return (ra->bucket < rb->bucket) ? -1 : 1;
+
+  if ((cmp = strcmp (ra->sid, rb->sid)))
+    return cmp;
+
+  if (ra->starttime != rb->starttime)
+    return (ra->starttime < rb->starttime) ? -1 : 1;
+
+  if (ra->sequence != rb->sequence)
+    return (ra->sequence < rb->sequence) ? -1 : 1;
+
+  return 0;
+} /* End of coalesce_compare() */
+
+/***************************************************************************
+ * coalesce_write:
+ *
+ * Write the packed records of all workers in time buckets before
+ * 'bucket', or all records if 'bucket' is INT64_MAX, in order of
+ * bucket, source ID and time.  Workers must be idle.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+coalesce_write (CoalesceWorker *workers, int count, int64_t bucket)
+{
+  CoalesceRecord *ordered;
+  uint64_t total = 0;
+  uint64_t index;
+  uint64_t kept;
+  int idx;
+
+  for (idx = 0; idx < count; idx++)
+    for (index = 0; index < workers[idx].recordcount; index++)
+      if (workers[idx].records[index].bucket < bucket)
+        total++;
+
+  if (total == 0)
+    return 0;
+
+  if ((ordered = (CoalesceRecord *)malloc (total * sizeof (CoalesceRecord))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for record ordering\n");
+    return -1;
+  }
+
+  /* Move records of completed buckets, keeping the others in order */
+  for (idx = 0, total = 0; idx < count; idx++)
+  {
+    for (index = 0, kept = 0; index < workers[idx].recordcount; index++)
+    {
+      if (workers[idx].records[index].bucket < bucket)
+        ordered[total++] = workers[idx].records[index];
+      else
+        workers[idx].records[kept++] = workers[idx].records[index];
+    }
+
+    workers[idx].recordcount = kept;
+  }
+
+  qsort (ordered, total, sizeof (CoalesceRecord), coalesce_compare);
+
+  for (index = 0; index < total; index++)
+  {
+    record_handler (ordered[index].record, ordered[index].reclen, NULL);
+    free (ordered[index].record);
+  }
+
+  free (ordered);
+
+  return 0;
+} /* End of coalesce_write() */
+
+/***************************************************************************
+ * coalesce_flush:
+ *
+ * Queue the partial batches and wait for all workers to process them,
+ * pack segments that will not grow, then write the records of all time
+ * buckets that are complete.  A bucket is complete when the remaining
+ * data of every source ID starts after it, as each source ID is
+ * expected in time order.  Source IDs without data for a bucket span
+ * before the newest data read are quiet, their segments are packed
+ * and they do not hold back writing.  As the flushes happen at fixed
+ * points of the input the output does not depend on the number of
+ * workers.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+coalesce_flush (CoalesceWorker *workers, CoalesceBatch **batches, int count)
+{
+  MS3TraceID *id;
+  MS3TraceSeg *seg;
+  nstime_t watermark = NSTUNSET;
+  nstime_t newest = NSTUNSET;
+  nstime_t remaining;
+  uint64_t written = 0;
+  int encoding;
+  int idx;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    if (batches[idx])
+    {
+      coalesce_queue (&workers[idx], batches[idx]);
+      batches[idx] = NULL;
+    }
+  }
+
+  for (idx = 0; idx < count; idx++)
+  {
+    coalesce_drain (&workers[idx]);
+
+    if (workers[idx].error)
+      return -1;
+  }
+
+  /* Latest data of all source IDs, workers are idle */
+  for (idx = 0; idx < count; idx++)
+    for (encoding = 0; encoding <= DE_STEIM2; encoding++)
+      if (workers[idx].mstl[encoding])
+        for (id = workers[idx].mstl[encoding]->traces.next[0]; id; id = id->next[0])
+          if (newest == NSTUNSET || id->latest > newest)
+            newest = id->latest;
+
+  if (newest == NSTUNSET)
+    return 0;
+
+  /* Pack segments that will not grow */
+  for (idx = 0; idx < count; idx++)
+    if (coalesce_pack (&workers[idx], 0, newest))
+      return -1;
+
+  /* Earliest start of the remaining data of any source ID that is not quiet */
+  for (idx = 0; idx < count; idx++)
+  {
+    for (encoding = 0; encoding <= DE_STEIM2; encoding++)
+    {
+      if (!workers[idx].mstl[encoding])
+        continue;
+
+      for (id = workers[idx].mstl[encoding]->traces.next[0]; id; id = id->next[0])
+      {
+        remaining = (id->latest > newest - COALESCE_BUCKET) ? id->latest : NSTUNSET;
+
+        for (seg = id->first; seg; seg = seg->next)
+          if (seg->numsamples > 0 && (remaining == NSTUNSET || seg->starttime < remaining))
+            remaining = seg->starttime;
+
+        if (remaining != NSTUNSET && (watermark == NSTUNSET || remaining < watermark))
+          watermark = remaining;
+      }
+    }
+  }
+
+  if (watermark == NSTUNSET)
+    return 0;
+
+  for (idx = 0; idx < count; idx++)
+    written += workers[idx].recordcount;
+
+  if (coalesce_write (workers, count, coalesce_bucket (watermark)))
+    return -1;
+
+  for (idx = 0; idx < count; idx++)
+    written -= workers[idx].recordcount;
+
+  if (verbose)
+    ms_log (0, "Wrote %" PRIu64 " coalesced records of completed time buckets\n", written);
+
+  return 0;
+} /* End of coalesce_flush() */
+
+/***************************************************************************
+ * coalesce_records:
+ *
+ * Read the input file and route records by a hash of the source ID to
+ * a fixed set of worker threads.  Each worker decodes its records into
+ * private trace lists and packs full records.  Packed records are
+ * written in time buckets, in order of source ID and time within each
+ * bucket, as soon as all source IDs have data beyond the bucket, and
+ * all remaining records when the input is done.
+ *
+ * Extra headers of input records are not retained as data from many
+ * records are combined, the extra header patch (-eh) is applied to an
+ * empty container and added to all records.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+coalesce_records (uint32_t flags)
+{
+  CoalesceWorker *workers = NULL;
+  CoalesceBatch **batches = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *extramsr = NULL;
+  uint64_t totalrecords = 0;
+  uint64_t totalsamples = 0;
+  uint64_t routed = 0;
+  uint64_t index;
+  uint32_t hash;
+  size_t size;
+  char *buffer;
+  const char *cp;
+  int encoding;
+  int reclen;
+  int retcode;
+  int workercount;
+  int started = 0;
+  int error = 0;
+  int idx;
+
+  workercount = (threads > 0) ? threads : (int)sysconf (_SC_NPROCESSORS_ONLN);
+  if (workercount < 1)
+    workercount = 1;
+
+  /* Extra headers for all records from the patch applied to an empty container */
+  if (extraheaderpatch)
+  {
+    if ((extramsr = msr3_init (NULL)) == NULL || apply_header_changes (extramsr))
+    {
+      msr3_free (&extramsr);
+      return -1;
+    }
+  }
+
+  /* Record length as used for independent conversion */
+  if (packreclen >= 0)
+    reclen = packreclen;
+  else if (packversion == 3 && shmring)
+    reclen = shmringslotsize;
+  else
+    reclen = -1;
+
+  if ((workers = (CoalesceWorker *)calloc (workercount, sizeof (CoalesceWorker))) == NULL ||
+      (batches = (CoalesceBatch **)calloc (workercount, sizeof (CoalesceBatch *))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for workers\n");
+    free (workers);
+    msr3_free (&extramsr);
+    return -1;
+  }
+
+  for (idx = 0; idx < workercount; idx++)
+  {
+    workers[idx].reclen    = reclen;
+    workers[idx].packflags = (packversion == 2) ? MSF_PACKVER2 : 0;
+    workers[idx].extra     = (extramsr) ? extramsr->extra : NULL;
+
+    pthread_mutex_init (&workers[idx].lock, NULL);
+    pthread_cond_init (&workers[idx].cond, NULL);
+  }
+
+  for (idx = 0; idx < workercount; idx++)
+  {
+    if (pthread_create (&workers[idx].thread, NULL, coalesce_worker, &workers[idx]))
+    {
+      ms_log (2, "Cannot create worker thread\n");
+      error = 1;
+      break;
+    }
+
+    started++;
+  }
+
+  if (verbose)
+    ms_log (1, "Coalescing records with %d worker threads\n", started);
+
+  /* Route raw records to workers by source ID, in batches */
+  while (!error && (retcode = ms3_readmsr (&msr, inputfile, flags, verbose)) == MS_NOERROR)
+  {
+    if (verbose >= 1)
+      msr3_print (msr, verbose - 1);
+
+    /* FNV-1a hash of source ID */
+    hash = 2166136261u;
+    for (cp = msr->sid; *cp; cp++)
+      hash = (hash ^ (uint8_t)*cp) * 16777619u;
+
+    idx = hash % started;
+
+    if (!batches[idx] && (batches[idx] = (CoalesceBatch *)calloc (1, sizeof (CoalesceBatch))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for record batch\n");
+      error = 1;
+      break;
+    }
+
+    if (batches[idx]->used + msr->reclen > batches[idx]->size)
+    {
+      size = (batches[idx]->size) ? batches[idx]->size * 2 : (size_t)msr->reclen * COALESCE_BATCH;
+      while (size < batches[idx]->used + msr->reclen)
+        size *= 2;
+
+      if ((buffer = (char *)realloc (batches[idx]->buffer, size)) == NULL)
+      {
+        ms_log (2, "Cannot allocate memory for record batch\n");
+        error = 1;
+        break;
+      }
+
+      batches[idx]->buffer = buffer;
+      batches[idx]->size   = size;
+    }
+
+    memcpy (batches[idx]->buffer + batches[idx]->used, msr->record, msr->reclen);
+    batches[idx]->reclen[batches[idx]->count++] = msr->reclen;
+    batches[idx]->used += msr->reclen;
+
+    if (batches[idx]->count == COALESCE_BATCH)
+    {
+      coalesce_queue (&workers[idx], batches[idx]);
+      batches[idx] = NULL;
+    }
+
+    /* Write completed time buckets */
+    if (++routed % COALESCE_FLUSH == 0 && coalesce_flush (workers, batches, started))
+      error = 1;
+  }
+
+  if (!error && retcode != MS_ENDOFFILE)
+  {
+    ms_log (2, "Error reading %s: %s\n", inputfile, ms_errorstr (retcode));
+    error = 1;
+  }
+
+  ms3_readmsr (&msr, NULL, 0, 0);
+
+  /* Queue partial batches, signal completion and wait for workers */
+  for (idx = 0; idx < started; idx++)
+  {
+    if (batches[idx])
+    {
+      if (!error)
+      {
+        coalesce_queue (&workers[idx], batches[idx]);
+      }
+      else
+      {
+        free (batches[idx]->buffer);
+        free (batches[idx]);
+      }
+    }
+
+    pthread_mutex_lock (&workers[idx].lock);
+    workers[idx].done = 1;
+    pthread_cond_broadcast (&workers[idx].cond);
+    pthread_mutex_unlock (&workers[idx].lock);
+  }
+
+  for (idx = 0; idx < started; idx++)
+  {
+    pthread_join (workers[idx].thread, NULL);
+
+    if (workers[idx].error)
+      error = 1;
+
+    totalrecords += workers[idx].packedrecords;
+    totalsamples += workers[idx].packedsamples;
+  }
+
+  /* Write remaining packed records of all workers */
+  if (!error && coalesce_write (workers, started, INT64_MAX))
+    error = 1;
+
+  if (verbose)
+    ms_log (0, "Packed %" PRIu64 " samples into %" PRIu64 " records\n",
+            totalsamples, totalrecords);
+
+  for (idx = 0; idx < workercount; idx++)
+  {
+    for (index = 0; index < workers[idx].recordcount; index++)
+      free (workers[idx].records[index].record);
+    free (workers[idx].records);
+
+    for (encoding = 0; encoding <= DE_STEIM2; encoding++)
+      if (workers[idx].mstl[encoding])
+        mstl3_free (&workers[idx].mstl[encoding], 0);
+
+    msr3_free (&workers[idx].parsed);
+    pthread_mutex_destroy (&workers[idx].lock);
+    pthread_cond_destroy (&workers[idx].cond);
+  }
+
+  free (workers);
+  free (batches);
+  msr3_free (&extramsr);
+
+  return (error) ? -1 : 0;
+} /* End of coalesce_records() */
+
+/***************************************************************************
+ * update_inplace:
+ *
+ * Apply header changes to each record of a version 3 file in place.
+ * Each record header is re-packed with msr3_pack_header3(), the CRC
+ * is re-calculated over the new header and existing data payload and
+ * only the changed header bytes are written back to the file.
+ *
+ * The file is first scanned without writing.  If any record is not
+ * version 3 or would change length, or the file cannot be read, the
+ * file is left unchanged.  Otherwise the headers are written in a
+ * second pass.
+ *
+ * Returns 0 on success, 1 if a full rewrite is needed and -1 on failure
+ ***************************************************************************/
+static int
+update_inplace (const char *path, uint32_t flags)
+{
+  char *header = NULL;
+  size_t headersize = MS3FSDH_LENGTH + UINT8_MAX + UINT16_MAX;
+  int fd;
+  int rv;
+  uint64_t updatedrecords = 0;
+  uint64_t totalrecords = 0;
+
+  if ((fd = open (path, O_RDWR)) < 0)
+  {
+    ms_log (2, "Cannot open %s for updating (%s)\n", path, strerror (errno));
+    return -1;
+  }
+
+  if ((header = (char *)malloc (headersize)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for header buffer\n");
+    close (fd);
+    return -1;
+  }
+
+  /* Scan all records, writing nothing, then write the changed headers */
+  if ((rv = update_records (path, flags, -1, header, headersize, &updatedrecords, &totalrecords)) == 0)
+  {
+    if ((rv = update_records (path, flags, fd, header, headersize, &updatedrecords, &totalrecords)))
+    {
+      ms_log (2, "%s is partially updated\n", path);
+      rv = -1;
+    }
+  }
+
+  if (verbose && rv == 0)
+    ms_log (0, "Updated %" PRIu64 " of %" PRIu64 " records in place\n",
+            updatedrecords, totalrecords);
+
+  free (header);
+
+  if (close (fd))
+  {
+    ms_log (2, "Cannot close %s (%s)\n", path, strerror (errno));
+    rv = -1;
+  }
+
+  return rv;
+} /* End of update_inplace() */
+
+/***************************************************************************
+ * update_records:
+ *
+ * Re-pack the header of each record of a version 3 file with header
+ * changes applied, using 'header' as a buffer.  The changed header
+ * bytes are written to 'fd' unless it is negative.  The number of
+ * records changed and read are returned in 'updated' and 'total'.
+ *
+ * Returns 0 on success, 1 if a record is not version 3 or would change
+ * length and -1 on failure
+ ***************************************************************************/
+static int
+update_records (const char *path, uint32_t flags, int fd, char *header, size_t headersize,
+                uint64_t *updated, uint64_t *total)
+{
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  int64_t recoffset;
+  uint32_t dataoffset;
+  uint32_t crc;
+  int headerlen;
+  int first;
+  int last;
+  int retcode;
+  int rv = 0;
+  int8_t swapflag = (ms_bigendianhost ()) ? 1 : 0;
+
+  *updated = 0;
+  *total   = 0;
+
+  while ((retcode = ms3_readmsr_r (&msfp, &msr, path, flags, verbose)) == MS_NOERROR)
+  {
+    if (msr->formatversion != 3)
+    {
+      rv = 1;
+      break;
+    }
+
+    recoffset  = msfp->streampos - msr->reclen;
+    dataoffset = MS3FSDH_LENGTH + *pMS3FSDH_SIDLENGTH (msr->record) + msr->extralength;
+
+    if (apply_header_changes (msr))
+    {
+      rv = -1;
+      break;
+    }
+
+    if ((headerlen = msr3_pack_header3 (msr, header, headersize, verbose)) < 0)
+    {
+      ms_log (2, "%s: Cannot pack record header\n", msr->sid);
+      rv = -1;
+      break;
+    }
+
+    /* Header length change would shift the data payload, a full rewrite is needed */
+    if ((uint32_t)headerlen != dataoffset || dataoffset + msr->datalength != (uint32_t)msr->reclen)
+    {
+      rv = 1;
+      break;
+    }
+
+    /* Calculate CRC of new header and existing payload, CRC field set to 0 */
+    *pMS3FSDH_NUMSAMPLES (header) = HO4u ((uint32_t)msr->samplecnt, swapflag);
+    *pMS3FSDH_DATALENGTH (header) = HO4u (msr->datalength, swapflag);
+    memset (pMS3FSDH_CRC (header), 0, sizeof (uint32_t));
+    crc = ms_crc32c ((const uint8_t *)header, headerlen, 0);
+    crc = ms_crc32c ((const uint8_t *)msr->record + dataoffset, msr->datalength, crc);
+    *pMS3FSDH_CRC (header) = HO4u (crc, swapflag);
+
+    /* Determine range of changed header bytes */
+    for (first = 0; first < headerlen && header[first] == msr->record[first]; first++)
+      ;
+    for (last = headerlen - 1; last > first && header[last] == msr->record[last]; last--)
+      ;
+
+    if (first < headerlen)
+    {
+      if (fd >= 0 && pwrite (fd, header + first, last - first + 1, recoffset + first) != (last - first + 1))
+      {
+        ms_log (2, "Cannot write to %s (%s)\n", path, strerror (errno));
+        rv = -1;
+        break;
+      }
+
+      *updated += 1;
+    }
+
+    *total += 1;
+  }
+
+  if (rv == 0 && retcode != MS_ENDOFFILE)
+  {
+    ms_log (2, "Error reading %s: %s\n", path, ms_errorstr (retcode));
+    rv = -1;
+  }
+
+  /* Make sure everything is cleaned up */
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+
+  return rv;
+} /* End of update_records() */
+
+/***************************************************************************
+ * hash_file:
+ *
+ * Calculate the CRC-32C of the bytes of a file from 'start' up to
+ * 'end', continuing from the value at 'crc', which is updated.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+hash_file (const char *path, int64_t start, int64_t end, uint32_t *crc)
+{
+  FILE *fp;
+  uint8_t *buffer;
+  size_t count;
+  int64_t position = start;
+  int rv = 0;
+
+  if ((fp = fopen (path, "rb")) == NULL)
+  {
+    ms_log (2, "Cannot open %s (%s)\n", path, strerror (errno));
+    return -1;
+  }
+
+  if ((buffer = (uint8_t *)malloc (SYNC_HASHBUFFER)) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for hash buffer\n");
+    fclose (fp);
+    return -1;
+  }
+
+  if (start > 0 && lmp_fseek64 (fp, start, SEEK_SET))
+  {
+    ms_log (2, "Cannot seek in %s to offset %" PRId64 "\n", path, start);
+    rv = -1;
+  }
+
+  while (rv == 0 && position < end)
+  {
+    count = (end - position < SYNC_HASHBUFFER) ? (size_t)(end - position) : SYNC_HASHBUFFER;
+
+    if (fread (buffer, count, 1, fp) != 1)
+    {
+      ms_log (2, "Cannot read %s at offset %" PRId64 "\n", path, position);
+      rv = -1;
+      break;
+    }
+
+    *crc = ms_crc32c (buffer, (int)count, *crc);
+    position += count;
+  }
+
+  if (nocache)
+    lmp_fdropcache (fp, 0, 0, 0);
+
+  free (buffer);
+  fclose (fp);
+
+  return rv;
+} /* End of hash_file() */
+
+/***************************************************************************
+ * sync_lock:
+ *
+ * Take an exclusive lock of the sync manifest, waiting for other
+ * processes holding it.  As the manifest is replaced when updated, a
+ * separate lock file, named after the manifest with a ".lock" suffix,
+ * is locked.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sync_lock (void)
+{
+  char lockfile[1024];
+
+  snprintf (lockfile, sizeof (lockfile), "%s.lock", syncmanifest);
+
+  if ((synclockfd = open (lockfile, O_RDWR | O_CREAT, 0666)) < 0)
+  {
+    ms_log (2, "Cannot open %s (%s)\n", lockfile, strerror (errno));
+    return -1;
+  }
+
+  while (flock (synclockfd, LOCK_EX))
+  {
+    if (errno != EINTR)
+    {
+      ms_log (2, "Cannot lock %s (%s)\n", lockfile, strerror (errno));
+      sync_unlock ();
+      return -1;
+    }
+  }
+
+  return 0;
+} /* End of sync_lock() */
+
+/***************************************************************************
+ * sync_unlock:
+ *
+ * Release the lock of the sync manifest, if held.
+ ***************************************************************************/
+static void
+sync_unlock (void)
+{
+  if (synclockfd >= 0)
+  {
+    close (synclockfd);
+    synclockfd = -1;
+  }
+} /* End of sync_unlock() */
+
+/***************************************************************************
+ * sync_load:
+ *
+ * Load the sync manifest, or start a new one if it does not exist,
+ * replacing a previously loaded manifest.  Should be called with the
+ * manifest locked.
+ *
+ * Returns the "files" object of the manifest on success, and NULL on
+ * failure
+ ***************************************************************************/
+static yyjson_mut_val *
+sync_load (void)
+{
+  yyjson_doc *doc;
+  yyjson_read_err rerr;
+  yyjson_mut_val *root;
+  yyjson_mut_val *files;
+
+  yyjson_mut_doc_free (syncdoc);
+  syncdoc = NULL;
+
+  if (access (syncmanifest, F_OK) == 0)
+  {
+    if ((doc = yyjson_read_file (syncmanifest, YYJSON_READ_NOFLAG, NULL, &rerr)) == NULL)
+    {
+      ms_log (2, "Cannot read JSON file %s: (%u) %s at position: %ld\n",
+              syncmanifest, rerr.code, rerr.msg, rerr.pos);
+      return NULL;
+    }
+
+    syncdoc = yyjson_doc_mut_copy (doc, NULL);
+    yyjson_doc_free (doc);
+  }
+  else
+  {
+    syncdoc = yyjson_mut_doc_new (NULL);
+  }
+
+  if (syncdoc == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for sync manifest\n");
+    return NULL;
+  }
+
+  if ((root = yyjson_mut_doc_get_root (syncdoc)) == NULL)
+  {
+    root = yyjson_mut_obj (syncdoc);
+    yyjson_mut_doc_set_root (syncdoc, root);
+  }
+
+  if ((files = yyjson_mut_obj_get (root, "files")) == NULL)
+  {
+    files = yyjson_mut_obj (syncdoc);
+    yyjson_mut_obj_add_val (syncdoc, root, "files", files);
+  }
+
+  if (!yyjson_mut_is_obj (root) || !yyjson_mut_is_obj (files))
+  {
+    ms_log (2, "Sync manifest %s is not valid\n", syncmanifest);
+    return NULL;
+  }
+
+  return files;
+} /* End of sync_load() */
+
+/***************************************************************************
+ * sync_plan:
+ *
+ * Load the sync manifest and determine how the input file must be
+ * converted.  The input is unchanged if its size and modification
+ * time match the manifest entry for the same output file.  Otherwise,
+ * if the input still begins with the bytes read by the previous
+ * conversion, verified by their CRC-32C, only the data appended
+ * beyond the previous read position must be converted.
+ *
+ * The output must also be the same file, with the same size, as
+ * recorded after the previous conversion.
+ *
+ * The input and output file status are returned in 'input' and
+ * 'output', the latter only if the output exists.  For SYNC_APPEND, and
+ * SYNC_SKIP when only the modification time changed, the previous
+ * read position and CRC-32C of the data up to it are returned in
+ * 'offset' and 'prefixcrc'.
+ *
+ * Returns SYNC_SKIP, SYNC_FULL or SYNC_APPEND on success, and -1 on
+ * failure
+ ***************************************************************************/
+static int
+sync_plan (struct stat *input, struct stat *output, int64_t *offset, uint32_t *prefixcrc)
+{
+  yyjson_mut_val *files;
+  yyjson_mut_val *entry;
+  yyjson_mut_val *outputpath;
+  uint64_t streampos;
+  uint32_t crc = 0;
+
+  if (stat (inputfile, input))
+  {
+    ms_log (2, "Cannot stat %s (%s)\n", inputfile, strerror (errno));
+    return -1;
+  }
+
+  /* Not locked while converting, the manifest is re-read when updated */
+  if (sync_lock ())
+    return -1;
+
+  files = sync_load ();
+  sync_unlock ();
+
+  if (files == NULL)
+    return -1;
+
+  /* Convert completely if unknown, converted to a different output or output is missing */
+  entry = yyjson_mut_obj_get (files, inputfile);
+  outputpath = yyjson_mut_obj_get (entry, "output");
+
+  if (!yyjson_mut_is_str (outputpath) || strcmp (yyjson_mut_get_str (outputpath), outputfile) ||
+      stat (outputfile, output))
+    return SYNC_FULL;
+
+  /* Convert completely if the output was replaced or modified since last written */
+  if (yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "outputsize")) != (uint64_t)output->st_size ||
+      yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "outputdev")) != (uint64_t)output->st_dev ||
+      yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "outputino")) != (uint64_t)output->st_ino)
+    return SYNC_FULL;
+
+  if (yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "size")) == (uint64_t)input->st_size &&
+      yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "mtime")) == (uint64_t)input->st_mtime)
+    return SYNC_SKIP;
+
+  /* Verify that the previously read data are unchanged */
+  streampos = yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "streampos"));
+
+  if (streampos == 0 || streampos > (uint64_t)input->st_size)
+    return SYNC_FULL;
+
+  if (hash_file (inputfile, 0, (int64_t)streampos, &crc))
+    return -1;
+
+  if (crc != (uint32_t)yyjson_mut_get_uint (yyjson_mut_obj_get (entry, "crc32c")))
+    return SYNC_FULL;
+
+  *offset = (int64_t)streampos;
+  *prefixcrc = crc;
+
+  return (streampos == (uint64_t)input->st_size) ? SYNC_SKIP : SYNC_APPEND;
+} /* End of sync_plan() */
+
+/***************************************************************************
+ * sync_update:
+ *
+ * Record the status of the input file, the position up to which it
+ * was read, the CRC-32C of the data up to that position and the
+ * identity and size of the output file in the sync manifest.
+ *
+ * The manifest is locked and re-read before the entry is replaced, so
+ * that entries recorded by other processes sharing the manifest since
+ * it was loaded are kept.  It is then written to a temporary file and
+ * renamed, before the lock is released.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sync_update (const struct stat *input, const struct stat *output,
+             int64_t streampos, uint32_t crc)
+{
+  yyjson_mut_val *files;
+  yyjson_mut_val *entry;
+  yyjson_write_err werr;
+  char tmpmanifest[1024];
+
+  if (sync_lock ())
+    return -1;
+
+  if ((files = sync_load ()) == NULL)
+  {
+    sync_unlock ();
+    return -1;
+  }
+
+  yyjson_mut_obj_remove_key (files, inputfile);
+
+  entry = yyjson_mut_obj (syncdoc);
+  yyjson_mut_obj_add_strcpy (syncdoc, entry, "output", outputfile);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "outputsize", (uint64_t)output->st_size);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "outputdev", (uint64_t)output->st_dev);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "outputino", (uint64_t)output->st_ino);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "size", (uint64_t)input->st_size);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "mtime", (uint64_t)input->st_mtime);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "streampos", (uint64_t)streampos);
+  yyjson_mut_obj_add_uint (syncdoc, entry, "crc32c", crc);
+  yyjson_mut_obj_add (files, yyjson_mut_strcpy (syncdoc, inputfile), entry);
+
+  snprintf (tmpmanifest, sizeof (tmpmanifest), "%s.tmp%ld", syncmanifest, (long)getpid ());
+
+  if (!yyjson_mut_write_file (tmpmanifest, syncdoc, YYJSON_WRITE_PRETTY, NULL, &werr))
+  {
+    ms_log (2, "Cannot write sync manifest %s: (%u) %s\n", tmpmanifest, werr.code, werr.msg);
+    sync_unlock ();
+    return -1;
+  }
+
+  if (rename (tmpmanifest, syncmanifest))
+  {
+    ms_log (2, "Cannot rename %s to %s (%s)\n", tmpmanifest, syncmanifest, strerror (errno));
+    remove (tmpmanifest);
+    sync_unlock ();
+    return -1;
+  }
+
+  sync_unlock ();
+
+  return 0;
+} /* End of sync_update() */
+
+/* Number of records verified by a checking worker at a time */
+#define CHECK_BATCH 256
+
+/* Maximum number of batches queued per checking worker */
+#define CHECK_QUEUE 4
+
+/* Batch of raw records and their file offsets for a checking worker */
+typedef struct CheckBatch
+{
+  char *buffer;
+  size_t used;
+  size_t size;
+  int64_t offset[CHECK_BATCH];
+  int reclen[CHECK_BATCH];
+  int count;
+  struct CheckBatch *next;
+} CheckBatch;
+
+/* Bad record, or range of unrecognized bytes when 'problems' is 0 */
+typedef struct CheckProblem
+{
+  int64_t offset;
+  int64_t length;
+  int problems;
+  char sid[LM_SIDLEN];
+} CheckProblem;
+
+/* List of problems found by a checking worker or the reader */
+typedef struct CheckList
+{
+  CheckProblem *entries;
+  uint64_t count;
+  uint64_t size;
+} CheckList;
+
+/* Queue of batches shared by all checking workers */
+typedef struct CheckQueue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  CheckBatch *head;
+  CheckBatch *tail;
+  int queued;
+  int limit;
+  int done;
+} CheckQueue;
+
+/* Checking worker, verifying batches from the shared queue */
+typedef struct CheckWorker
+{
+  pthread_t thread;
+  CheckQueue *queue;
+  CheckList list;
+  uint64_t records;
+  uint64_t samples;
+  int error;
+} CheckWorker;
+
+/* Names of record problems in the check report */
+static const struct
+{
+  int flag;
+  const char *name;
+} checknames[] = {
+    {MSV_UNPARSABLE, "unparsable"},
+    {MSV_CRC, "crc"},
+    {MSV_STRUCTURE, "structure"},
+    {MSV_DECODE, "decode"},
+    {MSV_SAMPLECOUNT, "samplecount"},
+    {MSV_INTEGRATION, "integration"},
+};
+
+/***************************************************************************
+ * check_add:
+ *
+ * Add a problem to a check list.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+check_add (CheckList *list, int64_t offset, int64_t length, int problems, const char *sid)
+{
+  CheckProblem *entries;
+
+  if (list->count == list->size)
+  {
+    list->size = (list->size) ? list->size * 2 : 64;
+
+    if ((entries = (CheckProblem *)realloc (list->entries,
+                                            list->size * sizeof (CheckProblem))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for check results\n");
+      return -1;
+    }
+
+    list->entries = entries;
+  }
+
+  list->entries[list->count].offset   = offset;
+  list->entries[list->count].length   = length;
+  list->entries[list->count].problems = problems;
+  snprintf (list->entries[list->count].sid, LM_SIDLEN, "%s", (sid) ? sid : "");
+  list->count++;
+
+  return 0;
+} /* End of check_add() */
+
+/***************************************************************************
+ * check_worker:
+ *
+ * Thread function of a checking worker: verify each record of the
+ * batches taken from the shared queue until the input is done.
+ ***************************************************************************/
+static void *
+check_worker (void *arg)
+{
+  CheckWorker *worker = (CheckWorker *)arg;
+  CheckQueue *queue   = worker->queue;
+  CheckBatch *batch;
+  MS3Record *msr = NULL;
+  size_t offset;
+  int problems;
+  int idx;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&queue->lock);
+    while (!queue->head && !queue->done)
+      pthread_cond_wait (&queue->cond, &queue->lock);
+
+    if ((batch = queue->head) != NULL)
+    {
+      queue->head = batch->next;
+      if (!queue->head)
+        queue->tail = NULL;
+      queue->queued--;
+      pthread_cond_broadcast (&queue->cond);
+    }
+    pthread_mutex_unlock (&queue->lock);
+
+    if (!batch)
+      break;
+
+    for (idx = 0, offset = 0; idx < batch->count && !worker->error; idx++)
+    {
+      problems = ms3_verify_record (batch->buffer + offset, batch->reclen[idx], &msr, verbose);
+
+      if (problems < 0)
+      {
+        worker->error = 1;
+      }
+      else if (problems)
+      {
+        if (verbose)
+          ms_log (1, "%s: Bad record at byte offset %" PRId64 "\n",
+                  (msr) ? msr->sid : "", batch->offset[idx]);
+
+        if (check_add (&worker->list, batch->offset[idx], batch->reclen[idx], problems,
+                       (msr && !(problems & MSV_UNPARSABLE)) ? msr->sid : NULL))
+          worker->error = 1;
+      }
+      else
+      {
+        worker->samples += msr->samplecnt;
+      }
+
+      worker->records++;
+      offset += batch->reclen[idx];
+    }
+
+    free (batch->buffer);
+    free (batch);
+  }
+
+  msr3_free (&msr);
+
+  return NULL;
+} /* End of check_worker() */
+
+/***************************************************************************
+ * check_queue:
+ *
+ * Queue a batch for the checking workers, waiting while the queue is
+ * full.
+ ***************************************************************************/
+static void
+check_queue (CheckQueue *queue, CheckBatch *batch)
+{
+  pthread_mutex_lock (&queue->lock);
+  while (queue->queued >= queue->limit)
+    pthread_cond_wait (&queue->cond, &queue->lock);
+
+  if (queue->tail)
+    queue->tail->next = batch;
+  else
+    queue->head = batch;
+  queue->tail = batch;
+  queue->queued++;
+
+  pthread_cond_broadcast (&queue->cond);
+  pthread_mutex_unlock (&queue->lock);
+} /* End of check_queue() */
+
+/***************************************************************************
+ * check_compare:
+ *
+ * qsort() comparison of problems by file offset.
+ ***************************************************************************/
+static int
+check_compare (const void *a, const void *b)
+{
+  const CheckProblem *pa = (const CheckProblem *)a;
+  const CheckProblem *pb = (const CheckProblem *)b;
+
+  if (pa->offset != pb->offset)
+    return (pa->offset < pb->offset) ? -1 : 1;
+
+  return 0;
+} /* End of check_compare() */
+
+/***************************************************************************
+ * check_write:
+ *
+ * Write the JSON check report of the input file, listing each bad
+ * record and range of unrecognized bytes in order of file offset.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+check_write (CheckList *list, int64_t size, uint64_t records, uint64_t samples)
+{
+  yyjson_mut_doc *doc;
+  yyjson_mut_val *root;
+  yyjson_mut_val *bad;
+  yyjson_mut_val *entry;
+  yyjson_mut_val *names;
+  yyjson_write_err werr;
+  char sidhex[LM_SIDLEN * 2 + 1];
+  const char *cp;
+  uint64_t badrecords = 0;
+  uint64_t unrecognized = 0;
+  uint64_t index;
+  int idx;
+  int rv = 0;
+
+  if ((doc = yyjson_mut_doc_new (NULL)) == NULL)
+  {
+    ms_log (2, "Cannot allocate check report\n");
+    return -1;
+  }
+
+  root = yyjson_mut_obj (doc);
+  yyjson_mut_doc_set_root (doc, root);
+  bad = yyjson_mut_arr (doc);
+
+  for (index = 0; index < list->count; index++)
+  {
+    entry = yyjson_mut_arr_add_obj (doc, bad);
+    yyjson_mut_obj_add_int (doc, entry, "offset", list->entries[index].offset);
+    yyjson_mut_obj_add_int (doc, entry, "length", list->entries[index].length);
+
+    /* Source IDs of corrupt records may contain any bytes, only printable ASCII is a valid string */
+    for (cp = list->entries[index].sid; *cp >= 0x20 && *cp < 0x7f; cp++)
+      ;
+
+    if (*cp == '\0' && cp != list->entries[index].sid)
+    {
+      yyjson_mut_obj_add_str (doc, entry, "sid", list->entries[index].sid);
+    }
+    else if (*cp)
+    {
+      for (idx = 0, cp = list->entries[index].sid; *cp && idx < (int)sizeof (sidhex) - 2; cp++, idx += 2)
+        snprintf (sidhex + idx, sizeof (sidhex) - idx, "%02x", (uint8_t)*cp);
+
+      yyjson_mut_obj_add_strcpy (doc, entry, "sidhex", sidhex);
+    }
+
+    names = yyjson_mut_obj_add_arr (doc, entry, "problems");
+
+    if (list->entries[index].problems == 0)
+    {
+      yyjson_mut_arr_add_str (doc, names,
+                              (list->entries[index].offset + list->entries[index].length == size) ?
+                              "truncated" : "unrecognized");
+      unrecognized += list->entries[index].length;
+      continue;
+    }
+
+    for (idx = 0; idx < (int)(sizeof (checknames) / sizeof (checknames[0])); idx++)
+      if (list->entries[index].problems & checknames[idx].flag)
+        yyjson_mut_arr_add_str (doc, names, checknames[idx].name);
+
+    badrecords++;
+  }
+
+  yyjson_mut_obj_add_str (doc, root, "file", inputfile);
+  if (size >= 0)
+    yyjson_mut_obj_add_int (doc, root, "size", size);
+  yyjson_mut_obj_add_uint (doc, root, "records", records);
+  yyjson_mut_obj_add_uint (doc, root, "samples", samples);
+  yyjson_mut_obj_add_uint (doc, root, "badrecords", badrecords);
+  yyjson_mut_obj_add_uint (doc, root, "unrecognizedbytes", unrecognized);
+  yyjson_mut_obj_add_val (doc, root, "bad", bad);
+
+  if (!strcmp (checkreport, "-"))
+  {
+    if (!yyjson_mut_write_fp (stdout, doc, YYJSON_WRITE_PRETTY, NULL, &werr) ||
+        fputc ('\n', stdout) == EOF)
+    {
+      ms_log (2, "Cannot write check report: (%u) %s\n", werr.code, werr.msg);
+      rv = -1;
+    }
+  }
+  else if (!yyjson_mut_write_file (checkreport, doc, YYJSON_WRITE_PRETTY, NULL, &werr))
+  {
+    ms_log (2, "Cannot write check report %s: (%u) %s\n", checkreport, werr.code, werr.msg);
+    rv = -1;
+  }
+
+  yyjson_mut_doc_free (doc);
+
+  return rv;
+} /* End of check_write() */
+
+/***************************************************************************
+ * check_read:
+ *
+ * Read the next record of the input file for checking.  Reading stops
+ * at a detected record that does not fit in the rest of the file, for
+ * example a record with a corrupt length.  If at least a minimal
+ * record length of data follows, the offset of that record is stored
+ * in 'resync', unless already set, and reading continues by scanning
+ * for the next record header from the following byte, using the
+ * path name range suffix in 'readpath'.
+ *
+ * Returns MS_NOERROR with a record, MS_ENDOFFILE at the end of the
+ * file or a libmseed error code.
+ ***************************************************************************/
+static int
+check_read (MS3FileParam **ppmsfp, MS3Record **ppmsr, char *readpath, size_t readpathsize,
+            uint32_t flags, int64_t size, int64_t *resync)
+{
+  int64_t stop;
+  int retcode;
+
+  while ((retcode = ms3_readmsr_r (ppmsfp, ppmsr, readpath, flags, verbose)) == MS_ENDOFFILE)
+  {
+    stop = (*ppmsfp)->streampos;
+
+    if (size < 0 || size - stop < MINRECLEN)
+      break;
+
+    if (*resync < 0)
+      *resync = stop;
+
+    if (verbose)
+      ms_log (1, "Record at byte offset %" PRId64 " does not fit in file, scanning for next record\n",
+              stop);
+
+    ms3_readmsr_r (ppmsfp, ppmsr, NULL, 0, 0);
+    snprintf (readpath, readpathsize, "%s@%" PRId64, inputfile, stop + 1);
+  }
+
+  return retcode;
+} /* End of check_read() */
+
+/***************************************************************************
+ * check_records:
+ *
+ * Verify the integrity of each record of the input file without
+ * producing output.  The input is read sequentially and batches of
+ * raw records are verified with ms3_verify_record() by a fixed set of
+ * worker threads.  Bytes skipped by the reader, which could not be
+ * identified as records, are reported as unrecognized.  A record that
+ * does not fit in the rest of the file is reported as unparsable up
+ * to the next record found by scanning forward.  The report is
+ * written to the check report file.
+ *
+ * Returns 0 if all records are intact, 1 if problems were found and
+ * -1 on failure
+ ***************************************************************************/
+static int
+check_records (uint32_t flags)
+{
+  CheckWorker *workers = NULL;
+  CheckQueue queue;
+  CheckBatch *batch = NULL;
+  CheckList list = {NULL, 0, 0};
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  struct stat input;
+  uint64_t records = 0;
+  uint64_t samples = 0;
+  uint64_t index;
+  int64_t size = -1;
+  int64_t expected = 0;
+  int64_t resync = -1;
+  int64_t offset;
+  char readpath[1024];
+  size_t bufsize;
+  char *buffer;
+  int retcode;
+  int workercount;
+  int started = 0;
+  int error = 0;
+  int idx;
+
+  workercount = (threads > 0) ? threads : (int)sysconf (_SC_NPROCESSORS_ONLN);
+  if (workercount < 1)
+    workercount = 1;
+
+  /* Size of the input to identify trailing unrecognized bytes, unknown for a range */
+  if (!stat (inputfile, &input))
+    size = (int64_t)input.st_size;
+
+  if ((workers = (CheckWorker *)calloc (workercount, sizeof (CheckWorker))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for workers\n");
+    return -1;
+  }
+
+  memset (&queue, 0, sizeof (queue));
+  queue.limit = workercount * CHECK_QUEUE;
+  pthread_mutex_init (&queue.lock, NULL);
+  pthread_cond_init (&queue.cond, NULL);
 
-  /* Open output file if specified, default is STDOUT */
-  if (outputfile && strcmp (outputfile, "-"))
+  for (idx = 0; idx < workercount; idx++)
   {
-    if ((outfile = fopen (outputfile, "wb")) == NULL)
-    {
-      ms_log (2, "Cannot open output file: %s (%s)\n", outputfile, strerror (errno));
+    workers[idx].queue = &queue;
 
-      return 1;
+    if (pthread_create (&workers[idx].thread, NULL, check_worker, &workers[idx]))
+    {
+      ms_log (2, "Cannot create worker thread\n");
+      error = 1;
+      break;
     }
-  }
-  else
-  {
-    outfile = stdout;
+
+    started++;
   }
 
-  /* Set flags to validate CRCs, check for range in path names, and skip non-data */
-  flags |= MSF_VALIDATECRC;
-  flags |= MSF_PNAMERANGE;
-  flags |= MSF_SKIPNOTDATA;
+  if (verbose)
+    ms_log (1, "Checking records with %d worker threads\n", started);
 
-  /* Loop over the input file */
-  while ((retcode = ms3_readmsr (&msr, inputfile, flags, verbose)) == MS_NOERROR)
+  /* Read records without validating CRCs, which is done by the workers */
+  snprintf (readpath, sizeof (readpath), "%s", inputfile);
+
+  while (!error && (retcode = check_read (&msfp, &msr, readpath, sizeof (readpath),
+                                          flags & ~MSF_VALIDATECRC, size, &resync)) == MS_NOERROR)
   {
-    if (verbose >= 1)
-      msr3_print (msr, verbose - 1);
+    offset = msfp->streampos - msr->reclen;
 
-    /* Retain v2 sequence number of data quality indicator if input and output are v2.
-     * Setting these insertion values triggers them to be inserted post-record creation */
-    if (msr->formatversion == 2 && packversion == 2 && msr->record)
-    {
-      memcpy (insertV2seqnum, pMS2FSDH_SEQNUM (msr->record), 6);
-      insertV2dataquality = *pMS2FSDH_DATAQUALITY (msr->record);
-    }
-    else
+    /* Skipped bytes began with a record not fitting in the file or could not be identified */
+    if (offset > expected && check_add (&list, expected, offset - expected,
+                                        (resync >= 0) ? MSV_UNPARSABLE : 0, NULL))
     {
-      insertV2seqnum[0]   = '\0';
-      insertV2dataquality = 0;
+      error = 1;
+      break;
     }
 
-    /* Determine if unpacking data is not needed when converting to version 3 */
-    if (forcerepack == 0 && packversion == 3 &&
-        (packencoding < 0 || packencoding == msr->encoding))
-    {
-      /* Steim encodings must be big endian */
-      if (msr->encoding == DE_STEIM1 || msr->encoding == DE_STEIM2)
-      {
-        /* If BE host and swapping not needed, data payload is BE */
-        if (bigendianhost && !(msr->swapflag & MSSWAP_PAYLOAD))
-          repackheaderV3 = 1;
-        /* If LE host and swapping is needed, data payload is BE */
-        else if (!bigendianhost && (msr->swapflag & MSSWAP_PAYLOAD))
-          repackheaderV3 = 1;
-      }
-
-      /* Integer and float encodings must be little endian */
-      else if (msr->encoding == DE_INT16 || msr->encoding == DE_INT32 ||
-               msr->encoding == DE_FLOAT32 || msr->encoding == DE_FLOAT64)
-      {
-        /* If BE host and swapping is needed, data payload is LE */
-        if (bigendianhost && (msr->swapflag & MSSWAP_PAYLOAD))
-          repackheaderV3 = 1;
-        /* If LE host and swapping is not needed, data payload is LE */
-        else if (!bigendianhost && !(msr->swapflag & MSSWAP_PAYLOAD))
-          repackheaderV3 = 1;
-      }
+    expected = msfp->streampos;
+    resync   = -1;
 
-      /* Text encoding does not need repacking */
-      else if (msr->encoding == DE_TEXT)
-      {
-        repackheaderV3 = 1;
-      }
+    if (!batch && (batch = (CheckBatch *)calloc (1, sizeof (CheckBatch))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for record batch\n");
+      error = 1;
+      break;
     }
 
-    /* Apply merge patch to extra headers */
-    if (extraheaderpatch)
+    if (batch->used + msr->reclen > batch->size)
     {
-      /* Allocate empty object container if no headers present */
-      if (msr->extra == NULL)
-      {
-        if ((msr->extra = libmseed_memory.malloc (2)) == NULL)
-        {
-          ms_log (2, "Cannot allocate memory\n");
-          break;
-        }
-        msr->extralength = 2;
-        memcpy (msr->extra, "{}", 2);
-      }
+      bufsize = (batch->size) ? batch->size * 2 : (size_t)msr->reclen * CHECK_BATCH;
+      while (bufsize < batch->used + msr->reclen)
+        bufsize *= 2;
 
-      /* Apply merge patch at root of container */
-      if (mseh_set_ptr_r (msr, "", extraheaderpatch, 'M', NULL))
+      if ((buffer = (char *)realloc (batch->buffer, bufsize)) == NULL)
       {
-        ms_log (2, "Cannot apply merge patch to extra headers\n");
+        ms_log (2, "Cannot allocate memory for record batch\n");
+        error = 1;
         break;
       }
 
-      /* Remove empty headers container */
-      if (!strncmp (msr->extra, "{}", msr->extralength))
-      {
-        libmseed_memory.free (msr->extra);
-        msr->extra       = NULL;
-        msr->extralength = 0;
-      }
+      batch->buffer = buffer;
+      batch->size   = bufsize;
     }
 
-    /* Avoid re-packing of data payload if not needed for version 3 output */
-    if (packversion == 3 && (repackheaderV3 || msr->samplecnt == 0))
-    {
-      if (verbose)
-        ms_log (1, "Re-packing record without re-packing encoded data payload\n");
+    memcpy (batch->buffer + batch->used, msr->record, msr->reclen);
+    batch->offset[batch->count] = offset;
+    batch->reclen[batch->count] = msr->reclen;
+    batch->count++;
+    batch->used += msr->reclen;
 
-      if (!rawrec && (rawrec = (char *)malloc (MAXRECLEN)) == NULL)
-      {
-        ms_log (2, "Cannot allocate memory for record buffer\n");
-        break;
-      }
+    if (batch->count == CHECK_BATCH)
+    {
+      check_queue (&queue, batch);
+      batch = NULL;
+    }
+  }
 
-      /* Re-packed a parsed record into a version 3 header using raw encoded data */
-      reclen = msr3_repack_mseed3 (msr, rawrec, MAXRECLEN, verbose);
+  if (!error && retcode != MS_ENDOFFILE)
+  {
+    ms_log (2, "Error reading %s: %s\n", inputfile, ms_errorstr (retcode));
+    error = 1;
+  }
 
-      if (reclen < 0)
-      {
-        ms_log (2, "%s: Cannot repack record\n", msr->sid);
-        break;
-      }
+  /* Trailing bytes, usually a truncated record */
+  if (!error && size > expected && check_add (&list, expected, size - expected, 0, NULL))
+    error = 1;
 
-      record_handler (rawrec, reclen, NULL);
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
 
-      packedsamples = msr->samplecnt;
-      packedrecords = 1;
+  /* Queue partial batch, signal completion and wait for workers */
+  if (batch)
+  {
+    if (!error)
+    {
+      check_queue (&queue, batch);
     }
-    /* Otherwise, unpack samples and repack record */
     else
     {
-      if (verbose)
-        ms_log (1, "Re-packing record with decoded data\n");
-
-      msr->numsamples = msr3_unpack_data (msr, verbose);
-
-      if (msr->numsamples < 0)
-      {
-        ms_log (2, "%s: Cannot unpack data samples\n", msr->sid);
-        break;
-      }
-
-      msr->formatversion = packversion;
-
-      if (packreclen >= 0)
-        msr->reclen = packreclen;
-      else if (msr->formatversion == 3)
-        msr->reclen = MAXRECLEN;
-
-      if (retired_encoding ((packencoding >= 0) ? packencoding : msr->encoding))
-      {
-        ms_log (2, "Packing for encoding %d not allowed, specify supported encoding with -E\n",
-                msr->encoding);
-        break;
-      }
-
-      /* Convert sample type as needed for packencoding */
-      if (packencoding >= 0 && msr->encoding != packencoding)
-      {
-        if (convertsamples (msr, packencoding))
-        {
-          ms_log (2, "Cannot convert samples for encoding %d\n", packencoding);
-          break;
-        }
-      }
-
-      if (packencoding >= 0)
-        msr->encoding = packencoding;
-
-      packedrecords = msr3_pack (msr, &record_handler, NULL, &packedsamples, MSF_FLUSHDATA, verbose);
+      free (batch->buffer);
+      free (batch);
     }
-
-    if (packedrecords == -1)
-      ms_log (2, "Cannot pack records\n");
-    else if (verbose >= 2)
-      ms_log (1, "Packed %" PRId64 " records\n", packedrecords);
-
-    totalpackedrecords += packedrecords;
-    totalpackedsamples += packedsamples;
   }
 
-  if (retcode != MS_ENDOFFILE)
-    ms_log (2, "Error reading %s: %s\n", inputfile, ms_errorstr (retcode));
-
-  if (verbose)
-    ms_log (0, "Packed %" PRIu64 " samples into %" PRIu64 " records\n",
-            totalpackedsamples, totalpackedrecords);
-
-  /* Make sure everything is cleaned up */
-  ms3_readmsr (&msr, NULL, 0, 0);
-
-  if (rawrec)
-    free (rawrec);
+  pthread_mutex_lock (&queue.lock);
+  queue.done = 1;
+  pthread_cond_broadcast (&queue.cond);
+  pthread_mutex_unlock (&queue.lock);
 
-  if (outfile)
-    fclose (outfile);
+  for (idx = 0; idx < started; idx++)
+  {
+    pthread_join (workers[idx].thread, NULL);
 
-  if (extraheaderpatch)
-    free (extraheaderpatch);
+    if (workers[idx].error)
+      error = 1;
 
-  return 0;
-} /* End of main() */
+    records += workers[idx].records;
+    samples += workers[idx].samples;
 
-/***************************************************************************
- * extraheader_init:
- *
- * Validate extra header merge patch by reading specified file and
- * parsing the JSON, and re-serializing in preparation for merge patch.
- *
- * Returns 0 on success, and -1 on failure
- ***************************************************************************/
-static int
-extraheader_init (char *file)
-{
-  yyjson_doc *doc;
-  yyjson_read_flag rflg = YYJSON_READ_NOFLAG;
-  yyjson_read_err rerr;
-  yyjson_write_flag wflg = YYJSON_WRITE_NOFLAG;
-  yyjson_write_err werr;
+    for (index = 0; !error && index < workers[idx].list.count; index++)
+    {
+      if (check_add (&list, workers[idx].list.entries[index].offset,
+                     workers[idx].list.entries[index].length,
+                     workers[idx].list.entries[index].problems,
+                     workers[idx].list.entries[index].sid))
+        error = 1;
+    }
 
-  doc = yyjson_read_file (file, rflg, NULL, &rerr);
+    free (workers[idx].list.entries);
+  }
 
-  if (doc == NULL)
+  /* Write report with problems in order of file offset */
+  if (!error)
   {
-    ms_log (2, "Cannot read JSON file %s: (%u) %s at position: %ld\n",
-            file, rerr.code, rerr.msg, rerr.pos);
-    return -1;
+    if (list.count > 1)
+      qsort (list.entries, list.count, sizeof (CheckProblem), check_compare);
+
+    if (check_write (&list, size, records, samples))
+      error = 1;
   }
 
-  extraheaderpatch = yyjson_write_opts (doc, wflg, NULL, NULL, &werr);
+  if (verbose && !error)
+    ms_log (0, "Checked %" PRIu64 " records, %" PRIu64 " problems found\n",
+            records, list.count);
 
-  yyjson_doc_free (doc);
+  pthread_mutex_destroy (&queue.lock);
+  pthread_cond_destroy (&queue.cond);
+  free (list.entries);
+  free (workers);
 
-  if (extraheaderpatch == NULL)
-  {
-    ms_log (2, "Cannot serialize extra header JSON: (%u) %s\n",
-            werr.code, werr.msg);
+  if (error)
     return -1;
-  }
 
-  return 0;
-} /* End of extraheader_init() */
+  return (list.count) ? 1 : 0;
+} /* End of check_records() */
 
 /***************************************************************************
  * convertsamples:
@@ -329,6 +2545,9 @@ convertsamples (MS3Record *msr, int packencoding)
   int32_t *idata;
   float *fdata;
   double *ddata;
+  float lastfloat   = 0.0;
+  double lastdouble = 0.0;
+  int32_t lastint   = 0;
   int idx;
 
   if (!msr)
@@ -380,6 +2599,13 @@ convertsamples (MS3Record *msr, int packencoding)
       {
         for (idx = 0; idx < msr->numsamples; idx++)
         {
+          /* Repeated value, e.g. stuck or zero channels: reuse last conversion */
+          if (idx > 0 && fdata[idx] == lastfloat)
+          {
+            idata[idx] = lastint;
+            continue;
+          }
+
           /* Check for loss of sub-integer */
           if ((fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
           {
@@ -388,13 +2614,21 @@ convertsamples (MS3Record *msr, int packencoding)
             return -1;
           }
 
-          idata[idx] = (int32_t) (fdata[idx] + 0.5);
+          lastfloat = fdata[idx];
+          idata[idx] = lastint = (int32_t) (fdata[idx] + 0.5);
         }
       }
       else if (msr->sampletype == 'd') /* Convert doubles to integers with simple rounding */
       {
         for (idx = 0; idx < msr->numsamples; idx++)
         {
+          /* Repeated value, e.g. stuck or zero channels: reuse last conversion */
+          if (idx > 0 && ddata[idx] == lastdouble)
+          {
+            idata[idx] = lastint;
+            continue;
+          }
+
           /* Check for loss of sub-integer */
           if ((ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
           {
@@ -403,15 +2637,18 @@ convertsamples (MS3Record *msr, int packencoding)
             return -1;
           }
 
-          idata[idx] = (int32_t) (ddata[idx] + 0.5);
+          lastdouble = ddata[idx];
+          idata[idx] = lastint = (int32_t) (ddata[idx] + 0.5);
         }
 
         /* Reallocate buffer for reduced size needed */
-        if (!(msr->datasamples = realloc (msr->datasamples, (size_t) (msr->numsamples * sizeof (int32_t)))))
+        if (!(msr->datasamples = libmseed_memory.realloc (msr->datasamples, (size_t) (msr->numsamples * sizeof (int32_t)))))
         {
           ms_log (2, "Error, cannot re-allocate buffer for sample conversion\n");
           return -1;
         }
+
+        msr->datasize = (size_t) (msr->numsamples * sizeof (int32_t));
       }
 
       msr->sampletype = 'i';
@@ -431,11 +2668,13 @@ convertsamples (MS3Record *msr, int packencoding)
           fdata[idx] = (float)ddata[idx];
 
         /* Reallocate buffer for reduced size needed */
-        if (!(msr->datasamples = realloc (msr->datasamples, (size_t) (msr->numsamples * sizeof (float)))))
+        if (!(msr->datasamples = libmseed_memory.realloc (msr->datasamples, (size_t) (msr->numsamples * sizeof (float)))))
         {
           ms_log (2, "Error, cannot re-allocate buffer for sample conversion\n");
           return -1;
         }
+
+        msr->datasize = (size_t) (msr->numsamples * sizeof (float));
       }
 
       msr->sampletype = 'f';
@@ -444,7 +2683,7 @@ convertsamples (MS3Record *msr, int packencoding)
     /* Convert to doubles */
     else if (encodingtype == 'd')
     {
-      if (!(ddata = (double *)malloc ((size_t) (msr->numsamples * sizeof (double)))))
+      if (!(ddata = (double *)libmseed_memory.malloc ((size_t) (msr->numsamples * sizeof (double)))))
       {
         ms_log (2, "Error, cannot allocate buffer for sample conversion to doubles\n");
         return -1;
@@ -455,17 +2694,18 @@ convertsamples (MS3Record *msr, int packencoding)
         for (idx = 0; idx < msr->numsamples; idx++)
           ddata[idx] = (double)idata[idx];
 
-        free (idata);
+        libmseed_memory.free (idata);
       }
       else if (msr->sampletype == 'f') /* Convert floats to doubles */
       {
         for (idx = 0; idx < msr->numsamples; idx++)
           ddata[idx] = (double)fdata[idx];
 
-        free (fdata);
+        libmseed_memory.free (fdata);
       }
 
       msr->datasamples = ddata;
+      msr->datasize = (size_t) (msr->numsamples * sizeof (double));
       msr->sampletype = 'd';
     }
   }
@@ -553,6 +2793,34 @@ parameter_proc (int argcount, char **argvec)
     {
       packversion = strtol (argvec[++optind], NULL, 10);
     }
+    else if (strcmp (argvec[optind], "-P") == 0)
+    {
+      packpubversion = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-I") == 0)
+    {
+      inplace = 1;
+    }
+    else if (strcmp (argvec[optind], "-M") == 0)
+    {
+      memprofile = 1;
+    }
+    else if (strcmp (argvec[optind], "-c") == 0)
+    {
+      coalesce = 1;
+    }
+    else if (strcmp (argvec[optind], "-nocache") == 0)
+    {
+      nocache = 1;
+    }
+    else if (strcmp (argvec[optind], "-check") == 0)
+    {
+      checkreport = argvec[++optind];
+    }
+    else if (strcmp (argvec[optind], "-sync") == 0)
+    {
+      syncmanifest = argvec[++optind];
+    }
     else if (strcmp (argvec[optind], "-eh") == 0)
     {
       extraheaderfile = argvec[++optind];
@@ -561,6 +2829,52 @@ parameter_proc (int argcount, char **argvec)
     {
       outputfile = argvec[++optind];
     }
+    else if (strcmp (argvec[optind], "-C") == 0)
+    {
+      columnbase = argvec[++optind];
+    }
+    else if (strcmp (argvec[optind], "-env") == 0)
+    {
+      envelopeprefix = argvec[++optind];
+    }
+    else if (strcmp (argvec[optind], "-envbucket") == 0)
+    {
+      const char *value = argvec[++optind];
+      char *endptr = NULL;
+      unsigned long bucket = 0;
+
+      if (value && *value != '-')
+        bucket = strtoul (value, &endptr, 10);
+
+      if (bucket == 0 || bucket > UINT32_MAX || endptr == value || *endptr)
+      {
+        ms_log (2, "Envelope bucket must be 1-%u samples, not '%s'\n", UINT32_MAX,
+                (value) ? value : "");
+        exit (1);
+      }
+
+      envelopebucket = (uint32_t)bucket;
+    }
+    else if (strcmp (argvec[optind], "-T") == 0)
+    {
+      threads = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-shm") == 0)
+    {
+      shmringname = argvec[++optind];
+    }
+    else if (strcmp (argvec[optind], "-shmslots") == 0)
+    {
+      shmringslots = (uint32_t)strtoul (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-shmsize") == 0)
+    {
+      shmringslotsize = (uint32_t)strtoul (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-shmreset") == 0)
+    {
+      shmringreset = 1;
+    }
     else if (strncmp (argvec[optind], "-", 1) == 0 &&
              strlen (argvec[optind]) > 1)
     {
@@ -594,6 +2908,42 @@ parameter_proc (int argcount, char **argvec)
     exit (1);
   }
 
+  if (packpubversion > UINT8_MAX)
+  {
+    ms_log (2, "Publication version must be 0-%d, not %d\n", UINT8_MAX, packpubversion);
+    exit (1);
+  }
+
+  /* In-place updates only change record headers of version 3 files */
+  if (inplace && (outputfile || shmringname || packreclen >= 0 || packencoding >= 0 ||
+                  packversion != 3 || forcerepack || coalesce))
+  {
+    ms_log (2, "In-place updating (-I) cannot be combined with -o, -shm, -R, -E, -F, -f or -c\n");
+    exit (1);
+  }
+
+  /* Column and envelope export replace record output */
+  if ((columnbase || envelopeprefix) && (outputfile || shmringname || inplace || coalesce))
+  {
+    ms_log (2, "Column or envelope export (-C, -env) cannot be combined with -o, -shm, -I or -c\n");
+    exit (1);
+  }
+
+  /* Sync mode converts a file to an output file, which can be appended to */
+  if (syncmanifest && (!outputfile || !strcmp (outputfile, "-") || inplace || coalesce))
+  {
+    ms_log (2, "Sync mode (-sync) requires an output file (-o) and cannot be combined with -I or -c\n");
+    exit (1);
+  }
+
+  /* Checking replaces all output */
+  if (checkreport && (outputfile || shmringname || inplace || coalesce || columnbase ||
+                      envelopeprefix || syncmanifest))
+  {
+    ms_log (2, "Checking (-check) cannot be combined with -o, -shm, -I, -c, -C, -env or -sync\n");
+    exit (1);
+  }
+
   /* Prepare specified replacement extra headers */
   if (extraheaderfile)
   {
@@ -604,12 +2954,18 @@ parameter_proc (int argcount, char **argvec)
     }
   }
 
-  /* Set output to STDOUT if a file is not specified */
-  if (!outputfile)
+  /* Set output to STDOUT if a file, shared memory ring, columns or envelopes are not specified */
+  if (!outputfile && !shmringname && !columnbase && !envelopeprefix && !checkreport)
   {
     outfile = stdout;
   }
 
+  /* Records must fit in shared memory ring slots */
+  if (shmringname && packreclen > 0 && (uint32_t)packreclen > shmringslotsize)
+  {
+    shmringslotsize = packreclen;
+  }
+
   /* Report the program version */
   if (verbose)
     ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
@@ -619,7 +2975,7 @@ parameter_proc (int argcount, char **argvec)
 
 /***************************************************************************
  * record_handler:
- * Saves passed records to the output file.
+ * Saves passed records to the output file and/or shared memory ring.
  ***************************************************************************/
 static void
 record_handler (char *record, int reclen, void *ptr)
@@ -634,10 +2990,29 @@ record_handler (char *record, int reclen, void *ptr)
     *pMS2FSDH_DATAQUALITY (record) = insertV2dataquality;
   }
 
-  if (fwrite (record, reclen, 1, outfile) != 1)
+  if (outfile && fwrite (record, reclen, 1, outfile) != 1)
   {
     ms_log (2, "Cannot write to output file\n");
   }
+
+  /* Write out and release output data from the page cache in large ranges */
+  if (outfile && nocache && outfile != stdout)
+  {
+    outfilewritten += reclen;
+
+    if (outfilewritten - outfilereleased >= NOCACHE_RELEASESIZE)
+    {
+      if (lmp_fdropcache (outfile, outfilereleased, outfilewritten - outfilereleased, 1))
+        ms_log (1, "Cannot release output file data from page cache\n");
+
+      outfilereleased = outfilewritten;
+    }
+  }
+
+  if (shmring && ms3_shmring_write (shmring, record, reclen) < 0)
+  {
+    ms_log (2, "Cannot publish record to shared memory ring\n");
+  }
 } /* End of record_handler() */
 
 /***************************************************************************
@@ -668,12 +3043,32 @@ usage (void)
            " -R bytes       Specify record length in bytes for packing\n"
            " -E encoding    Specify encoding format for packing\n"
            " -F version     Specify output format version, default is 3\n"
+           " -P pubversion  Specify publication version of output records\n"
            " -eh JSONFile   Specify file with an extra header JSON Merge Patch\n"
+           " -I             Update header values of version 3 input file in place\n"
+           " -M             Report library memory allocation profile\n"
+           " -c             Coalesce records of each source ID into full records\n"
+           " -nocache       Release input and output data from the page cache as processed\n"
+           " -sync manifest Convert only new or changed input, tracked in a JSON manifest\n"
+           " -check report  Verify records without output, write JSON report of bad records\n"
            "\n"
-           " -o outfile     Specify the output file, required\n"
+           " -o outfile     Specify the output file, required unless -shm, -C or -env is used\n"
+           " -shm name      Publish records to a POSIX shared memory ring, e.g. /mseed\n"
+           " -shmslots N    Number of record slots in shared memory ring, default 1024\n"
+           " -shmsize bytes Maximum record size in shared memory ring, default 65536\n"
+           " -shmreset      Re-create the shared memory ring, e.g. to change its geometry\n"
+           " -C base        Export decoded samples as columns to base.dat, index to base.idx\n"
+           " -env prefix    Export min/max envelope pyramid of each source ID to prefix<SID>.env\n"
+           " -envbucket N   Samples per envelope bucket at the finest level, default 16\n"
+           " -T threads     Threads for column export, coalescing or checking, default is one per processor\n"
            "\n"
            " infile         Input miniSEED file\n"
            "\n"
            "Each record is converted independently.  This can lead to unfilled records\n"
-           "that contain padding depending on the conversion options.\n");
+           "that contain padding depending on the conversion options.  With -c the\n"
+           "data of each source ID are repacked into full records, written in order\n"
+           "of source ID and time.\n"
+           "\n"
+           "With -check the exit status is 0 when all records are intact and 2 when\n"
+           "problems were found.\n");
 } /* End of usage() */
@@ -0,0 +1,169 @@
+/***************************************************************************
+ * Test of coalescing (-c) with a source ID that ends early.
+ *
+ * Generates input with two channels of 10 hours and one channel that
+ * ends after 1 hour, each record containing a single sample, converts
+ * it with 'mseedconvert -c' and checks that the records of completed
+ * time buckets are written before the end of the input, i.e. the
+ * channel that ended does not hold back the output, and that the
+ * output contains all samples in one segment per channel.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define INPUTFILE "test-coalesce-input.mseed"
+#define OUTPUTFILE "test-coalesce-output.mseed"
+#define LOGFILE "test-coalesce.log"
+
+#define SECONDS 36000  /* Seconds of data of the long channels */
+#define EARLYEND 3600  /* Seconds of data of the channel ending early */
+
+static const char *sids[] = {"FDSN:XX_TEST__B_H_E", "FDSN:XX_TEST__B_H_N", "FDSN:XX_TEST__B_H_Z"};
+
+static void
+write_record (char *record, int reclen, void *handlerdata)
+{
+  fwrite (record, reclen, 1, (FILE *)handlerdata);
+}
+
+/* Write records of one sample, in time order across channels */
+static int
+generate (void)
+{
+  MS3Record *msr;
+  FILE *fp;
+  int32_t sample;
+  int64_t packedsamples;
+  int second;
+  int idx;
+
+  if ((fp = fopen (INPUTFILE, "wb")) == NULL || (msr = msr3_init (NULL)) == NULL)
+    return -1;
+
+  msr->reclen      = 256;
+  msr->encoding    = DE_INT32;
+  msr->samprate    = 1.0;
+  msr->pubversion  = 1;
+  msr->sampletype  = 'i';
+  msr->datasamples = &sample;
+  msr->numsamples  = 1;
+  msr->samplecnt   = 1;
+
+  for (second = 0; second < SECONDS; second++)
+  {
+    for (idx = 0; idx < 3; idx++)
+    {
+      if (idx == 2 && second >= EARLYEND)
+        continue;
+
+      strcpy (msr->sid, sids[idx]);
+      msr->starttime = ms_time2nstime (2024, 1, 0, 0, 0, 0) + (nstime_t)second * NSTMODULUS;
+      sample         = second * 3 + idx;
+
+      if (msr3_pack (msr, write_record, fp, &packedsamples, MSF_FLUSHDATA, 0) != 1)
+        return -1;
+    }
+  }
+
+  msr->datasamples = NULL;
+  msr3_free (&msr);
+  fclose (fp);
+
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id;
+  char command[1024];
+  char line[1024];
+  FILE *fp;
+  uint64_t written = 0;
+  uint64_t records = 0;
+  int64_t expected;
+  int failed = 0;
+
+  if (argc < 2)
+  {
+    fprintf (stderr, "Usage: %s mseedconvert\n", argv[0]);
+    return 1;
+  }
+
+  if (generate ())
+  {
+    fprintf (stderr, "Cannot generate %s\n", INPUTFILE);
+    return 1;
+  }
+
+  snprintf (command, sizeof (command), "%s -c -T 2 -v -o %s %s > %s 2>&1",
+            argv[1], OUTPUTFILE, INPUTFILE, LOGFILE);
+
+  if (system (command))
+  {
+    fprintf (stderr, "Command failed: %s\n", command);
+    return 1;
+  }
+
+  /* Records written before the end of the input */
+  if ((fp = fopen (LOGFILE, "r")) == NULL)
+    return 1;
+
+  while (fgets (line, sizeof (line), fp))
+    if (!strncmp (line, "Wrote ", 6))
+      written += strtoull (line + 6, NULL, 10);
+
+  fclose (fp);
+
+  if (ms3_readtracelist (&mstl, OUTPUTFILE, NULL, 0, MSF_RECORDLIST, 0) != MS_NOERROR)
+  {
+    fprintf (stderr, "Cannot read %s\n", OUTPUTFILE);
+    return 1;
+  }
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    expected = (strcmp (id->sid, sids[2])) ? SECONDS : EARLYEND;
+
+    if (id->numsegments != 1 || id->first->samplecnt != expected)
+    {
+      fprintf (stderr, "%s: expected 1 segment of %lld samples\n", id->sid, (long long)expected);
+      failed = 1;
+    }
+
+    records += id->first->recordlist->recordcnt;
+  }
+
+  if (mstl->numtraceids != 3)
+  {
+    fprintf (stderr, "Expected 3 source IDs, found %u\n", mstl->numtraceids);
+    failed = 1;
+  }
+
+  /* The first flush is at about 8.6 hours of data, all but the last
+   * two hours must have been written by then */
+  if (written * 10 < records * 7)
+  {
+    fprintf (stderr, "Only %llu of %llu records written before the end of input\n",
+             (unsigned long long)written, (unsigned long long)records);
+    failed = 1;
+  }
+
+  mstl3_free (&mstl, 0);
+
+  if (!failed)
+  {
+    remove (INPUTFILE);
+    remove (OUTPUTFILE);
+    remove (LOGFILE);
+  }
+
+  printf ("test-coalesce: %s\n", (failed) ? "FAILED" : "passed");
+
+  return failed;
+}